@@ -40,11 +40,18 @@
  *  This program draws several overlapping filled polygons
  *  to demonstrate the effect order has on alpha blending results.
  *  Use the 't' key to toggle the order of drawing polygons.
+ *  Use the 'o' key to switch to weighted blended transparency
+ *  (OpenGL 3.0), with which the order no longer matters.
  */
 #include <GL/glut.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include "transparent.h"
 
 static int leftFirst = GL_TRUE;
+static TransparentQueue queue;
+static const GLfloat leftCenter[3] = { 0.3, 0.5, 0.0 };
+static const GLfloat rightCenter[3] = { 0.7, 0.5, 0.0 };
 
 /*  Initialize alpha blending function.
  */
@@ -54,9 +61,10 @@ static void init(void)
    glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
    glShadeModel (GL_FLAT);
    glClearColor (0.0, 0.0, 0.0, 0.0);
+   transparentInit (&queue, TRANSPARENT_SORTED);
 }
 
-static void drawLeftTriangle(void)
+static void drawLeftTriangle(void *data)
 {
    /* draw yellow triangle on LHS of screen */
 
@@ -68,7 +76,7 @@ static void drawLeftTriangle(void)
    glEnd();
 }
 
-static void drawRightTriangle(void)
+static void drawRightTriangle(void *data)
 {
    /* draw cyan triangle on RHS of screen */
 
@@ -84,14 +92,18 @@ void display(void)
 {
    glClear(GL_COLOR_BUFFER_BIT);
 
+/*  Both triangles are at the same depth, so the sort keeps the
+ *  order in which they are submitted.
+ */
    if (leftFirst) {
-      drawLeftTriangle();
-      drawRightTriangle();
+      transparentSubmit(&queue, leftCenter, drawLeftTriangle, NULL);
+      transparentSubmit(&queue, rightCenter, drawRightTriangle, NULL);
    }
    else {
-      drawRightTriangle();
-      drawLeftTriangle();
+      transparentSubmit(&queue, rightCenter, drawRightTriangle, NULL);
+      transparentSubmit(&queue, leftCenter, drawLeftTriangle, NULL);
    }
+   transparentFlush(&queue);
 
    glFlush();
 }
@@ -115,6 +127,19 @@ void keyboard(unsigned char key, int x, int y)
          leftFirst = !leftFirst;
          glutPostRedisplay();	
          break;
+      case 'o':
+      case 'O':
+         if (queue.mode == TRANSPARENT_SORTED &&
+             !transparentWeightedSupported()) {
+            printf("weighted blended transparency needs OpenGL 3.0\n");
+            break;
+         }
+         queue.mode = queue.mode == TRANSPARENT_SORTED ?
+                      TRANSPARENT_WEIGHTED : TRANSPARENT_SORTED;
+         printf("%s\n", queue.mode == TRANSPARENT_SORTED ?
+                "sorted" : "weighted blended");
+         glutPostRedisplay();
+         break;
       case 27:  /*  Escape key  */
          exit(0);
          break;
@@ -42,18 +42,59 @@
  *  glDepthMask.  Press the 'a' key to animate moving the 
  *  transparent object through the opaque object.  Press 
  *  the 'r' key to reset the scene.
+ *
+ *  The transparent object is drawn through a transparency queue.
+ *  Press the 'm' key to switch between sorted and weighted blended
+ *  transparency (OpenGL 3.0), and the 'b' key to time both with
+ *  10000 overlapping transparent cubes.
+ *
+ *  The animation runs in fixed ticks of a game loop (loop.h), 30 a
+ *  second, and frames are drawn between them at 60 a second; the
+ *  frame timing is printed when it ends.
  */
 #include <GL/glut.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include "loop.h"
+#include "transparent.h"
+#include "timer.h"
 
 #define MAXZ 8.0
 #define MINZ -8.0
 #define ZINC 0.4
+#define TICK_RATE 30.0
+#define FRAME_RATE 60.0
+
+#define BENCH_OBJECTS 10000
+#define BENCH_SORTS 50
+#define BENCH_FRAMES 10
+
+typedef struct benchobject {
+   GLfloat position[3];
+   GLfloat diffuse[4];
+} BenchObject;
 
-static float solidZ = MAXZ;
-static float transparentZ = MINZ;
-static GLuint sphereList, cubeList;
+static float solidZ = MAXZ, lastSolidZ = MAXZ;
+static float transparentZ = MINZ, lastTransparentZ = MINZ;
+static GameLoop loop;
+static GLuint sphereList, cubeList, smallCubeList;
+static TransparentQueue queue;
+static BenchObject *objects;
+
+/*  one tick; ZINC per tick at TICK_RATE  */
+void animate(double dt)
+{
+   lastSolidZ = solidZ;
+   lastTransparentZ = transparentZ;
+   if (solidZ <= MINZ || transparentZ >= MAXZ) {
+      loopStop(&loop);
+      loopPrintStats("alpha3D", &loop);
+   }
+   else {
+      solidZ -= ZINC * TICK_RATE * dt;
+      transparentZ += ZINC * TICK_RATE * dt;
+   }
+}
 
 static void init(void)
 {
@@ -78,41 +119,156 @@ static void init(void)
    glNewList(cubeList, GL_COMPILE);
       glutSolidCube (0.6);
    glEndList();
+
+   smallCubeList = glGenLists(1);
+   glNewList(smallCubeList, GL_COMPILE);
+      glutSolidCube (0.2);
+   glEndList();
+
+   transparentInit(&queue, TRANSPARENT_SORTED);
+   loopInit(&loop, TICK_RATE, FRAME_RATE, animate);
 }
 
-void display(void)
+static void drawSolid(GLfloat z)
 {
    GLfloat mat_solid[] = { 0.75, 0.75, 0.0, 1.0 };
    GLfloat mat_zero[] = { 0.0, 0.0, 0.0, 1.0 };
-   GLfloat mat_transparent[] = { 0.0, 0.8, 0.8, 0.6 };
-   GLfloat mat_emission[] = { 0.0, 0.3, 0.3, 0.6 };
-
-   glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
    glPushMatrix ();
-      glTranslatef (-0.15, -0.15, solidZ);
+      glTranslatef (-0.15, -0.15, z);
       glMaterialfv(GL_FRONT, GL_EMISSION, mat_zero);
       glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_solid);
       glCallList (sphereList);
    glPopMatrix ();
+}
+
+static void drawCube(void *data)
+{
+   GLfloat mat_transparent[] = { 0.0, 0.8, 0.8, 0.6 };
+   GLfloat mat_emission[] = { 0.0, 0.3, 0.3, 0.6 };
+
+   glMaterialfv(GL_FRONT, GL_EMISSION, mat_emission);
+   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_transparent);
+   glCallList (cubeList);
+}
+
+void display(void)
+{
+   static const GLfloat origin[3] = { 0.0, 0.0, 0.0 };
+   GLfloat a = (GLfloat) loopAlpha(&loop);
+
+   glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+   drawSolid (lastSolidZ + (solidZ - lastSolidZ) * a);
 
    glPushMatrix ();
-      glTranslatef (0.15, 0.15, transparentZ);
+      glTranslatef (0.15, 0.15,
+                    lastTransparentZ + (transparentZ - lastTransparentZ) * a);
       glRotatef (15.0, 1.0, 1.0, 0.0);
       glRotatef (30.0, 0.0, 1.0, 0.0);
-      glMaterialfv(GL_FRONT, GL_EMISSION, mat_emission);
-      glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_transparent);
-      glEnable (GL_BLEND);
-      glDepthMask (GL_FALSE);
-      glBlendFunc (GL_SRC_ALPHA, GL_ONE);
-      glCallList (cubeList);
-      glDepthMask (GL_TRUE);
-      glDisable (GL_BLEND);
+      transparentSubmit (&queue, origin, drawCube, NULL);
    glPopMatrix ();
+   transparentFlush (&queue);
 
    glutSwapBuffers();
 }
 
+static void drawObject(void *data)
+{
+   BenchObject *o = (BenchObject *) data;
+
+   glMaterialfv(GL_FRONT, GL_DIFFUSE, o->diffuse);
+   glCallList (smallCubeList);
+}
+
+static void submitObjects(TransparentQueue *q)
+{
+   static const GLfloat origin[3] = { 0.0, 0.0, 0.0 };
+   int i;
+
+   for (i = 0; i < BENCH_OBJECTS; i++) {
+      glPushMatrix ();
+         glTranslatef (objects[i].position[0], objects[i].position[1],
+                       objects[i].position[2]);
+         transparentSubmit (q, origin, drawObject, &objects[i]);
+      glPopMatrix ();
+   }
+}
+
+static double timeSorts(TransparentQueue *q)
+{
+   double start = timerSeconds();
+   int i;
+
+   for (i = 0; i < BENCH_SORTS; i++)
+      transparentSort(q);
+   return (timerSeconds() - start) * 1000.0 / BENCH_SORTS;
+}
+
+/*  Random cubes crowded around the middle of the view, so that most
+ *  pixels are covered many times.
+ */
+static void benchmark(void)
+{
+   GLfloat mat_zero[] = { 0.0, 0.0, 0.0, 1.0 };
+   TransparentQueue q;
+   double serial, parallel, start;
+   int i, mode;
+
+   if (objects == NULL) {
+      objects = (BenchObject *) malloc(BENCH_OBJECTS * sizeof(BenchObject));
+      if (objects == NULL) {
+         printf("alpha3D: out of memory\n");
+         exit(1);
+      }
+      srand(1);
+      for (i = 0; i < BENCH_OBJECTS; i++) {
+         BenchObject *o = &objects[i];
+
+         o->position[0] = 2.0 * rand() / RAND_MAX - 1.0;
+         o->position[1] = 2.0 * rand() / RAND_MAX - 1.0;
+         o->position[2] = 16.0 * rand() / RAND_MAX - 8.0;
+         o->diffuse[0] = (GLfloat) rand() / RAND_MAX;
+         o->diffuse[1] = (GLfloat) rand() / RAND_MAX;
+         o->diffuse[2] = (GLfloat) rand() / RAND_MAX;
+         o->diffuse[3] = 0.2 + 0.4 * rand() / RAND_MAX;
+      }
+   }
+
+   transparentInit(&q, TRANSPARENT_SORTED);
+   submitObjects(&q);
+   q.parallelMin = BENCH_OBJECTS + 1;
+   serial = timeSorts(&q);
+   q.parallelMin = TRANSPARENT_PARALLEL_MIN;
+   parallel = timeSorts(&q);
+   printf("sort %d objects: %.3f ms serial, %.3f ms in %d jobs, "
+          "%d passes\n", BENCH_OBJECTS, serial, parallel,
+          q.sortChunks, q.sortPasses);
+   q.count = 0;
+
+   for (mode = TRANSPARENT_SORTED; mode <= TRANSPARENT_WEIGHTED; mode++) {
+      if (mode == TRANSPARENT_WEIGHTED && !transparentWeightedSupported()) {
+         printf("weighted blended: needs OpenGL 3.0\n");
+         break;
+      }
+      q.mode = mode;
+      glFinish();
+      start = timerSeconds();
+      for (i = 0; i < BENCH_FRAMES; i++) {
+         glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+         drawSolid (solidZ);
+         glMaterialfv(GL_FRONT, GL_EMISSION, mat_zero);
+         submitObjects(&q);
+         transparentFlush(&q);
+      }
+      glFinish();
+      printf("%s: %.2f ms per frame\n",
+             mode == TRANSPARENT_SORTED ? "sorted" : "weighted blended",
+             (timerSeconds() - start) * 1000.0 / BENCH_FRAMES);
+   }
+   transparentFree(&q);
+   glutPostRedisplay();
+}
+
 void reshape(int w, int h)
 {
    glViewport(0, 0, (GLint) w, (GLint) h);
@@ -128,32 +284,40 @@ void reshape(int w, int h)
    glLoadIdentity();
 }
 
-void animate(void)
-{
-   if (solidZ <= MINZ || transparentZ >= MAXZ)
-      glutIdleFunc(NULL);
-   else {
-      solidZ -= ZINC;
-      transparentZ += ZINC;
-      glutPostRedisplay();
-   }
-}
-
 void keyboard(unsigned char key, int x, int y)
 {
    switch (key) {
       case 'a':
       case 'A':
-         solidZ = MAXZ;
-         transparentZ = MINZ;
-         glutIdleFunc(animate);
+         solidZ = lastSolidZ = MAXZ;
+         transparentZ = lastTransparentZ = MINZ;
+         loopResetStats(&loop);
+         loopStart(&loop);
          break;
       case 'r':
       case 'R':
-         solidZ = MAXZ;
-         transparentZ = MINZ;
+         loopStop(&loop);
+         solidZ = lastSolidZ = MAXZ;
+         transparentZ = lastTransparentZ = MINZ;
          glutPostRedisplay();
          break;
+      case 'm':
+      case 'M':
+         if (queue.mode == TRANSPARENT_SORTED &&
+             !transparentWeightedSupported()) {
+            printf("weighted blended transparency needs OpenGL 3.0\n");
+            break;
+         }
+         queue.mode = queue.mode == TRANSPARENT_SORTED ?
+                      TRANSPARENT_WEIGHTED : TRANSPARENT_SORTED;
+         printf("%s\n", queue.mode == TRANSPARENT_SORTED ?
+                "sorted" : "weighted blended");
+         glutPostRedisplay();
+         break;
+      case 'b':
+      case 'B':
+         benchmark();
+         break;
       case 27:
         exit(0);
     }
@@ -162,7 +326,10 @@ void keyboard(unsigned char key, int x, int y)
 int main(int argc, char** argv)
 {
    glutInit(&argc, argv);
-   glutInitDisplayMode (GLUT_SINGLE | GLUT_RGB | GLUT_DEPTH);
+/*  the stencil buffer makes the depth buffer the format that the
+ *  weighted blended mode can copy
+ */
+   glutInitDisplayMode (GLUT_SINGLE | GLUT_RGB | GLUT_DEPTH | GLUT_STENCIL);
    glutInitWindowSize(500, 500);
    glutCreateWindow(argv[0]);
    init();
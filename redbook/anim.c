@@ -0,0 +1,408 @@
+/*
+ *  anim.c
+ *  Keyframed animation clips.  See anim.h.
+ *
+ *  Key reduction is greedy: from each key it keeps, the next is the
+ *  furthest frame for which blending the two reproduces every frame
+ *  between them.  It is measured against the quantized keys, so the
+ *  tolerance covers both losses.
+ */
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "anim.h"
+#include "jobs.h"
+
+#define PI_ 3.14159265358979323846
+#define DEGREES (180.0 / PI_)
+
+#define QUANT_MAX   32767.0f
+#define QUANT_RANGE 0.70710678f     /* largest of the smallest three */
+#define CHUNK_MIN   32              /* instances */
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("anim: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+/*
+ *  Quaternions
+ */
+static GLfloat dot4(const GLfloat a[4], const GLfloat b[4])
+{
+   return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+}
+
+/*  Normalized linear interpolation along the shorter arc.  */
+static void nlerp(const GLfloat a[4], const GLfloat b[4], GLfloat t,
+                  GLfloat out[4])
+{
+#ifdef __SSE2__
+   __m128 va = _mm_loadu_ps(a), vb = _mm_loadu_ps(b);
+   __m128 d = _mm_mul_ps(va, vb), q, n, r;
+
+   d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+   d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+   vb = _mm_xor_ps(vb, _mm_and_ps(_mm_cmplt_ps(d, _mm_setzero_ps()),
+                                  _mm_set1_ps(-0.0f)));
+   q = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), _mm_set1_ps(t)));
+   n = _mm_mul_ps(q, q);
+   n = _mm_add_ps(n, _mm_shuffle_ps(n, n, _MM_SHUFFLE(2, 3, 0, 1)));
+   n = _mm_add_ps(n, _mm_shuffle_ps(n, n, _MM_SHUFFLE(1, 0, 3, 2)));
+
+/*  one Newton step on the estimate of 1 / sqrt(n)  */
+   r = _mm_rsqrt_ps(n);
+   r = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r),
+                  _mm_sub_ps(_mm_set1_ps(3.0f),
+                             _mm_mul_ps(_mm_mul_ps(n, r), r)));
+   _mm_storeu_ps(out, _mm_mul_ps(q, r));
+#else
+   GLfloat s = dot4(a, b) < 0 ? -1.0f : 1.0f, q[4], n;
+   int k;
+
+   for (k = 0; k < 4; k++)
+      q[k] = a[k] + (s * b[k] - a[k]) * t;
+   n = (GLfloat) (1.0 / sqrt(dot4(q, q)));
+   for (k = 0; k < 4; k++)
+      out[k] = q[k] * n;
+#endif
+}
+
+static void multiply(const GLfloat a[4], const GLfloat b[4],
+                     GLfloat out[4])
+{
+   GLfloat q[4];
+
+   q[0] = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+   q[1] = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+   q[2] = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+   q[3] = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+   memcpy(out, q, sizeof(q));
+}
+
+/*  The angle between two rotations, in degrees.  */
+static GLfloat difference(const GLfloat a[4], const GLfloat b[4])
+{
+   double d = fabs(dot4(a, b));
+
+   return (GLfloat) (2.0 * acos(d < 1.0 ? d : 1.0) * DEGREES);
+}
+
+void animHinge(GLfloat q[4], int axis, GLfloat degrees)
+{
+   double half = degrees / DEGREES / 2;
+
+   q[0] = q[1] = q[2] = 0;
+   q[axis] = (GLfloat) sin(half);
+   q[3] = (GLfloat) cos(half);
+}
+
+/*  -q is the same rotation, which gives the angle plus 360.  */
+GLfloat animHingeAngle(const GLfloat q[4], int axis)
+{
+   double a = 2.0 * atan2(q[axis], q[3]) * DEGREES;
+
+   if (a > 180.0)
+      a -= 360.0;
+   else if (a <= -180.0)
+      a += 360.0;
+   return (GLfloat) a;
+}
+
+/*
+ *  Keys
+ */
+static void encode(const GLfloat q[4], AnimKey *key)
+{
+   GLfloat sign;
+   int largest = 0, i, k;
+
+   for (k = 1; k < 4; k++)
+      if (fabs(q[k]) > fabs(q[largest]))
+         largest = k;
+   sign = q[largest] < 0 ? -1.0f : 1.0f;
+   for (i = k = 0; k < 4; k++) {
+      GLfloat v;
+
+      if (k == largest)
+         continue;
+      v = (sign * q[k] / QUANT_RANGE + 1.0f) * 0.5f;
+      v = v < 0 ? 0 : v > 1 ? 1 : v;
+      key->c[i++] = (GLushort) (v * QUANT_MAX + 0.5f);
+   }
+   key->c[0] |= (GLushort) ((largest & 1) << 15);
+   key->c[1] |= (GLushort) ((largest >> 1) << 15);
+}
+
+static void decode(const AnimKey *key, GLfloat q[4])
+{
+   int largest = (key->c[0] >> 15) | (key->c[1] >> 15 << 1);
+   GLfloat sum = 0;
+   int i, k;
+
+   for (i = k = 0; k < 4; k++) {
+      GLfloat v;
+
+      if (k == largest)
+         continue;
+      v = ((key->c[i++] & 0x7fff) / QUANT_MAX * 2.0f - 1.0f) * QUANT_RANGE;
+      q[k] = v;
+      sum += v * v;
+   }
+   q[largest] = (GLfloat) sqrt(sum < 1.0f ? 1.0f - sum : 0.0f);
+}
+
+/*  Whether blending keys a and b reproduces the frames between.  */
+static int spans(const GLfloat (*quantized)[4], const GLfloat *poses,
+                 int stride, int a, int b, GLfloat tolerance)
+{
+   GLfloat q[4];
+   int f;
+
+   for (f = a + 1; f < b; f++) {
+      nlerp(quantized[a], quantized[b], (GLfloat) (f - a) / (b - a), q);
+      if (difference(q, poses + f * stride) > tolerance)
+         return 0;
+   }
+   return 1;
+}
+
+void animClipBuild(AnimClip *clip, int trackCount, int frames,
+                   GLfloat rate, int loop, const GLfloat *poses,
+                   GLfloat tolerance)
+{
+   GLfloat (*quantized)[4];
+   AnimKey *keys;
+   int stride = trackCount * 4, t, f, a, b;
+
+   memset(clip, 0, sizeof(AnimClip));
+   if (trackCount > ANIM_MAX_TRACKS)
+      trackCount = ANIM_MAX_TRACKS;
+   if (frames > 65535)
+      frames = 65535;
+   clip->trackCount = trackCount;
+   clip->frames = frames;
+   clip->rate = rate;
+   clip->loop = loop;
+   quantized = (GLfloat (*)[4]) allocate(NULL, frames * sizeof(*quantized));
+   keys = (AnimKey *) allocate(NULL, frames * sizeof(AnimKey));
+
+   for (t = 0; t < trackCount; t++) {
+      const GLfloat *track = poses + t * 4;
+      AnimTrack *tr = &clip->tracks[t];
+
+      for (f = 0; f < frames; f++) {
+         encode(track + f * stride, &keys[f]);
+         keys[f].frame = (GLushort) f;
+         decode(&keys[f], quantized[f]);
+      }
+      tr->first = clip->keyCount;
+      clip->keys = (AnimKey *) allocate(clip->keys, (clip->keyCount +
+                                        frames) * sizeof(AnimKey));
+      clip->keys[clip->keyCount++] = keys[0];
+      for (a = 0; a < frames - 1; a = b) {
+         for (b = a + 1; b + 1 < frames; b++)
+            if (!spans((const GLfloat (*)[4]) quantized, track, stride,
+                       a, b + 1, tolerance))
+               break;
+         clip->keys[clip->keyCount++] = keys[b];
+      }
+      tr->count = clip->keyCount - tr->first;
+   }
+   clip->keys = (AnimKey *) allocate(clip->keys,
+                                     clip->keyCount * sizeof(AnimKey));
+   free(quantized);
+   free(keys);
+}
+
+void animClipFree(AnimClip *clip)
+{
+   free(clip->keys);
+   clip->keys = NULL;
+   clip->keyCount = 0;
+}
+
+GLfloat animClipDuration(const AnimClip *clip)
+{
+   return clip->frames > 1 ? (clip->frames - 1) / clip->rate : 0;
+}
+
+void animSample(const AnimClip *clip, GLfloat time, GLfloat (*pose)[4])
+{
+   GLfloat f = time * clip->rate, last = (GLfloat) (clip->frames - 1);
+   int t;
+
+   if (clip->loop && last > 0) {
+      f = (GLfloat) fmod(f, last);
+      if (f < 0)
+         f += last;
+   } else if (f > last) {
+      f = last;
+   }
+   if (f < 0)
+      f = 0;
+
+   for (t = 0; t < clip->trackCount; t++) {
+      const AnimKey *k = clip->keys + clip->tracks[t].first;
+      int lo = 0, hi = clip->tracks[t].count - 1, mid;
+      GLfloat a[4], b[4];
+
+/*  the last key at or before the frame  */
+      while (lo < hi) {
+         mid = (lo + hi + 1) / 2;
+         if (k[mid].frame <= f)
+            lo = mid;
+         else
+            hi = mid - 1;
+      }
+      decode(&k[lo], a);
+      if (lo + 1 == clip->tracks[t].count) {
+         memcpy(pose[t], a, sizeof(a));
+         continue;
+      }
+      decode(&k[lo + 1], b);
+      nlerp(a, b, (f - k[lo].frame) / (k[lo + 1].frame - k[lo].frame),
+            pose[t]);
+   }
+}
+
+/*
+ *  Blending
+ */
+void animBlend(GLfloat (*out)[4], GLfloat (*a)[4], GLfloat (*b)[4],
+               int trackCount, GLfloat weight)
+{
+   int t;
+
+   for (t = 0; t < trackCount; t++)
+      nlerp(a[t], b[t], weight, out[t]);
+}
+
+void animAdd(GLfloat (*out)[4], GLfloat (*base)[4], GLfloat (*delta)[4],
+             int trackCount, GLfloat weight)
+{
+   static const GLfloat identity[4] = { 0, 0, 0, 1 };
+   GLfloat d[4];
+   int t;
+
+   for (t = 0; t < trackCount; t++) {
+      nlerp(identity, delta[t], weight, d);
+      multiply(base[t], d, out[t]);
+   }
+}
+
+void animDifference(GLfloat (*delta)[4], GLfloat (*reference)[4],
+                    GLfloat (*pose)[4], int trackCount)
+{
+   GLfloat inverse[4];
+   int t;
+
+   for (t = 0; t < trackCount; t++) {
+      inverse[0] = -reference[t][0];
+      inverse[1] = -reference[t][1];
+      inverse[2] = -reference[t][2];
+      inverse[3] = reference[t][3];
+      multiply(inverse, pose[t], delta[t]);
+   }
+}
+
+/*
+ *  Instances
+ */
+void animInstanceInit(AnimInstance *a, int trackCount)
+{
+   int t;
+
+   memset(a, 0, sizeof(AnimInstance));
+   a->trackCount = trackCount < ANIM_MAX_TRACKS ? trackCount
+                                                : ANIM_MAX_TRACKS;
+   a->speed = 1.0f;
+   for (t = 0; t < ANIM_MAX_TRACKS; t++)
+      a->from[t][3] = a->pose[t][3] = 1.0f;
+}
+
+void animPlay(AnimInstance *a, const AnimClip *clip, GLfloat fadeTime)
+{
+   memcpy(a->from, a->pose, sizeof(a->from));
+   a->clip = clip;
+   a->time = 0;
+   a->fade = 0;
+   a->fadeTime = fadeTime;
+}
+
+static GLfloat advance(const AnimClip *clip, GLfloat time)
+{
+   GLfloat d = animClipDuration(clip);
+
+   if (clip->loop && d > 0 && time >= d)
+      time = (GLfloat) fmod(time, d);
+   return time;
+}
+
+static void update(AnimInstance *a, GLfloat dt)
+{
+   GLfloat sampled[ANIM_MAX_TRACKS][4];
+
+   if (a->clip) {
+      a->time = advance(a->clip, a->time + dt * a->speed);
+      animSample(a->clip, a->time, sampled);
+   } else {
+      memcpy(sampled, a->from, sizeof(sampled));
+   }
+   if (a->fade < a->fadeTime) {
+      a->fade += dt;
+      animBlend(a->pose, a->from, sampled, a->trackCount,
+                a->fade < a->fadeTime ? a->fade / a->fadeTime : 1.0f);
+   } else {
+      memcpy(a->pose, sampled, sizeof(sampled));
+   }
+   if (a->additive && a->additiveWeight > 0) {
+      a->additiveTime = advance(a->additive, a->additiveTime + dt);
+      animSample(a->additive, a->additiveTime, sampled);
+      animAdd(a->pose, a->pose, sampled, a->trackCount, a->additiveWeight);
+   }
+}
+
+typedef struct animbatch {
+   AnimInstance  *instances;
+   int            count, chunks;
+   GLfloat        dt;
+} AnimBatch;
+
+static void updateChunk(int index, void *user)
+{
+   AnimBatch *b = (AnimBatch *) user;
+   int i = (int) ((long) b->count * index / b->chunks);
+   int end = (int) ((long) b->count * (index + 1) / b->chunks);
+
+   for (; i < end; i++)
+      update(&b->instances[i], b->dt);
+}
+
+void animUpdate(AnimInstance *instances, int count, GLfloat dt)
+{
+   AnimBatch b;
+
+   b.instances = instances;
+   b.count = count;
+   b.dt = dt;
+   b.chunks = count >= 2 * CHUNK_MIN ? jobsThreadCount() * 4 : 1;
+   if (b.chunks > count / CHUNK_MIN)
+      b.chunks = count / CHUNK_MIN;
+   if (b.chunks <= 1) {
+      b.chunks = 1;
+      updateChunk(0, &b);
+   } else {
+      jobsParallelFor(b.chunks, updateChunk, &b);
+   }
+}
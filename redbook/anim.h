@@ -0,0 +1,107 @@
+/*
+ *  anim.h
+ *  Keyframed animation clips for jointed models.  A clip holds a
+ *  track of rotations for each joint, as quaternions (x, y, z, w) in
+ *  the joint's frame, built from poses sampled at a fixed rate.
+ *  Building compresses it twice over:
+ *
+ *  - each rotation is quantized to 48 bits, the three smallest
+ *    components at 15 bits each and which one was left out, from
+ *    which the fourth is recovered as the quaternion has unit length;
+ *  - then keys are removed wherever blending the keys either side
+ *    reproduces every pose in between, as it was authored, to within
+ *    a tolerance angle.
+ *
+ *  A key is 8 bytes instead of the 16 of a float quaternion, and a
+ *  track that moves smoothly or not at all keeps only a few of them.
+ *
+ *  An AnimInstance plays one clip at a time.  Starting another clip
+ *  crossfades to it from the pose the instance had, so a clip can be
+ *  interrupted at any point, and an additive clip can be layered on
+ *  top with a weight.  animUpdate() advances and samples many
+ *  instances at once on the worker pool (jobs.h).  Rotations are
+ *  blended by normalized linear interpolation along the shorter arc,
+ *  four components at a time with SSE where it is available.
+ */
+#ifndef ANIM_H
+#define ANIM_H
+
+#define ANIM_MAX_TRACKS  8
+#define ANIM_TOLERANCE   0.1f       /* degrees */
+
+typedef struct animkey {
+   GLushort  frame;
+   GLushort  c[3];                  /* smallest three, and which */
+} AnimKey;
+
+typedef struct animtrack {
+   int  first, count;               /* in keys */
+} AnimTrack;
+
+typedef struct animclip {
+   AnimKey   *keys;
+   int        keyCount;
+   AnimTrack  tracks[ANIM_MAX_TRACKS];
+   int        trackCount;
+   int        frames;
+   GLfloat    rate;                 /* frames per second */
+   int        loop;
+} AnimClip;
+
+typedef struct animinstance {
+   const AnimClip  *clip;           /* NULL holds the pose it fades from */
+   GLfloat          time, speed;
+   GLfloat          fade, fadeTime; /* seconds */
+   const AnimClip  *additive;
+   GLfloat          additiveTime, additiveWeight;
+   int              trackCount;
+   GLfloat          from[ANIM_MAX_TRACKS][4];
+   GLfloat          pose[ANIM_MAX_TRACKS][4];
+} AnimInstance;
+
+/*  Build a clip of frames poses of trackCount rotations each, the
+ *  frames one after another, keeping every pose to within tolerance
+ *  degrees.  A looping clip should end on the pose it starts with.
+ */
+void animClipBuild(AnimClip *clip, int trackCount, int frames,
+                   GLfloat rate, int loop, const GLfloat *poses,
+                   GLfloat tolerance);
+void animClipFree(AnimClip *clip);
+GLfloat animClipDuration(const AnimClip *clip);
+
+/*  Sample every track at a time in seconds, which wraps on a looping
+ *  clip and is held at the ends of another.
+ */
+void animSample(const AnimClip *clip, GLfloat time, GLfloat (*pose)[4]);
+
+/*  out = a blended towards b by weight, 0 to 1.  out may be a or b.  */
+void animBlend(GLfloat (*out)[4], GLfloat (*a)[4], GLfloat (*b)[4],
+               int trackCount, GLfloat weight);
+
+/*  out = base with the rotations in delta applied on top by weight,
+ *  0 to 1; animDifference() makes the delta that takes reference to
+ *  pose, from which additive clips are built.
+ */
+void animAdd(GLfloat (*out)[4], GLfloat (*base)[4], GLfloat (*delta)[4],
+             int trackCount, GLfloat weight);
+void animDifference(GLfloat (*delta)[4], GLfloat (*reference)[4],
+                    GLfloat (*pose)[4], int trackCount);
+
+/*  Rotations about a single joint axis, 0, 1 or 2 for x, y or z, as
+ *  glRotatef() makes them, and the angle back, in degrees.
+ */
+void animHinge(GLfloat q[4], int axis, GLfloat degrees);
+GLfloat animHingeAngle(const GLfloat q[4], int axis);
+
+/*  Start an instance with trackCount tracks at the identity.  */
+void animInstanceInit(AnimInstance *a, int trackCount);
+
+/*  Crossfade to a clip, or with NULL hold the pose, over fadeTime
+ *  seconds.
+ */
+void animPlay(AnimInstance *a, const AnimClip *clip, GLfloat fadeTime);
+
+/*  Advance every instance by dt seconds and sample its pose.  */
+void animUpdate(AnimInstance *instances, int count, GLfloat dt);
+
+#endif
@@ -0,0 +1,270 @@
+/*
+ *  arena.c
+ *  Arenas, scratch memory and pools.  See arena.h.
+ *
+ *  Blocks that overflow an arena carry a header linking them into a
+ *  list, padded so that what follows is aligned like the rest.  A
+ *  pool threads its free blocks through their first word.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+
+#define ROUND(n, a)  (((n) + (a) - 1) / (a) * (a))
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("arena: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+/*
+ *  Arenas
+ */
+void arenaInit(Arena *a, size_t size)
+{
+   a->size = ROUND(size, ARENA_ALIGN);
+   a->base = a->size ? (char *) allocate(NULL, a->size) : NULL;
+   a->used = 0;
+   a->overflow = NULL;
+   a->overflowBytes = 0;
+   a->stats.allocs = a->stats.bytes = 0;
+   a->stats.overflows = a->stats.resets = 0;
+   a->stats.peak = 0;
+}
+
+static void freeOverflow(Arena *a)
+{
+   while (a->overflow) {
+      void *next = *(void **) a->overflow;
+
+      free(a->overflow);
+      a->overflow = next;
+   }
+   a->overflowBytes = 0;
+}
+
+void arenaFree(Arena *a)
+{
+   freeOverflow(a);
+   free(a->base);
+   a->base = NULL;
+   a->size = a->used = 0;
+}
+
+void *arenaAlloc(Arena *a, size_t bytes)
+{
+   char *p;
+
+   bytes = ROUND(bytes, ARENA_ALIGN);
+   a->stats.allocs++;
+   a->stats.bytes += bytes;
+   if (a->used + bytes <= a->size) {
+      p = a->base + a->used;
+      a->used += bytes;
+   } else {
+      p = (char *) allocate(NULL, ARENA_ALIGN + bytes);
+      *(void **) p = a->overflow;
+      a->overflow = p;
+      a->overflowBytes += bytes;
+      a->stats.overflows++;
+      p += ARENA_ALIGN;
+   }
+   if (a->used + a->overflowBytes > a->stats.peak)
+      a->stats.peak = a->used + a->overflowBytes;
+   return p;
+}
+
+/*  After an overflow, grow the block to the most that was in use.  */
+void arenaReset(Arena *a)
+{
+   if (a->overflow) {
+      freeOverflow(a);
+      free(a->base);
+      a->size = ROUND(a->stats.peak, ARENA_ALIGN);
+      a->base = (char *) allocate(NULL, a->size);
+   }
+   a->used = 0;
+   a->stats.resets++;
+}
+
+size_t arenaMark(const Arena *a)
+{
+   return a->used;
+}
+
+void arenaRelease(Arena *a, size_t mark)
+{
+   if (mark < a->used)
+      a->used = mark;
+}
+
+void arenaPrintStats(const char *name, const ArenaStats *s)
+{
+   printf("%s: %lu allocations of %lu bytes, %lu overflowed, "
+          "peak %lu bytes, %lu resets\n", name, s->allocs, s->bytes,
+          s->overflows, (unsigned long) s->peak, s->resets);
+}
+
+/*
+ *  Frame arenas
+ */
+void frameArenaInit(FrameArena *f, size_t size)
+{
+   arenaInit(&f->arenas[0], size);
+   arenaInit(&f->arenas[1], size);
+   f->current = 0;
+   f->frame = 0;
+}
+
+void frameArenaFree(FrameArena *f)
+{
+   arenaFree(&f->arenas[0]);
+   arenaFree(&f->arenas[1]);
+}
+
+void frameArenaBegin(FrameArena *f)
+{
+   f->current = !f->current;
+   f->frame++;
+   arenaReset(&f->arenas[f->current]);
+}
+
+void *frameAlloc(FrameArena *f, size_t bytes)
+{
+   return arenaAlloc(&f->arenas[f->current], bytes);
+}
+
+/*
+ *  Scratch, an arena for each thread made when it first asks
+ */
+static Arena scratch[ARENA_MAX_THREADS];
+
+static Arena *threadScratch(int thread)
+{
+   Arena *a = &scratch[thread];
+
+   if (a->base == NULL)
+      arenaInit(a, ARENA_SCRATCH);
+   return a;
+}
+
+void *scratchAlloc(int thread, size_t bytes)
+{
+   return arenaAlloc(threadScratch(thread), bytes);
+}
+
+size_t scratchMark(int thread)
+{
+   return arenaMark(threadScratch(thread));
+}
+
+/*  Released to empty, an arena that overflowed grows to fit.  */
+void scratchRelease(int thread, size_t mark)
+{
+   Arena *a = threadScratch(thread);
+
+   arenaRelease(a, mark);
+   if (a->used == 0 && a->overflow)
+      arenaReset(a);
+}
+
+void scratchStats(ArenaStats *s)
+{
+   int i;
+
+   s->allocs = s->bytes = s->overflows = s->resets = 0;
+   s->peak = 0;
+   for (i = 0; i < ARENA_MAX_THREADS; i++) {
+      const ArenaStats *t = &scratch[i].stats;
+
+      s->allocs += t->allocs;
+      s->bytes += t->bytes;
+      s->overflows += t->overflows;
+      s->resets += t->resets;
+      if (t->peak > s->peak)
+         s->peak = t->peak;
+   }
+}
+
+/*
+ *  Pools
+ */
+void poolInit(Pool *p, size_t blockSize, int chunkBlocks)
+{
+   if (blockSize < sizeof(void *))
+      blockSize = sizeof(void *);
+   p->blockSize = ROUND(blockSize, sizeof(void *));
+   p->chunkBlocks = chunkBlocks > 0 ? chunkBlocks : 1;
+   p->free = NULL;
+   p->chunks = NULL;
+   p->stats.allocs = p->stats.frees = 0;
+   p->stats.live = p->stats.peak = 0;
+   p->stats.chunks = 0;
+}
+
+void poolFree(Pool *p)
+{
+   int i;
+
+   for (i = 0; i < p->stats.chunks; i++)
+      free(p->chunks[i]);
+   free(p->chunks);
+   p->chunks = NULL;
+   p->free = NULL;
+   p->stats.chunks = 0;
+   p->stats.live = 0;
+}
+
+/*  Carve a new chunk into free blocks, the first one first.  */
+static void grow(Pool *p)
+{
+   char *chunk = (char *) allocate(NULL, p->chunkBlocks * p->blockSize);
+   int i;
+
+   p->chunks = (void **)
+      allocate(p->chunks, (p->stats.chunks + 1) * sizeof(void *));
+   p->chunks[p->stats.chunks++] = chunk;
+   for (i = p->chunkBlocks - 1; i >= 0; i--) {
+      void *block = chunk + i * p->blockSize;
+
+      *(void **) block = p->free;
+      p->free = block;
+   }
+}
+
+void *poolAlloc(Pool *p)
+{
+   void *block;
+
+   if (p->free == NULL)
+      grow(p);
+   block = p->free;
+   p->free = *(void **) block;
+   p->stats.allocs++;
+   if (++p->stats.live > p->stats.peak)
+      p->stats.peak = p->stats.live;
+   return block;
+}
+
+void poolRelease(Pool *p, void *block)
+{
+   if (block == NULL)
+      return;
+   *(void **) block = p->free;
+   p->free = block;
+   p->stats.frees++;
+   p->stats.live--;
+}
+
+void poolPrintStats(const char *name, const Pool *p)
+{
+   printf("%s: %lu allocations, %lu frees, %lu live, peak %lu blocks of "
+          "%lu bytes in %d chunks\n", name, p->stats.allocs, p->stats.frees,
+          p->stats.live, p->stats.peak, (unsigned long) p->blockSize,
+          p->stats.chunks);
+}
@@ -0,0 +1,107 @@
+/*
+ *  arena.h
+ *  Allocators for data that lives for a frame or less and for many
+ *  objects of one size, in place of malloc() and free() on every
+ *  frame.
+ *
+ *  An Arena hands out memory from one block by moving a pointer and
+ *  takes it all back at once when it is reset.  What does not fit
+ *  comes from malloc() until the next reset, which then grows the
+ *  block to hold everything that was asked for, so after the first
+ *  few frames nothing is allocated at all.
+ *
+ *  A FrameArena is a pair of arenas used on alternate frames, so that
+ *  what was allocated for one frame is still there while the next is
+ *  built, as when the workers finish one frame as the next begins.
+ *
+ *  Scratch memory is an arena for each thread of the pool (jobs.h),
+ *  for temporary buffers inside a job: take a mark, allocate, and
+ *  release back to the mark before the job returns.  The caller
+ *  names its thread with jobsThreadIndex(), so arena.c needs nothing
+ *  from the pool.
+ *
+ *  A Pool keeps blocks of one size on a free list, carved from chunks
+ *  of many blocks, so objects can be freed in any order.  Neither
+ *  arenas nor pools lock; each belongs to one thread at a time.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGN        16         /* of every allocation */
+#define ARENA_SCRATCH      (256 * 1024)
+#define ARENA_MAX_THREADS  65         /* the caller and 64 workers */
+
+typedef struct arenastats {
+   unsigned long  allocs;             /* since the arena was made */
+   unsigned long  bytes;
+   unsigned long  overflows;          /* allocations that did not fit */
+   unsigned long  resets;
+   size_t         peak;               /* most ever in use */
+} ArenaStats;
+
+typedef struct arena {
+   char        *base;
+   size_t       size, used;
+   void        *overflow;             /* blocks from malloc() */
+   size_t       overflowBytes;
+   ArenaStats   stats;
+} Arena;
+
+typedef struct framearena {
+   Arena          arenas[2];
+   int            current;
+   unsigned long  frame;
+} FrameArena;
+
+typedef struct poolstats {
+   unsigned long  allocs, frees;
+   unsigned long  live, peak;         /* blocks */
+   int            chunks;
+} PoolStats;
+
+typedef struct pool {
+   size_t      blockSize;
+   int         chunkBlocks;
+   void       *free;                  /* list of free blocks */
+   void      **chunks;
+   PoolStats   stats;
+} Pool;
+
+void arenaInit(Arena *a, size_t size);
+void arenaFree(Arena *a);
+void *arenaAlloc(Arena *a, size_t bytes);
+void arenaReset(Arena *a);
+
+/*  Free what was allocated since the mark; blocks that overflowed
+ *  are kept until the next reset.
+ */
+size_t arenaMark(const Arena *a);
+void arenaRelease(Arena *a, size_t mark);
+
+void arenaPrintStats(const char *name, const ArenaStats *s);
+
+void frameArenaInit(FrameArena *f, size_t size);
+void frameArenaFree(FrameArena *f);
+
+/*  Start a frame, taking back what was allocated two frames ago.  */
+void frameArenaBegin(FrameArena *f);
+void *frameAlloc(FrameArena *f, size_t bytes);
+
+/*  Scratch memory of a thread, 0 to ARENA_MAX_THREADS - 1.  */
+void *scratchAlloc(int thread, size_t bytes);
+size_t scratchMark(int thread);
+void scratchRelease(int thread, size_t mark);
+
+/*  The statistics of every thread's scratch added up.  */
+void scratchStats(ArenaStats *s);
+
+void poolInit(Pool *p, size_t blockSize, int chunkBlocks);
+void poolFree(Pool *p);
+void *poolAlloc(Pool *p);
+void poolRelease(Pool *p, void *block);
+
+void poolPrintStats(const char *name, const Pool *p);
+
+#endif
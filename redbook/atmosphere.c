@@ -0,0 +1,644 @@
+/*
+ *  atmosphere.c
+ *  Precomputed sky and aerial perspective.  See atmosphere.h.
+ *
+ *  Heights are taken above a sphere the size of the Earth, so that a
+ *  ray into the sky leaves the atmosphere after a finite distance and
+ *  one below the horizon meets the ground.  Table coordinates are
+ *  squeezed where things change fastest: heights and distances by a
+ *  square root, towards the eye and the ground, and angles by a signed
+ *  square root, towards the horizon.  The shader undoes the same
+ *  mappings.
+ *
+ *  The scattering table is marched once for each eye height and view
+ *  angle, out to where the ray ends, storing what has built up at each
+ *  of the table's distances; one job takes every angle for a height.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atmosphere.h"
+#include "shader.h"
+#include "timer.h"
+
+#define PLANET          6360000.0     /* meters */
+#define TOP             60000.0       /* of the atmosphere, above it */
+#define MIE_EXTINCTION  1.11          /* haze absorbs a little */
+#define SUN_STEP        0.002         /* in height, to rebuild for */
+#define SUN_HEIGHTS     128           /* sunlight samples */
+#define T_STEPS         40            /* per transmittance ray */
+#define SUBSTEPS        4             /* between scattering distances */
+
+#define DIRTY_TRANSMITTANCE  1
+#define DIRTY_SCATTERING     2
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("atmosphere: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+#ifdef GL_VERSION_3_3
+static const char *applyVertex =
+   "#version 330 compatibility\n"
+   "void main()\n"
+   "{\n"
+   "   gl_Position = gl_Vertex;\n"
+   "}\n";
+
+static const char *applyFragment =
+   "#version 330 compatibility\n"
+   "uniform sampler2D color, depth;\n"
+   "uniform sampler3D air, haze, transmittance;\n"
+   "uniform mat3 eyeToWorld;\n"
+   "uniform vec4 viewport, projection;\n"
+   "uniform vec2 depthTerms, fade;\n"
+   "uniform vec3 sun;\n"
+   "uniform float eyeHeight, mieG, intensity;\n"
+   "const float planet = 6360000.0, top = 60000.0, pi = 3.14159265;\n"
+   "float rayLength(float h, float mu)\n"
+   "{\n"
+   "   float r = planet + h, c = r * r * (mu * mu - 1.0);\n"
+   "   if (mu < 0.0 && c + planet * planet >= 0.0)\n"
+   "      return -r * mu - sqrt(c + planet * planet);\n"
+   "   return -r * mu + sqrt(c + (planet + top) * (planet + top));\n"
+   "}\n"
+   "vec3 table(float h, float mu, float d)\n"
+   "{\n"
+   "   vec3 n = vec3(textureSize(air, 0));\n"
+   "   vec3 u = vec3(sqrt(clamp(d / rayLength(h, mu), 0.0, 1.0)),\n"
+   "                 0.5 + 0.5 * sign(mu) * sqrt(abs(mu)),\n"
+   "                 sqrt(clamp(h / top, 0.0, 1.0)));\n"
+   "   return (u * (n - 1.0) + 0.5) / n;\n"
+   "}\n"
+   "void main()\n"
+   "{\n"
+   "   vec2 uv = (gl_FragCoord.xy - viewport.xy) / viewport.zw;\n"
+   "   vec3 ray = vec3((uv * 2.0 - 1.0 + projection.zw) / projection.xy,\n"
+   "                   -1.0);\n"
+   "   vec3 dir = normalize(eyeToWorld * ray);\n"
+   "   float z = texture(depth, uv).r, h = max(eyeHeight, 0.0);\n"
+   "   float nu = dot(dir, sun), g = mieG;\n"
+   "   float pr = 3.0 / (16.0 * pi) * (1.0 + nu * nu);\n"
+   "   float pm = 3.0 / (8.0 * pi) * (1.0 - g * g) * (1.0 + nu * nu) /\n"
+   "              ((2.0 + g * g) * pow(1.0 + g * g - 2.0 * g * nu, 1.5));\n"
+   "   vec3 c = table(h, max(dir.y, 0.0), 1e30), sky, lit;\n"
+   "   float d;\n"
+   "   sky = intensity * (texture(air, c).rgb * pr +\n"
+   "                      texture(haze, c).rgb * pm);\n"
+   "   if (z >= 1.0) {\n"
+   "      if (nu > 0.99996)\n"
+   "         sky += intensity * texture(transmittance, c).rgb;\n"
+   "      gl_FragColor = vec4(sky, 1.0);\n"
+   "      return;\n"
+   "   }\n"
+   "   d = length(ray) * depthTerms.y / (z * 2.0 - 1.0 + depthTerms.x);\n"
+   "   c = table(h, dir.y, d);\n"
+   "   lit = texture(color, uv).rgb * texture(transmittance, c).rgb +\n"
+   "         intensity * (texture(air, c).rgb * pr +\n"
+   "                      texture(haze, c).rgb * pm);\n"
+   "   gl_FragColor = vec4(mix(lit, sky, smoothstep(fade.x, fade.y, d)),\n"
+   "                       1.0);\n"
+   "}\n";
+#endif
+
+void atmosphereDefaults(AtmosphereParams *p)
+{
+   p->rayleigh[0] = 5.8e-6;
+   p->rayleigh[1] = 13.5e-6;
+   p->rayleigh[2] = 33.1e-6;
+   p->rayleighHeight = 8000.0;
+   p->mie = 20e-6;
+   p->mieHeight = 1200.0;
+   p->mieG = 0.76;
+   p->sunIntensity = 20.0;
+}
+
+/*  Where a ray from height h at cosine mu from the zenith leaves the
+ *  atmosphere or meets the ground.
+ */
+static double rayLength(double h, double mu)
+{
+   double r = PLANET + h, c = r * r * (mu * mu - 1.0);
+
+   if (mu < 0.0 && c + PLANET * PLANET >= 0.0)
+      return -r * mu - sqrt(c + PLANET * PLANET);
+   return -r * mu + sqrt(c + (PLANET + TOP) * (PLANET + TOP));
+}
+
+static double heightAt(double h, double mu, double t)
+{
+   double r = PLANET + h;
+
+   r = sqrt(r * r + t * t + 2.0 * r * t * mu);
+   return r > PLANET ? r - PLANET : 0.0;
+}
+
+/*  Table coordinates, in [0, 1], and back.  */
+static double toHeight(double u)
+{
+   return TOP * u * u;
+}
+
+static double toAngle(double u)
+{
+   double s = 2.0 * u - 1.0;
+
+   return s < 0.0 ? -s * s : s * s;
+}
+
+static double fromHeight(double h)
+{
+   return h <= 0.0 ? 0.0 : h >= TOP ? 1.0 : sqrt(h / TOP);
+}
+
+static double fromAngle(double mu)
+{
+   return 0.5 + 0.5 * (mu < 0.0 ? -sqrt(-mu) : sqrt(mu));
+}
+
+/*  Extinction per meter at a height.  */
+static void extinction(const AtmosphereParams *p, double h, double e[3])
+{
+   double air = exp(-h / p->rayleighHeight);
+   double haze = exp(-h / p->mieHeight) * p->mie * MIE_EXTINCTION;
+   int i;
+
+   for (i = 0; i < 3; i++)
+      e[i] = p->rayleigh[i] * air + haze;
+}
+
+/*  One height of the transmittance table, every angle.  */
+static void transmittanceJob(int index, void *user)
+{
+   Atmosphere *a = (Atmosphere *) user;
+   double h = toHeight((double) index / (ATMOSPHERE_T_HEIGHTS - 1));
+   int j, k, i;
+
+   for (j = 0; j < ATMOSPHERE_T_ANGLES; j++) {
+      double mu = toAngle((double) j / (ATMOSPHERE_T_ANGLES - 1));
+      double r = PLANET + h, len = rayLength(h, mu);
+      double depth[3] = { 0.0, 0.0, 0.0 }, e[3];
+      GLfloat *out = a->transmittance + (index * ATMOSPHERE_T_ANGLES + j) * 3;
+
+      /*  into the ground  */
+      if (mu < 0.0 && r * r * (mu * mu - 1.0) + PLANET * PLANET >= 0.0) {
+         out[0] = out[1] = out[2] = 0.0;
+         continue;
+      }
+      /*  steps growing with distance, as the air thins  */
+      for (k = 0; k < T_STEPS; k++) {
+         double t0 = len * k * k / (T_STEPS * T_STEPS);
+         double t1 = len * (k + 1) * (k + 1) / (T_STEPS * T_STEPS);
+
+         extinction(&a->built, heightAt(h, mu, (t0 + t1) * 0.5), e);
+         for (i = 0; i < 3; i++)
+            depth[i] += e[i] * (t1 - t0);
+      }
+      for (i = 0; i < 3; i++)
+         out[i] = exp(-depth[i]);
+   }
+}
+
+/*  Bilinear lookup in the transmittance table.  */
+static void transmittanceAt(const Atmosphere *a, double h, double mu,
+                            GLfloat t[3])
+{
+   double x = fromAngle(mu) * (ATMOSPHERE_T_ANGLES - 1);
+   double y = fromHeight(h) * (ATMOSPHERE_T_HEIGHTS - 1);
+   int x0 = (int) x, y0 = (int) y, x1, y1, i;
+   double fx, fy;
+
+   if (x0 > ATMOSPHERE_T_ANGLES - 2)
+      x0 = ATMOSPHERE_T_ANGLES - 2;
+   if (y0 > ATMOSPHERE_T_HEIGHTS - 2)
+      y0 = ATMOSPHERE_T_HEIGHTS - 2;
+   x1 = x0 + 1;
+   y1 = y0 + 1;
+   fx = x - x0;
+   fy = y - y0;
+   for (i = 0; i < 3; i++) {
+      const GLfloat *tt = a->transmittance;
+      double low = tt[(y0 * ATMOSPHERE_T_ANGLES + x0) * 3 + i] * (1.0 - fx) +
+                   tt[(y0 * ATMOSPHERE_T_ANGLES + x1) * 3 + i] * fx;
+      double high = tt[(y1 * ATMOSPHERE_T_ANGLES + x0) * 3 + i] * (1.0 - fx) +
+                    tt[(y1 * ATMOSPHERE_T_ANGLES + x1) * 3 + i] * fx;
+
+      t[i] = low * (1.0 - fy) + high * fy;
+   }
+}
+
+/*  Sunlight by height for the sun of the build, so that the march
+ *  need not search the transmittance table.
+ */
+static void buildSunLight(Atmosphere *a)
+{
+   int i;
+
+   for (i = 0; i < SUN_HEIGHTS; i++)
+      transmittanceAt(a, toHeight((double) i / (SUN_HEIGHTS - 1)),
+                      a->builtSun, a->sunLight + i * 3);
+}
+
+static void sunLightAt(const Atmosphere *a, double h, double s[3])
+{
+   double x = fromHeight(h) * (SUN_HEIGHTS - 1), f;
+   int x0 = (int) x, i;
+
+   if (x0 > SUN_HEIGHTS - 2)
+      x0 = SUN_HEIGHTS - 2;
+   f = x - x0;
+   for (i = 0; i < 3; i++)
+      s[i] = a->sunLight[x0 * 3 + i] * (1.0 - f) +
+             a->sunLight[(x0 + 1) * 3 + i] * f;
+}
+
+/*  One eye height of the scattering table, every angle and distance.  */
+static void scatteringJob(int index, void *user)
+{
+   Atmosphere *a = (Atmosphere *) user;
+   const AtmosphereParams *p = &a->built;
+   double h = toHeight((double) index / (ATMOSPHERE_HEIGHTS - 1));
+   int j, k, m, i;
+
+   for (j = 0; j < ATMOSPHERE_ANGLES; j++) {
+      double mu = toAngle((double) j / (ATMOSPHERE_ANGLES - 1));
+      double len = rayLength(h, mu), t = 0.0;
+      double depth[3] = { 0.0, 0.0, 0.0 };
+      double air[3] = { 0.0, 0.0, 0.0 }, haze[3] = { 0.0, 0.0, 0.0 };
+      int base = (index * ATMOSPHERE_ANGLES + j) * ATMOSPHERE_DISTANCES;
+
+      for (k = 0; k < ATMOSPHERE_DISTANCES; k++) {
+         double u = (double) k / (ATMOSPHERE_DISTANCES - 1), end = len * u * u;
+         double dt = (end - t) / SUBSTEPS;
+         GLfloat *out;
+
+         for (m = 0; m < SUBSTEPS && dt > 0.0; m++) {
+            double y = heightAt(h, mu, t + 0.5 * dt), e[3], s[3];
+            double ra = exp(-y / p->rayleighHeight);
+            double hz = exp(-y / p->mieHeight) * p->mie;
+
+            extinction(p, y, e);
+            sunLightAt(a, y, s);
+            for (i = 0; i < 3; i++) {
+               double seen = exp(-(depth[i] + 0.5 * e[i] * dt)) * s[i] * dt;
+
+               air[i] += p->rayleigh[i] * ra * seen;
+               haze[i] += hz * seen;
+               depth[i] += e[i] * dt;
+            }
+            t += dt;
+         }
+         for (i = 0; i < 3; i++) {
+            out = a->scattering[0] + (base + k) * 3;
+            out[i] = air[i];
+            out = a->scattering[1] + (base + k) * 3;
+            out[i] = haze[i];
+            out = a->scattering[2] + (base + k) * 3;
+            out[i] = exp(-depth[i]);
+         }
+      }
+   }
+}
+
+static void buildTransmittance(Atmosphere *a, int parallel)
+{
+   double t0 = timerSeconds();
+   int i;
+
+   if (parallel)
+      jobsParallelFor(ATMOSPHERE_T_HEIGHTS, transmittanceJob, a);
+   else
+      for (i = 0; i < ATMOSPHERE_T_HEIGHTS; i++)
+         transmittanceJob(i, a);
+   a->stats.transmittanceTime = timerSeconds() - t0;
+   a->stats.transmittanceBuilds++;
+}
+
+/*  Take the wanted state as the one to build, and build what it
+ *  needs before the scattering table.
+ */
+static void prepareBuild(Atmosphere *a, int all, int parallel)
+{
+   if (all || a->dirty & DIRTY_TRANSMITTANCE) {
+      a->built = a->params;
+      buildTransmittance(a, parallel);
+   }
+   a->built.mieG = a->params.mieG;
+   a->built.sunIntensity = a->params.sunIntensity;
+   a->builtSun = a->sun[1];
+   buildSunLight(a);
+   a->dirty = 0;
+}
+
+static void upload(Atmosphere *a)
+{
+#ifdef GL_VERSION_3_3
+   double t0 = timerSeconds();
+   int i;
+
+   if (a->program == 0)
+      return;
+   for (i = 0; i < 3; i++) {
+      glBindTexture(GL_TEXTURE_3D, a->tables[i]);
+      glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, ATMOSPHERE_DISTANCES,
+                      ATMOSPHERE_ANGLES, ATMOSPHERE_HEIGHTS, GL_RGB, GL_FLOAT,
+                      a->scattering[i]);
+   }
+   glBindTexture(GL_TEXTURE_3D, 0);
+   a->stats.uploadTime = timerSeconds() - t0;
+#endif
+}
+
+static void finishBuild(Atmosphere *a)
+{
+   jobsWait(&a->group);
+   a->building = 0;
+   upload(a);
+   a->stats.scatteringTime = timerSeconds() - a->started;
+   a->stats.scatteringBuilds++;
+}
+
+#ifdef GL_VERSION_3_3
+static void setupTable(GLuint texture)
+{
+   glBindTexture(GL_TEXTURE_3D, texture);
+   glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, ATMOSPHERE_DISTANCES,
+                ATMOSPHERE_ANGLES, ATMOSPHERE_HEIGHTS, 0, GL_RGB, GL_FLOAT,
+                NULL);
+   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+   glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+static void setupProgram(Atmosphere *a)
+{
+   static const char *samplers[5] = {
+      "color", "depth", "air", "haze", "transmittance"
+   };
+   int i;
+
+   if (!shaderGLVersion(3, 3))
+      return;
+   a->program = shaderProgram(applyVertex, applyFragment);
+   if (a->program == 0)
+      return;
+   glUseProgram(a->program);
+   for (i = 0; i < 5; i++)
+      glUniform1i(glGetUniformLocation(a->program, samplers[i]), i + 1);
+   a->viewportLocation = glGetUniformLocation(a->program, "viewport");
+   a->eyeToWorldLocation = glGetUniformLocation(a->program, "eyeToWorld");
+   a->projectionLocation = glGetUniformLocation(a->program, "projection");
+   a->depthTermsLocation = glGetUniformLocation(a->program, "depthTerms");
+   a->sunLocation = glGetUniformLocation(a->program, "sun");
+   a->eyeHeightLocation = glGetUniformLocation(a->program, "eyeHeight");
+   a->fadeLocation = glGetUniformLocation(a->program, "fade");
+   a->mieGLocation = glGetUniformLocation(a->program, "mieG");
+   a->intensityLocation = glGetUniformLocation(a->program, "intensity");
+   glUseProgram(0);
+
+   glGenTextures(3, a->tables);
+   for (i = 0; i < 3; i++)
+      setupTable(a->tables[i]);
+   glGenTextures(1, &a->color);
+   glGenTextures(1, &a->depth);
+}
+#endif
+
+void atmosphereInit(Atmosphere *a)
+{
+   size_t cells = (size_t) ATMOSPHERE_DISTANCES * ATMOSPHERE_ANGLES *
+                  ATMOSPHERE_HEIGHTS * 3;
+   int i;
+
+   memset(a, 0, sizeof(*a));
+   atmosphereDefaults(&a->params);
+   a->sun[1] = 1.0;
+   a->fade[0] = a->fade[1] = 1e30;
+   a->transmittance = (GLfloat *) allocate(NULL, ATMOSPHERE_T_HEIGHTS *
+                                  ATMOSPHERE_T_ANGLES * 3 * sizeof(GLfloat));
+   a->sunLight = (GLfloat *) allocate(NULL, SUN_HEIGHTS * 3 *
+                                      sizeof(GLfloat));
+   for (i = 0; i < 3; i++)
+      a->scattering[i] = (GLfloat *) allocate(NULL, cells * sizeof(GLfloat));
+#ifdef GL_VERSION_3_3
+   setupProgram(a);
+#endif
+   atmosphereRebuild(a, 1);
+}
+
+void atmosphereFree(Atmosphere *a)
+{
+   int i;
+
+   if (a->building)
+      jobsWait(&a->group);
+#ifdef GL_VERSION_3_3
+   if (a->program) {
+      glDeleteProgram(a->program);
+      glDeleteTextures(3, a->tables);
+      glDeleteTextures(1, &a->color);
+      glDeleteTextures(1, &a->depth);
+   }
+#endif
+   free(a->transmittance);
+   free(a->sunLight);
+   for (i = 0; i < 3; i++)
+      free(a->scattering[i]);
+   memset(a, 0, sizeof(*a));
+}
+
+int atmosphereSupported(const Atmosphere *a)
+{
+   return a->program != 0;
+}
+
+void atmosphereSetParams(Atmosphere *a, const AtmosphereParams *p)
+{
+   AtmosphereParams *q = &a->params;
+
+   if (memcmp(q->rayleigh, p->rayleigh, sizeof(q->rayleigh)) != 0 ||
+       q->rayleighHeight != p->rayleighHeight || q->mie != p->mie ||
+       q->mieHeight != p->mieHeight)
+      a->dirty |= DIRTY_TRANSMITTANCE | DIRTY_SCATTERING;
+   *q = *p;
+}
+
+void atmosphereSetSun(Atmosphere *a, const GLfloat direction[3])
+{
+   GLfloat len = sqrt(direction[0] * direction[0] +
+                      direction[1] * direction[1] +
+                      direction[2] * direction[2]), sun[3];
+   int i;
+
+   for (i = 0; i < 3; i++)
+      sun[i] = direction[i] / len;
+   if (memcmp(sun, a->sun, sizeof(sun)) == 0)
+      return;
+   memcpy(a->sun, sun, sizeof(sun));
+   if (fabs(a->sun[1] - a->builtSun) > SUN_STEP)
+      a->dirty |= DIRTY_SCATTERING;
+   else if (!a->dirty)
+      a->stats.unchanged++;
+}
+
+void atmosphereSetFade(Atmosphere *a, GLfloat start, GLfloat end)
+{
+   a->fade[0] = start;
+   a->fade[1] = end;
+}
+
+int atmosphereUpdate(Atmosphere *a)
+{
+   int uploaded = 0;
+
+   if (a->building) {
+      if (!jobsDone(&a->group))
+         return 0;
+      finishBuild(a);
+      uploaded = 1;
+   }
+   if (a->dirty) {
+      prepareBuild(a, 0, 1);
+      a->started = timerSeconds();
+      jobsSubmit(&a->group, ATMOSPHERE_HEIGHTS, scatteringJob, a);
+      a->building = 1;
+   }
+   return uploaded;
+}
+
+void atmosphereFinish(Atmosphere *a)
+{
+   if (a->building)
+      finishBuild(a);
+}
+
+double atmosphereRebuild(Atmosphere *a, int parallel)
+{
+   double t0;
+   int i;
+
+   atmosphereFinish(a);
+   t0 = timerSeconds();
+   prepareBuild(a, 1, parallel);
+   a->started = timerSeconds();
+   if (parallel)
+      jobsParallelFor(ATMOSPHERE_HEIGHTS, scatteringJob, a);
+   else
+      for (i = 0; i < ATMOSPHERE_HEIGHTS; i++)
+         scatteringJob(i, a);
+   t0 = timerSeconds() - t0;
+   upload(a);
+   a->stats.scatteringTime = timerSeconds() - a->started;
+   a->stats.scatteringBuilds++;
+   return t0;
+}
+
+void atmosphereSunColor(const Atmosphere *a, GLfloat height,
+                        GLfloat color[3])
+{
+   transmittanceAt(a, height, a->sun[1], color);
+}
+
+void atmosphereApply(Atmosphere *a, const GLfloat eye[3])
+{
+#ifdef GL_VERSION_3_3
+   GLfloat m[16], p[16], eyeToWorld[9];
+   GLint viewport[4];
+   int i, j;
+
+   if (a->program == 0)
+      return;
+   glGetIntegerv(GL_VIEWPORT, viewport);
+   glGetFloatv(GL_MODELVIEW_MATRIX, m);
+   glGetFloatv(GL_PROJECTION_MATRIX, p);
+   for (i = 0; i < 3; i++)
+      for (j = 0; j < 3; j++)
+         eyeToWorld[j * 3 + i] = m[i * 4 + j];
+
+   /*  copy the frame to read it while drawing over it  */
+   glActiveTexture(GL_TEXTURE1);
+   glBindTexture(GL_TEXTURE_2D, a->color);
+   if (viewport[2] != a->width || viewport[3] != a->height) {
+      a->width = viewport[2];
+      a->height = viewport[3];
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, a->width, a->height, 0,
+                   GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glBindTexture(GL_TEXTURE_2D, a->depth);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, a->width,
+                   a->height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glBindTexture(GL_TEXTURE_2D, a->color);
+   }
+   glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1],
+                       a->width, a->height);
+   glActiveTexture(GL_TEXTURE2);
+   glBindTexture(GL_TEXTURE_2D, a->depth);
+   glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1],
+                       a->width, a->height);
+   for (i = 0; i < 3; i++) {
+      glActiveTexture(GL_TEXTURE3 + i);
+      glBindTexture(GL_TEXTURE_3D, a->tables[i]);
+   }
+   glActiveTexture(GL_TEXTURE0);
+
+   glUseProgram(a->program);
+   glUniform4f(a->viewportLocation, viewport[0], viewport[1], viewport[2],
+               viewport[3]);
+   glUniformMatrix3fv(a->eyeToWorldLocation, 1, GL_FALSE, eyeToWorld);
+   glUniform4f(a->projectionLocation, p[0], p[5], p[8], p[9]);
+   glUniform2f(a->depthTermsLocation, p[10], p[14]);
+   glUniform3fv(a->sunLocation, 1, a->sun);
+   glUniform1f(a->eyeHeightLocation, eye[1]);
+   glUniform2fv(a->fadeLocation, 1, a->fade);
+   glUniform1f(a->mieGLocation, a->params.mieG);
+   glUniform1f(a->intensityLocation, a->params.sunIntensity);
+
+   glPushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT | GL_POLYGON_BIT);
+   glDisable(GL_DEPTH_TEST);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_FOG);
+   glDisable(GL_CULL_FACE);
+   glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+   glBegin(GL_QUADS);
+   glVertex2f(-1.0, -1.0);
+   glVertex2f(1.0, -1.0);
+   glVertex2f(1.0, 1.0);
+   glVertex2f(-1.0, 1.0);
+   glEnd();
+   glPopAttrib();
+   glUseProgram(0);
+
+   for (i = 0; i < 5; i++) {
+      glActiveTexture(GL_TEXTURE1 + i);
+      glBindTexture(i < 2 ? GL_TEXTURE_2D : GL_TEXTURE_3D, 0);
+   }
+   glActiveTexture(GL_TEXTURE0);
+#endif
+}
+
+void atmospherePrintStats(const char *name, const Atmosphere *a)
+{
+   const AtmosphereStats *st = &a->stats;
+
+   printf("%s: %d transmittance builds, last %.3f ms; %d scattering "
+          "builds, last %.3f ms\n", name, st->transmittanceBuilds,
+          st->transmittanceTime * 1000.0, st->scatteringBuilds,
+          st->scatteringTime * 1000.0);
+   printf("  upload %.3f ms; %d sun moves needed no build%s\n",
+          st->uploadTime * 1000.0, st->unchanged,
+          a->building ? "; building" : "");
+}
@@ -0,0 +1,138 @@
+/*
+ *  atmosphere.h
+ *  Sky, aerial perspective and height fog from precomputed tables.
+ *
+ *  Air (Rayleigh scattering, bluest light most) and haze or fog (Mie
+ *  scattering, grey and mostly forward) thin out exponentially with
+ *  height.  Two kinds of table are made on the CPU, on the worker
+ *  threads of jobs.h:
+ *
+ *     transmittance  the fraction of sunlight reaching each height
+ *                    from each zenith angle, which depends only on
+ *                    the air and haze;
+ *     scattering     for an eye at each height looking up or down at
+ *                    each angle, the light scattered towards it by
+ *                    air and by haze within each distance, and the
+ *                    fraction of the light from that distance that
+ *                    gets through.  It depends on the sun's height
+ *                    in the sky but not on its bearing, since the
+ *                    phase functions, which do, are applied per
+ *                    pixel.
+ *
+ *  Changing the air or haze rebuilds both; moving the sun up or down
+ *  rebuilds the scattering table only, and turning it about the
+ *  vertical rebuilds nothing.  The scattering table is built in the
+ *  background: frames go on with the old one until the new one is
+ *  done, and a change made meanwhile starts another build after it.
+ *
+ *  atmosphereApply() then shades the frame already drawn: each pixel's
+ *  distance and direction, found from the depth buffer, look up the
+ *  scattering table, and pixels with nothing drawn get the sky, or
+ *  below the horizon the sky at the horizon, into which distant land
+ *  fades.  The sun is taken to be equally high everywhere along a
+ *  ray, which is close over the tens of kilometers an eye sees across
+ *  land; the ground curves under rays that reach into the sky.
+ *
+ *  World coordinates are meters, with y up and sea level at 0.
+ *  Requires OpenGL 3.3 for the shader.
+ */
+#ifndef ATMOSPHERE_H
+#define ATMOSPHERE_H
+
+#include "jobs.h"
+
+#define ATMOSPHERE_T_ANGLES   64      /* transmittance: zenith angles */
+#define ATMOSPHERE_T_HEIGHTS  32      /* and heights */
+#define ATMOSPHERE_DISTANCES  32      /* scattering: distances */
+#define ATMOSPHERE_ANGLES     64      /* view angles */
+#define ATMOSPHERE_HEIGHTS    32      /* eye heights */
+
+typedef struct atmosphereparams {
+   GLfloat  rayleigh[3];              /* per meter, at sea level */
+   GLfloat  rayleighHeight;           /* meters, to thin by e */
+   GLfloat  mie;                      /* per meter, at sea level */
+   GLfloat  mieHeight;
+   GLfloat  mieG;                     /* forward scattering, 0 .. 1 */
+   GLfloat  sunIntensity;
+} AtmosphereParams;
+
+typedef struct atmospherestats {
+   int      transmittanceBuilds;
+   int      scatteringBuilds;
+   int      unchanged;                /* sun moves that needed none */
+   double   transmittanceTime;        /* seconds, of the last build */
+   double   scatteringTime;           /* from start to upload */
+   double   uploadTime;
+} AtmosphereStats;
+
+typedef struct atmosphere {
+   AtmosphereParams  params;          /* as wanted */
+   AtmosphereParams  built;           /* as in the tables */
+   GLfloat           sun[3];          /* towards the sun, unit */
+   GLfloat           builtSun;        /* its height, as in the tables */
+   int               dirty;
+   int               building;
+   JobGroup          group;
+   double            started;
+
+   GLfloat          *transmittance;   /* 3 per height and angle */
+   GLfloat          *sunLight;        /* the sun's, by height */
+   GLfloat          *scattering[3];   /* air, haze, transmittance */
+
+   GLuint            program;
+   GLuint            tables[3];
+   GLuint            color, depth;    /* copies of the frame */
+   int               width, height;
+   GLint             viewportLocation;
+   GLint             eyeToWorldLocation, projectionLocation;
+   GLint             depthTermsLocation, sunLocation, eyeHeightLocation;
+   GLint             fadeLocation, mieGLocation, intensityLocation;
+   GLfloat           fade[2];
+   AtmosphereStats   stats;
+} Atmosphere;
+
+void atmosphereDefaults(AtmosphereParams *p);
+
+/*  Builds the tables for the defaults and a sun overhead before
+ *  returning.
+ */
+void atmosphereInit(Atmosphere *a);
+void atmosphereFree(Atmosphere *a);
+
+/*  False where the GL cannot run the shader.  */
+int atmosphereSupported(const Atmosphere *a);
+
+void atmosphereSetParams(Atmosphere *a, const AtmosphereParams *p);
+void atmosphereSetSun(Atmosphere *a, const GLfloat direction[3]);
+
+/*  Fade whatever is drawn into the sky between two distances, to hide
+ *  where the scene ends.
+ */
+void atmosphereSetFade(Atmosphere *a, GLfloat start, GLfloat end);
+
+/*  Start a build the changes call for, and upload one that is done.
+ *  Once a frame; returns true when new tables were uploaded.
+ */
+int atmosphereUpdate(Atmosphere *a);
+
+/*  Wait for the build in progress, if any, and upload it.  */
+void atmosphereFinish(Atmosphere *a);
+
+/*  Build every table now, on this thread only or on all of them, and
+ *  return the seconds taken.  For timing.
+ */
+double atmosphereRebuild(Atmosphere *a, int parallel);
+
+/*  The color of sunlight at a height, from the transmittance table.  */
+void atmosphereSunColor(const Atmosphere *a, GLfloat height,
+                        GLfloat color[3]);
+
+/*  Shade the frame in the current viewport, drawn with the current
+ *  modelview matrix (a rotation and a translation) and perspective
+ *  projection, for an eye at eye[] in world coordinates.
+ */
+void atmosphereApply(Atmosphere *a, const GLfloat eye[3]);
+
+void atmospherePrintStats(const char *name, const Atmosphere *a);
+
+#endif
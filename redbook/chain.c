@@ -0,0 +1,500 @@
+/*
+ *  chain.c
+ *  Forward and inverse kinematics of joint chains.  See chain.h.
+ *
+ *  The Jacobian solvers work in radians and take the position of the
+ *  tip only.  Each step is limited to CHAIN_MAX_STEP degrees a joint,
+ *  and a joint that the step would push past a limit is held there
+ *  and the step worked out again without it, so that the others make
+ *  up for it instead of the chain stalling against the limit.
+ */
+#include <GL/glut.h>
+#include <math.h>
+#include <string.h>
+#include "chain.h"
+#include "jobs.h"
+
+#define PI_ 3.14159265358979323846
+#define DEGREES (180.0 / PI_)
+
+#define CHAIN_MAX_STEP  20.0f       /* degrees per iteration */
+#define CHUNK_MIN       64          /* problems */
+
+void chainInit(Chain *c)
+{
+   memset(c, 0, sizeof(Chain));
+}
+
+int chainAddJoint(Chain *c, GLfloat x, GLfloat y, GLfloat z, int axis,
+                  GLfloat min, GLfloat max)
+{
+   ChainJoint *j;
+
+   if (c->jointCount == CHAIN_MAX_JOINTS)
+      return -1;
+   j = &c->joints[c->jointCount];
+   j->offset[0] = x;
+   j->offset[1] = y;
+   j->offset[2] = z;
+   j->axis = axis;
+   j->min = min;
+   j->max = max;
+   return c->jointCount++;
+}
+
+static GLfloat clampAngle(const ChainJoint *j, GLfloat a)
+{
+   return a < j->min ? j->min : a > j->max ? j->max : a;
+}
+
+void chainClamp(const Chain *c, GLfloat *angles)
+{
+   int i;
+
+   for (i = 0; i < c->jointCount; i++)
+      angles[i] = clampAngle(&c->joints[i], angles[i]);
+}
+
+/*  r = r * the rotation glRotatef() makes about the axis  */
+static void rotate(GLfloat r[3][3], int axis, GLfloat degrees)
+{
+   GLfloat c = (GLfloat) cos(degrees / DEGREES);
+   GLfloat s = (GLfloat) sin(degrees / DEGREES);
+   int i = (axis + 1) % 3, j = (axis + 2) % 3, k;
+
+   for (k = 0; k < 3; k++) {
+      GLfloat a = r[k][i], b = r[k][j];
+
+      r[k][i] = a * c + b * s;
+      r[k][j] = b * c - a * s;
+   }
+}
+
+static void transform(GLfloat r[3][3], const GLfloat v[3], GLfloat out[3])
+{
+   int k;
+
+   for (k = 0; k < 3; k++)
+      out[k] += r[k][0] * v[0] + r[k][1] * v[1] + r[k][2] * v[2];
+}
+
+void chainForward(const Chain *c, const GLfloat *angles,
+                  GLfloat positions[][3], GLfloat axes[][3],
+                  GLfloat tip[3])
+{
+   GLfloat r[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+   GLfloat p[3] = { 0, 0, 0 };
+   int i, k;
+
+   for (i = 0; i < c->jointCount; i++) {
+      const ChainJoint *j = &c->joints[i];
+
+      transform(r, j->offset, p);
+      rotate(r, j->axis, angles[i]);
+      if (positions)
+         for (k = 0; k < 3; k++)
+            positions[i][k] = p[k];
+      if (axes)
+         for (k = 0; k < 3; k++)
+            axes[i][k] = r[k][j->axis];
+   }
+   if (tip) {
+      for (k = 0; k < 3; k++)
+         tip[k] = p[k];
+      transform(r, c->tip, tip);
+   }
+}
+
+static GLfloat distance(const GLfloat a[3], const GLfloat b[3])
+{
+   GLfloat d[3];
+
+   d[0] = a[0] - b[0];
+   d[1] = a[1] - b[1];
+   d[2] = a[2] - b[2];
+   return (GLfloat) sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+}
+
+static GLfloat dot(const GLfloat a[3], const GLfloat b[3])
+{
+   return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void cross(const GLfloat a[3], const GLfloat b[3], GLfloat out[3])
+{
+   out[0] = a[1] * b[2] - a[2] * b[1];
+   out[1] = a[2] * b[0] - a[0] * b[2];
+   out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+/*  Degrees from -180 to 180.  */
+static GLfloat wrap(double a)
+{
+   a = fmod(a, 360.0);
+   if (a > 180.0)
+      a -= 360.0;
+   else if (a <= -180.0)
+      a += 360.0;
+   return (GLfloat) a;
+}
+
+/*  Analytic solution.  The chain must be a yaw, three pitch joints
+ *  and any rolls, with every link and the tip along the y axis of
+ *  its frame.  The yaw turns the arm's plane through the target,
+ *  either way round; the last link is set at the approach angle,
+ *  which leaves the shoulder and elbow a triangle to close, elbow up
+ *  or down.  Of the four poses, the one within the limits that moves
+ *  the joints least is taken.
+ */
+GLfloat chainSolveAnalytic(const Chain *c, GLfloat *angles,
+                           const GLfloat target[3], GLfloat approach)
+{
+   const ChainJoint *j = c->joints;
+   int pitch[3], n = 0, i, yaw, elbow;
+   GLfloat length[4] = { 0, 0, 0, 0 };
+   GLfloat dx, dz, r, best[CHAIN_MAX_JOINTS], tip[3];
+   double bestCost = -1;
+
+   if (c->jointCount < 4 || j[0].axis != 1 ||
+       c->tip[0] != 0 || c->tip[2] != 0)
+      return -1;
+   for (i = 1; i < c->jointCount; i++) {
+      if (j[i].offset[0] != 0 || j[i].offset[2] != 0 || j[i].axis == 0)
+         return -1;
+      length[n] += j[i].offset[1];
+      if (j[i].axis == 2) {
+         if (n == 3)
+            return -1;
+         pitch[n++] = i;
+      }
+   }
+   length[3] += c->tip[1];
+   if (n != 3 || length[1] <= 0 || length[2] <= 0)
+      return -1;
+
+   dx = target[0] - j[0].offset[0];
+   dz = target[2] - j[0].offset[2];
+   r = (GLfloat) sqrt(dx * dx + dz * dz);
+
+   for (yaw = 0; yaw < 2; yaw++) {
+      double psi = r > 1e-6f ? atan2(-dz, dx) * DEGREES : angles[0];
+      GLfloat x = yaw ? -r : r;
+      GLfloat y = target[1] - j[0].offset[1] - length[0];
+      double tool = (x >= 0 ? -approach : approach) / DEGREES;
+      double wx = x + length[3] * sin(tool);
+      double wy = y - length[3] * cos(tool);
+      double l1 = length[1], l2 = length[2];
+      double c2 = (wx * wx + wy * wy - l1 * l1 - l2 * l2) / (2 * l1 * l2);
+
+      if (yaw)
+         psi += 180.0;
+      if (c2 < -1.0 || c2 > 1.0)
+         continue;
+      for (elbow = 0; elbow < 2; elbow++) {
+         double t2 = elbow ? -acos(c2) : acos(c2);
+         double t1 = atan2(wy, wx) -
+                     atan2(l2 * sin(t2), l1 + l2 * cos(t2)) - PI_ / 2;
+         GLfloat pose[CHAIN_MAX_JOINTS];
+         double cost = 0;
+
+         for (i = 0; i < c->jointCount; i++)
+            pose[i] = 0;
+         pose[0] = wrap(psi);
+         pose[pitch[0]] = wrap(t1 * DEGREES);
+         pose[pitch[1]] = wrap(t2 * DEGREES);
+         pose[pitch[2]] = wrap((tool - t1 - t2) * DEGREES);
+         for (i = 0; i < c->jointCount; i++) {
+            if (pose[i] < j[i].min || pose[i] > j[i].max)
+               break;
+            cost += fabs(wrap(pose[i] - angles[i]));
+         }
+         if (i == c->jointCount && (bestCost < 0 || cost < bestCost)) {
+            bestCost = cost;
+            memcpy(best, pose, sizeof(best));
+         }
+      }
+   }
+   if (bestCost < 0)
+      return -1;
+   memcpy(angles, best, c->jointCount * sizeof(GLfloat));
+   chainForward(c, angles, NULL, NULL, tip);
+   return distance(tip, target);
+}
+
+/*  Turn p about the axis through center.  */
+static void turnAbout(GLfloat p[3], const GLfloat center[3],
+                      const GLfloat axis[3], double radians)
+{
+   GLfloat v[3], w[3];
+   GLfloat c = (GLfloat) cos(radians), s = (GLfloat) sin(radians), d;
+   int k;
+
+   for (k = 0; k < 3; k++)
+      v[k] = p[k] - center[k];
+   cross(axis, v, w);
+   d = dot(axis, v) * (1 - c);
+   for (k = 0; k < 3; k++)
+      p[k] = center[k] + v[k] * c + w[k] * s + axis[k] * d;
+}
+
+/*  Turning a joint moves nothing before it, so one pass of the
+ *  chain needs only the joints from a single forward pass, and the
+ *  tip is turned along with each joint.
+ */
+GLfloat chainSolveCCD(const Chain *c, GLfloat *angles,
+                      const GLfloat target[3], int *iterations)
+{
+   GLfloat positions[CHAIN_MAX_JOINTS][3], axes[CHAIN_MAX_JOINTS][3];
+   GLfloat tip[3], error = 0;
+   int it, i, k;
+
+   chainClamp(c, angles);
+   for (it = 0; it < CHAIN_ITERATIONS; it++) {
+      chainForward(c, angles, positions, axes, tip);
+      error = distance(tip, target);
+      if (error < CHAIN_TOLERANCE)
+         break;
+      for (i = c->jointCount - 1; i >= 0; i--) {
+         GLfloat u[3], v[3], w[3], *a = axes[i], du, dv, turned;
+
+         for (k = 0; k < 3; k++) {
+            u[k] = tip[k] - positions[i][k];
+            v[k] = target[k] - positions[i][k];
+         }
+         du = dot(u, a);
+         dv = dot(v, a);
+         for (k = 0; k < 3; k++) {
+            u[k] -= du * a[k];
+            v[k] -= dv * a[k];
+         }
+         if (dot(u, u) < 1e-12f || dot(v, v) < 1e-12f)
+            continue;
+         cross(u, v, w);
+         turned = clampAngle(&c->joints[i], angles[i] + (GLfloat)
+                             (atan2(dot(a, w), dot(u, v)) * DEGREES));
+         turnAbout(tip, positions[i], a, (turned - angles[i]) / DEGREES);
+         angles[i] = turned;
+      }
+   }
+   if (it == CHAIN_ITERATIONS) {
+      chainForward(c, angles, NULL, NULL, tip);
+      error = distance(tip, target);
+   }
+   if (iterations)
+      *iterations = it;
+   return error;
+}
+
+/*  Columns of the Jacobian of the tip position, per radian, for the
+ *  joints that are free; the others are zero.
+ */
+static void jacobian(const Chain *c, const GLfloat *angles,
+                     const int *held, GLfloat J[][3], GLfloat tip[3])
+{
+   GLfloat positions[CHAIN_MAX_JOINTS][3], axes[CHAIN_MAX_JOINTS][3];
+   GLfloat d[3];
+   int i;
+
+   chainForward(c, angles, positions, axes, tip);
+   for (i = 0; i < c->jointCount; i++) {
+      if (held[i]) {
+         J[i][0] = J[i][1] = J[i][2] = 0;
+         continue;
+      }
+      d[0] = tip[0] - positions[i][0];
+      d[1] = tip[1] - positions[i][1];
+      d[2] = tip[2] - positions[i][2];
+      cross(axes[i], d, J[i]);
+   }
+}
+
+/*  The change of the angles, in degrees, that moves the tip by e:
+ *  by the damped pseudo-inverse, or along the transpose if damping
+ *  is negative.  Returns 0 if the joints cannot move the tip.
+ */
+static int step(const Chain *c, GLfloat J[][3], const GLfloat e[3],
+                GLfloat damping, GLfloat *delta)
+{
+   double A[3][3], f[3], largest = 0;
+   int i, k, l;
+
+   for (k = 0; k < 3; k++)
+      for (l = 0; l < 3; l++) {
+         A[k][l] = 0;
+         for (i = 0; i < c->jointCount; i++)
+            A[k][l] += (double) J[i][k] * J[i][l];
+      }
+
+   if (damping < 0) {
+      double g[3], ee = 0, gg = 0;
+
+      for (k = 0; k < 3; k++) {
+         g[k] = A[k][0] * e[0] + A[k][1] * e[1] + A[k][2] * e[2];
+         ee += e[k] * g[k];
+         gg += g[k] * g[k];
+      }
+      if (gg < 1e-20)
+         return 0;
+      for (k = 0; k < 3; k++)
+         f[k] = e[k] * ee / gg;
+   } else {
+      double det, inv[3][3];
+
+      for (k = 0; k < 3; k++)
+         A[k][k] += (double) damping * damping;
+      inv[0][0] = A[1][1] * A[2][2] - A[1][2] * A[2][1];
+      inv[0][1] = A[0][2] * A[2][1] - A[0][1] * A[2][2];
+      inv[0][2] = A[0][1] * A[1][2] - A[0][2] * A[1][1];
+      inv[1][0] = A[1][2] * A[2][0] - A[1][0] * A[2][2];
+      inv[1][1] = A[0][0] * A[2][2] - A[0][2] * A[2][0];
+      inv[1][2] = A[0][2] * A[1][0] - A[0][0] * A[1][2];
+      inv[2][0] = A[1][0] * A[2][1] - A[1][1] * A[2][0];
+      inv[2][1] = A[0][1] * A[2][0] - A[0][0] * A[2][1];
+      inv[2][2] = A[0][0] * A[1][1] - A[0][1] * A[1][0];
+      det = A[0][0] * inv[0][0] + A[0][1] * inv[1][0] +
+            A[0][2] * inv[2][0];
+      if (fabs(det) < 1e-20)
+         return 0;
+      for (k = 0; k < 3; k++)
+         f[k] = (inv[k][0] * e[0] + inv[k][1] * e[1] +
+                 inv[k][2] * e[2]) / det;
+   }
+
+   for (i = 0; i < c->jointCount; i++) {
+      delta[i] = (GLfloat) ((J[i][0] * f[0] + J[i][1] * f[1] +
+                             J[i][2] * f[2]) * DEGREES);
+      if (fabs(delta[i]) > largest)
+         largest = fabs(delta[i]);
+   }
+   if (largest > CHAIN_MAX_STEP)
+      for (i = 0; i < c->jointCount; i++)
+         delta[i] *= (GLfloat) (CHAIN_MAX_STEP / largest);
+   return largest > 0;
+}
+
+static GLfloat solveJacobian(const Chain *c, GLfloat *angles,
+                             const GLfloat target[3], GLfloat damping,
+                             int *iterations)
+{
+   GLfloat J[CHAIN_MAX_JOINTS][3], delta[CHAIN_MAX_JOINTS];
+   GLfloat tip[3], e[3], error = 0;
+   int held[CHAIN_MAX_JOINTS], it, i, again;
+
+   chainClamp(c, angles);
+   for (it = 0; it < CHAIN_ITERATIONS; it++) {
+      memset(held, 0, sizeof(held));
+      jacobian(c, angles, held, J, tip);
+      e[0] = target[0] - tip[0];
+      e[1] = target[1] - tip[1];
+      e[2] = target[2] - tip[2];
+      error = (GLfloat) sqrt(dot(e, e));
+      if (error < CHAIN_TOLERANCE)
+         break;
+      if (!step(c, J, e, damping, delta))
+         break;
+
+/*  hold the joints the step would take past a limit  */
+      again = 0;
+      for (i = 0; i < c->jointCount; i++) {
+         const ChainJoint *j = &c->joints[i];
+
+         if ((delta[i] > 0 && angles[i] >= j->max) ||
+             (delta[i] < 0 && angles[i] <= j->min)) {
+            held[i] = 1;
+            again = 1;
+         }
+      }
+      if (again) {
+         jacobian(c, angles, held, J, tip);
+         if (!step(c, J, e, damping, delta))
+            break;
+      }
+      for (i = 0; i < c->jointCount; i++)
+         angles[i] = clampAngle(&c->joints[i], angles[i] + delta[i]);
+   }
+   if (it == CHAIN_ITERATIONS || error >= CHAIN_TOLERANCE) {
+      chainForward(c, angles, NULL, NULL, tip);
+      error = distance(tip, target);
+   }
+   if (iterations)
+      *iterations = it;
+   return error;
+}
+
+GLfloat chainSolveTranspose(const Chain *c, GLfloat *angles,
+                            const GLfloat target[3], int *iterations)
+{
+   return solveJacobian(c, angles, target, -1.0f, iterations);
+}
+
+GLfloat chainSolveDLS(const Chain *c, GLfloat *angles,
+                      const GLfloat target[3], GLfloat damping,
+                      int *iterations)
+{
+   return solveJacobian(c, angles, target, damping, iterations);
+}
+
+static void solve(ChainProblem *p, int method)
+{
+   p->iterations = 0;
+   switch (method) {
+   case CHAIN_ANALYTIC:
+      p->error = chainSolveAnalytic(p->chain, p->angles, p->target,
+                                    p->approach);
+      break;
+   case CHAIN_CCD:
+      p->error = chainSolveCCD(p->chain, p->angles, p->target,
+                               &p->iterations);
+      break;
+   case CHAIN_TRANSPOSE:
+      p->error = chainSolveTranspose(p->chain, p->angles, p->target,
+                                     &p->iterations);
+      break;
+   case CHAIN_DLS:
+      p->error = chainSolveDLS(p->chain, p->angles, p->target,
+                               CHAIN_DAMPING, &p->iterations);
+      break;
+   }
+}
+
+typedef struct chainbatch {
+   ChainProblem  *problems;
+   int            count, chunks, method;
+} ChainBatch;
+
+static void solveChunk(int index, void *user)
+{
+   ChainBatch *b = (ChainBatch *) user;
+   int i = (int) ((long) b->count * index / b->chunks);
+   int end = (int) ((long) b->count * (index + 1) / b->chunks);
+
+   for (; i < end; i++)
+      solve(&b->problems[i], b->method);
+}
+
+void chainSolveBatch(ChainProblem *problems, int count, int method)
+{
+   ChainBatch b;
+
+   b.problems = problems;
+   b.count = count;
+   b.method = method;
+   b.chunks = jobsThreadCount() * 4;
+   if (b.chunks > count / CHUNK_MIN)
+      b.chunks = count / CHUNK_MIN;
+   if (b.chunks < 1)
+      b.chunks = 1;
+   if (b.chunks == 1)
+      solveChunk(0, &b);
+   else
+      jobsParallelFor(b.chunks, solveChunk, &b);
+}
+
+const char *chainMethodName(int method)
+{
+   static const char *names[CHAIN_METHODS] = {
+      "analytic", "CCD", "Jacobian transpose", "damped least squares"
+   };
+
+   return method >= 0 && method < CHAIN_METHODS ? names[method] : "?";
+}
@@ -0,0 +1,111 @@
+/*
+ *  chain.h
+ *  Articulated chains of revolute joints, such as the robot arm.
+ *  Each joint is a translation from the joint before, in its frame,
+ *  followed by a rotation about its own x, y or z axis, as the
+ *  modeling transformations glTranslatef() and glRotatef() build it;
+ *  angles are in degrees and each joint has limits.  The tip is a
+ *  point in the frame of the last joint.
+ *
+ *  chainForward() gives where the joints and the tip are for a pose.
+ *  The inverse solvers find a pose that puts the tip at a target
+ *  within the limits:
+ *
+ *  CHAIN_ANALYTIC   closed form for arms like the robot's: a yaw
+ *                   about y at the root, then pitch joints about z
+ *                   and rolls about y along straight links.  The
+ *                   rolls are held at 0 and exactly three pitch
+ *                   joints are solved for the tip position and the
+ *                   approach angle of the last link.
+ *  CHAIN_CCD        cyclic coordinate descent: each joint in turn,
+ *                   from the tip back, turns the tip towards the
+ *                   target about its axis.  Works on any chain.
+ *  CHAIN_TRANSPOSE  steps along the transpose of the Jacobian.
+ *  CHAIN_DLS        damped least squares: the pseudo-inverse of the
+ *                   Jacobian, damped so that it stays stable near
+ *                   singular poses and out of reach.
+ *
+ *  The iterative solvers start from the pose they are given, so a
+ *  chain following a moving target converges in a few iterations.
+ *  chainSolveBatch() solves many chains at once on the worker pool
+ *  (jobs.h).
+ */
+#ifndef CHAIN_H
+#define CHAIN_H
+
+#define CHAIN_MAX_JOINTS  8
+#define CHAIN_ITERATIONS  64
+#define CHAIN_TOLERANCE   0.001f    /* distance from the target */
+#define CHAIN_DAMPING     0.1f
+
+enum {
+   CHAIN_ANALYTIC,
+   CHAIN_CCD,
+   CHAIN_TRANSPOSE,
+   CHAIN_DLS,
+   CHAIN_METHODS
+};
+
+typedef struct chainjoint {
+   GLfloat  offset[3];          /* from the joint before */
+   int      axis;               /* 0, 1 or 2 for x, y or z */
+   GLfloat  min, max;           /* degrees */
+} ChainJoint;
+
+typedef struct chain {
+   ChainJoint  joints[CHAIN_MAX_JOINTS];
+   int         jointCount;
+   GLfloat     tip[3];          /* in the frame of the last joint */
+} Chain;
+
+typedef struct chainproblem {
+   const Chain  *chain;
+   GLfloat       angles[CHAIN_MAX_JOINTS];  /* start in, solution out */
+   GLfloat       target[3];
+   GLfloat       approach;      /* CHAIN_ANALYTIC only */
+   GLfloat       error;         /* distance left from the target */
+   int           iterations;
+} ChainProblem;
+
+void chainInit(Chain *c);
+
+/*  Returns the index of the joint, or -1 if the chain is full.  */
+int chainAddJoint(Chain *c, GLfloat x, GLfloat y, GLfloat z, int axis,
+                  GLfloat min, GLfloat max);
+
+/*  Positions and axes of the joints and position of the tip, in the
+ *  frame of the chain's root; any of them may be NULL.
+ */
+void chainForward(const Chain *c, const GLfloat *angles,
+                  GLfloat positions[][3], GLfloat axes[][3],
+                  GLfloat tip[3]);
+
+void chainClamp(const Chain *c, GLfloat *angles);
+
+/*  The analytic solver also takes the angle between the last link
+ *  and straight up, in degrees, leaning towards the target: 180
+ *  points the tip straight down.  It returns the distance left, or a
+ *  negative value if the target is out of reach within the limits,
+ *  in which case the angles are unchanged.
+ */
+GLfloat chainSolveAnalytic(const Chain *c, GLfloat *angles,
+                           const GLfloat target[3], GLfloat approach);
+
+/*  The iterative solvers return the distance left and how many
+ *  iterations they took in *iterations, if not NULL.  A damping of 0
+ *  gives the plain pseudo-inverse.
+ */
+GLfloat chainSolveCCD(const Chain *c, GLfloat *angles,
+                      const GLfloat target[3], int *iterations);
+GLfloat chainSolveTranspose(const Chain *c, GLfloat *angles,
+                            const GLfloat target[3], int *iterations);
+GLfloat chainSolveDLS(const Chain *c, GLfloat *angles,
+                      const GLfloat target[3], GLfloat damping,
+                      int *iterations);
+
+/*  Solve every problem with the method, on all threads.  */
+void chainSolveBatch(ChainProblem *problems, int count, int method);
+
+const char *chainMethodName(int method);
+
+#endif
@@ -60,6 +60,7 @@ static GLubyte checkImage[checkImageHeight][checkImageWidth][4];
 static GLuint texName;
 #endif
 static GLuint texture;
+static GLUquadric *quad;   // criada uma vez, não a cada quadro
 
 void loadTexture(const char *filename)
 {
@@ -131,6 +132,9 @@ void init(void)
    makeCheckImage();
    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
+   quad = gluNewQuadric();
+   gluQuadricTexture(quad, GL_TRUE);
+
 #ifdef GL_VERSION_1_1
    glGenTextures(1, &texName);
    glBindTexture(GL_TEXTURE_2D, texName);
@@ -183,9 +187,6 @@ void display(void)
    // Define cor vermelha para áreas sem textura
    glColor3f(1.0f, 0.0f, 0.0f);
 
-   GLUquadric *quad = gluNewQuadric();
-   gluQuadricTexture(quad, GL_TRUE);
-
    gluSphere(quad, 1.0, 32, 32);
 
    glFlush();
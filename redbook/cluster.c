@@ -0,0 +1,465 @@
+/*
+ *  cluster.c
+ *  Clustered lighting.  See cluster.h.
+ *
+ *  The boundaries between the clusters along each axis are planes:
+ *  the tile edges come from the rows of the projection matrix, as
+ *  clip x - a * clip w = 0 for the edge at x = a in normalized device
+ *  coordinates, and the slices are planes of constant depth.  Each is
+ *  oriented so that the clusters of higher index are on its positive
+ *  side.  A sphere wholly on the positive side of an edge cannot
+ *  touch the clusters below it and one wholly on the negative side
+ *  none above, so counting those edges gives the range of clusters
+ *  it may touch along that axis.  With SSE2 the count is made for
+ *  four lights at once, the lights kept in eye space as separate
+ *  arrays of x, y, z and radius.
+ *
+ *  The cells hold the first index and number of lights of each
+ *  cluster, found with a counting pass and a prefix sum; the shader
+ *  reads cells, indices and lights from texture buffers.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "cluster.h"
+#include "shader.h"
+#include "timer.h"
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("cluster: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+#ifdef GL_VERSION_3_1
+/*  The cluster of a fragment from its window position and depth, then
+ *  Blinn-Phong shading by each light listed for it.
+ */
+static const char *clusterVertex =
+   "#version 330 compatibility\n"
+   "out vec3 eyePosition, eyeNormal;\n"
+   "void main()\n"
+   "{\n"
+   "   eyePosition = (gl_ModelViewMatrix * gl_Vertex).xyz;\n"
+   "   eyeNormal = gl_NormalMatrix * gl_Normal;\n"
+   "   gl_Position = ftransform();\n"
+   "}\n";
+
+static const char *clusterFragment =
+   "#version 330 compatibility\n"
+   "uniform usamplerBuffer cells, indices;\n"
+   "uniform samplerBuffer lights;\n"
+   "uniform ivec3 dims;\n"
+   "uniform vec4 viewport;\n"
+   "uniform vec2 slice;\n"
+   "uniform bool perspective;\n"
+   "in vec3 eyePosition, eyeNormal;\n"
+   "void main()\n"
+   "{\n"
+   "   vec2 t = (gl_FragCoord.xy - viewport.xy) / viewport.zw;\n"
+   "   ivec2 c = clamp(ivec2(t * vec2(dims.xy)), ivec2(0), dims.xy - 1);\n"
+   "   float depth = -eyePosition.z;\n"
+   "   float s = perspective ? log(max(depth, 1e-6)) : depth;\n"
+   "   int z = clamp(int(s * slice.x + slice.y), 0, dims.z - 1);\n"
+   "   uvec2 cell = texelFetch(cells, (z * dims.y + c.y) * dims.x + c.x).rg;\n"
+   "   vec3 n = normalize(eyeNormal);\n"
+   "   vec3 v = perspective ? normalize(-eyePosition) : vec3(0.0, 0.0, 1.0);\n"
+   "   vec3 color = gl_FrontLightModelProduct.sceneColor.rgb;\n"
+   "   uint i;\n"
+   "   if (!gl_FrontFacing)\n"
+   "      n = -n;\n"
+   "   for (i = 0u; i < cell.y; i++) {\n"
+   "      int l = int(texelFetch(indices, int(cell.x + i)).r);\n"
+   "      vec4 p = texelFetch(lights, 2 * l);\n"
+   "      vec3 d = p.xyz - eyePosition;\n"
+   "      float dd = dot(d, d), rr = p.w * p.w;\n"
+   "      if (dd < rr) {\n"
+   "         vec3 L = d * inversesqrt(dd);\n"
+   "         float a = 1.0 - dd / rr;\n"
+   "         float nl = max(dot(n, L), 0.0);\n"
+   "         float sp = nl > 0.0 ? pow(max(dot(n, normalize(L + v)), 0.0),\n"
+   "                                   gl_FrontMaterial.shininess) : 0.0;\n"
+   "         color += a * a * texelFetch(lights, 2 * l + 1).rgb *\n"
+   "                  (nl * gl_FrontMaterial.diffuse.rgb +\n"
+   "                   sp * gl_FrontMaterial.specular.rgb);\n"
+   "      }\n"
+   "   }\n"
+   "   gl_FragColor = vec4(color, gl_FrontMaterial.diffuse.a);\n"
+   "}\n";
+#endif
+
+void clusterInit(ClusterGrid *g)
+{
+   memset(g, 0, sizeof(*g));
+   g->cells = (GLuint *) allocate(NULL, CLUSTER_COUNT * 2 * sizeof(GLuint));
+#ifdef GL_VERSION_3_1
+   if (!shaderGLVersion(3, 3))
+      return;
+   g->program = shaderProgram(clusterVertex, clusterFragment);
+   if (g->program == 0)
+      return;
+   glUseProgram(g->program);
+   glUniform1i(glGetUniformLocation(g->program, "cells"), 1);
+   glUniform1i(glGetUniformLocation(g->program, "indices"), 2);
+   glUniform1i(glGetUniformLocation(g->program, "lights"), 3);
+   g->dimsLocation = glGetUniformLocation(g->program, "dims");
+   g->viewportLocation = glGetUniformLocation(g->program, "viewport");
+   g->sliceLocation = glGetUniformLocation(g->program, "slice");
+   g->perspectiveLocation = glGetUniformLocation(g->program, "perspective");
+   glUseProgram(0);
+
+   glGenBuffers(3, g->buffers);
+   glGenTextures(3, g->textures);
+#endif
+}
+
+void clusterFree(ClusterGrid *g)
+{
+#ifdef GL_VERSION_3_1
+   if (g->program) {
+      glDeleteProgram(g->program);
+      glDeleteBuffers(3, g->buffers);
+      glDeleteTextures(3, g->textures);
+   }
+#endif
+   free(g->x);
+   free(g->y);
+   free(g->z);
+   free(g->r);
+   free(g->range);
+   free(g->lightData);
+   free(g->cells);
+   free(g->indices);
+   memset(g, 0, sizeof(*g));
+}
+
+int clusterSupported(const ClusterGrid *g)
+{
+   return g->program != 0;
+}
+
+/*  The planes between clusters along one axis, from row of the
+ *  projection matrix, for n clusters across the window.
+ */
+static void edgePlanes(GLfloat (*planes)[4], int n, const GLfloat *p,
+                       int row)
+{
+   int i, k;
+
+   for (i = 0; i <= n; i++) {
+      GLfloat a = -1.0 + 2.0 * i / n, len;
+
+      for (k = 0; k < 4; k++)
+         planes[i][k] = p[k * 4 + row] - a * p[k * 4 + 3];
+      len = sqrt(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] +
+                 planes[i][2] * planes[i][2]);
+      for (k = 0; k < 4; k++)
+         planes[i][k] /= len;
+   }
+}
+
+/*  The depths between slices, and the scale and bias taking a depth,
+ *  or its log, to a slice.
+ */
+static void depthSlices(ClusterGrid *g, const GLfloat *p)
+{
+   GLfloat n, f;
+   int i;
+
+   g->perspective = p[15] == 0.0;
+   if (g->perspective) {
+      n = p[14] / (p[10] - 1.0);
+      f = p[14] / (p[10] + 1.0);
+      for (i = 0; i <= CLUSTER_Z; i++)
+         g->slices[i] = n * pow(f / n, (double) i / CLUSTER_Z);
+      g->sliceScale[0] = CLUSTER_Z / log(f / n);
+      g->sliceScale[1] = -log(n) * g->sliceScale[0];
+   } else {
+      n = (p[14] + 1.0) / p[10];
+      f = (p[14] - 1.0) / p[10];
+      for (i = 0; i <= CLUSTER_Z; i++)
+         g->slices[i] = n + (f - n) * i / CLUSTER_Z;
+      g->sliceScale[0] = CLUSTER_Z / (f - n);
+      g->sliceScale[1] = -n * g->sliceScale[0];
+   }
+}
+
+/*  Store a range, empty if the light misses every cluster on an
+ *  axis.
+ */
+static void setRange(unsigned char *range, int lo, int hi)
+{
+   if (lo > hi) {
+      range[0] = 1;
+      range[1] = 0;
+   } else {
+      range[0] = (unsigned char) lo;
+      range[1] = (unsigned char) hi;
+   }
+}
+
+#ifdef __SSE2__
+static void axisRanges(const GLfloat (*planes)[4], int n, __m128 x,
+                       __m128 y, __m128 z, __m128 r, unsigned char *range)
+{
+   __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+   __m128 nr = _mm_sub_ps(_mm_setzero_ps(), r);
+   int los[4], his[4], i;
+
+   for (i = 0; i <= n; i++) {
+      __m128 d = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(x, _mm_set1_ps(planes[i][0])),
+                    _mm_mul_ps(y, _mm_set1_ps(planes[i][1]))),
+                 _mm_add_ps(
+                    _mm_mul_ps(z, _mm_set1_ps(planes[i][2])),
+                    _mm_set1_ps(planes[i][3])));
+
+      if (i > 0)
+         lo = _mm_sub_epi32(lo, _mm_castps_si128(_mm_cmpge_ps(d, r)));
+      if (i < n)
+         hi = _mm_sub_epi32(hi, _mm_castps_si128(_mm_cmple_ps(d, nr)));
+   }
+   _mm_storeu_si128((__m128i *) los, lo);
+   _mm_storeu_si128((__m128i *) his, hi);
+   for (i = 0; i < 4; i++)
+      setRange(range + i * 6, los[i], n - 1 - his[i]);
+}
+#else
+static void axisRange(const GLfloat (*planes)[4], int n, GLfloat x,
+                      GLfloat y, GLfloat z, GLfloat r, unsigned char *range)
+{
+   int lo = 0, hi = 0, i;
+
+   for (i = 0; i <= n; i++) {
+      GLfloat d = x * planes[i][0] + y * planes[i][1] + z * planes[i][2] +
+                  planes[i][3];
+
+      if (i > 0 && d >= r)
+         lo++;
+      if (i < n && d <= -r)
+         hi++;
+   }
+   setRange(range, lo, n - 1 - hi);
+}
+#endif
+
+/*  The range of clusters along each axis that each light may reach.  */
+static void lightRanges(ClusterGrid *g, const GLfloat *p, int count)
+{
+   GLfloat xPlanes[CLUSTER_X + 1][4], yPlanes[CLUSTER_Y + 1][4];
+   GLfloat zPlanes[CLUSTER_Z + 1][4];
+   int i;
+
+   edgePlanes(xPlanes, CLUSTER_X, p, 0);
+   edgePlanes(yPlanes, CLUSTER_Y, p, 1);
+   for (i = 0; i <= CLUSTER_Z; i++) {
+      zPlanes[i][0] = zPlanes[i][1] = 0.0;
+      zPlanes[i][2] = -1.0;
+      zPlanes[i][3] = -g->slices[i];
+   }
+
+#ifdef __SSE2__
+   for (i = 0; i < count; i += 4) {
+      __m128 x = _mm_loadu_ps(g->x + i), y = _mm_loadu_ps(g->y + i);
+      __m128 z = _mm_loadu_ps(g->z + i), r = _mm_loadu_ps(g->r + i);
+      unsigned char *range = g->range + i * 6;
+
+      axisRanges((const GLfloat (*)[4]) xPlanes, CLUSTER_X, x, y, z, r,
+                 range);
+      axisRanges((const GLfloat (*)[4]) yPlanes, CLUSTER_Y, x, y, z, r,
+                 range + 2);
+      axisRanges((const GLfloat (*)[4]) zPlanes, CLUSTER_Z, x, y, z, r,
+                 range + 4);
+   }
+#else
+   for (i = 0; i < count; i++) {
+      unsigned char *range = g->range + i * 6;
+
+      axisRange((const GLfloat (*)[4]) xPlanes, CLUSTER_X, g->x[i], g->y[i],
+                g->z[i], g->r[i], range);
+      axisRange((const GLfloat (*)[4]) yPlanes, CLUSTER_Y, g->x[i], g->y[i],
+                g->z[i], g->r[i], range + 2);
+      axisRange((const GLfloat (*)[4]) zPlanes, CLUSTER_Z, g->x[i], g->y[i],
+                g->z[i], g->r[i], range + 4);
+   }
+#endif
+}
+
+static void grow(ClusterGrid *g, int count)
+{
+   int n = (count + 3) & ~3;
+
+   if (n <= g->capacity)
+      return;
+   g->capacity = n;
+   g->x = (GLfloat *) allocate(g->x, n * sizeof(GLfloat));
+   g->y = (GLfloat *) allocate(g->y, n * sizeof(GLfloat));
+   g->z = (GLfloat *) allocate(g->z, n * sizeof(GLfloat));
+   g->r = (GLfloat *) allocate(g->r, n * sizeof(GLfloat));
+   g->range = (unsigned char *) allocate(g->range, n * 6);
+   g->lightData = (GLfloat *) allocate(g->lightData, n * 8 * sizeof(GLfloat));
+}
+
+void clusterBuild(ClusterGrid *g, const ClusterLight *lights, int count)
+{
+   GLfloat m[16], p[16];
+   ClusterStats *st = &g->stats;
+   int i, x, y, z, padded = (count + 3) & ~3, total;
+   double t0 = timerSeconds();
+
+   glGetFloatv(GL_MODELVIEW_MATRIX, m);
+   glGetFloatv(GL_PROJECTION_MATRIX, p);
+   glGetIntegerv(GL_VIEWPORT, g->viewport);
+   grow(g, count);
+   depthSlices(g, p);
+
+   for (i = 0; i < count; i++) {
+      const GLfloat *v = lights[i].position;
+      GLfloat *d = g->lightData + i * 8;
+
+      g->x[i] = m[0] * v[0] + m[4] * v[1] + m[8] * v[2] + m[12];
+      g->y[i] = m[1] * v[0] + m[5] * v[1] + m[9] * v[2] + m[13];
+      g->z[i] = m[2] * v[0] + m[6] * v[1] + m[10] * v[2] + m[14];
+      g->r[i] = lights[i].radius;
+      d[0] = g->x[i];
+      d[1] = g->y[i];
+      d[2] = g->z[i];
+      d[3] = g->r[i];
+      d[4] = lights[i].color[0];
+      d[5] = lights[i].color[1];
+      d[6] = lights[i].color[2];
+      d[7] = 0.0;
+   }
+   /*  lights to make up the last four, behind the eye  */
+   for (; i < padded; i++) {
+      g->x[i] = g->y[i] = 0.0;
+      g->z[i] = 1e30;
+      g->r[i] = 0.0;
+   }
+   lightRanges(g, p, count);
+
+   /*  count the lights of each cluster, then place them  */
+   memset(g->cells, 0, CLUSTER_COUNT * 2 * sizeof(GLuint));
+   st->visible = 0;
+   for (i = 0; i < count; i++) {
+      const unsigned char *r = g->range + i * 6;
+
+      if (r[0] > r[1] || r[2] > r[3] || r[4] > r[5])
+         continue;
+      st->visible++;
+      for (z = r[4]; z <= r[5]; z++)
+         for (y = r[2]; y <= r[3]; y++)
+            for (x = r[0]; x <= r[1]; x++)
+               g->cells[((z * CLUSTER_Y + y) * CLUSTER_X + x) * 2 + 1]++;
+   }
+   total = 0;
+   st->clusters = st->most = 0;
+   for (i = 0; i < CLUSTER_COUNT; i++) {
+      GLuint n = g->cells[i * 2 + 1];
+
+      g->cells[i * 2] = total;
+      g->cells[i * 2 + 1] = 0;
+      total += n;
+      if (n > 0)
+         st->clusters++;
+      if ((int) n > st->most)
+         st->most = n;
+   }
+   if (total > g->maxIndices) {
+      g->maxIndices = total;
+      g->indices = (GLuint *) allocate(g->indices, total * sizeof(GLuint));
+   }
+   for (i = 0; i < count; i++) {
+      const unsigned char *r = g->range + i * 6;
+
+      if (r[0] > r[1] || r[2] > r[3] || r[4] > r[5])
+         continue;
+      for (z = r[4]; z <= r[5]; z++)
+         for (y = r[2]; y <= r[3]; y++)
+            for (x = r[0]; x <= r[1]; x++) {
+               GLuint *c = g->cells + ((z * CLUSTER_Y + y) * CLUSTER_X + x) * 2;
+
+               g->indices[c[0] + c[1]++] = i;
+            }
+   }
+   st->lights = count;
+   st->indices = total;
+   st->buildTime = timerSeconds() - t0;
+
+#ifdef GL_VERSION_3_1
+   if (g->program == 0)
+      return;
+   t0 = timerSeconds();
+   glBindBuffer(GL_TEXTURE_BUFFER, g->buffers[0]);
+   glBufferData(GL_TEXTURE_BUFFER, CLUSTER_COUNT * 2 * sizeof(GLuint),
+                g->cells, GL_STREAM_DRAW);
+   glBindBuffer(GL_TEXTURE_BUFFER, g->buffers[1]);
+   glBufferData(GL_TEXTURE_BUFFER, (total > 0 ? total : 1) * sizeof(GLuint),
+                g->indices, GL_STREAM_DRAW);
+   glBindBuffer(GL_TEXTURE_BUFFER, g->buffers[2]);
+   glBufferData(GL_TEXTURE_BUFFER, (count > 0 ? count : 1) * 8 *
+                sizeof(GLfloat), g->lightData, GL_STREAM_DRAW);
+   glBindBuffer(GL_TEXTURE_BUFFER, 0);
+   st->uploadTime = timerSeconds() - t0;
+#endif
+}
+
+void clusterBegin(const ClusterGrid *g)
+{
+#ifdef GL_VERSION_3_1
+   static const GLenum formats[3] = { GL_RG32UI, GL_R32UI, GL_RGBA32F };
+   int i;
+
+   if (g->program == 0)
+      return;
+   glUseProgram(g->program);
+   glUniform3i(g->dimsLocation, CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+   glUniform4f(g->viewportLocation, g->viewport[0], g->viewport[1],
+               g->viewport[2], g->viewport[3]);
+   glUniform2f(g->sliceLocation, g->sliceScale[0], g->sliceScale[1]);
+   glUniform1i(g->perspectiveLocation, g->perspective);
+   for (i = 0; i < 3; i++) {
+      glActiveTexture(GL_TEXTURE1 + i);
+      glBindTexture(GL_TEXTURE_BUFFER, g->textures[i]);
+      glTexBuffer(GL_TEXTURE_BUFFER, formats[i], g->buffers[i]);
+   }
+   glActiveTexture(GL_TEXTURE0);
+#endif
+}
+
+void clusterEnd(void)
+{
+#ifdef GL_VERSION_3_1
+   int i;
+
+   for (i = 0; i < 3; i++) {
+      glActiveTexture(GL_TEXTURE1 + i);
+      glBindTexture(GL_TEXTURE_BUFFER, 0);
+   }
+   glActiveTexture(GL_TEXTURE0);
+   glUseProgram(0);
+#endif
+}
+
+void clusterPrintStats(const char *name, const ClusterGrid *g)
+{
+   const ClusterStats *st = &g->stats;
+
+   printf("%s: %d lights, %d in view, in %d of %d clusters\n", name,
+          st->lights, st->visible, st->clusters, CLUSTER_COUNT);
+   printf("  %d light indices, at most %d in a cluster, %.1f on average\n",
+          st->indices, st->most,
+          st->clusters ? (double) st->indices / st->clusters : 0.0);
+   printf("  build %.3f ms, upload %.3f ms\n", st->buildTime * 1000.0,
+          st->uploadTime * 1000.0);
+}
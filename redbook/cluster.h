@@ -0,0 +1,83 @@
+/*
+ *  cluster.h
+ *  Per pixel lighting by many point lights, assigned to clusters.
+ *
+ *  The view volume is cut into CLUSTER_X x CLUSTER_Y tiles of the
+ *  window and CLUSTER_Z slices of depth, spaced evenly for an
+ *  orthographic projection and growing with distance for a
+ *  perspective one.  clusterBuild() finds, on the CPU, the clusters
+ *  that each light's sphere of influence reaches, testing four
+ *  lights at a time against the planes between the clusters, and
+ *  lists the lights of every cluster.  Between clusterBegin() and
+ *  clusterEnd() a shader finds the cluster of each fragment and
+ *  shades it by the lights in that list only, so a pixel pays for the
+ *  lights near it rather than for every light in the scene.
+ *
+ *  Lights fade to nothing at their radius.  The material is the
+ *  fixed-function one (glMaterial(), or matBind() of matcache.h), lit
+ *  as with a local viewer for a perspective projection, and the
+ *  scene ambient light of glLightModel() is added; the fixed-function
+ *  lights are not used.
+ *
+ *  Requires OpenGL 3.3 for the shader and texture buffers.
+ */
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#define CLUSTER_X      16
+#define CLUSTER_Y      8
+#define CLUSTER_Z      24
+#define CLUSTER_COUNT  (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+typedef struct clusterlight {
+   GLfloat  position[3], radius;
+   GLfloat  color[3];
+} ClusterLight;
+
+/*  For the last build.  */
+typedef struct clusterstats {
+   int      lights, visible;          /* in at least one cluster */
+   int      clusters;                 /* with at least one light */
+   int      indices, most;            /* lights in all, in the fullest */
+   double   buildTime, uploadTime;    /* seconds */
+} ClusterStats;
+
+typedef struct clustergrid {
+   GLuint         program;
+   GLuint         buffers[3], textures[3];  /* cells, indices, lights */
+   GLint          dimsLocation, viewportLocation, sliceLocation;
+   GLint          perspectiveLocation;
+
+   int            capacity;           /* lights */
+   GLfloat       *x, *y, *z, *r;      /* in eye space */
+   unsigned char *range;              /* 6 per light: x, y, z min, max */
+   GLfloat       *lightData;          /* 8 per light, for the shader */
+   GLuint        *cells;              /* first index and count */
+   GLuint        *indices;
+   int            maxIndices;
+
+   int            perspective;
+   GLfloat        slices[CLUSTER_Z + 1];   /* depths between slices */
+   GLfloat        sliceScale[2];
+   GLint          viewport[4];
+   ClusterStats   stats;
+} ClusterGrid;
+
+void clusterInit(ClusterGrid *g);
+void clusterFree(ClusterGrid *g);
+
+/*  False where the GL cannot run the shader.  */
+int clusterSupported(const ClusterGrid *g);
+
+/*  Assign the lights, whose positions are transformed by the current
+ *  modelview matrix, to the clusters of the current projection and
+ *  viewport.
+ */
+void clusterBuild(ClusterGrid *g, const ClusterLight *lights, int count);
+
+void clusterBegin(const ClusterGrid *g);
+void clusterEnd(void);
+
+void clusterPrintStats(const char *name, const ClusterGrid *g);
+
+#endif
@@ -0,0 +1,384 @@
+/*
+ *  cmdbuf.c
+ *  Command buffers.  See cmdbuf.h.
+ *
+ *  A command is a header giving its type and size followed by its
+ *  arguments, rounded up to CMD_ALIGN so that the next one is aligned
+ *  for a pointer.  cmdEnd() closes a packet with CMD_END, so a packet
+ *  is replayed from its first command without knowing its length, and
+ *  the sorted order is a DrawQueue whose items point at packets.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmdbuf.h"
+#include "jobs.h"
+
+#define CMD_ALIGN    8
+#define ROUND(n, a)  (((n) + (a) - 1) / (a) * (a))
+#define NO_STATE     0xffffffffU
+
+enum {
+   CMD_END,
+   CMD_PROGRAM,
+   CMD_TEXTURE,
+   CMD_MATERIAL,
+   CMD_UNIFORM4F,
+   CMD_UNIFORM_MATRIX,
+   CMD_COLOR,
+   CMD_MATRIX,
+   CMD_CALL_LIST,
+   CMD_DRAW_ARRAYS,
+   CMD_DRAW_ELEMENTS,
+   CMD_CALL
+};
+
+typedef struct cmdheader {
+   unsigned short  type, bytes;
+} CmdHeader;
+
+typedef struct cmdbind {
+   CmdHeader  h;
+   GLuint     id;
+} CmdBind;
+
+typedef struct cmduniform {
+   CmdHeader  h;
+   GLint      location;
+   GLfloat    v[16];                  /* 4 of them for CMD_UNIFORM4F */
+} CmdUniform;
+
+typedef struct cmdvalues {
+   CmdHeader  h;
+   GLfloat    v[16];                  /* 4 of them for CMD_COLOR */
+} CmdValues;
+
+typedef struct cmddraw {
+   CmdHeader  h;
+   GLenum     mode, type;
+   GLint      first;
+   GLsizei    count;
+   size_t     offset;
+} CmdDraw;
+
+typedef struct cmdcall {
+   CmdHeader  h;
+   DrawFunc   fn;
+   void      *data;
+} CmdCall;
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("cmdbuf: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+void cmdQueueInit(CmdQueue *q)
+{
+   memset(q, 0, sizeof(*q));
+   drawQueueInit(&q->order, 256);
+}
+
+void cmdQueueFree(CmdQueue *q)
+{
+   int i;
+
+   for (i = 0; i < CMD_MAX_THREADS; i++) {
+      free(q->buffers[i].data);
+      free(q->buffers[i].packets);
+   }
+   drawQueueFree(&q->order);
+   memset(q, 0, sizeof(*q));
+}
+
+CmdBuffer *cmdThreadBuffer(CmdQueue *q)
+{
+   return &q->buffers[jobsThreadIndex()];
+}
+
+/*  Room for a command of the given size, header filled in.  */
+static void *record(CmdBuffer *b, int type, size_t size)
+{
+   size_t bytes = ROUND(size, CMD_ALIGN);
+   CmdHeader *h;
+
+   if (b->used + bytes > b->size) {
+      b->size = b->size ? b->size * 2 : 4096;
+      while (b->used + bytes > b->size)
+         b->size *= 2;
+      b->data = (char *) allocate(b->data, b->size);
+   }
+   h = (CmdHeader *) (b->data + b->used);
+   h->type = (unsigned short) type;
+   h->bytes = (unsigned short) bytes;
+   b->used += bytes;
+   b->commands++;
+   return h;
+}
+
+void cmdBegin(CmdBuffer *b, DrawKey key)
+{
+   CmdPacket *p;
+
+   if (b->packetCount == b->maxPackets) {
+      b->maxPackets = b->maxPackets ? b->maxPackets * 2 : 64;
+      b->packets = (CmdPacket *)
+         allocate(b->packets, b->maxPackets * sizeof(CmdPacket));
+   }
+   p = &b->packets[b->packetCount];
+   p->key = key;
+   p->offset = b->used;
+   p->bytes = 0;
+}
+
+void cmdEnd(CmdBuffer *b)
+{
+   CmdPacket *p = &b->packets[b->packetCount++];
+
+   record(b, CMD_END, sizeof(CmdHeader));
+   b->commands--;
+   p->bytes = b->used - p->offset;
+}
+
+static void bind(CmdBuffer *b, int type, GLuint id)
+{
+   CmdBind *c = (CmdBind *) record(b, type, sizeof(CmdBind));
+
+   c->id = id;
+}
+
+void cmdProgram(CmdBuffer *b, GLuint program)
+{
+   bind(b, CMD_PROGRAM, program);
+}
+
+void cmdTexture(CmdBuffer *b, GLuint texture)
+{
+   bind(b, CMD_TEXTURE, texture);
+}
+
+void cmdMaterial(CmdBuffer *b, unsigned material)
+{
+   bind(b, CMD_MATERIAL, material);
+}
+
+void cmdUniform4f(CmdBuffer *b, GLint location, const GLfloat v[4])
+{
+   CmdUniform *c = (CmdUniform *)
+      record(b, CMD_UNIFORM4F, offsetof(CmdUniform, v) + 4 * sizeof(GLfloat));
+
+   c->location = location;
+   memcpy(c->v, v, 4 * sizeof(GLfloat));
+}
+
+void cmdUniformMatrix(CmdBuffer *b, GLint location, const GLfloat m[16])
+{
+   CmdUniform *c = (CmdUniform *)
+      record(b, CMD_UNIFORM_MATRIX, sizeof(CmdUniform));
+
+   c->location = location;
+   memcpy(c->v, m, 16 * sizeof(GLfloat));
+}
+
+void cmdColor(CmdBuffer *b, const GLfloat color[4])
+{
+   CmdValues *c = (CmdValues *)
+      record(b, CMD_COLOR, offsetof(CmdValues, v) + 4 * sizeof(GLfloat));
+
+   memcpy(c->v, color, 4 * sizeof(GLfloat));
+}
+
+void cmdMatrix(CmdBuffer *b, const GLfloat m[16])
+{
+   CmdValues *c = (CmdValues *) record(b, CMD_MATRIX, sizeof(CmdValues));
+
+   memcpy(c->v, m, 16 * sizeof(GLfloat));
+}
+
+void cmdCallList(CmdBuffer *b, GLuint list)
+{
+   bind(b, CMD_CALL_LIST, list);
+}
+
+void cmdDrawArrays(CmdBuffer *b, GLenum mode, GLint first, GLsizei count)
+{
+   CmdDraw *c = (CmdDraw *) record(b, CMD_DRAW_ARRAYS, sizeof(CmdDraw));
+
+   c->mode = mode;
+   c->first = first;
+   c->count = count;
+}
+
+void cmdDrawElements(CmdBuffer *b, GLenum mode, GLsizei count, GLenum type,
+                     size_t offset)
+{
+   CmdDraw *c = (CmdDraw *) record(b, CMD_DRAW_ELEMENTS, sizeof(CmdDraw));
+
+   c->mode = mode;
+   c->count = count;
+   c->type = type;
+   c->offset = offset;
+}
+
+void cmdCall(CmdBuffer *b, DrawFunc fn, void *data)
+{
+   CmdCall *c = (CmdCall *) record(b, CMD_CALL, sizeof(CmdCall));
+
+   c->fn = fn;
+   c->data = data;
+}
+
+/*
+ *  Replay, on the GL thread
+ */
+typedef struct replaystate {
+   GLuint  program, texture;
+   unsigned material;
+} ReplayState;
+
+static void replay(CmdQueue *q, ReplayState *r, const char *p)
+{
+   CmdStats *st = &q->stats;
+   int pushed = 0;
+
+   for (;;) {
+      const CmdHeader *h = (const CmdHeader *) p;
+      const CmdBind *bc = (const CmdBind *) p;
+      const CmdUniform *u = (const CmdUniform *) p;
+      const CmdValues *v = (const CmdValues *) p;
+      const CmdDraw *d = (const CmdDraw *) p;
+      const CmdCall *c = (const CmdCall *) p;
+
+      switch (h->type) {
+         case CMD_END:
+            if (pushed)
+               glPopMatrix();
+            return;
+         case CMD_PROGRAM:
+            if (bc->id == r->program) {
+               st->skipped++;
+               break;
+            }
+#ifdef GL_VERSION_2_0
+            glUseProgram(bc->id);
+#endif
+            r->program = bc->id;
+            st->binds++;
+            break;
+         case CMD_TEXTURE:
+            if (bc->id == r->texture) {
+               st->skipped++;
+               break;
+            }
+            glBindTexture(GL_TEXTURE_2D, bc->id);
+            r->texture = bc->id;
+            st->binds++;
+            break;
+         case CMD_MATERIAL:
+            if (q->bindMaterial == NULL)
+               break;
+            if (bc->id == r->material) {
+               st->skipped++;
+               break;
+            }
+            q->bindMaterial(bc->id, q->user);
+            r->material = bc->id;
+            st->binds++;
+            break;
+#ifdef GL_VERSION_2_0
+         case CMD_UNIFORM4F:
+            glUniform4fv(u->location, 1, u->v);
+            break;
+         case CMD_UNIFORM_MATRIX:
+            glUniformMatrix4fv(u->location, 1, GL_FALSE, u->v);
+            break;
+#endif
+         case CMD_COLOR:
+            glColor4fv(v->v);
+            break;
+         case CMD_MATRIX:
+            if (!pushed) {
+               glPushMatrix();
+               pushed = 1;
+            }
+            glMultMatrixf(v->v);
+            break;
+         case CMD_CALL_LIST:
+            glCallList(bc->id);
+            break;
+         case CMD_DRAW_ARRAYS:
+            glDrawArrays(d->mode, d->first, d->count);
+            break;
+         case CMD_DRAW_ELEMENTS:
+            glDrawElements(d->mode, d->count, d->type,
+                           (const GLvoid *) d->offset);
+            break;
+         case CMD_CALL:
+            c->fn(c->data);
+            break;
+      }
+      p += h->bytes;
+   }
+}
+
+void cmdSubmit(CmdQueue *q)
+{
+   ReplayState r;
+   CmdStats *st = &q->stats;
+   int i, j;
+
+   memset(st, 0, sizeof(*st));
+   for (i = 0; i < CMD_MAX_THREADS; i++) {
+      CmdBuffer *b = &q->buffers[i];
+
+      if (b->packetCount == 0)
+         continue;
+      for (j = 0; j < b->packetCount; j++)
+         if (!drawQueueSubmit(&q->order, b->packets[j].key, NULL,
+                              b->data + b->packets[j].offset)) {
+            printf("cmdbuf: out of memory\n");
+            exit(1);
+         }
+      st->buffers++;
+      st->packets += b->packetCount;
+      st->commands += b->commands;
+      st->bytes += b->used;
+   }
+
+   drawQueueSort(&q->order);
+   st->sortPasses = q->order.stats.sortPasses;
+
+   r.program = r.texture = NO_STATE;
+   r.material = NO_STATE;
+   for (i = 0; i < (int) q->order.count; i++)
+      replay(q, &r, (const char *) q->order.items[i].data);
+#ifdef GL_VERSION_2_0
+   if (r.program != NO_STATE && r.program != 0)
+      glUseProgram(0);
+#endif
+   if (r.texture != NO_STATE && r.texture != 0)
+      glBindTexture(GL_TEXTURE_2D, 0);
+
+   drawQueueReset(&q->order);
+   for (i = 0; i < CMD_MAX_THREADS; i++) {
+      q->buffers[i].used = 0;
+      q->buffers[i].packetCount = 0;
+      q->buffers[i].commands = 0;
+   }
+}
+
+void cmdPrintStats(const CmdQueue *q)
+{
+   const CmdStats *st = &q->stats;
+
+   printf("command buffers: %d packets, %d commands, %lu bytes from %d "
+          "threads, %d radix passes\n", st->packets, st->commands, st->bytes,
+          st->buffers, st->sortPasses);
+   printf("  binds issued %d, already bound %d\n", st->binds, st->skipped);
+}
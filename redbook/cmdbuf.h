@@ -0,0 +1,95 @@
+/*
+ *  cmdbuf.h
+ *  Command buffers, so that what to draw can be worked out on many
+ *  threads while only the thread that owns the GL context talks to
+ *  GL.
+ *
+ *  Each thread records into its own CmdBuffer, cmdThreadBuffer(), with
+ *  no locking.  What it records is a series of packets, each a draw
+ *  and the state it needs, opened by cmdBegin() with a sort key
+ *  (drawqueue.h) and closed by cmdEnd().  Inside a packet the commands
+ *  are small tagged records: bind a program, texture or material, set
+ *  a uniform, the color or a matrix, and draw.
+ *
+ *  cmdSubmit(), on the GL thread once every recording job is done,
+ *  gathers the packets of all the buffers, sorts them by key, replays
+ *  them, skipping binds of what is already bound, and empties the
+ *  buffers for the next frame.  The buffers keep their memory, so a
+ *  frame like the last allocates nothing.  Packets with the same key
+ *  replay in no particular order; give them different depths in the
+ *  key when the order matters.
+ *
+ *  A matrix command multiplies onto the modelview matrix that was
+ *  current at cmdSubmit() and lasts until the end of its packet.
+ */
+#ifndef CMDBUF_H
+#define CMDBUF_H
+
+#include "arena.h"
+#include "drawqueue.h"
+
+#define CMD_MAX_THREADS  ARENA_MAX_THREADS
+
+typedef struct cmdpacket {
+   DrawKey  key;
+   size_t   offset, bytes;            /* of its commands in the buffer */
+} CmdPacket;
+
+typedef struct cmdbuffer {
+   char       *data;
+   size_t      used, size;
+   CmdPacket  *packets;
+   int         packetCount, maxPackets;
+   int         commands;
+} CmdBuffer;
+
+/*  Counters for the last submission.  */
+typedef struct cmdstats {
+   int            buffers;            /* that had packets */
+   int            packets;
+   int            commands;
+   unsigned long  bytes;
+   int            binds;              /* issued */
+   int            skipped;            /* binds of what was bound */
+   int            sortPasses;
+} CmdStats;
+
+typedef struct cmdqueue {
+   CmdBuffer   buffers[CMD_MAX_THREADS];
+   DrawQueue   order;                 /* the packets of every buffer */
+   BindFunc    bindMaterial;          /* for cmdMaterial() */
+   void       *user;
+   CmdStats    stats;
+} CmdQueue;
+
+void cmdQueueInit(CmdQueue *q);
+void cmdQueueFree(CmdQueue *q);
+
+/*  The buffer of the calling thread.  */
+CmdBuffer *cmdThreadBuffer(CmdQueue *q);
+
+void cmdBegin(CmdBuffer *b, DrawKey key);
+void cmdEnd(CmdBuffer *b);
+
+void cmdProgram(CmdBuffer *b, GLuint program);
+void cmdTexture(CmdBuffer *b, GLuint texture);
+void cmdMaterial(CmdBuffer *b, unsigned material);
+void cmdUniform4f(CmdBuffer *b, GLint location, const GLfloat v[4]);
+void cmdUniformMatrix(CmdBuffer *b, GLint location, const GLfloat m[16]);
+void cmdColor(CmdBuffer *b, const GLfloat color[4]);
+void cmdMatrix(CmdBuffer *b, const GLfloat m[16]);
+
+void cmdCallList(CmdBuffer *b, GLuint list);
+void cmdDrawArrays(CmdBuffer *b, GLenum mode, GLint first, GLsizei count);
+void cmdDrawElements(CmdBuffer *b, GLenum mode, GLsizei count, GLenum type,
+                     size_t offset);
+
+/*  For anything else; fn is called with data on the GL thread.  */
+void cmdCall(CmdBuffer *b, DrawFunc fn, void *data);
+
+/*  Sort and replay what every thread recorded, then empty the buffers.  */
+void cmdSubmit(CmdQueue *q);
+
+void cmdPrintStats(const CmdQueue *q);
+
+#endif
@@ -43,6 +43,8 @@
  */
 #include <GL/glut.h>
 #include <stdlib.h>
+#include <string.h>
+#include "matcache.h"
 
 GLfloat diffuseMaterial[4] = { 0.5, 0.5, 0.5, 1.0 };
 
@@ -53,13 +55,16 @@ void init(void)
 {
    GLfloat mat_specular[] = { 1.0, 1.0, 1.0, 1.0 };
    GLfloat light_position[] = { 1.0, 1.0, 1.0, 0.0 };
+   MatBlock m;
 
    glClearColor (0.0, 0.0, 0.0, 0.0);
    glShadeModel (GL_SMOOTH);
    glEnable(GL_DEPTH_TEST);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuseMaterial);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-   glMaterialf(GL_FRONT, GL_SHININESS, 25.0);
+   matDefaults(&m);
+   memcpy(m.diffuse, diffuseMaterial, sizeof(m.diffuse));
+   memcpy(m.specular, mat_specular, sizeof(m.specular));
+   m.shininess = 25.0;
+   matBind(matIntern(&m));
    glLightfv(GL_LIGHT0, GL_POSITION, light_position);
    glEnable(GL_LIGHTING);
    glEnable(GL_LIGHT0);
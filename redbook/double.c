@@ -40,17 +40,31 @@
  *  This is a simple double buffered program.
  *  Pressing the left mouse button rotates the rectangle.
  *  Pressing the middle mouse button stops the rotation.
+ *
+ *  The rotation advances in fixed ticks of a game loop (loop.h)
+ *  and is drawn between them at 60 frames a second, so it turns at
+ *  the same speed on any machine.  Press "s" to print the frame
+ *  timing.
  */
 #include <GL/glut.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include "loop.h"
+
+#define TICK_RATE  30.0     /* ticks a second */
+#define FRAME_RATE 60.0
+#define SPIN_SPEED 120.0    /* degrees a second */
 
-static GLfloat spin = 0.0;
+static GLfloat spin = 0.0, lastSpin = 0.0;
+static GameLoop loop;
 
 void display(void)
 {
+   GLfloat a = (GLfloat) loopAlpha(&loop);
+
    glClear(GL_COLOR_BUFFER_BIT);
    glPushMatrix();
-   glRotatef(spin, 0.0, 0.0, 1.0);
+   glRotatef(lastSpin + (spin - lastSpin) * a, 0.0, 0.0, 1.0);
    glColor3f(1.0, 1.0, 1.0);
    glRectf(-25.0, -25.0, 25.0, 25.0);
    glPopMatrix();
@@ -58,18 +72,21 @@ void display(void)
    glutSwapBuffers();
 }
 
-void spinDisplay(void)
+void spinDisplay(double dt)
 {
-   spin = spin + 2.0;
-   if (spin > 360.0)
+   lastSpin = spin;
+   spin = spin + SPIN_SPEED * dt;
+   if (spin > 360.0) {
       spin = spin - 360.0;
-   glutPostRedisplay();
+      lastSpin = lastSpin - 360.0;
+   }
 }
 
 void init(void) 
 {
    glClearColor (0.0, 0.0, 0.0, 0.0);
    glShadeModel (GL_FLAT);
+   loopInit(&loop, TICK_RATE, FRAME_RATE, spinDisplay);
 }
 
 void reshape(int w, int h)
@@ -87,17 +104,31 @@ void mouse(int button, int state, int x, int y)
    switch (button) {
       case GLUT_LEFT_BUTTON:
          if (state == GLUT_DOWN)
-            glutIdleFunc(spinDisplay);
+            loopStart(&loop);
          break;
       case GLUT_MIDDLE_BUTTON:
       case GLUT_RIGHT_BUTTON:
          if (state == GLUT_DOWN)
-            glutIdleFunc(NULL);
+            loopStop(&loop);
          break;
       default:
          break;
    }
 }
+
+void keyboard(unsigned char key, int x, int y)
+{
+   switch (key) {
+      case 's':
+      case 'S':
+         loopPrintStats("double", &loop);
+         loopResetStats(&loop);
+         break;
+      case 27:
+         exit(0);
+         break;
+   }
+}
    
 /* 
  *  Request double buffer display mode.
@@ -114,6 +145,7 @@ int main(int argc, char** argv)
    glutDisplayFunc(display); 
    glutReshapeFunc(reshape); 
    glutMouseFunc(mouse);
+   glutKeyboardFunc(keyboard);
    glutMainLoop();
    return 0;   /* ANSI C requires main to return int. */
 }
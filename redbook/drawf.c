@@ -38,30 +38,38 @@
 /*
  *  drawf.c
  *  Draws the bitmapped letter F on the screen (several times).
- *  This demonstrates use of the glBitmap() call.
+ *  The bitmap is in the form glBitmap() takes; it is rasterized
+ *  once into a glyph atlas and the letters are drawn as a batch
+ *  of textured quads.
  */
 #include <GL/glut.h>
 #include <stdlib.h>
+#include "text.h"
 
 GLubyte rasters[24] = {
    0xc0, 0x00, 0xc0, 0x00, 0xc0, 0x00, 0xc0, 0x00, 0xc0, 0x00,
    0xff, 0x00, 0xff, 0x00, 0xc0, 0x00, 0xc0, 0x00, 0xc0, 0x00,
    0xff, 0xc0, 0xff, 0xc0};
 
+TextFont font;
+TextBatch batch;
+
 void init(void)
 {
-   glPixelStorei (GL_UNPACK_ALIGNMENT, 1);
+   textFontInit(&font);
+   textFontGlyph(&font, 'F', 10, 12, 0.0, 0.0, 11.0, rasters);
+   textFontBuild(&font);
+   textBatchInit(&batch);
    glClearColor (0.0, 0.0, 0.0, 0.0);
 }
 
 void display(void)
 {
+   static const GLubyte white[4] = { 255, 255, 255, 255 };
+
    glClear(GL_COLOR_BUFFER_BIT);
-   glColor3f (1.0, 1.0, 1.0);
-   glRasterPos2i (20, 20);
-   glBitmap (10, 12, 0.0, 0.0, 11.0, 0.0, rasters);
-   glBitmap (10, 12, 0.0, 0.0, 11.0, 0.0, rasters);
-   glBitmap (10, 12, 0.0, 0.0, 11.0, 0.0, rasters);
+   textBatchString(&batch, &font, 20, 20, "FFF", white);
+   textBatchDraw(&batch, &font);
    glFlush();
 }
 
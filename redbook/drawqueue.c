@@ -0,0 +1,220 @@
+/*
+ *  drawqueue.c
+ *  Sort-key render queue.  See drawqueue.h for the key layout.
+ *
+ *  Items are sorted with an LSD radix sort, one byte per pass.  All
+ *  eight byte histograms are gathered in a single sweep and passes in
+ *  which every key has the same byte are skipped, so a frame that uses
+ *  a single shader and a handful of materials typically needs only
+ *  four or five passes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "drawqueue.h"
+
+#define NO_STATE 0xffffffffU
+
+void drawQueueInit(DrawQueue *q, unsigned capacity)
+{
+   memset(q, 0, sizeof(*q));
+   if (capacity == 0)
+      capacity = 64;
+   q->items = (DrawItem *) malloc(capacity * sizeof(DrawItem));
+   q->scratch = (DrawItem *) malloc(capacity * sizeof(DrawItem));
+   if (q->items == NULL || q->scratch == NULL) {
+      printf("drawQueueInit: out of memory\n");
+      exit(1);
+   }
+   q->capacity = capacity;
+}
+
+void drawQueueFree(DrawQueue *q)
+{
+   free(q->items);
+   free(q->scratch);
+   memset(q, 0, sizeof(*q));
+}
+
+void drawQueueReset(DrawQueue *q)
+{
+   q->count = 0;
+}
+
+/*  Depth is clamped to [0, 1] and quantized to 24 bits so that
+ *  nearer items sort first within the same state bucket.
+ */
+DrawKey drawQueueKey(unsigned shader, unsigned material, unsigned texture,
+                     float depth)
+{
+   DrawKey d;
+
+   if (depth < 0.0f) depth = 0.0f;
+   if (depth > 1.0f) depth = 1.0f;
+   d = (DrawKey) (depth * (float) DQ_DEPTH_MASK);
+
+   return ((DrawKey) (shader & DQ_SHADER_MASK) << DQ_SHADER_SHIFT) |
+          ((DrawKey) (material & DQ_MATERIAL_MASK) << DQ_MATERIAL_SHIFT) |
+          ((DrawKey) (texture & DQ_TEXTURE_MASK) << DQ_TEXTURE_SHIFT) |
+          (d & DQ_DEPTH_MASK);
+}
+
+static int grow(DrawQueue *q)
+{
+   unsigned n = q->capacity * 2;
+   DrawItem *items, *scratch;
+
+   items = (DrawItem *) realloc(q->items, n * sizeof(DrawItem));
+   if (items == NULL)
+      return 0;
+   q->items = items;
+   scratch = (DrawItem *) realloc(q->scratch, n * sizeof(DrawItem));
+   if (scratch == NULL)
+      return 0;
+   q->scratch = scratch;
+   q->capacity = n;
+   return 1;
+}
+
+int drawQueueSubmit(DrawQueue *q, DrawKey key, DrawFunc draw, void *data)
+{
+   DrawItem *it;
+
+   if (q->count == q->capacity && !grow(q))
+      return 0;
+   it = &q->items[q->count++];
+   it->key = key;
+   it->draw = draw;
+   it->data = data;
+   return 1;
+}
+
+void drawQueueSort(DrawQueue *q)
+{
+   unsigned hist[8][256];
+   unsigned n = q->count, i, pass, sum, c;
+   DrawItem *src = q->items, *dst = q->scratch, *tmp;
+
+   q->stats.sortPasses = 0;
+   if (n < 2)
+      return;
+
+   memset(hist, 0, sizeof(hist));
+   for (i = 0; i < n; i++) {
+      DrawKey k = src[i].key;
+      for (pass = 0; pass < 8; pass++)
+         hist[pass][(k >> (pass * 8)) & 0xff]++;
+   }
+
+   for (pass = 0; pass < 8; pass++) {
+      unsigned shift = pass * 8;
+      unsigned *h = hist[pass];
+
+      /*  every key has the same byte here; the pass would be a copy  */
+      if (h[(src[0].key >> shift) & 0xff] == n)
+         continue;
+
+      sum = 0;
+      for (i = 0; i < 256; i++) {
+         c = h[i];
+         h[i] = sum;
+         sum += c;
+      }
+      for (i = 0; i < n; i++)
+         dst[h[(src[i].key >> shift) & 0xff]++] = src[i];
+
+      tmp = src; src = dst; dst = tmp;
+      q->stats.sortPasses++;
+   }
+
+   /*  keep the sorted data in q->items  */
+   q->items = src;
+   q->scratch = dst;
+}
+
+/*  Number of binds a redundant-state filter would issue if the items
+ *  were replayed in the order given.
+ */
+static unsigned countChanges(const DrawQueue *q)
+{
+   unsigned s = NO_STATE, m = NO_STATE, t = NO_STATE;
+   unsigned i, changes = 0;
+
+   for (i = 0; i < q->count; i++) {
+      DrawKey k = q->items[i].key;
+      if (q->bindShader && DQ_KEY_SHADER(k) != s) {
+         s = DQ_KEY_SHADER(k);
+         changes++;
+      }
+      if (q->bindMaterial && DQ_KEY_MATERIAL(k) != m) {
+         m = DQ_KEY_MATERIAL(k);
+         changes++;
+      }
+      if (q->bindTexture && DQ_KEY_TEXTURE(k) != t) {
+         t = DQ_KEY_TEXTURE(k);
+         changes++;
+      }
+   }
+   return changes;
+}
+
+/*  Sort the queue, replay it, and reset it for the next frame.
+ *  Bind callbacks that are NULL are treated as state the caller does
+ *  not track.
+ */
+void drawQueueFlush(DrawQueue *q)
+{
+   unsigned s = NO_STATE, m = NO_STATE, t = NO_STATE;
+   unsigned i, fields = 0;
+   DrawQueueStats *st = &q->stats;
+
+   if (q->bindShader) fields++;
+   if (q->bindMaterial) fields++;
+   if (q->bindTexture) fields++;
+
+   st->items = q->count;
+   st->requested = q->count * fields;
+   st->unsorted = countChanges(q);
+   st->emitted = 0;
+
+   drawQueueSort(q);
+
+   for (i = 0; i < q->count; i++) {
+      DrawItem *it = &q->items[i];
+      unsigned v;
+
+      v = DQ_KEY_SHADER(it->key);
+      if (q->bindShader && v != s) {
+         q->bindShader(v, q->user);
+         s = v;
+         st->emitted++;
+      }
+      v = DQ_KEY_MATERIAL(it->key);
+      if (q->bindMaterial && v != m) {
+         q->bindMaterial(v, q->user);
+         m = v;
+         st->emitted++;
+      }
+      v = DQ_KEY_TEXTURE(it->key);
+      if (q->bindTexture && v != t) {
+         q->bindTexture(v, q->user);
+         t = v;
+         st->emitted++;
+      }
+      it->draw(it->data);
+   }
+
+   st->eliminated = st->requested - st->emitted;
+   q->count = 0;
+}
+
+void drawQueuePrintStats(const DrawQueue *q)
+{
+   const DrawQueueStats *st = &q->stats;
+
+   printf("draw queue: %u items, %u radix passes\n",
+          st->items, st->sortPasses);
+   printf("  state binds requested %u, unsorted %u, emitted %u\n",
+          st->requested, st->unsorted, st->emitted);
+   printf("  redundant binds eliminated %u\n", st->eliminated);
+}
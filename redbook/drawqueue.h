@@ -0,0 +1,83 @@
+/*
+ *  drawqueue.h
+ *  A per-frame render queue.  Draw items are recorded with a 64-bit
+ *  sort key, radix sorted, and replayed so that shader, material and
+ *  texture state is only changed when it actually differs from the
+ *  state that is already bound.
+ *
+ *  Key layout, most significant field first:
+ *
+ *     63..56  shader    (8 bits)
+ *     55..40  material  (16 bits)
+ *     39..24  texture   (16 bits)
+ *     23..0   depth     (24 bits, 0.0 = near, 1.0 = far)
+ */
+#ifndef DRAWQUEUE_H
+#define DRAWQUEUE_H
+
+typedef unsigned long long DrawKey;
+
+#define DQ_SHADER_SHIFT    56
+#define DQ_MATERIAL_SHIFT  40
+#define DQ_TEXTURE_SHIFT   24
+
+#define DQ_SHADER_MASK     0xffULL
+#define DQ_MATERIAL_MASK   0xffffULL
+#define DQ_TEXTURE_MASK    0xffffULL
+#define DQ_DEPTH_MASK      0xffffffULL
+
+#define DQ_KEY_SHADER(k)   ((unsigned) (((k) >> DQ_SHADER_SHIFT) & DQ_SHADER_MASK))
+#define DQ_KEY_MATERIAL(k) ((unsigned) (((k) >> DQ_MATERIAL_SHIFT) & DQ_MATERIAL_MASK))
+#define DQ_KEY_TEXTURE(k)  ((unsigned) (((k) >> DQ_TEXTURE_SHIFT) & DQ_TEXTURE_MASK))
+
+typedef void (*DrawFunc)(void *data);
+typedef void (*BindFunc)(unsigned id, void *user);
+
+typedef struct drawitem {
+   DrawKey   key;
+   DrawFunc  draw;
+   void     *data;
+} DrawItem;
+
+/*  Counters for the last flushed frame.  "requested" is the number of
+ *  state binds a caller that sets every field for every draw would
+ *  issue; "unsorted" is what a redundant-state filter alone would
+ *  issue in submission order; "emitted" is what was actually issued.
+ */
+typedef struct drawqueuestats {
+   unsigned items;
+   unsigned requested;
+   unsigned unsorted;
+   unsigned emitted;
+   unsigned eliminated;
+   unsigned sortPasses;
+} DrawQueueStats;
+
+typedef struct drawqueue {
+   DrawItem  *items;
+   DrawItem  *scratch;
+   unsigned   count;
+   unsigned   capacity;
+
+   BindFunc   bindShader;
+   BindFunc   bindMaterial;
+   BindFunc   bindTexture;
+   void      *user;
+
+   DrawQueueStats stats;
+} DrawQueue;
+
+void drawQueueInit(DrawQueue *q, unsigned capacity);
+void drawQueueFree(DrawQueue *q);
+void drawQueueReset(DrawQueue *q);
+
+DrawKey drawQueueKey(unsigned shader, unsigned material, unsigned texture,
+                     float depth);
+int drawQueueSubmit(DrawQueue *q, DrawKey key, DrawFunc draw, void *data);
+
+void drawQueueSort(DrawQueue *q);
+void drawQueueFlush(DrawQueue *q);
+
+void drawQueuePrintStats(const DrawQueue *q);
+
+#endif
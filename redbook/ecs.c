@@ -0,0 +1,389 @@
+/*
+ *  ecs.c
+ *  Entity-component store.  See ecs.h.
+ *
+ *  A chunk is a header and then the ids of its entities and an array
+ *  for each component, each array starting on a multiple of
+ *  ARENA_ALIGN bytes; the archetype works out how many entities fit
+ *  and where the arrays go once, when it is made.  Chunks come from a
+ *  pool of ECS_CHUNK_BYTES blocks and go back to it when they empty.
+ *  The low ECS_INDEX_BITS of an id are the index of its record and the
+ *  rest its generation, which is never 0.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ecs.h"
+#include "jobs.h"
+
+#define ROUND(n, a)     (((n) + (a) - 1) / (a) * (a))
+#define INDEX_MASK      ((1u << ECS_INDEX_BITS) - 1)
+#define GENERATIONS     (1u << (32 - ECS_INDEX_BITS))
+#define JOBS_PER_THREAD 4
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("ecs: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+void ecsInit(EcsWorld *w)
+{
+   memset(w, 0, sizeof(EcsWorld));
+   w->freeIndex = -1;
+   poolInit(&w->chunks, ECS_CHUNK_BYTES, 16);
+}
+
+void ecsFree(EcsWorld *w)
+{
+   int i;
+
+   for (i = 0; i < w->archetypeCount; i++) {
+      free(w->archetypes[i]->chunks);
+      free(w->archetypes[i]);
+   }
+   free(w->archetypes);
+   free(w->records);
+   free(w->matches);
+   poolFree(&w->chunks);
+   memset(w, 0, sizeof(EcsWorld));
+   w->freeIndex = -1;
+}
+
+int ecsComponent(EcsWorld *w, size_t size, const char *name)
+{
+   if (w->componentCount == ECS_MAX_COMPONENTS) {
+      printf("ecs: more than %d components\n", ECS_MAX_COMPONENTS);
+      exit(1);
+   }
+   w->sizes[w->componentCount] = size;
+   w->names[w->componentCount] = name;
+   return w->componentCount++;
+}
+
+/*
+ *  Archetypes and chunks
+ */
+
+/*  Bytes a chunk of n entities of the mask takes.  */
+static size_t chunkBytes(const EcsWorld *w, EcsMask mask, int n)
+{
+   size_t bytes = ROUND(sizeof(EcsChunk), ARENA_ALIGN);
+   int c;
+
+   bytes += ROUND(n * sizeof(EcsEntity), ARENA_ALIGN);
+   for (c = 0; c < w->componentCount; c++)
+      if (mask & ECS_BIT(c))
+         bytes += ROUND(n * w->sizes[c], ARENA_ALIGN);
+   return bytes;
+}
+
+static EcsArchetype *archetype(EcsWorld *w, EcsMask mask)
+{
+   EcsArchetype *a;
+   size_t perEntity = sizeof(EcsEntity), offset;
+   int i, c;
+
+   for (i = 0; i < w->archetypeCount; i++)
+      if (w->archetypes[i]->mask == mask)
+         return w->archetypes[i];
+
+   a = (EcsArchetype *) allocate(NULL, sizeof(EcsArchetype));
+   memset(a, 0, sizeof(EcsArchetype));
+   a->mask = mask;
+   for (c = 0; c < w->componentCount; c++)
+      if (mask & ECS_BIT(c))
+         perEntity += w->sizes[c];
+   a->capacity = (int) (ECS_CHUNK_BYTES / perEntity);
+   while (a->capacity > 0 &&
+          chunkBytes(w, mask, a->capacity) > ECS_CHUNK_BYTES)
+      a->capacity--;
+   if (a->capacity == 0) {
+      printf("ecs: an entity does not fit in a chunk\n");
+      exit(1);
+   }
+   offset = ROUND(sizeof(EcsChunk), ARENA_ALIGN);
+   a->entities = offset;
+   offset += ROUND(a->capacity * sizeof(EcsEntity), ARENA_ALIGN);
+   for (c = 0; c < w->componentCount; c++) {
+      if (mask & ECS_BIT(c)) {
+         a->offsets[c] = offset;
+         offset += ROUND(a->capacity * w->sizes[c], ARENA_ALIGN);
+      }
+   }
+
+   w->archetypes = (EcsArchetype **) allocate(w->archetypes,
+                      (w->archetypeCount + 1) * sizeof(EcsArchetype *));
+   w->archetypes[w->archetypeCount++] = a;
+   return a;
+}
+
+#define COLUMN(chunk, c)  ((char *) (chunk) + (chunk)->archetype->offsets[c])
+#define ENTITIES(chunk) \
+   ((EcsEntity *) ((char *) (chunk) + (chunk)->archetype->entities))
+
+/*  A row at the end of an archetype, for an entity, zeroed.  */
+static void append(EcsWorld *w, EcsArchetype *a, EcsEntity e)
+{
+   EcsRecord *r = &w->records[e & INDEX_MASK];
+   EcsChunk *chunk;
+   int c;
+
+   chunk = a->chunkCount ? a->chunks[a->chunkCount - 1] : NULL;
+   if (chunk == NULL || chunk->count == a->capacity) {
+      if (a->chunkCount == a->maxChunks) {
+         a->maxChunks = a->maxChunks ? a->maxChunks * 2 : 8;
+         a->chunks = (EcsChunk **)
+            allocate(a->chunks, a->maxChunks * sizeof(EcsChunk *));
+      }
+      chunk = (EcsChunk *) poolAlloc(&w->chunks);
+      chunk->archetype = a;
+      chunk->count = 0;
+      a->chunks[a->chunkCount++] = chunk;
+   }
+   r->chunk = chunk;
+   r->row = chunk->count++;
+   a->count++;
+   ENTITIES(chunk)[r->row] = e;
+   for (c = 0; c < w->componentCount; c++)
+      if (a->mask & ECS_BIT(c))
+         memset(COLUMN(chunk, c) + r->row * w->sizes[c], 0, w->sizes[c]);
+}
+
+/*  Take a row out of its archetype, moving the last row into it.  */
+static void removeRow(EcsWorld *w, EcsChunk *chunk, int row)
+{
+   EcsArchetype *a = chunk->archetype;
+   EcsChunk *last = a->chunks[a->chunkCount - 1];
+   int lastRow = last->count - 1, c;
+
+   if (last != chunk || lastRow != row) {
+      EcsEntity moved = ENTITIES(last)[lastRow];
+      EcsRecord *r = &w->records[moved & INDEX_MASK];
+
+      for (c = 0; c < w->componentCount; c++)
+         if (a->mask & ECS_BIT(c))
+            memcpy(COLUMN(chunk, c) + row * w->sizes[c],
+                   COLUMN(last, c) + lastRow * w->sizes[c], w->sizes[c]);
+      ENTITIES(chunk)[row] = moved;
+      r->chunk = chunk;
+      r->row = row;
+   }
+   last->count--;
+   a->count--;
+   if (last->count == 0) {
+      poolRelease(&w->chunks, last);
+      a->chunkCount--;
+   }
+}
+
+/*
+ *  Entities
+ */
+EcsEntity ecsCreate(EcsWorld *w, EcsMask mask)
+{
+   EcsRecord *r;
+   int index;
+
+   if (w->freeIndex >= 0) {
+      index = w->freeIndex;
+      w->freeIndex = w->records[index].row;
+   } else {
+      if (w->recordCount > (int) INDEX_MASK) {
+         printf("ecs: more than %u entities\n", INDEX_MASK + 1);
+         exit(1);
+      }
+      if (w->recordCount == w->maxRecords) {
+         w->maxRecords = w->maxRecords ? w->maxRecords * 2 : 1024;
+         w->records = (EcsRecord *)
+            allocate(w->records, w->maxRecords * sizeof(EcsRecord));
+      }
+      index = w->recordCount++;
+      w->records[index].generation = 1;
+   }
+   r = &w->records[index];
+   append(w, archetype(w, mask), r->generation << ECS_INDEX_BITS | index);
+   w->live++;
+   return r->generation << ECS_INDEX_BITS | index;
+}
+
+int ecsAlive(const EcsWorld *w, EcsEntity e)
+{
+   unsigned index = e & INDEX_MASK;
+
+   return index < (unsigned) w->recordCount &&
+          w->records[index].chunk != NULL &&
+          w->records[index].generation == e >> ECS_INDEX_BITS;
+}
+
+void ecsDestroy(EcsWorld *w, EcsEntity e)
+{
+   EcsRecord *r;
+
+   if (!ecsAlive(w, e))
+      return;
+   r = &w->records[e & INDEX_MASK];
+   removeRow(w, r->chunk, r->row);
+   r->chunk = NULL;
+   r->generation = r->generation % (GENERATIONS - 1) + 1;
+   r->row = w->freeIndex;
+   w->freeIndex = (int) (e & INDEX_MASK);
+   w->live--;
+}
+
+EcsMask ecsMask(const EcsWorld *w, EcsEntity e)
+{
+   if (!ecsAlive(w, e))
+      return 0;
+   return w->records[e & INDEX_MASK].chunk->archetype->mask;
+}
+
+void *ecsGet(const EcsWorld *w, EcsEntity e, int component)
+{
+   const EcsRecord *r;
+
+   if (!(ecsMask(w, e) & ECS_BIT(component)))
+      return NULL;
+   r = &w->records[e & INDEX_MASK];
+   return COLUMN(r->chunk, component) + r->row * w->sizes[component];
+}
+
+/*  Move an entity to the archetype of mask, keeping what they share.  */
+static void move(EcsWorld *w, EcsEntity e, EcsMask mask)
+{
+   EcsRecord *r = &w->records[e & INDEX_MASK];
+   EcsChunk *from = r->chunk;
+   int row = r->row, c;
+
+   append(w, archetype(w, mask), e);
+   for (c = 0; c < w->componentCount; c++)
+      if (mask & from->archetype->mask & ECS_BIT(c))
+         memcpy(COLUMN(r->chunk, c) + r->row * w->sizes[c],
+                COLUMN(from, c) + row * w->sizes[c], w->sizes[c]);
+   removeRow(w, from, row);
+}
+
+void *ecsAdd(EcsWorld *w, EcsEntity e, int component)
+{
+   EcsMask mask = ecsMask(w, e);
+
+   if (!ecsAlive(w, e))
+      return NULL;
+   if (!(mask & ECS_BIT(component)))
+      move(w, e, mask | ECS_BIT(component));
+   return ecsGet(w, e, component);
+}
+
+void ecsRemove(EcsWorld *w, EcsEntity e, int component)
+{
+   EcsMask mask = ecsMask(w, e);
+
+   if (mask & ECS_BIT(component))
+      move(w, e, mask & ~ECS_BIT(component));
+}
+
+void *ecsColumn(const EcsChunk *c, int component)
+{
+   if (!(c->archetype->mask & ECS_BIT(component)))
+      return NULL;
+   return COLUMN(c, component);
+}
+
+const EcsEntity *ecsEntities(const EcsChunk *c)
+{
+   return ENTITIES(c);
+}
+
+/*
+ *  Queries
+ */
+void ecsForEach(EcsWorld *w, EcsMask all, EcsMask none, EcsFunc fn,
+                void *user)
+{
+   int i, k;
+
+   for (i = 0; i < w->archetypeCount; i++) {
+      EcsArchetype *a = w->archetypes[i];
+
+      if ((a->mask & all) == all && !(a->mask & none))
+         for (k = 0; k < a->chunkCount; k++)
+            fn(a->chunks[k], user);
+   }
+}
+
+typedef struct query {
+   EcsChunk  **chunks;
+   int         count, jobs;
+   EcsFunc     fn;
+   void       *user;
+} Query;
+
+/*  A job runs an even share of the chunks.  */
+static void runChunks(int index, void *user)
+{
+   Query *q = (Query *) user;
+   int first = (int) ((long long) q->count * index / q->jobs);
+   int last = (int) ((long long) q->count * (index + 1) / q->jobs), i;
+
+   for (i = first; i < last; i++)
+      q->fn(q->chunks[i], q->user);
+}
+
+void ecsForEachParallel(EcsWorld *w, EcsMask all, EcsMask none,
+                        EcsFunc fn, void *user)
+{
+   Query q;
+   int i, k, limit;
+
+   q.count = 0;
+   for (i = 0; i < w->archetypeCount; i++) {
+      EcsArchetype *a = w->archetypes[i];
+
+      if ((a->mask & all) != all || (a->mask & none))
+         continue;
+      if (q.count + a->chunkCount > w->maxMatches) {
+         w->maxMatches = (q.count + a->chunkCount) * 2;
+         w->matches = (EcsChunk **)
+            allocate(w->matches, w->maxMatches * sizeof(EcsChunk *));
+      }
+      for (k = 0; k < a->chunkCount; k++)
+         w->matches[q.count++] = a->chunks[k];
+   }
+   if (q.count == 0)
+      return;
+   limit = JOBS_PER_THREAD * jobsThreadCount();
+   q.chunks = w->matches;
+   q.jobs = q.count < limit ? q.count : limit;
+   q.fn = fn;
+   q.user = user;
+   jobsParallelFor(q.jobs, runChunks, &q);
+}
+
+void ecsPrintStats(const char *name, const EcsWorld *w)
+{
+   int i, c, chunks = 0;
+   long slots = 0;
+
+   for (i = 0; i < w->archetypeCount; i++) {
+      chunks += w->archetypes[i]->chunkCount;
+      slots += (long) w->archetypes[i]->chunkCount *
+               w->archetypes[i]->capacity;
+   }
+   printf("%s: %d entities in %d archetypes, %d chunks of %d KB, "
+          "%.1f%% full\n", name, w->live, w->archetypeCount, chunks,
+          ECS_CHUNK_BYTES / 1024, slots ? 100.0 * w->live / slots : 0.0);
+   for (i = 0; i < w->archetypeCount; i++) {
+      const EcsArchetype *a = w->archetypes[i];
+
+      printf("  ");
+      for (c = 0; c < w->componentCount; c++)
+         if (a->mask & ECS_BIT(c))
+            printf(" %s", w->names[c]);
+      printf(": %d in %d chunks of %d\n", a->count, a->chunkCount,
+             a->capacity);
+   }
+}
@@ -0,0 +1,111 @@
+/*
+ *  ecs.h
+ *  An entity-component store.  An entity is an id with a set of
+ *  components, each a block of plain data of a size registered with
+ *  the world.  Entities with the same set of components belong to one
+ *  archetype, which keeps them in chunks of ECS_CHUNK_BYTES: a chunk
+ *  holds an array of each component, one element per entity, so a
+ *  system that reads some components of every entity that has them
+ *  goes through memory in order, chunk by chunk.
+ *
+ *  Chunks are kept full but for the last of each archetype: removing
+ *  an entity moves the last one of its archetype into its place, and
+ *  adding or removing a component moves it to another archetype.  So
+ *  pointers to components last only until the next change of that
+ *  kind, but ids last: an id is an index into a table of where each
+ *  entity is, with a generation that changes whenever the index is
+ *  reused, so an id kept after its entity is destroyed is seen to be
+ *  stale rather than finding another entity.
+ *
+ *  ecsForEachParallel() hands the chunks that match a query to the
+ *  worker pool (jobs.h); the function must touch only its own chunk
+ *  and must not create, destroy or change the components of entities.
+ */
+#ifndef ECS_H
+#define ECS_H
+
+#include "arena.h"
+
+#define ECS_CHUNK_BYTES     16384
+#define ECS_MAX_COMPONENTS  32
+#define ECS_INDEX_BITS      24        /* so up to 16M entities */
+#define ECS_NULL            0         /* never a live entity */
+
+typedef unsigned EcsEntity;
+typedef unsigned EcsMask;             /* a bit for each component */
+
+#define ECS_BIT(c)          (1u << (c))
+
+/*  The header of a chunk; the arrays follow it in the same block.  */
+typedef struct ecschunk {
+   struct ecsarchetype  *archetype;
+   int                   count;
+} EcsChunk;
+
+typedef struct ecsarchetype {
+   EcsMask     mask;
+   int         capacity;              /* entities a chunk holds */
+   size_t      entities;              /* offsets of the arrays in a chunk */
+   size_t      offsets[ECS_MAX_COMPONENTS];
+   EcsChunk  **chunks;
+   int         chunkCount, maxChunks;
+   int         count;                 /* entities */
+} EcsArchetype;
+
+typedef struct ecsrecord {
+   EcsChunk   *chunk;                 /* NULL while the index is free */
+   int         row;                   /* or the next free index */
+   unsigned    generation;
+} EcsRecord;
+
+typedef struct ecsworld {
+   size_t          sizes[ECS_MAX_COMPONENTS];
+   const char     *names[ECS_MAX_COMPONENTS];
+   int             componentCount;
+   EcsArchetype  **archetypes;
+   int             archetypeCount;
+   EcsRecord      *records;
+   int             recordCount, maxRecords;
+   int             freeIndex;         /* -1 for none */
+   int             live;
+   Pool            chunks;            /* of ECS_CHUNK_BYTES */
+   EcsChunk      **matches;           /* for parallel queries */
+   int             maxMatches;
+} EcsWorld;
+
+typedef void (*EcsFunc)(EcsChunk *chunk, void *user);
+
+void ecsInit(EcsWorld *w);
+void ecsFree(EcsWorld *w);
+
+/*  Register a component and return its number, from 0 on.  */
+int ecsComponent(EcsWorld *w, size_t size, const char *name);
+
+/*  Make an entity with the components in mask, all zero.  */
+EcsEntity ecsCreate(EcsWorld *w, EcsMask mask);
+void ecsDestroy(EcsWorld *w, EcsEntity e);
+int ecsAlive(const EcsWorld *w, EcsEntity e);
+EcsMask ecsMask(const EcsWorld *w, EcsEntity e);
+
+/*  The component of an entity, or NULL if it has none.  ecsAdd()
+ *  returns the component it adds, zeroed, or the one there was.
+ */
+void *ecsGet(const EcsWorld *w, EcsEntity e, int component);
+void *ecsAdd(EcsWorld *w, EcsEntity e, int component);
+void ecsRemove(EcsWorld *w, EcsEntity e, int component);
+
+/*  The array of a component in a chunk, or NULL, and its entities.  */
+void *ecsColumn(const EcsChunk *c, int component);
+const EcsEntity *ecsEntities(const EcsChunk *c);
+
+/*  Call fn for each chunk of the entities that have every component
+ *  in all and none in none.
+ */
+void ecsForEach(EcsWorld *w, EcsMask all, EcsMask none, EcsFunc fn,
+                void *user);
+void ecsForEachParallel(EcsWorld *w, EcsMask all, EcsMask none,
+                        EcsFunc fn, void *user);
+
+void ecsPrintStats(const char *name, const EcsWorld *w);
+
+#endif
@@ -38,13 +38,21 @@
 /*
  *  font.c
  *
- *  Draws some text in a bitmapped font.  Uses glBitmap() 
- *  and other pixel routines.  Also demonstrates use of 
- *  display lists.
+ *  Draws some text in a bitmapped font.  The glyphs are given
+ *  in glBitmap() form and rasterized once into a texture atlas;
+ *  each frame the strings are appended to a batch of textured
+ *  quads and drawn with a single call.  Press "b" to time many
+ *  labels drawn this way against glBitmap() display lists, one
+ *  list per character, and "s" for the text statistics.
  */
 #include <GL/glut.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "text.h"
+#include "timer.h"
+
+#define BENCH_LABELS 5000
 
 GLubyte space[] = 
 {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
@@ -78,9 +86,24 @@ GLubyte letters[][13] = {
 {0x00, 0x00, 0xff, 0xc0, 0xc0, 0x60, 0x30, 0x7e, 0x0c, 0x06, 0x03, 0x03, 0xff}
 };
 
+TextFont font;
+TextBatch batch;
 GLuint fontOffset;
 
 void makeRasterFont(void)
+{
+   GLuint i, j;
+
+   textFontInit(&font);
+   for (i = 0,j = 'A'; i < 26; i++,j++)
+      textFontGlyph(&font, j, 8, 13, 0.0, 2.0, 10.0, letters[i]);
+   textFontGlyph(&font, ' ', 8, 13, 0.0, 2.0, 10.0, space);
+   textFontBuild(&font);
+   textBatchInit(&batch);
+}
+
+/*  The same font as glBitmap() display lists, for comparison.  */
+void makeBitmapLists(void)
 {
    GLuint i, j;
    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -100,9 +123,17 @@ void init(void)
 {
    glShadeModel (GL_FLAT);
    makeRasterFont();
+   makeBitmapLists();
 }
 
-void printString(char *s)
+void printString(GLfloat x, GLfloat y, const char *s)
+{
+   static const GLubyte white[4] = { 255, 255, 255, 255 };
+
+   textBatchString(&batch, &font, x, y, s, white);
+}
+
+void printBitmapString(const char *s)
 {
    glPushAttrib (GL_LIST_BIT);
    glListBase(fontOffset);
@@ -113,22 +144,50 @@ void printString(char *s)
 /* Everything above this line could be in a library 
  * that defines a font.  To make it work, you've got 
  * to call makeRasterFont() before you start making 
- * calls to printString().
+ * calls to printString(), and draw the batch once the
+ * frame's strings have been added.
  */
 void display(void)
 {
-   GLfloat white[3] = { 1.0, 1.0, 1.0 };
-
    glClear(GL_COLOR_BUFFER_BIT);
-   glColor3fv(white);
 
-   glRasterPos2i(20, 60);
-   printString("THE QUICK BROWN FOX JUMPS");
-   glRasterPos2i(20, 40);
-   printString("OVER A LAZY DOG");
+   printString(20, 60, "THE QUICK BROWN FOX JUMPS");
+   printString(20, 40, "OVER A LAZY DOG");
+   textBatchDraw(&batch, &font);
    glFlush ();
 }
 
+static const char *labels[] = {
+   "THE QUICK BROWN FOX JUMPS", "OVER A LAZY DOG", "HUD", "DEBUG OVERLAY"
+};
+
+static void benchmark(void)
+{
+   double start, lists, batched;
+   int i;
+
+   glColor3f(1.0, 1.0, 1.0);
+   glFinish();
+   start = timerSeconds();
+   for (i = 0; i < BENCH_LABELS; i++) {
+      glRasterPos2i(20, 20 + i % 60);
+      printBitmapString(labels[i % 4]);
+   }
+   glFinish();
+   lists = timerSeconds() - start;
+
+   start = timerSeconds();
+   for (i = 0; i < BENCH_LABELS; i++)
+      printString(20, 20 + i % 60, labels[i % 4]);
+   textBatchDraw(&batch, &font);
+   glFinish();
+   batched = timerSeconds() - start;
+
+   printf("%d labels: glBitmap lists %.2f ms, atlas batch %.2f ms\n",
+          BENCH_LABELS, lists * 1000.0, batched * 1000.0);
+   glutPostRedisplay();
+}
+
 void reshape(int w, int h)
 {
    glViewport(0, 0, (GLsizei) w, (GLsizei) h);
@@ -140,7 +199,19 @@ void reshape(int w, int h)
 
 void keyboard(unsigned char key, int x, int y)
 {
+   const TextStats *ts;
+
    switch (key) {
+      case 'b':
+      case 'B':
+         benchmark();
+         break;
+      case 's':
+      case 'S':
+         ts = textStats();
+         printf("%u strings, %u layouts cached, %u glyphs, %u draws\n",
+                ts->strings, ts->cacheHits, ts->glyphs, ts->draws);
+         break;
       case 27:
          exit(0);
    }
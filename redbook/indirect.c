@@ -0,0 +1,367 @@
+/*
+ *  indirect.c
+ *  Indirect draw batches.  See indirect.h.
+ *
+ *  The indices of every mesh are stored already offset by where its
+ *  vertices start, so a command's base vertex is always 0 and the one
+ *  at a time path can use plain glDrawElements().  Instances are
+ *  grouped by mesh with a counting sort as they are written into the
+ *  ring, so each command's instances are consecutive and its base
+ *  instance says where they start.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "indirect.h"
+#include "shader.h"
+
+#define BUFFER_OFFSET(bytes) ((const GLubyte *) NULL + (bytes))
+#define VERTEX_BYTES (6 * sizeof(GLfloat))
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("indirect: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+#ifdef GL_VERSION_4_2
+/*  Per vertex lighting with light 0, as in transparent.c, but with the
+ *  color and model matrix of the instance as attributes.
+ */
+static const char *instanceVertex =
+   "#version 330 compatibility\n"
+   "layout(location = 0) in vec3 position;\n"
+   "layout(location = 1) in vec3 normal;\n"
+   "layout(location = 2) in vec4 color;\n"
+   "layout(location = 3) in mat4 model;\n"
+   "out vec4 shade;\n"
+   "void main()\n"
+   "{\n"
+   "   mat3 m = transpose(inverse(mat3(model)));\n"
+   "   vec3 n = normalize(gl_NormalMatrix * (m * normal));\n"
+   "   vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+   "   float d = max(dot(n, l), 0.0);\n"
+   "   shade.rgb = color.rgb * (gl_LightModel.ambient.rgb +\n"
+   "                            gl_LightSource[0].ambient.rgb +\n"
+   "                            d * gl_LightSource[0].diffuse.rgb);\n"
+   "   shade.a = color.a;\n"
+   "   shade = clamp(shade, 0.0, 1.0);\n"
+   "   gl_Position = gl_ModelViewProjectionMatrix *\n"
+   "                 (model * vec4(position, 1.0));\n"
+   "}\n";
+
+static const char *instanceFragment =
+   "#version 330 compatibility\n"
+   "in vec4 shade;\n"
+   "void main()\n"
+   "{\n"
+   "   gl_FragColor = shade;\n"
+   "}\n";
+#endif
+
+void indirectInit(IndirectBatch *b)
+{
+   memset(b, 0, sizeof(*b));
+   b->best = b->method = INDIRECT_CPU;
+}
+
+void indirectFree(IndirectBatch *b)
+{
+   if (b->vbo) {
+      glDeleteBuffers(1, &b->vbo);
+      glDeleteBuffers(1, &b->ibo);
+      streamFree(&b->stream);
+   }
+#ifdef GL_VERSION_2_0
+   if (b->program)
+      glDeleteProgram(b->program);
+#endif
+   free(b->verts);
+   free(b->indices);
+   free(b->instances);
+   free(b->meshOf);
+   memset(b, 0, sizeof(*b));
+}
+
+int indirectAddMesh(IndirectBatch *b, const MeshBuilder *mb)
+{
+   int mesh = b->meshCount, r;
+   GLuint i, base = b->vertexCount;
+   GLfloat *v;
+
+   if (mesh == INDIRECT_MAX_MESHES) {
+      printf("indirect: more than %d meshes\n", INDIRECT_MAX_MESHES);
+      exit(1);
+   }
+   b->verts = (GLfloat *) allocate(b->verts, (b->vertexCount +
+                                   mb->vertexCount) * VERTEX_BYTES);
+   for (i = 0; i < mb->vertexCount; i++) {
+      const GLfloat *src = mb->verts + i * mb->floatsPerVertex;
+
+      v = b->verts + (base + i) * 6;
+      v[0] = src[0];
+      v[1] = src[1];
+      v[2] = src[2];
+      if (mb->attribs & MESH_NORMAL) {
+         v[3] = src[3];
+         v[4] = src[4];
+         v[5] = src[5];
+      } else {
+         v[3] = v[4] = 0.0;
+         v[5] = 1.0;
+      }
+   }
+   b->vertexCount += mb->vertexCount;
+
+   b->firstIndex[mesh] = b->indexTotal;
+   b->indexCount[mesh] = 0;
+   for (r = 0; r < mb->rangeCount; r++) {
+      const MeshRange *range = &mb->ranges[r];
+
+      b->indices = (GLuint *) allocate(b->indices, (b->indexTotal +
+                                       range->count) * sizeof(GLuint));
+      for (i = 0; i < (GLuint) range->count; i++)
+         b->indices[b->indexTotal++] = base + mb->indices[range->first + i];
+      b->indexCount[mesh] += range->count;
+   }
+   return b->meshCount++;
+}
+
+void indirectCompile(IndirectBatch *b)
+{
+   glGenBuffers(1, &b->vbo);
+   glBindBuffer(GL_ARRAY_BUFFER, b->vbo);
+   glBufferData(GL_ARRAY_BUFFER, b->vertexCount * VERTEX_BYTES, b->verts,
+                GL_STATIC_DRAW);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   glGenBuffers(1, &b->ibo);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, b->ibo);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER, b->indexTotal * sizeof(GLuint),
+                b->indices, GL_STATIC_DRAW);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+   free(b->verts);
+   free(b->indices);
+   b->verts = NULL;
+   b->indices = NULL;
+
+   b->best = INDIRECT_CPU;
+#ifdef GL_VERSION_4_2
+   if (shaderGLVersion(4, 2))
+      b->program = shaderProgram(instanceVertex, instanceFragment);
+   if (b->program) {
+      b->best = INDIRECT_INSTANCED;
+#ifdef GL_VERSION_4_3
+      if (shaderGLVersion(4, 3))
+         b->best = INDIRECT_MULTI;
+#endif
+   }
+#endif
+   b->method = b->best;
+   streamInit(&b->stream, 64 * 1024, 1);
+}
+
+int indirectSetMethod(IndirectBatch *b, int method)
+{
+   b->method = method > b->best ? method : b->best;
+   return b->method;
+}
+
+const char *indirectMethodName(int method)
+{
+   switch (method) {
+   case INDIRECT_MULTI:
+      return "multi-draw indirect";
+   case INDIRECT_INSTANCED:
+      return "instanced draw per mesh";
+   default:
+      return "draw per instance";
+   }
+}
+
+void indirectBegin(IndirectBatch *b)
+{
+   b->count = 0;
+}
+
+void indirectAdd(IndirectBatch *b, int mesh, const GLfloat matrix[16],
+                 const GLfloat color[4])
+{
+   IndirectInstance *in;
+   int i;
+
+   if (b->count == b->capacity) {
+      b->capacity = b->capacity ? b->capacity * 2 : 1024;
+      b->instances = (IndirectInstance *)
+         allocate(b->instances, b->capacity * sizeof(IndirectInstance));
+      b->meshOf = (unsigned char *) allocate(b->meshOf, b->capacity);
+   }
+   in = &b->instances[b->count];
+   memcpy(in->matrix, matrix, sizeof(in->matrix));
+   for (i = 0; i < 4; i++)
+      in->color[i] = (GLubyte) (color[i] * 255.0 + 0.5);
+   b->meshOf[b->count++] = (unsigned char) mesh;
+}
+
+static void drawEach(IndirectBatch *b)
+{
+   int i;
+
+   glBindBuffer(GL_ARRAY_BUFFER, b->vbo);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, b->ibo);
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_NORMAL_ARRAY);
+   glVertexPointer(3, GL_FLOAT, VERTEX_BYTES, BUFFER_OFFSET(0));
+   glNormalPointer(GL_FLOAT, VERTEX_BYTES, BUFFER_OFFSET(3 * sizeof(GLfloat)));
+   for (i = 0; i < b->count; i++) {
+      const IndirectInstance *in = &b->instances[i];
+      int mesh = b->meshOf[i];
+
+      glPushMatrix();
+      glMultMatrixf(in->matrix);
+      glColor4ubv(in->color);
+      glDrawElements(GL_TRIANGLES, b->indexCount[mesh], GL_UNSIGNED_INT,
+                     BUFFER_OFFSET(b->firstIndex[mesh] * sizeof(GLuint)));
+      glPopMatrix();
+      b->stats.drawCalls++;
+   }
+   glDisableClientState(GL_VERTEX_ARRAY);
+   glDisableClientState(GL_NORMAL_ARRAY);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+#ifdef GL_VERSION_4_2
+/*  Point attributes 2 to 6 at the instances, advancing per instance.  */
+static void instanceArrays(const IndirectBatch *b, size_t offset)
+{
+   GLsizei stride = sizeof(IndirectInstance);
+   int i;
+
+   glBindBuffer(GL_ARRAY_BUFFER, b->stream.vbo);
+   glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                         BUFFER_OFFSET(offset +
+                                       offsetof(IndirectInstance, color)));
+   for (i = 0; i < 4; i++)
+      glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, stride,
+                            BUFFER_OFFSET(offset + i * 4 * sizeof(GLfloat)));
+   for (i = 2; i < 7; i++) {
+      glEnableVertexAttribArray(i);
+      glVertexAttribDivisor(i, 1);
+   }
+}
+
+/*  Write the instances grouped by mesh and a command for each mesh
+ *  that has any into the ring, and draw them.  False if the ring was
+ *  full, which it will not be the frame after.
+ */
+static int drawIndirect(IndirectBatch *b, const GLuint *counts)
+{
+   IndirectCommand commands[INDIRECT_MAX_MESHES], *c;
+   IndirectInstance *out;
+   GLuint start[INDIRECT_MAX_MESHES], first = 0;
+   size_t commandOffset = 0, instanceOffset = 0;
+   int i, n = 0;
+
+   streamBegin(&b->stream);
+   c = (IndirectCommand *) streamAlloc(&b->stream,
+            b->meshCount * sizeof(IndirectCommand), &commandOffset);
+   out = (IndirectInstance *) streamAlloc(&b->stream,
+            b->count * sizeof(IndirectInstance), &instanceOffset);
+   if (c == NULL || out == NULL) {
+      streamEnd(&b->stream);
+      return 0;
+   }
+
+   for (i = 0; i < b->meshCount; i++) {
+      start[i] = first;
+      if (counts[i]) {
+         commands[n].count = b->indexCount[i];
+         commands[n].instanceCount = counts[i];
+         commands[n].firstIndex = b->firstIndex[i];
+         commands[n].baseVertex = 0;
+         commands[n].baseInstance = first;
+         n++;
+      }
+      first += counts[i];
+   }
+   for (i = 0; i < b->count; i++)
+      out[start[b->meshOf[i]]++] = b->instances[i];
+   memcpy(c, commands, n * sizeof(IndirectCommand));
+   streamUpload(&b->stream);
+   b->stats.bytes = n * sizeof(IndirectCommand) +
+                    b->count * sizeof(IndirectInstance);
+
+   glUseProgram(b->program);
+   glBindBuffer(GL_ARRAY_BUFFER, b->vbo);
+   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_BYTES,
+                         BUFFER_OFFSET(0));
+   glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_BYTES,
+                         BUFFER_OFFSET(3 * sizeof(GLfloat)));
+   glEnableVertexAttribArray(0);
+   glEnableVertexAttribArray(1);
+   instanceArrays(b, instanceOffset);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, b->ibo);
+
+#ifdef GL_VERSION_4_3
+   if (b->method == INDIRECT_MULTI) {
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, b->stream.vbo);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                  BUFFER_OFFSET(commandOffset), n, 0);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+      b->stats.drawCalls++;
+   } else
+#endif
+   for (i = 0; i < n; i++) {
+      glDrawElementsInstancedBaseInstance(GL_TRIANGLES, commands[i].count,
+         GL_UNSIGNED_INT,
+         BUFFER_OFFSET(commands[i].firstIndex * sizeof(GLuint)),
+         commands[i].instanceCount, commands[i].baseInstance);
+      b->stats.drawCalls++;
+   }
+
+   for (i = 0; i < 7; i++) {
+      glVertexAttribDivisor(i, 0);
+      glDisableVertexAttribArray(i);
+   }
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+   glUseProgram(0);
+   streamEnd(&b->stream);
+   return 1;
+}
+#endif
+
+void indirectDraw(IndirectBatch *b)
+{
+   GLuint counts[INDIRECT_MAX_MESHES];
+   int i;
+
+   memset(&b->stats, 0, sizeof(b->stats));
+   b->stats.instances = b->count;
+   memset(counts, 0, sizeof(counts));
+   for (i = 0; i < b->count; i++)
+      counts[b->meshOf[i]]++;
+   for (i = 0; i < b->meshCount; i++)
+      if (counts[i])
+         b->stats.commands++;
+#ifdef GL_VERSION_4_2
+   if (b->method != INDIRECT_CPU && drawIndirect(b, counts))
+      return;
+#endif
+   drawEach(b);
+}
+
+void indirectPrintStats(const char *name, const IndirectBatch *b)
+{
+   const IndirectStats *st = &b->stats;
+
+   printf("%s: %s, %d instances of %d meshes in %d draw calls, "
+          "%lu bytes written\n", name, indirectMethodName(b->method),
+          st->instances, st->commands, st->drawCalls, st->bytes);
+}
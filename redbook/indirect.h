@@ -0,0 +1,98 @@
+/*
+ *  indirect.h
+ *  Drawing many instances of a few meshes in a handful of calls.
+ *
+ *  The meshes of a batch share one vertex and one index buffer.  Each
+ *  frame the instances, a matrix and a color each, are grouped by mesh
+ *  and written with one draw command per mesh into a streaming ring
+ *  buffer (stream.h); glMultiDrawElementsIndirect() then draws every
+ *  one of them in a single call, reading each instance's matrix and
+ *  color as vertex attributes that advance once per instance.
+ *
+ *  Where that is missing the same commands are issued one at a time,
+ *  one instanced draw per mesh, and below that each instance is drawn
+ *  by itself with the fixed-function matrix stack.  The instances are
+ *  lit by light 0 as the fixed-function pipeline would light them with
+ *  glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE) and the color of
+ *  the instance; the caller sets up and enables the lighting.
+ *
+ *  Meshes are given as builders with normals whose ranges are all
+ *  triangles (shapes.h makes them so).
+ */
+#ifndef INDIRECT_H
+#define INDIRECT_H
+
+#include "mesh.h"
+#include "stream.h"
+
+#define INDIRECT_MAX_MESHES  32
+
+/*  The ways of drawing, best first.  */
+#define INDIRECT_MULTI       0        /* GL 4.3 */
+#define INDIRECT_INSTANCED   1        /* GL 4.2 */
+#define INDIRECT_CPU         2        /* one call per instance */
+
+typedef struct indirectinstance {
+   GLfloat  matrix[16];
+   GLubyte  color[4];
+} IndirectInstance;
+
+/*  As glMultiDrawElementsIndirect() reads it.  */
+typedef struct indirectcommand {
+   GLuint  count, instanceCount, firstIndex;
+   GLint   baseVertex;
+   GLuint  baseInstance;
+} IndirectCommand;
+
+typedef struct indirectstats {
+   int  instances;
+   int  commands;                     /* meshes with instances */
+   int  drawCalls;                    /* GL draw calls issued */
+   unsigned long  bytes;              /* instances and commands written */
+} IndirectStats;
+
+typedef struct indirectbatch {
+   GLuint        vbo, ibo;            /* of every mesh */
+   GLuint        program;
+   int           best;                /* the best way this GL has */
+   int           method;              /* the way in use */
+   int           meshCount;
+   GLuint        firstIndex[INDIRECT_MAX_MESHES];
+   GLsizei       indexCount[INDIRECT_MAX_MESHES];
+   GLfloat      *verts;               /* position and normal, until */
+   GLuint       *indices;             /* indirectCompile() */
+   GLuint        vertexCount, indexTotal;
+
+   IndirectInstance *instances;       /* added this frame */
+   unsigned char    *meshOf;
+   int           count, capacity;
+   StreamBuffer  stream;
+   IndirectStats stats;
+} IndirectBatch;
+
+void indirectInit(IndirectBatch *b);
+void indirectFree(IndirectBatch *b);
+
+/*  Add a mesh and return its number; then compile once they are all
+ *  in.
+ */
+int indirectAddMesh(IndirectBatch *b, const MeshBuilder *mb);
+void indirectCompile(IndirectBatch *b);
+
+/*  Use a way of drawing no better than the best available, and
+ *  return the one in use.
+ */
+int indirectSetMethod(IndirectBatch *b, int method);
+const char *indirectMethodName(int method);
+
+/*  A frame: begin, add the instances, then draw them all.  Matrices
+ *  are multiplied onto the current modelview matrix.
+ */
+void indirectBegin(IndirectBatch *b);
+void indirectAdd(IndirectBatch *b, int mesh, const GLfloat matrix[16],
+                 const GLfloat color[4]);
+void indirectDraw(IndirectBatch *b);
+
+void indirectPrintStats(const char *name, const IndirectBatch *b);
+
+#endif
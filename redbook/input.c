@@ -0,0 +1,247 @@
+/*
+ *  input.c
+ *  Input queue with latency measurement.  See input.h.
+ *
+ *  The retrace is measured by drawing frames back to back and taking
+ *  the median time between their presents, which a late wakeup or two
+ *  does not move; swaps that are not held to the retrace come much
+ *  faster than any display refreshes, and then there is nothing to
+ *  wait for.  Every present afterwards marks
+ *  the phase of the retrace for the next frame, and nudges the period
+ *  when it falls a whole number of retraces after the last one.  How
+ *  long a frame takes to draw is the recent worst, decaying slowly,
+ *  so that one quick frame does not make the next one late.
+ */
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "input.h"
+#include "timer.h"
+
+#define SHORTEST_RETRACE  0.004     /* faster is not synchronized */
+
+static void push(InputQueue *q, int type, int key, int x, int y)
+{
+   InputEvent *e;
+
+   q->received++;
+   if (q->count == INPUT_QUEUE) {
+      q->dropped++;
+      return;
+   }
+   e = &q->events[(q->head + q->count) % INPUT_QUEUE];
+   e->type = type;
+   e->key = key;
+   e->x = x;
+   e->y = y;
+   e->time = timerSeconds();
+   q->count++;
+   inputRequestFrame(q);
+}
+
+void inputKeyboard(InputQueue *q, unsigned char key, int x, int y)
+{
+   push(q, INPUT_KEY, key, x, y);
+}
+
+void inputSpecial(InputQueue *q, int key, int x, int y)
+{
+   push(q, INPUT_SPECIAL, key, x, y);
+}
+
+static void redisplay(int value)
+{
+   glutPostRedisplay();
+}
+
+void inputRequestFrame(InputQueue *q)
+{
+   double now, lead, wait;
+   long n;
+
+   if (q->scheduled)
+      return;
+   q->scheduled = 1;
+   q->target = 0;
+   if (!q->lowLatency || q->calibrating || q->period == 0 ||
+       q->lastPresent == 0) {
+      glutPostRedisplay();
+      return;
+   }
+
+/*  the first retrace that leaves time enough to draw  */
+   now = timerSeconds();
+   lead = q->renderTime + INPUT_MARGIN;
+   n = (long) ceil((now + lead - q->lastPresent) / q->period);
+   q->target = q->lastPresent + n * q->period;
+   wait = q->target - lead - now;
+   if (wait < 0.001) {
+      glutPostRedisplay();
+      return;
+   }
+   q->waited += wait;
+   glutTimerFunc((unsigned) (wait * 1000.0), redisplay, 0);
+}
+
+void inputBeginFrame(InputQueue *q)
+{
+   q->frameStart = timerSeconds();
+   q->nApplied = 0;
+}
+
+int inputPoll(InputQueue *q, InputEvent *e)
+{
+   if (q->count == 0)
+      return 0;
+   *e = q->events[q->head];
+   q->head = (q->head + 1) % INPUT_QUEUE;
+   q->count--;
+   q->applied[q->nApplied++] = e->time;
+   return 1;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+   double x = *(const double *) a, y = *(const double *) b;
+
+   return x < y ? -1 : x > y;
+}
+
+static void record(InputQueue *q, double latency)
+{
+   int bin = (int) (latency * 1000.0);
+
+   q->samples++;
+   q->sum += latency;
+   q->sumSquares += latency * latency;
+   if (latency > q->worst)
+      q->worst = latency;
+   q->histogram[bin < INPUT_HISTOGRAM ? bin : INPUT_HISTOGRAM]++;
+}
+
+/*  Follow the retrace from the time a frame was shown.  */
+static void track(InputQueue *q, double present)
+{
+   double interval = present - q->lastPresent;
+   long n;
+
+   if (q->calibrating) {
+      n = INPUT_CALIBRATE - q->calibrating--;
+      q->intervals[n] = q->lastPresent > 0 ? interval : 1e9;
+      if (q->calibrating == 0) {
+         qsort(q->intervals, INPUT_CALIBRATE, sizeof(double),
+               compareDoubles);
+         interval = q->intervals[INPUT_CALIBRATE / 2 - 1];
+         q->period = interval >= SHORTEST_RETRACE ? interval : 0;
+         if (q->period > 0)
+            printf("retrace every %.2f ms\n", q->period * 1000.0);
+         else
+            printf("swaps are not synchronized to the retrace\n");
+      }
+      return;
+   }
+   if (q->period == 0 || q->lastPresent == 0)
+      return;
+   if (q->target > 0 && present > q->target + q->period / 2)
+      q->missed++;
+   n = (long) floor(interval / q->period + 0.5);
+   if (n >= 1 && n <= 1000 &&
+       fabs(interval - n * q->period) < q->period / 8)
+      q->period += (interval / n - q->period) * 0.05;
+}
+
+void inputSwapBuffers(InputQueue *q)
+{
+   double present, render;
+   int i;
+
+   glFinish();
+   q->renderEnd = timerSeconds();
+   glutSwapBuffers();
+   glFinish();
+   present = timerSeconds();
+
+   render = q->renderEnd - q->frameStart;
+   if (render > q->renderTime)
+      q->renderTime = render;
+   else
+      q->renderTime += (render - q->renderTime) * 0.05;
+   for (i = 0; i < q->nApplied; i++)
+      record(q, present - q->applied[i]);
+   q->nApplied = 0;
+   q->frames++;
+
+   track(q, present);
+   q->lastPresent = present;
+   q->scheduled = 0;
+   if (q->calibrating) {
+      q->scheduled = 1;
+      glutPostRedisplay();
+   } else if (q->count > 0) {
+      inputRequestFrame(q);
+   }
+}
+
+void inputSetLowLatency(InputQueue *q, int on)
+{
+   q->lowLatency = on;
+   if (on) {
+      q->calibrating = INPUT_CALIBRATE;
+      q->lastPresent = 0;
+      q->scheduled = 1;
+      glutPostRedisplay();
+   }
+}
+
+void inputInit(InputQueue *q)
+{
+   memset(q, 0, sizeof(InputQueue));
+   inputResetStats(q);
+}
+
+void inputResetStats(InputQueue *q)
+{
+   q->received = q->dropped = q->frames = q->missed = 0;
+   q->samples = 0;
+   q->sum = q->sumSquares = q->worst = 0;
+   q->waited = 0;
+   memset(q->histogram, 0, sizeof(q->histogram));
+}
+
+/*  Upper end in milliseconds of the bin holding the fraction p.  */
+static int percentile(const InputQueue *q, double p)
+{
+   unsigned long need = (unsigned long) ceil(q->samples * p), seen = 0;
+   int i;
+
+   for (i = 0; i < INPUT_HISTOGRAM; i++) {
+      seen += q->histogram[i];
+      if (seen >= need)
+         return i + 1;
+   }
+   return INPUT_HISTOGRAM;
+}
+
+void inputPrintStats(const char *name, const InputQueue *q)
+{
+   double mean = 0, deviation = 0;
+
+   if (q->samples) {
+      mean = q->sum / q->samples;
+      deviation = sqrt(fabs(q->sumSquares / q->samples - mean * mean));
+   }
+   printf("%s: %lu events in %lu frames, %lu dropped\n", name, q->received,
+          q->frames, q->dropped);
+   if (q->samples)
+      printf("   input to frame %.2f ms mean, jitter %.2f ms, under %d ms "
+             "for half, %d ms for 99%%, worst %.2f ms\n", mean * 1000.0,
+             deviation * 1000.0, percentile(q, 0.5), percentile(q, 0.99),
+             q->worst * 1000.0);
+   if (q->lowLatency)
+      printf("   low latency: retrace %.2f ms, drawing %.2f ms, %.2f ms "
+             "waited per frame, %lu late\n", q->period * 1000.0,
+             q->renderTime * 1000.0,
+             q->frames ? q->waited * 1000.0 / q->frames : 0.0, q->missed);
+}
@@ -0,0 +1,97 @@
+/*
+ *  input.h
+ *  Input queue with latency measurement for GLUT programs.  The
+ *  keyboard callbacks only stamp each event with the time it arrived
+ *  and queue it; display() takes the events from the queue and applies
+ *  them to the frame it draws, and after the swap the time from each
+ *  event to the completed frame is recorded.  GLUT does not pass on
+ *  the time of the system event, so arrival is when the callback ran.
+ *
+ *  Frames are drawn only when an event asks for one.  Normally the
+ *  frame is drawn as soon as GLUT gets to the redisplay.  In low
+ *  latency mode it is put off until just in time for the next
+ *  vertical retrace, predicted from the frames before, so that input
+ *  is sampled as late as possible and the events that arrive in the
+ *  meantime reach the screen in the same frame.  The wait is a GLUT
+ *  timer, so events keep being queued while it runs.
+ *
+ *  The frame is complete when glFinish() after the swap returns,
+ *  which with the swap synchronized to the retrace is when it is
+ *  shown.  Finishing also keeps the driver from queueing frames ahead.
+ */
+#ifndef INPUT_H
+#define INPUT_H
+
+#define INPUT_QUEUE       64
+#define INPUT_MARGIN      0.002     /* seconds of slack before a retrace */
+#define INPUT_CALIBRATE   16        /* frames to measure the retrace */
+#define INPUT_HISTOGRAM   100       /* 1 ms bins of latency */
+
+enum {
+   INPUT_KEY,
+   INPUT_SPECIAL
+};
+
+typedef struct inputevent {
+   int     type;
+   int     key;
+   int     x, y;
+   double  time;                    /* arrival, timerSeconds() */
+} InputEvent;
+
+typedef struct inputqueue {
+   InputEvent     events[INPUT_QUEUE];
+   int            head, count;
+   int            lowLatency;
+
+   /* the frame being drawn */
+   double         applied[INPUT_QUEUE];     /* arrival of its events */
+   int            nApplied;
+   double         frameStart, renderEnd;
+   int            scheduled;                /* a frame is requested */
+   double         target;                   /* retrace it aims at */
+
+   /* retrace prediction */
+   double         period;                   /* 0 if not synchronized */
+   double         lastPresent;
+   double         renderTime;               /* recent worst, seconds */
+   int            calibrating;
+   double         intervals[INPUT_CALIBRATE];
+
+   /* since inputResetStats() */
+   unsigned long  received, dropped, frames, missed;
+   unsigned long  samples;
+   double         sum, sumSquares, worst;   /* latency, seconds */
+   double         waited;                   /* put off in total */
+   unsigned long  histogram[INPUT_HISTOGRAM + 1];
+} InputQueue;
+
+void inputInit(InputQueue *q);
+
+/*  Queue an event from a GLUT keyboard or special callback and ask
+ *  for a frame.  An event that finds the queue full is dropped.
+ */
+void inputKeyboard(InputQueue *q, unsigned char key, int x, int y);
+void inputSpecial(InputQueue *q, int key, int x, int y);
+
+/*  Ask for a frame without an event, e.g. after a reshape.  */
+void inputRequestFrame(InputQueue *q);
+
+/*  Call at the start of display(); then take the events with
+ *  inputPoll() until it returns 0 and draw.
+ */
+void inputBeginFrame(InputQueue *q);
+int inputPoll(InputQueue *q, InputEvent *e);
+
+/*  Call instead of glutSwapBuffers().  */
+void inputSwapBuffers(InputQueue *q);
+
+/*  Switch low latency mode; turning it on measures the retrace over
+ *  the next INPUT_CALIBRATE frames, which are drawn back to back.
+ */
+void inputSetLowLatency(InputQueue *q, int on);
+
+void inputResetStats(InputQueue *q);
+void inputPrintStats(const char *name, const InputQueue *q);
+
+#endif
@@ -0,0 +1,308 @@
+/*
+ *  jobs.c
+ *  Worker thread pool.  See jobs.h.
+ *
+ *  Batches wait in a FIFO list guarded by one mutex.  A worker takes
+ *  the next index of the first batch; the batch leaves the list once
+ *  its last index has been handed out and goes onto a free list,
+ *  under the same mutex, when its last job has finished, so batches
+ *  are only allocated while the queue grows.  Win32 threads and
+ *  condition variables are used on Windows, POSIX threads elsewhere.
+ */
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include "jobs.h"
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+#define THREAD_FUNC DWORD WINAPI
+#define THREAD_RETURN 0
+static CRITICAL_SECTION lock;
+static CONDITION_VARIABLE work, done;
+static DWORD indexKey;
+#define LOCK()           EnterCriticalSection(&lock)
+#define UNLOCK()         LeaveCriticalSection(&lock)
+#define WAIT(cond)       SleepConditionVariableCS(&(cond), &lock, INFINITE)
+#define BROADCAST(cond)  WakeAllConditionVariable(&(cond))
+#define SET_INDEX(p)     TlsSetValue(indexKey, (p))
+#define GET_INDEX()      TlsGetValue(indexKey)
+#else
+typedef pthread_t Thread;
+#define THREAD_FUNC void *
+#define THREAD_RETURN NULL
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static pthread_key_t indexKey;
+#define LOCK()           pthread_mutex_lock(&lock)
+#define UNLOCK()         pthread_mutex_unlock(&lock)
+#define WAIT(cond)       pthread_cond_wait(&(cond), &lock)
+#define BROADCAST(cond)  pthread_cond_broadcast(&(cond))
+#define SET_INDEX(p)     pthread_setspecific(indexKey, (p))
+#define GET_INDEX()      pthread_getspecific(indexKey)
+#endif
+
+#define MAX_THREADS 64
+
+typedef struct batch {
+   JobFunc       fn;
+   void         *user;
+   int           count;
+   int           next;
+   int           running;
+   JobGroup     *group;
+   struct batch *link;
+} Batch;
+
+static Thread threads[MAX_THREADS];
+static int nthreads;
+static int started, quitting;
+static Batch *head, *tail;
+static Batch *freeBatches;
+
+/*  Called with the lock held.  */
+static Batch *newBatch(void)
+{
+   Batch *b = freeBatches;
+
+   if (b != NULL) {
+      freeBatches = b->link;
+      return b;
+   }
+   b = (Batch *) malloc(sizeof(Batch));
+   if (b == NULL) {
+      printf("jobs: out of memory\n");
+      exit(1);
+   }
+   return b;
+}
+
+static void freeBatch(Batch *b)
+{
+   b->link = freeBatches;
+   freeBatches = b;
+}
+
+/*  Take one job off the queue; called with the lock held.  */
+static Batch *takeJob(int *index)
+{
+   Batch *b = head;
+
+   if (b == NULL)
+      return NULL;
+   *index = b->next++;
+   b->running++;
+   if (b->next == b->count) {
+      head = b->link;
+      if (head == NULL)
+         tail = NULL;
+   }
+   return b;
+}
+
+/*  Run a job taken with takeJob(); called with the lock held and
+ *  returns with it held.
+ */
+static void runJob(Batch *b, int index)
+{
+   UNLOCK();
+   b->fn(index, b->user);
+   LOCK();
+
+   b->running--;
+   if (--b->group->pending == 0)
+      BROADCAST(done);
+   if (b->next == b->count && b->running == 0)
+      freeBatch(b);
+}
+
+static THREAD_FUNC worker(void *arg)
+{
+   Batch *b;
+   int index;
+
+   SET_INDEX(arg);
+   LOCK();
+   while (!quitting) {
+      b = takeJob(&index);
+      if (b == NULL) {
+         WAIT(work);
+         continue;
+      }
+      runJob(b, index);
+   }
+   UNLOCK();
+   return THREAD_RETURN;
+}
+
+static int processorCount(void)
+{
+#ifdef _WIN32
+   SYSTEM_INFO info;
+
+   GetSystemInfo(&info);
+   return (int) info.dwNumberOfProcessors;
+#else
+   return (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+static int startThread(Thread *t, long index)
+{
+#ifdef _WIN32
+   *t = CreateThread(NULL, 0, worker, (void *) (size_t) index, 0, NULL);
+   return *t != NULL;
+#else
+   return pthread_create(t, NULL, worker, (void *) (size_t) index) == 0;
+#endif
+}
+
+void jobsInit(int n)
+{
+   long i;
+
+   if (started)
+      return;
+   if (n <= 0)
+      n = processorCount();
+   if (n < 1)
+      n = 1;
+   if (n > MAX_THREADS)
+      n = MAX_THREADS;
+#ifdef _WIN32
+   InitializeCriticalSection(&lock);
+   InitializeConditionVariable(&work);
+   InitializeConditionVariable(&done);
+   indexKey = TlsAlloc();
+#else
+   pthread_key_create(&indexKey, NULL);
+#endif
+   quitting = 0;
+   for (i = 0; i < n; i++) {
+      if (!startThread(&threads[i], i + 1)) {
+         printf("jobsInit: cannot create thread\n");
+         exit(1);
+      }
+   }
+   nthreads = n;
+   started = 1;
+}
+
+void jobsShutdown(void)
+{
+   int i;
+
+   if (!started)
+      return;
+   LOCK();
+   quitting = 1;
+   BROADCAST(work);
+   UNLOCK();
+   for (i = 0; i < nthreads; i++) {
+#ifdef _WIN32
+      WaitForSingleObject(threads[i], INFINITE);
+      CloseHandle(threads[i]);
+#else
+      pthread_join(threads[i], NULL);
+#endif
+   }
+   while (freeBatches != NULL) {
+      Batch *b = freeBatches;
+
+      freeBatches = b->link;
+      free(b);
+   }
+   nthreads = 0;
+   started = 0;
+}
+
+int jobsThreadCount(void)
+{
+   if (!started)
+      jobsInit(0);
+   return nthreads;
+}
+
+int jobsThreadIndex(void)
+{
+   if (!started)
+      return 0;
+   return (int) (size_t) GET_INDEX();
+}
+
+void jobsSubmit(JobGroup *g, int count, JobFunc fn, void *user)
+{
+   Batch *b;
+
+   if (count <= 0)
+      return;
+   if (!started)
+      jobsInit(0);
+   LOCK();
+   b = newBatch();
+   b->fn = fn;
+   b->user = user;
+   b->count = count;
+   b->next = 0;
+   b->running = 0;
+   b->group = g;
+   b->link = NULL;
+   g->pending += count;
+   if (tail)
+      tail->link = b;
+   else
+      head = b;
+   tail = b;
+   BROADCAST(work);
+   UNLOCK();
+}
+
+/*  Help with queued work until the group is finished.  */
+void jobsWait(JobGroup *g)
+{
+   Batch *b;
+   int index;
+
+   if (!started)
+      return;
+   LOCK();
+   while (g->pending > 0) {
+      b = takeJob(&index);
+      if (b != NULL)
+         runJob(b, index);
+      else
+         WAIT(done);
+   }
+   UNLOCK();
+}
+
+int jobsDone(JobGroup *g)
+{
+   int pending;
+
+   if (!started)
+      return g->pending == 0;
+   LOCK();
+   pending = g->pending;
+   UNLOCK();
+   return pending == 0;
+}
+
+void jobsParallelFor(int count, JobFunc fn, void *user)
+{
+   JobGroup g;
+
+   if (count == 1) {
+      fn(0, user);
+      return;
+   }
+   g.pending = 0;
+   jobsSubmit(&g, count, fn, user);
+   jobsWait(&g);
+}
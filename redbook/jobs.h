@@ -0,0 +1,41 @@
+/*
+ *  jobs.h
+ *  A small worker thread pool.  Work is submitted as a batch of
+ *  indexed jobs, fn(0, user) .. fn(count - 1, user), which the
+ *  workers pick up in order.  A JobGroup counts the jobs that are
+ *  still outstanding so a caller can overlap its own work with the
+ *  batch and wait for it later; jobsParallelFor() is the blocking
+ *  form, in which the calling thread works on the batch as well.
+ *
+ *  Jobs are meant to be coarse: split fine-grained loops into a few
+ *  chunks per thread.
+ */
+#ifndef JOBS_H
+#define JOBS_H
+
+typedef void (*JobFunc)(int index, void *user);
+
+typedef struct jobgroup {
+   int pending;
+} JobGroup;
+
+/*  Start the pool; threads <= 0 uses one worker per processor.
+ *  Called implicitly by the first submission.
+ */
+void jobsInit(int threads);
+void jobsShutdown(void);
+int jobsThreadCount(void);
+
+void jobsSubmit(JobGroup *g, int count, JobFunc fn, void *user);
+void jobsWait(JobGroup *g);
+int jobsDone(JobGroup *g);
+
+void jobsParallelFor(int count, JobFunc fn, void *user);
+
+/*  Index of the calling thread: 0 for threads outside the pool,
+ *  1 .. jobsThreadCount() for the workers.  Useful for per-thread
+ *  scratch data.
+ */
+int jobsThreadIndex(void);
+
+#endif
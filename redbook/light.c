@@ -40,20 +40,46 @@
  *  This program demonstrates the use of the OpenGL lighting
  *  model.  A sphere is drawn using a grey material characteristic.
  *  A single light source illuminates the object.
+ *
+ *  Each click turns the lights by 30 degrees.  The turn is animated
+ *  in fixed ticks of a game loop (loop.h), which stops once the
+ *  lights are in place.
  */
 #include <GL/glut.h>
 #include <stdlib.h>
+#include "loop.h"
+
+#define TICK_RATE  60.0
+#define FRAME_RATE 60.0
+#define SPIN_SPEED 240.0    /* degrees a second */
 
 /*  Initialize material property, light source, lighting model,
  *  and depth buffer.
  */
 
-static int spin = 0;
+static GLdouble spin = 0, lastSpin = 0, targetSpin = 0;
 static int lights_on = 1;
+static GameLoop loop;
 
 static void update_spin(void)
 {
-   spin = (spin + 30) % 360;
+   targetSpin += 30;
+   loopStart(&loop);
+}
+
+static void turn(double dt)
+{
+   lastSpin = spin;
+   spin += SPIN_SPEED * dt;
+   if (spin >= targetSpin) {
+      spin = targetSpin;
+      loopStop(&loop);
+   }
+   if (lastSpin >= 360) {
+      spin -= 360;
+      lastSpin -= 360;
+      targetSpin -= 360;
+   }
 }
 
 void init(void)
@@ -90,6 +116,8 @@ void init(void)
    glEnable(GL_LIGHT1);
    glEnable(GL_LIGHT2);
    glEnable(GL_DEPTH_TEST);
+
+   loopInit(&loop, TICK_RATE, FRAME_RATE, turn);
 }
 
 void display(void)
@@ -97,6 +125,7 @@ void display(void)
    GLfloat red_position[] = {0.0, 2.0, 0.0, 1.0};
    GLfloat green_position[] = {2.0, 0.0, 0.0, 1.0};
    GLfloat blue_position[] = {-2.0, 0.0, 0.0, 1.0};
+   GLdouble angle = lastSpin + (spin - lastSpin) * loopAlpha(&loop);
 
    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
    glPushMatrix();
@@ -116,17 +145,17 @@ void display(void)
    }
 
    glPushMatrix();
-   glRotated((GLdouble)spin, 1.0, 0.0, 0.0);
+   glRotated(angle, 1.0, 0.0, 0.0);
    glLightfv(GL_LIGHT0, GL_POSITION, red_position);
    glPopMatrix();
 
    glPushMatrix();
-   glRotated((GLdouble)spin, 0.0, 1.0, 0.0);
+   glRotated(angle, 0.0, 1.0, 0.0);
    glLightfv(GL_LIGHT1, GL_POSITION, green_position);
    glPopMatrix();
 
    glPushMatrix();
-   glRotated((GLdouble)spin, 0.0, 0.0, 1.0);
+   glRotated(angle, 0.0, 0.0, 1.0);
    glLightfv(GL_LIGHT2, GL_POSITION, blue_position);
    glPopMatrix();
 
@@ -37,30 +37,44 @@
 
 /*
  *  list.c
- *  This program demonstrates how to make and execute a 
- *  display list.  Note that attributes, such as current 
- *  color and matrix, are changed.
+ *  This program demonstrates how to make and draw a mesh
+ *  object.  Note that attributes, such as current color
+ *  and matrix, are changed by drawTriangle().
  */
+#define GL_GLEXT_PROTOTYPES
 #include <GL/glut.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include "mesh.h"
 
-GLuint listName;
+#ifdef GL_VERSION_1_5
+Mesh triangle;
 
 static void init (void)
 {
-   listName = glGenLists (1);
-   glNewList (listName, GL_COMPILE);
-      glColor3f (1.0, 0.0, 0.0);  /*  current color red  */
-      glBegin (GL_TRIANGLES);
-      glVertex2f (0.0, 0.0);
-      glVertex2f (1.0, 0.0);
-      glVertex2f (0.0, 1.0);
-      glEnd ();
-      glTranslatef (1.5, 0.0, 0.0); /*  move position  */
-   glEndList ();
+   static const GLfloat v[3][3] = {
+      { 0.0, 0.0, 0.0 }, { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }
+   };
+   MeshBuilder b;
+   int i;
+
+   meshBuilderInit (&b, 0);
+   meshBegin (&b, GL_TRIANGLES);
+   for (i = 0; i < 3; i++)
+      meshIndex (&b, meshVertex (&b, v[i], NULL, NULL));
+   meshEnd (&b);
+   meshCompile (&triangle, &b);
+   meshBuilderFree (&b);
    glShadeModel (GL_FLAT);
 }
 
+static void drawTriangle (void)
+{
+   glColor3f (1.0, 0.0, 0.0);  /*  current color red  */
+   meshDraw (&triangle);
+   glTranslatef (1.5, 0.0, 0.0); /*  move position  */
+}
+
 static void drawLine (void)
 {
    glBegin (GL_LINES);
@@ -76,7 +90,7 @@ void display(void)
    glClear (GL_COLOR_BUFFER_BIT);
    glColor3f (0.0, 1.0, 0.0);  /*  current color green  */
    for (i = 0; i < 10; i++)    /*  draw 10 triangles    */
-      glCallList (listName);
+      drawTriangle ();
    drawLine ();  /*  is this line green?  NO!  */
                  /*  where is the line drawn?  */
    glFlush ();
@@ -122,3 +136,12 @@ int main(int argc, char** argv)
    glutMainLoop();
    return 0;
 }
+#else
+int main(int argc, char** argv)
+{
+    fprintf (stderr, "This program demonstrates a feature which is not in OpenGL before Version 1.5.\n");
+    fprintf (stderr, "If your implementation has the ARB_vertex_buffer_object extension,\n");
+    fprintf (stderr, "you may be able to modify this program to make it run.\n");
+    return 0;
+}
+#endif
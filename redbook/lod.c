@@ -0,0 +1,278 @@
+/*
+ *  lod.c
+ *  Levels of detail for generated meshes.  See lod.h.
+ *
+ *  An arc of radius r cut into segments of angle a is off the true
+ *  curve by at most r (1 - cos(a / 2)) in the middle of a segment;
+ *  the error of a level is that sum over its two directions.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "lod.h"
+#include "shapes.h"
+
+#define PI_ 3.14159265358979323846
+
+void lodInit(LodManager *lm)
+{
+   memset(lm, 0, sizeof(LodManager));
+   lm->tolerance = LOD_TOLERANCE;
+   lm->hysteresis = LOD_HYSTERESIS;
+   lm->enabled = 1;
+}
+
+void lodResetStats(LodManager *lm)
+{
+   lm->instances = 0;
+   lm->triangles = lm->fullTriangles = 0;
+   memset(lm->levelInstances, 0, sizeof(lm->levelInstances));
+}
+
+void lodPrintStats(const char *name, const LodManager *lm)
+{
+   int i;
+
+   printf("%s: %lu instances, %lu triangles of %lu", name,
+          lm->instances, lm->triangles, lm->fullTriangles);
+   if (lm->fullTriangles)
+      printf(" (%.1f%% saved)",
+             100.0 * (lm->fullTriangles - lm->triangles) / lm->fullTriangles);
+   printf("\n   instances per level:");
+   for (i = 0; i < LOD_MAX_LEVELS; i++)
+      printf(" %lu", lm->levelInstances[i]);
+   printf("\n");
+}
+
+static GLuint triangleCount(const MeshBuilder *b)
+{
+   GLuint n = 0;
+   int i;
+
+   for (i = 0; i < b->rangeCount; i++) {
+      const MeshRange *r = &b->ranges[i];
+
+      if (r->mode == GL_TRIANGLES)
+         n += r->count / 3;
+      else if (r->count >= 3 &&
+               (r->mode == GL_TRIANGLE_STRIP || r->mode == GL_TRIANGLE_FAN))
+         n += r->count - 2;
+   }
+   return n;
+}
+
+static GLfloat arcError(GLfloat radius, GLfloat angle, int segments)
+{
+   return radius * (GLfloat) (1 - cos(angle / (2 * segments)));
+}
+
+void lodBuild(LodMesh *m, int attribs, const LodShape *s,
+              LodBuildFunc build, void *data)
+{
+   int u = s->u, v = s->v;
+
+   memset(m, 0, sizeof(LodMesh));
+   m->bound = s->bound;
+   for (;;) {
+      MeshBuilder b;
+      int i = m->levelCount++;
+
+      meshBuilderInit(&b, attribs);
+      build(&b, i, u, v, data);
+      m->triangles[i] = triangleCount(&b);
+      meshCompile(&m->levels[i], &b);
+      meshBuilderFree(&b);
+      m->u[i] = u;
+      m->v[i] = v;
+      m->error[i] = arcError(s->radiusU, s->angleU, u) +
+                    arcError(s->radiusV, s->angleV, v);
+
+      if (m->levelCount == LOD_MAX_LEVELS ||
+          (u <= s->minU && v <= s->minV))
+         break;
+      u = (u + 1) / 2 > s->minU ? (u + 1) / 2 : s->minU;
+      v = (v + 1) / 2 > s->minV ? (v + 1) / 2 : s->minV;
+   }
+}
+
+void lodFree(LodMesh *m)
+{
+   int i;
+
+   for (i = 0; i < m->levelCount; i++)
+      meshRelease(&m->levels[i]);
+   m->levelCount = 0;
+}
+
+/*
+ *  Shapes
+ */
+typedef struct shapeparams {
+   GLdouble a, b, c;
+} ShapeParams;
+
+static void buildSphere(MeshBuilder *b, int level, int u, int v, void *data)
+{
+   ShapeParams *p = (ShapeParams *) data;
+
+   shapeSphere(b, p->a, u, v);
+}
+
+static void buildCylinder(MeshBuilder *b, int level, int u, int v,
+                          void *data)
+{
+   ShapeParams *p = (ShapeParams *) data;
+
+   shapeCylinder(b, p->a, p->b, p->c, u, v);
+}
+
+static void buildDisk(MeshBuilder *b, int level, int u, int v, void *data)
+{
+   ShapeParams *p = (ShapeParams *) data;
+
+   shapeDisk(b, p->a, p->b, u, v);
+}
+
+static void buildTorus(MeshBuilder *b, int level, int u, int v, void *data)
+{
+   ShapeParams *p = (ShapeParams *) data;
+
+   shapeTorus(b, p->a, p->b, u, v);
+}
+
+static void shape(LodShape *s, int u, int v, int minU, int minV)
+{
+   memset(s, 0, sizeof(LodShape));
+   s->u = u;
+   s->v = v;
+   s->minU = u < minU ? u : minU;
+   s->minV = v < minV ? v : minV;
+}
+
+/*  u is around the axis, v from pole to pole.  */
+void lodSphere(LodMesh *m, GLdouble radius, int slices, int stacks)
+{
+   ShapeParams p;
+   LodShape s;
+
+   p.a = radius;
+   shape(&s, slices, stacks, 4, 2);
+   s.radiusU = s.radiusV = (GLfloat) radius;
+   s.angleU = (GLfloat) (2 * PI_);
+   s.angleV = (GLfloat) PI_;
+   s.bound = (GLfloat) radius;
+   lodBuild(m, MESH_NORMAL, &s, buildSphere, &p);
+}
+
+void lodCylinder(LodMesh *m, GLdouble base, GLdouble top, GLdouble height,
+                 int slices, int stacks)
+{
+   GLdouble r = base > top ? base : top;
+   ShapeParams p;
+   LodShape s;
+
+   p.a = base;
+   p.b = top;
+   p.c = height;
+   shape(&s, slices, stacks, 3, 1);
+   s.radiusU = (GLfloat) r;
+   s.angleU = (GLfloat) (2 * PI_);
+   s.bound = (GLfloat) sqrt(r * r + height * height);
+   lodBuild(m, MESH_NORMAL, &s, buildCylinder, &p);
+}
+
+void lodDisk(LodMesh *m, GLdouble inner, GLdouble outer, int slices,
+             int loops)
+{
+   ShapeParams p;
+   LodShape s;
+
+   p.a = inner;
+   p.b = outer;
+   shape(&s, slices, loops, 3, 1);
+   s.radiusU = (GLfloat) outer;
+   s.angleU = (GLfloat) (2 * PI_);
+   s.bound = (GLfloat) outer;
+   lodBuild(m, MESH_NORMAL, &s, buildDisk, &p);
+}
+
+/*  u is around the tube, v around the hole.  */
+void lodTorus(LodMesh *m, GLdouble inner, GLdouble outer, int sides,
+              int rings)
+{
+   ShapeParams p;
+   LodShape s;
+
+   p.a = inner;
+   p.b = outer;
+   shape(&s, sides, rings, 3, 3);
+   s.radiusU = (GLfloat) inner;
+   s.radiusV = (GLfloat) (outer + inner);
+   s.angleU = s.angleV = (GLfloat) (2 * PI_);
+   s.bound = (GLfloat) (outer + inner);
+   lodBuild(m, MESH_NORMAL, &s, buildTorus, &p);
+}
+
+/*
+ *  Selection
+ */
+GLfloat lodPixelScale(GLfloat bound)
+{
+   GLfloat mv[16], p[16], scale = 0, w;
+   GLint viewport[4];
+   int i;
+
+   glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+   glGetFloatv(GL_PROJECTION_MATRIX, p);
+   glGetIntegerv(GL_VIEWPORT, viewport);
+   for (i = 0; i < 3; i++) {
+      GLfloat len = mv[i * 4] * mv[i * 4] + mv[i * 4 + 1] * mv[i * 4 + 1] +
+                    mv[i * 4 + 2] * mv[i * 4 + 2];
+
+      if (len > scale)
+         scale = len;
+   }
+   scale = (GLfloat) sqrt(scale);
+
+/*  clip w of the origin, less the bound along the view direction  */
+   w = p[3] * mv[12] + p[7] * mv[13] + p[11] * mv[14] + p[15];
+   w -= bound * scale * (GLfloat) fabs(p[11]);
+   if (w <= 1e-6f)
+      return 1e30f;
+   return scale * (GLfloat) fabs(p[5]) * viewport[3] * 0.5f / w;
+}
+
+int lodSelect(const LodManager *lm, const LodMesh *m, GLfloat scale,
+              int *level)
+{
+   int best = 0, relaxed = 0, i;
+
+   if (!lm->enabled) {
+      *level = 0;
+      return 0;
+   }
+   for (i = 1; i < m->levelCount; i++) {
+      if (m->error[i] * scale <= lm->tolerance)
+         best = i;
+      if (m->error[i] * scale <= lm->tolerance * (1 - lm->hysteresis))
+         relaxed = i;
+   }
+   if (*level >= 0 && best > *level)
+      best = relaxed > *level ? relaxed : *level;
+   *level = best;
+   return best;
+}
+
+int lodDraw(LodManager *lm, const LodMesh *m, int *level)
+{
+   int i = lodSelect(lm, m, lodPixelScale(m->bound), level);
+
+   meshDraw(&m->levels[i]);
+   lm->instances++;
+   lm->triangles += m->triangles[i];
+   lm->fullTriangles += m->triangles[0];
+   lm->levelInstances[i]++;
+   return i;
+}
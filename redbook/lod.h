@@ -0,0 +1,101 @@
+/*
+ *  lod.h
+ *  Levels of detail for generated meshes.  A LodMesh holds up to
+ *  LOD_MAX_LEVELS tessellations of one shape, each with about half
+ *  the segments of the level before in both directions, and for each
+ *  the largest distance between the true surface and its facets.
+ *  When an instance is drawn that error is projected to pixels at
+ *  the nearest point of the shape's bounding sphere, and the coarsest
+ *  level within the manager's tolerance is drawn.
+ *
+ *  Each instance keeps its level in an int owned by the caller, -1
+ *  at first.  It moves to a finer level as soon as its level is out
+ *  of tolerance, but to a coarser one only once that is within
+ *  tolerance * (1 - hysteresis), so that an instance at a boundary
+ *  does not switch back and forth.
+ *
+ *  Requires OpenGL 1.5 buffer objects (mesh.h).
+ */
+#ifndef LOD_H
+#define LOD_H
+
+#include "mesh.h"
+
+#define LOD_MAX_LEVELS  6
+#define LOD_TOLERANCE   0.5f    /* pixels */
+#define LOD_HYSTERESIS  0.25f
+
+/*  Build the shape with u by v segments into b; level 0 is the
+ *  finest.
+ */
+typedef void (*LodBuildFunc)(MeshBuilder *b, int level, int u, int v,
+                             void *data);
+
+/*  The segments of the finest and coarsest levels in the two
+ *  directions of a shape.  The curvature in each direction is given
+ *  as the radius of the arc and the angle all its segments span; the
+ *  radius is 0 in a straight direction.  bound is the radius of a
+ *  sphere around the origin that holds the shape.
+ */
+typedef struct lodshape {
+   int      u, v, minU, minV;
+   GLfloat  radiusU, radiusV;
+   GLfloat  angleU, angleV;
+   GLfloat  bound;
+} LodShape;
+
+typedef struct lodmesh {
+   Mesh     levels[LOD_MAX_LEVELS];
+   int      u[LOD_MAX_LEVELS], v[LOD_MAX_LEVELS];
+   GLfloat  error[LOD_MAX_LEVELS];      /* object units */
+   GLuint   triangles[LOD_MAX_LEVELS];
+   int      levelCount;
+   GLfloat  bound;
+} LodMesh;
+
+typedef struct lodmanager {
+   GLfloat        tolerance;            /* pixels */
+   GLfloat        hysteresis;
+   int            enabled;              /* 0 always draws level 0 */
+
+   /* since lodResetStats() */
+   unsigned long  instances;
+   unsigned long  triangles, fullTriangles;
+   unsigned long  levelInstances[LOD_MAX_LEVELS];
+} LodManager;
+
+void lodInit(LodManager *lm);
+void lodResetStats(LodManager *lm);
+void lodPrintStats(const char *name, const LodManager *lm);
+
+void lodBuild(LodMesh *m, int attribs, const LodShape *s,
+              LodBuildFunc build, void *data);
+void lodFree(LodMesh *m);
+
+/*  The shapes of shapes.h, with normals.  */
+void lodSphere(LodMesh *m, GLdouble radius, int slices, int stacks);
+void lodCylinder(LodMesh *m, GLdouble base, GLdouble top, GLdouble height,
+                 int slices, int stacks);
+void lodDisk(LodMesh *m, GLdouble inner, GLdouble outer, int slices,
+             int loops);
+void lodTorus(LodMesh *m, GLdouble inner, GLdouble outer, int sides,
+              int rings);
+
+/*  Pixels per object unit at the nearest point of a sphere of radius
+ *  bound around the origin, under the current GL matrices and
+ *  viewport.  Very large when the sphere reaches the eye.
+ */
+GLfloat lodPixelScale(GLfloat bound);
+
+/*  Choose the level of an instance drawn at the given pixel scale,
+ *  updating *level.
+ */
+int lodSelect(const LodManager *lm, const LodMesh *m, GLfloat scale,
+              int *level);
+
+/*  Select with the current GL state, draw and count an instance;
+ *  returns the level drawn.
+ */
+int lodDraw(LodManager *lm, const LodMesh *m, int *level);
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ *  loop.c
+ *  Fixed timestep main loop.  See loop.h.
+ *
+ *  Each frame is a timer callback: it waits out the rest of the frame,
+ *  runs the ticks that the time since the last frame pays for, posts
+ *  a redisplay and sets a timer for the next frame.  A frame that
+ *  starts after its deadline is late, and the schedule restarts from
+ *  it rather than rushing to catch up.  Timers carry the generation
+ *  of the loop that set them, so a timer left over from before
+ *  loopStop() cannot start a second chain of frames.
+ */
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "loop.h"
+#include "timer.h"
+
+static GameLoop *current;
+static int generation;
+
+static void yieldProcessor(void)
+{
+#ifdef _WIN32
+   Sleep(0);
+#else
+   sched_yield();
+#endif
+}
+
+/*  processor time of the whole process, for the load it puts on it  */
+static double cpuSeconds(void)
+{
+   return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static void step(int value);
+
+static void schedule(GameLoop *l, double now)
+{
+   double wait = l->nextFrame - LOOP_SPIN - now;
+
+   glutTimerFunc(wait > 0 ? (unsigned) (wait * 1000.0) : 0, step,
+                 generation);
+}
+
+static void step(int value)
+{
+   GameLoop *l = current;
+   double now, keep;
+   int n = 0;
+
+   if (l == NULL || !l->running || value != generation)
+      return;
+   now = timerSeconds();
+   if (now < l->nextFrame - LOOP_SPIN) {
+      schedule(l, now);                 /* woke early */
+      return;
+   }
+   while (now < l->nextFrame) {
+      yieldProcessor();
+      now = timerSeconds();
+   }
+
+   l->accumulator += now - l->last;
+   l->last = now;
+   while (l->accumulator >= l->tickTime && n < LOOP_MAX_TICKS &&
+          l->running) {
+      l->tick(l->tickTime);
+      l->accumulator -= l->tickTime;
+      l->ticks++;
+      n++;
+   }
+   if (l->accumulator >= l->tickTime) {
+      keep = fmod(l->accumulator, l->tickTime);
+      l->dropped += l->accumulator - keep;
+      l->accumulator = keep;
+   }
+
+   if (l->lastFrame > 0) {
+      double interval = now - l->lastFrame;
+      double error = fabs(interval - l->frameTime);
+
+      l->intervals++;
+      l->sum += interval;
+      l->sumSquares += interval * interval;
+      if (error > l->worst)
+         l->worst = error;
+   }
+   l->lastFrame = now;
+   l->frames++;
+   l->nextFrame += l->frameTime;
+   if (l->nextFrame <= now) {
+      l->late++;
+      l->nextFrame = now + l->frameTime;
+   }
+
+   glutPostRedisplay();
+   if (l->running)
+      schedule(l, now);
+}
+
+void loopInit(GameLoop *l, double tickRate, double frameRate,
+              LoopTickFunc tick)
+{
+   memset(l, 0, sizeof(GameLoop));
+   l->tickTime = 1.0 / tickRate;
+   l->frameTime = 1.0 / frameRate;
+   l->tick = tick;
+   loopResetStats(l);
+}
+
+void loopStart(GameLoop *l)
+{
+   double now = timerSeconds();
+
+   if (current && current != l)
+      loopStop(current);
+   if (l->running)
+      return;
+   current = l;
+   l->running = 1;
+   l->last = l->nextFrame = now;
+   l->lastFrame = 0;
+   generation++;
+   schedule(l, now);
+}
+
+void loopStop(GameLoop *l)
+{
+   l->running = 0;
+}
+
+double loopAlpha(const GameLoop *l)
+{
+   double a;
+
+   if (!l->running)
+      return 1.0;
+   a = (l->accumulator + timerSeconds() - l->last) / l->tickTime;
+   return a < 1.0 ? a : 1.0;
+}
+
+void loopResetStats(GameLoop *l)
+{
+   l->ticks = l->frames = l->late = l->intervals = 0;
+   l->sum = l->sumSquares = 0;
+   l->worst = 0;
+   l->dropped = 0;
+   l->statsStart = timerSeconds();
+   l->cpuStart = cpuSeconds();
+   l->lastFrame = 0;
+}
+
+void loopPrintStats(const char *name, const GameLoop *l)
+{
+   unsigned long n = l->intervals;
+   double mean = n ? l->sum / n : 0, deviation = 0;
+   double wall = timerSeconds() - l->statsStart;
+
+   if (n)
+      deviation = sqrt(fabs(l->sumSquares / n - mean * mean));
+   printf("%s: %lu frames, %.2f ms apart (target %.2f), jitter %.3f ms, "
+          "worst %.3f ms, %lu late\n", name, l->frames, mean * 1000.0,
+          l->frameTime * 1000.0, deviation * 1000.0, l->worst * 1000.0,
+          l->late);
+   printf("   %lu ticks of %.2f ms, %.1f ms dropped, %.0f%% of a "
+          "processor\n", l->ticks, l->tickTime * 1000.0,
+          l->dropped * 1000.0,
+          wall > 0 ? (cpuSeconds() - l->cpuStart) * 100.0 / wall : 0.0);
+}
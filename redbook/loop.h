@@ -0,0 +1,57 @@
+/*
+ *  loop.h
+ *  Fixed timestep main loop for GLUT programs.  The simulation
+ *  advances in ticks of exactly 1 / tickRate seconds, however fast
+ *  the program draws, and display() interpolates between the last
+ *  two ticks with loopAlpha().  Frames are paced to frameRate with
+ *  glutTimerFunc(), which sleeps, and the last LOOP_SPIN seconds
+ *  before each frame are waited out by yielding the processor, as
+ *  timers are only as precise as the system tick.  A stopped loop
+ *  costs nothing; unlike an idle function it does not spin.
+ *
+ *  The intervals between frames are measured against the target so
+ *  a program can report its jitter.  Only one loop runs at a time.
+ */
+#ifndef LOOP_H
+#define LOOP_H
+
+#define LOOP_SPIN       0.002   /* seconds */
+#define LOOP_MAX_TICKS  8       /* per frame, beyond which time is lost */
+
+typedef void (*LoopTickFunc)(double dt);
+
+typedef struct gameloop {
+   double        tickTime, frameTime;   /* seconds */
+   LoopTickFunc  tick;
+   int           running;
+   double        accumulator;           /* time not yet ticked */
+   double        last, nextFrame;
+
+   /* since loopResetStats() */
+   unsigned long ticks, frames, late;
+   unsigned long intervals;
+   double        sum, sumSquares;       /* of the intervals */
+   double        worst;                 /* largest error, seconds */
+   double        dropped;               /* simulation time lost */
+   double        statsStart, cpuStart;
+   double        lastFrame;
+} GameLoop;
+
+void loopInit(GameLoop *l, double tickRate, double frameRate,
+              LoopTickFunc tick);
+
+/*  Start or stop ticking and drawing; the simulation does not
+ *  advance while the loop is stopped.
+ */
+void loopStart(GameLoop *l);
+void loopStop(GameLoop *l);
+
+/*  How far the present lies between the last tick and the next, 0
+ *  to 1.  Draw prev + (cur - prev) * loopAlpha().
+ */
+double loopAlpha(const GameLoop *l);
+
+void loopResetStats(GameLoop *l);
+void loopPrintStats(const char *name, const GameLoop *l);
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ *  matcache.c
+ *  Interned material blocks with diffed binding.  See matcache.h.
+ */
+#include <GL/glut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matcache.h"
+
+static MatBlock *blocks;
+static unsigned nblocks, maxblocks;
+
+/*  open addressing table of handles, keyed by block contents  */
+static MatHandle *table;
+static unsigned tablesize;
+
+static MatHandle bound = MAT_NONE;
+static MatBlock current;
+static MatCacheStats stats;
+
+void matDefaults(MatBlock *m)
+{
+   static const MatBlock def = {
+      { 0.2, 0.2, 0.2, 1.0 },
+      { 0.8, 0.8, 0.8, 1.0 },
+      { 0.0, 0.0, 0.0, 1.0 },
+      { 0.0, 0.0, 0.0, 1.0 },
+      0.0,
+      GL_FRONT
+   };
+   *m = def;
+}
+
+/*  FNV-1a over the raw block.  MatBlock has no padding.  */
+static unsigned hashBlock(const MatBlock *m)
+{
+   const unsigned char *p = (const unsigned char *) m;
+   unsigned h = 2166136261U, i;
+
+   for (i = 0; i < sizeof(MatBlock); i++) {
+      h ^= p[i];
+      h *= 16777619U;
+   }
+   return h;
+}
+
+static void rehash(unsigned size)
+{
+   unsigned i, j;
+
+   free(table);
+   table = (MatHandle *) malloc(size * sizeof(MatHandle));
+   if (table == NULL) {
+      printf("matcache: out of memory\n");
+      exit(1);
+   }
+   for (i = 0; i < size; i++)
+      table[i] = MAT_NONE;
+   tablesize = size;
+   for (i = 0; i < nblocks; i++) {
+      j = hashBlock(&blocks[i]) & (size - 1);
+      while (table[j] != MAT_NONE)
+         j = (j + 1) & (size - 1);
+      table[j] = i;
+   }
+}
+
+MatHandle matIntern(const MatBlock *m)
+{
+   unsigned j;
+
+   if (tablesize == 0 || (nblocks + 1) * 2 > tablesize)
+      rehash(tablesize ? tablesize * 2 : 64);
+
+   j = hashBlock(m) & (tablesize - 1);
+   while (table[j] != MAT_NONE) {
+      if (memcmp(&blocks[table[j]], m, sizeof(MatBlock)) == 0)
+         return table[j];
+      j = (j + 1) & (tablesize - 1);
+   }
+
+   if (nblocks == maxblocks) {
+      unsigned n = maxblocks ? maxblocks * 2 : 32;
+      MatBlock *b = (MatBlock *) realloc(blocks, n * sizeof(MatBlock));
+      if (b == NULL) {
+         printf("matcache: out of memory\n");
+         exit(1);
+      }
+      blocks = b;
+      maxblocks = n;
+   }
+   blocks[nblocks] = *m;
+   table[j] = nblocks;
+   return nblocks++;
+}
+
+/*  Convenience for the common ambient/diffuse/specular/shininess
+ *  material with opaque alpha and no emission.  Shininess is given in
+ *  GL units (0..128).
+ */
+MatHandle matInternColors(const GLfloat ambient[3], const GLfloat diffuse[3],
+                          const GLfloat specular[3], GLfloat shininess)
+{
+   MatBlock m;
+   int i;
+
+   matDefaults(&m);
+   for (i = 0; i < 3; i++) {
+      m.ambient[i] = ambient[i];
+      m.diffuse[i] = diffuse[i];
+      m.specular[i] = specular[i];
+   }
+   m.shininess = shininess;
+   return matIntern(&m);
+}
+
+const MatBlock *matGet(MatHandle h)
+{
+   return h < nblocks ? &blocks[h] : NULL;
+}
+
+const MatBlock *matBlocks(unsigned *count)
+{
+   *count = nblocks;
+   return blocks;
+}
+
+#define DIFF4(a, b) memcmp((a), (b), 4 * sizeof(GLfloat))
+
+void matBind(MatHandle h)
+{
+   const MatBlock *m;
+   int all;
+
+   stats.binds++;
+   if (h == bound) {
+      stats.sameHandle++;
+      stats.paramsSkipped += 5;
+      return;
+   }
+   m = &blocks[h];
+   all = (bound == MAT_NONE || m->face != current.face);
+
+   if (all || DIFF4(m->ambient, current.ambient)) {
+      glMaterialfv(m->face, GL_AMBIENT, m->ambient);
+      stats.paramsIssued++;
+   } else stats.paramsSkipped++;
+   if (all || DIFF4(m->diffuse, current.diffuse)) {
+      glMaterialfv(m->face, GL_DIFFUSE, m->diffuse);
+      stats.paramsIssued++;
+   } else stats.paramsSkipped++;
+   if (all || DIFF4(m->specular, current.specular)) {
+      glMaterialfv(m->face, GL_SPECULAR, m->specular);
+      stats.paramsIssued++;
+   } else stats.paramsSkipped++;
+   if (all || DIFF4(m->emission, current.emission)) {
+      glMaterialfv(m->face, GL_EMISSION, m->emission);
+      stats.paramsIssued++;
+   } else stats.paramsSkipped++;
+   if (all || m->shininess != current.shininess) {
+      glMaterialf(m->face, GL_SHININESS, m->shininess);
+      stats.paramsIssued++;
+   } else stats.paramsSkipped++;
+
+   current = *m;
+   bound = h;
+}
+
+void matInvalidate(void)
+{
+   bound = MAT_NONE;
+}
+
+const MatCacheStats *matStats(void)
+{
+   return &stats;
+}
+
+void matResetStats(void)
+{
+   memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,55 @@
+/*
+ *  matcache.h
+ *  Material parameter blocks.  A material is an immutable block of
+ *  lighting parameters, interned by value: interning the same values
+ *  twice returns the same handle.  Blocks live in one contiguous
+ *  array so they can be uploaded as a whole when a shader path
+ *  exists; on the fixed-function path, binding a handle issues
+ *  glMaterialfv() only for the parameters that differ from the block
+ *  that is currently bound.
+ */
+#ifndef MATCACHE_H
+#define MATCACHE_H
+
+typedef unsigned MatHandle;
+
+#define MAT_NONE 0xffffffffU
+
+typedef struct matblock {
+   GLfloat ambient[4];
+   GLfloat diffuse[4];
+   GLfloat specular[4];
+   GLfloat emission[4];
+   GLfloat shininess;
+   GLenum  face;
+} MatBlock;
+
+typedef struct matcachestats {
+   unsigned binds;          /* calls to matBind()                    */
+   unsigned sameHandle;     /* binds of the already bound handle     */
+   unsigned paramsIssued;   /* glMaterial calls actually made        */
+   unsigned paramsSkipped;  /* glMaterial calls avoided by diffing   */
+} MatCacheStats;
+
+/*  Fill a block with the GL default material for GL_FRONT.  */
+void matDefaults(MatBlock *m);
+
+MatHandle matIntern(const MatBlock *m);
+MatHandle matInternColors(const GLfloat ambient[3], const GLfloat diffuse[3],
+                          const GLfloat specular[3], GLfloat shininess);
+const MatBlock *matGet(MatHandle h);
+
+/*  All interned blocks, in handle order.  */
+const MatBlock *matBlocks(unsigned *count);
+
+void matBind(MatHandle h);
+
+/*  Forget what is bound, e.g. after other code has called
+ *  glMaterial() directly or popped GL_LIGHTING_BIT.
+ */
+void matInvalidate(void);
+
+const MatCacheStats *matStats(void);
+void matResetStats(void);
+
+#endif
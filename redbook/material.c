@@ -42,7 +42,14 @@
  * A single light source illuminates the objects.
  */
 #include <stdlib.h>
+#include <string.h>
 #include <GL/glut.h>
+#include "drawqueue.h"
+#include "matcache.h"
+
+static DrawQueue queue;
+
+static void initMaterials(void);
 
 /*  Initialize z-buffer, projection matrix, light source, 
  *  and lighting model.  Do not specify a material property here.
@@ -68,6 +75,8 @@ void init(void)
 
    glEnable(GL_LIGHTING);
    glEnable(GL_LIGHT0);
+
+   initMaterials();
 }
 
 /*  Draw twelve spheres in 3 rows with 4 columns.  
@@ -82,179 +91,93 @@ void init(void)
  *  reflection with a high shininess exponent (a more concentrated highlight).
  *  The fourth column has materials which also include an emissive component.
  *
- *  glTranslatef() is used to move spheres to their appropriate locations.
- */
-
-void display(void)
+ *  Each sphere is recorded into a draw queue with its material handle
+ *  in the sort key; the queue binds a material only when it changes,
+ *  and the material cache then sets only the parameters that differ
+ *  from the previous sphere.
+ */
+
+static GLfloat no_mat[] = { 0.0, 0.0, 0.0, 1.0 };
+static GLfloat mat_ambient[] = { 0.7, 0.7, 0.7, 1.0 };
+static GLfloat mat_ambient_color[] = { 0.8, 0.8, 0.2, 1.0 };
+static GLfloat mat_diffuse[] = { 0.1, 0.5, 0.8, 1.0 };
+static GLfloat mat_specular[] = { 1.0, 1.0, 1.0, 1.0 };
+static GLfloat no_shininess[] = { 0.0 };
+static GLfloat low_shininess[] = { 5.0 };
+static GLfloat high_shininess[] = { 100.0 };
+static GLfloat mat_emission[] = {0.3, 0.2, 0.2, 0.0};
+
+typedef struct sphere {
+   GLfloat x, y;
+   GLfloat *ambient, *specular, *shininess, *emission;
+   MatHandle mat;
+} Sphere;
+
+static Sphere spheres[] = {
+/*  first row: diffuse only; low shininess; high shininess; emission  */
+   { -3.75, 3.0, no_mat, no_mat, no_shininess, no_mat },
+   { -1.25, 3.0, no_mat, mat_specular, low_shininess, no_mat },
+   { 1.25, 3.0, no_mat, mat_specular, high_shininess, no_mat },
+   { 3.75, 3.0, no_mat, no_mat, no_shininess, mat_emission },
+/*  second row: the same, with ambient reflection  */
+   { -3.75, 0.0, mat_ambient, no_mat, no_shininess, no_mat },
+   { -1.25, 0.0, mat_ambient, mat_specular, low_shininess, no_mat },
+   { 1.25, 0.0, mat_ambient, mat_specular, high_shininess, no_mat },
+   { 3.75, 0.0, mat_ambient, no_mat, no_shininess, mat_emission },
+/*  third row: the same, with colored ambient reflection  */
+   { -3.75, -3.0, mat_ambient_color, no_mat, no_shininess, no_mat },
+   { -1.25, -3.0, mat_ambient_color, mat_specular, low_shininess, no_mat },
+   { 1.25, -3.0, mat_ambient_color, mat_specular, high_shininess, no_mat },
+   { 3.75, -3.0, mat_ambient_color, no_mat, no_shininess, mat_emission }
+};
+
+#define NSPHERES (sizeof(spheres) / sizeof(spheres[0]))
+
+static void bindMaterial(unsigned id, void *user)
 {
-   GLfloat no_mat[] = { 0.0, 0.0, 0.0, 1.0 };
-   GLfloat mat_ambient[] = { 0.7, 0.7, 0.7, 1.0 };
-   GLfloat mat_ambient_color[] = { 0.8, 0.8, 0.2, 1.0 };
-   GLfloat mat_diffuse[] = { 0.1, 0.5, 0.8, 1.0 };
-   GLfloat mat_specular[] = { 1.0, 1.0, 1.0, 1.0 };
-   GLfloat no_shininess[] = { 0.0 };
-   GLfloat low_shininess[] = { 5.0 };
-   GLfloat high_shininess[] = { 100.0 };
-   GLfloat mat_emission[] = {0.3, 0.2, 0.2, 0.0};
-
-   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-/*  draw sphere in first row, first column
- *  diffuse reflection only; no ambient or specular  
- */
-   glPushMatrix();
-   glTranslatef (-3.75, 3.0, 0.0);
-   glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, no_mat);
-   glMaterialfv(GL_FRONT, GL_SHININESS, no_shininess);
-   glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-   glutSolidSphere(1.0, 16, 16);
-   glPopMatrix();
-
-/*  draw sphere in first row, second column
- *  diffuse and specular reflection; low shininess; no ambient
- */
-   glPushMatrix();
-   glTranslatef (-1.25, 3.0, 0.0);
-   glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-   glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-   glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-   glutSolidSphere(1.0, 16, 16);
-   glPopMatrix();
-
-/*  draw sphere in first row, third column
- *  diffuse and specular reflection; high shininess; no ambient
- */
-   glPushMatrix();
-   glTranslatef (1.25, 3.0, 0.0);
-   glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-   glMaterialfv(GL_FRONT, GL_SHININESS, high_shininess);
-   glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-   glutSolidSphere(1.0, 16, 16);
-   glPopMatrix();
-
-/*  draw sphere in first row, fourth column
- *  diffuse reflection; emission; no ambient or specular reflection
- */
-   glPushMatrix();
-   glTranslatef (3.75, 3.0, 0.0);
-   glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, no_mat);
-   glMaterialfv(GL_FRONT, GL_SHININESS, no_shininess);
-   glMaterialfv(GL_FRONT, GL_EMISSION, mat_emission);
-   glutSolidSphere(1.0, 16, 16);
-   glPopMatrix();
-
-/*  draw sphere in second row, first column
- *  ambient and diffuse reflection; no specular  
- */
-   glPushMatrix();
-   glTranslatef (-3.75, 0.0, 0.0);
-   glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, no_mat);
-   glMaterialfv(GL_FRONT, GL_SHININESS, no_shininess);
-   glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-   glutSolidSphere(1.0, 16, 16);
-   glPopMatrix();
-
-/*  draw sphere in second row, second column
- *  ambient, diffuse and specular reflection; low shininess
- */
-   glPushMatrix();
-   glTranslatef (-1.25, 0.0, 0.0);
-   glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-   glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-   glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-   glutSolidSphere(1.0, 16, 16);
-   glPopMatrix();
-
-/*  draw sphere in second row, third column
- *  ambient, diffuse and specular reflection; high shininess
- */
-   glPushMatrix();
-   glTranslatef (1.25, 0.0, 0.0);
-   glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-   glMaterialfv(GL_FRONT, GL_SHININESS, high_shininess);
-   glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-   glutSolidSphere(1.0, 16, 16);
-   glPopMatrix();
+   matBind(id);
+}
 
-/*  draw sphere in second row, fourth column
- *  ambient and diffuse reflection; emission; no specular
- */
-   glPushMatrix();
-   glTranslatef (3.75, 0.0, 0.0);
-   glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, no_mat);
-   glMaterialfv(GL_FRONT, GL_SHININESS, no_shininess);
-   glMaterialfv(GL_FRONT, GL_EMISSION, mat_emission);
-   glutSolidSphere(1.0, 16, 16);
-   glPopMatrix();
+static void initMaterials(void)
+{
+   MatBlock m;
+   unsigned i;
+
+   for (i = 0; i < NSPHERES; i++) {
+      Sphere *s = &spheres[i];
+
+      matDefaults(&m);
+      memcpy(m.ambient, s->ambient, sizeof(m.ambient));
+      memcpy(m.diffuse, mat_diffuse, sizeof(m.diffuse));
+      memcpy(m.specular, s->specular, sizeof(m.specular));
+      memcpy(m.emission, s->emission, sizeof(m.emission));
+      m.shininess = s->shininess[0];
+      s->mat = matIntern(&m);
+   }
 
-/*  draw sphere in third row, first column
- *  colored ambient and diffuse reflection; no specular  
- */
-   glPushMatrix();
-   glTranslatef (-3.75, -3.0, 0.0);
-   glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient_color);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, no_mat);
-   glMaterialfv(GL_FRONT, GL_SHININESS, no_shininess);
-   glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-   glutSolidSphere(1.0, 16, 16);
-   glPopMatrix();
+   drawQueueInit(&queue, 16);
+   queue.bindMaterial = bindMaterial;
+}
 
-/*  draw sphere in third row, second column
- *  colored ambient, diffuse and specular reflection; low shininess
- */
-   glPushMatrix();
-   glTranslatef (-1.25, -3.0, 0.0);
-   glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient_color);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-   glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-   glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-   glutSolidSphere(1.0, 16, 16);
-   glPopMatrix();
+static void drawSphere(void *data)
+{
+   Sphere *s = (Sphere *) data;
 
-/*  draw sphere in third row, third column
- *  colored ambient, diffuse and specular reflection; high shininess
- */
    glPushMatrix();
-   glTranslatef (1.25, -3.0, 0.0);
-   glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient_color);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-   glMaterialfv(GL_FRONT, GL_SHININESS, high_shininess);
-   glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
+   glTranslatef (s->x, s->y, 0.0);
    glutSolidSphere(1.0, 16, 16);
    glPopMatrix();
+}
 
-/*  draw sphere in third row, fourth column
- *  colored ambient and diffuse reflection; emission; no specular
- */
-   glPushMatrix();
-   glTranslatef (3.75, -3.0, 0.0);
-   glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient_color);
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-   glMaterialfv(GL_FRONT, GL_SPECULAR, no_mat);
-   glMaterialfv(GL_FRONT, GL_SHININESS, no_shininess);
-   glMaterialfv(GL_FRONT, GL_EMISSION, mat_emission);
-   glutSolidSphere(1.0, 16, 16);
-   glPopMatrix();
+void display(void)
+{
+   unsigned i;
 
+   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+   for (i = 0; i < NSPHERES; i++)
+      drawQueueSubmit(&queue, drawQueueKey(0, spheres[i].mat, 0, 0.0),
+                      drawSphere, &spheres[i]);
+   drawQueueFlush(&queue);
    glFlush();
 }
 
@@ -276,6 +199,10 @@ void reshape(int w, int h)
 void keyboard(unsigned char key, int x, int y)
 {
    switch (key) {
+      case 's':
+      case 'S':
+         drawQueuePrintStats(&queue);
+         break;
       case 27:
          exit(0);
          break;
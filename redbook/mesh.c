@@ -0,0 +1,241 @@
+/*
+ *  mesh.c
+ *  Buffer object meshes.  See mesh.h.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mesh.h"
+
+#define BUFFER_OFFSET(bytes) ((const GLubyte *) NULL + (bytes))
+
+static unsigned long totalBytes;
+
+static void *grow(void *p, GLuint *max, size_t elem)
+{
+   GLuint n = *max ? *max * 2 : 256;
+
+   p = realloc(p, n * elem);
+   if (p == NULL) {
+      printf("mesh: out of memory\n");
+      exit(1);
+   }
+   *max = n;
+   return p;
+}
+
+void meshBuilderInit(MeshBuilder *b, int attribs)
+{
+   memset(b, 0, sizeof(*b));
+   b->attribs = attribs;
+   b->floatsPerVertex = 3;
+   if (attribs & MESH_NORMAL)
+      b->floatsPerVertex += 3;
+   if (attribs & MESH_COLOR)
+      b->floatsPerVertex += 3;
+}
+
+void meshBuilderFree(MeshBuilder *b)
+{
+   free(b->verts);
+   free(b->indices);
+   memset(b, 0, sizeof(*b));
+}
+
+/*  Append a vertex and return its index.  Attributes the builder was
+ *  not created with are ignored.
+ */
+GLuint meshVertex(MeshBuilder *b, const GLfloat pos[3],
+                  const GLfloat normal[3], const GLfloat color[3])
+{
+   GLfloat *v;
+
+   if (b->vertexCount == b->maxVerts)
+      b->verts = (GLfloat *) grow(b->verts, &b->maxVerts,
+                                  b->floatsPerVertex * sizeof(GLfloat));
+   v = b->verts + b->vertexCount * b->floatsPerVertex;
+   v[0] = pos[0]; v[1] = pos[1]; v[2] = pos[2];
+   v += 3;
+   if (b->attribs & MESH_NORMAL) {
+      v[0] = normal[0]; v[1] = normal[1]; v[2] = normal[2];
+      v += 3;
+   }
+   if (b->attribs & MESH_COLOR) {
+      v[0] = color[0]; v[1] = color[1]; v[2] = color[2];
+   }
+   return b->vertexCount++;
+}
+
+void meshIndex(MeshBuilder *b, GLuint i)
+{
+   if (b->indexCount == b->maxIndices)
+      b->indices = (GLuint *) grow(b->indices, &b->maxIndices,
+                                   sizeof(GLuint));
+   b->indices[b->indexCount++] = i;
+}
+
+void meshBegin(MeshBuilder *b, GLenum mode)
+{
+   if (b->rangeCount == MESH_MAX_RANGES) {
+      printf("mesh: more than %d ranges\n", MESH_MAX_RANGES);
+      exit(1);
+   }
+   b->ranges[b->rangeCount].mode = mode;
+   b->ranges[b->rangeCount].first = b->indexCount;
+}
+
+void meshEnd(MeshBuilder *b)
+{
+   MeshRange *r = &b->ranges[b->rangeCount++];
+
+   r->count = b->indexCount - r->first;
+}
+
+void meshSource(const MeshBuilder *b, VertexSource *src)
+{
+   GLsizei stride = b->floatsPerVertex * sizeof(GLfloat);
+   const GLfloat *v = b->verts + 3;
+
+   memset(src, 0, sizeof(*src));
+   src->count = b->vertexCount;
+   src->position = b->verts;
+   src->positionStride = stride;
+   if (b->attribs & MESH_NORMAL) {
+      src->normal = v;
+      src->normalStride = stride;
+      v += 3;
+   }
+   if (b->attribs & MESH_COLOR) {
+      src->color = v;
+      src->colorStride = stride;
+      src->colorSize = 3;
+   }
+}
+
+void meshCompile(Mesh *m, const MeshBuilder *b)
+{
+   VertexSource src;
+   VertexLayout l;
+
+   meshSource(b, &src);
+   vertexLayoutChoose(&l, &src);
+   meshCompileLayout(m, b, &l);
+}
+
+void meshCompileLayout(Mesh *m, const MeshBuilder *b, const VertexLayout *l)
+{
+   VertexSource src;
+   VertexBuffer vb;
+   GLsizei ibytes;
+
+   memset(m, 0, sizeof(*m));
+   m->attribs = b->attribs;
+   m->vertexCount = b->vertexCount;
+   m->indexCount = b->indexCount;
+   memcpy(m->ranges, b->ranges, sizeof(m->ranges));
+   m->rangeCount = b->rangeCount;
+   m->refs = 1;
+
+   meshSource(b, &src);
+   vertexBufferCreate(&vb, l, &src);
+   m->vbo = vb.vbo;
+   m->layout = vb.layout;
+
+/*  16 bit indices whenever the vertex count allows it  */
+   glGenBuffers(1, &m->ibo);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->ibo);
+   if (b->vertexCount <= 65536) {
+      GLushort *s = (GLushort *) malloc(b->indexCount * sizeof(GLushort));
+      GLuint k;
+
+      if (s == NULL) {
+         printf("mesh: out of memory\n");
+         exit(1);
+      }
+      for (k = 0; k < b->indexCount; k++)
+         s[k] = (GLushort) b->indices[k];
+      m->indexType = GL_UNSIGNED_SHORT;
+      ibytes = b->indexCount * sizeof(GLushort);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, ibytes, s, GL_STATIC_DRAW);
+      free(s);
+   }
+   else {
+      m->indexType = GL_UNSIGNED_INT;
+      ibytes = b->indexCount * sizeof(GLuint);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, ibytes, b->indices,
+                   GL_STATIC_DRAW);
+   }
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+   totalBytes += meshBytes(m);
+}
+
+void meshRetain(Mesh *m)
+{
+   m->refs++;
+}
+
+void meshRelease(Mesh *m)
+{
+   if (--m->refs > 0)
+      return;
+   totalBytes -= meshBytes(m);
+   glDeleteBuffers(1, &m->vbo);
+   glDeleteBuffers(1, &m->ibo);
+   m->vbo = m->ibo = 0;
+}
+
+static void bindArrays(const Mesh *m)
+{
+   glBindBuffer(GL_ARRAY_BUFFER, m->vbo);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->ibo);
+   vertexLayoutEnable(&m->layout, 0);
+}
+
+static void unbindArrays(const Mesh *m)
+{
+   vertexLayoutDisable(&m->layout);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void drawRange(const Mesh *m, const MeshRange *r)
+{
+   int size = m->indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+
+   glDrawElements(r->mode, r->count, m->indexType,
+                  BUFFER_OFFSET(r->first * size));
+}
+
+/*  Draw every range of the mesh.  */
+void meshDraw(const Mesh *m)
+{
+   int i;
+
+   bindArrays(m);
+   for (i = 0; i < m->rangeCount; i++)
+      drawRange(m, &m->ranges[i]);
+   unbindArrays(m);
+}
+
+void meshDrawRange(const Mesh *m, int range)
+{
+   bindArrays(m);
+   drawRange(m, &m->ranges[range]);
+   unbindArrays(m);
+}
+
+unsigned long meshBytes(const Mesh *m)
+{
+   int size = m->indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+
+   return (unsigned long) m->vertexCount * m->layout.stride +
+          (unsigned long) m->indexCount * size;
+}
+
+unsigned long meshTotalBytes(void)
+{
+   return totalBytes;
+}
@@ -0,0 +1,88 @@
+/*
+ *  mesh.h
+ *  Mesh objects: geometry compiled once into an interleaved vertex
+ *  buffer and an index buffer, with the draw ranges recorded next to
+ *  them.  Unlike a display list a mesh can be inspected, measured and
+ *  drawn in parts.  Buffer objects are shared by every context in a
+ *  share group (glXCreateContext() shareList, wglShareLists()), so a
+ *  Mesh may be drawn from any of them; meshRetain()/meshRelease()
+ *  count the owners so the buffers outlive the context that made them.
+ *
+ *  Vertices are stored in the smallest layout that represents them
+ *  (see vformat.h) unless a layout is given to meshCompileLayout().
+ *
+ *  Requires OpenGL 1.5 buffer objects.
+ */
+#ifndef MESH_H
+#define MESH_H
+
+#include "vformat.h"
+
+/*  vertex attributes, besides the position which is always present  */
+#define MESH_NORMAL  1
+#define MESH_COLOR   2
+
+#define MESH_MAX_RANGES 128
+
+typedef struct meshrange {
+   GLenum  mode;
+   GLuint  first;        /* first index */
+   GLsizei count;        /* number of indices */
+} MeshRange;
+
+typedef struct mesh {
+   GLuint    vbo, ibo;
+   int       attribs;
+   VertexLayout layout;
+   GLenum    indexType;         /* GL_UNSIGNED_SHORT or GL_UNSIGNED_INT */
+   GLuint    vertexCount;
+   GLuint    indexCount;
+   MeshRange ranges[MESH_MAX_RANGES];
+   int       rangeCount;
+   int       refs;
+} Mesh;
+
+/*  CPU side accumulation of a mesh before it is compiled.  Ranges are
+ *  opened with meshBegin() and closed with meshEnd(); indices issued
+ *  in between belong to that range.
+ */
+typedef struct meshbuilder {
+   int       attribs;
+   int       floatsPerVertex;
+   GLfloat  *verts;
+   GLuint    vertexCount, maxVerts;
+   GLuint   *indices;
+   GLuint    indexCount, maxIndices;
+   MeshRange ranges[MESH_MAX_RANGES];
+   int       rangeCount;
+} MeshBuilder;
+
+void meshBuilderInit(MeshBuilder *b, int attribs);
+void meshBuilderFree(MeshBuilder *b);
+
+GLuint meshVertex(MeshBuilder *b, const GLfloat pos[3],
+                  const GLfloat normal[3], const GLfloat color[3]);
+void meshIndex(MeshBuilder *b, GLuint i);
+void meshBegin(MeshBuilder *b, GLenum mode);
+void meshEnd(MeshBuilder *b);
+
+/*  Upload the builder into new buffer objects.  The builder may be
+ *  freed afterwards.
+ */
+void meshCompile(Mesh *m, const MeshBuilder *b);
+void meshCompileLayout(Mesh *m, const MeshBuilder *b, const VertexLayout *l);
+
+/*  The builder's vertices as a float source for vformat.  */
+void meshSource(const MeshBuilder *b, VertexSource *src);
+
+void meshRetain(Mesh *m);
+void meshRelease(Mesh *m);
+
+void meshDraw(const Mesh *m);
+void meshDrawRange(const Mesh *m, int range);
+
+/*  Bytes of buffer storage held by one mesh, and by all live meshes.  */
+unsigned long meshBytes(const Mesh *m);
+unsigned long meshTotalBytes(void);
+
+#endif
@@ -0,0 +1,550 @@
+/*
+ *  meshopt.c
+ *  Vertex cache, overdraw and vertex fetch optimization.  See
+ *  meshopt.h.
+ *
+ *  The vertex cache pass follows Tom Forsyth, "Linear-Speed Vertex
+ *  Cache Optimisation" (2006); the overdraw pass follows Sander,
+ *  Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality
+ *  and Reduced Overdraw" (2007), with clusters sorted by a view
+ *  independent key instead of measured overdraw.
+ */
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "meshopt.h"
+#include "jobs.h"
+
+/*  Forsyth's scoring parameters  */
+#define FORSYTH_CACHE        32
+#define FORSYTH_VALENCE      32
+#define CACHE_DECAY_POWER    1.5
+#define LAST_TRI_SCORE       0.75f
+#define VALENCE_BOOST_SCALE  2.0
+#define VALENCE_BOOST_POWER  0.5
+
+static float cacheScore[FORSYTH_CACHE];
+static float valenceScore[FORSYTH_VALENCE];
+
+static void *allocate(size_t bytes)
+{
+   void *p = malloc(bytes ? bytes : 1);
+
+   if (p == NULL) {
+      printf("meshopt: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+/*  Built on first use; meshOptimizeAll() builds them before starting
+ *  any job so the workers only read them.
+ */
+static void initScores(void)
+{
+   int i;
+
+   if (valenceScore[0] != 0)
+      return;
+   for (i = 0; i < FORSYTH_CACHE; i++) {
+      if (i < 3)
+         cacheScore[i] = LAST_TRI_SCORE;
+      else
+         cacheScore[i] = (float) pow(1.0 - (double) (i - 3) /
+                                     (FORSYTH_CACHE - 3), CACHE_DECAY_POWER);
+   }
+   for (i = 1; i < FORSYTH_VALENCE; i++)
+      valenceScore[i] = (float) (VALENCE_BOOST_SCALE *
+                                 pow((double) i, -VALENCE_BOOST_POWER));
+   valenceScore[0] = -1;
+}
+
+static float vertexScore(int cachePos, GLuint live)
+{
+   float score;
+
+   if (live == 0)
+      return 0;
+   score = cachePos >= 0 ? cacheScore[cachePos] : 0;
+   if (live < FORSYTH_VALENCE)
+      return score + valenceScore[live];
+   return score + (float) (VALENCE_BOOST_SCALE *
+                           pow((double) live, -VALENCE_BOOST_POWER));
+}
+
+/*  FIFO cache simulation.  stamp[v] is the time vertex v entered the
+ *  cache; it is still there while fewer than cacheSize vertices have
+ *  entered since.
+ */
+GLuint meshoptCacheMisses(const GLuint *indices, GLuint count,
+                          GLuint vertexCount, int cacheSize)
+{
+   GLuint *stamp = (GLuint *) allocate(vertexCount * sizeof(GLuint));
+   GLuint time = cacheSize + 1, misses = 0, k;
+
+   memset(stamp, 0, vertexCount * sizeof(GLuint));
+   for (k = 0; k < count; k++) {
+      GLuint v = indices[k];
+
+      if (time - stamp[v] > (GLuint) cacheSize) {
+         stamp[v] = time++;
+         misses++;
+      }
+   }
+   free(stamp);
+   return misses;
+}
+
+void meshoptVertexCache(GLuint *dst, const GLuint *indices, GLuint count,
+                        GLuint vertexCount)
+{
+   GLuint tris = count / 3, t, v, k, out;
+   GLuint *first, *live, *adjacency;
+   int *cachePos;
+   float *vscore, *tscore;
+   unsigned char *emitted;
+   GLuint cache[FORSYTH_CACHE + 3], next[FORSYTH_CACHE + 3];
+   int cacheSize = 0, nextSize, i, j;
+   GLuint cursor = 0;
+   long best;
+
+   initScores();
+   first = (GLuint *) allocate((vertexCount + 1) * sizeof(GLuint));
+   live = (GLuint *) allocate(vertexCount * sizeof(GLuint));
+   adjacency = (GLuint *) allocate(tris * 3 * sizeof(GLuint));
+   cachePos = (int *) allocate(vertexCount * sizeof(int));
+   vscore = (float *) allocate(vertexCount * sizeof(float));
+   tscore = (float *) allocate(tris * sizeof(float));
+   emitted = (unsigned char *) allocate(tris);
+
+/*  triangles using each vertex, as one array sliced by first[]  */
+   memset(live, 0, vertexCount * sizeof(GLuint));
+   for (k = 0; k < tris * 3; k++)
+      live[indices[k]]++;
+   first[0] = 0;
+   for (v = 0; v < vertexCount; v++)
+      first[v + 1] = first[v] + live[v];
+   memset(live, 0, vertexCount * sizeof(GLuint));
+   for (k = 0; k < tris * 3; k++) {
+      v = indices[k];
+      adjacency[first[v] + live[v]++] = k / 3;
+   }
+
+   for (v = 0; v < vertexCount; v++) {
+      cachePos[v] = -1;
+      vscore[v] = vertexScore(-1, live[v]);
+   }
+   for (t = 0; t < tris; t++) {
+      tscore[t] = vscore[indices[t * 3]] + vscore[indices[t * 3 + 1]] +
+                  vscore[indices[t * 3 + 2]];
+      emitted[t] = 0;
+   }
+
+   best = -1;
+   for (out = 0; out < tris; out++) {
+/*  nothing in the cache: restart from the first unused triangle  */
+      if (best < 0) {
+         while (emitted[cursor])
+            cursor++;
+         best = cursor;
+      }
+      t = (GLuint) best;
+      emitted[t] = 1;
+      memcpy(dst + out * 3, indices + t * 3, 3 * sizeof(GLuint));
+
+/*  drop the triangle from its vertices' lists  */
+      for (i = 0; i < 3; i++) {
+         GLuint *adj;
+
+         v = indices[t * 3 + i];
+         adj = adjacency + first[v];
+         for (k = 0; k < live[v]; k++) {
+            if (adj[k] == t) {
+               adj[k] = adj[--live[v]];
+               break;
+            }
+         }
+      }
+
+/*  the triangle's vertices move to the front of the cache  */
+      nextSize = 0;
+      for (i = 0; i < 3; i++) {
+         v = indices[t * 3 + i];
+         for (j = 0; j < nextSize; j++)
+            if (next[j] == v)
+               break;
+         if (j == nextSize)
+            next[nextSize++] = v;
+      }
+      for (i = 0; i < cacheSize; i++) {
+         v = cache[i];
+         for (j = 0; j < 3; j++)
+            if (indices[t * 3 + j] == v)
+               break;
+         if (j == 3)
+            next[nextSize++] = v;
+      }
+
+/*  rescore the vertices whose position changed, including those
+ *  pushed out, and the triangles that use them
+ */
+      for (i = 0; i < nextSize; i++) {
+         float score;
+
+         v = next[i];
+         cachePos[v] = i < FORSYTH_CACHE ? i : -1;
+         score = vertexScore(cachePos[v], live[v]);
+         for (k = 0; k < live[v]; k++)
+            tscore[adjacency[first[v] + k]] += score - vscore[v];
+         vscore[v] = score;
+      }
+      cacheSize = nextSize < FORSYTH_CACHE ? nextSize : FORSYTH_CACHE;
+      memcpy(cache, next, cacheSize * sizeof(GLuint));
+
+/*  the next triangle is the best one touching the cache  */
+      best = -1;
+      for (i = 0; i < cacheSize; i++) {
+         v = cache[i];
+         for (k = 0; k < live[v]; k++) {
+            GLuint a = adjacency[first[v] + k];
+
+            if (best < 0 || tscore[a] > tscore[best])
+               best = a;
+         }
+      }
+   }
+
+   free(first);
+   free(live);
+   free(adjacency);
+   free(cachePos);
+   free(vscore);
+   free(tscore);
+   free(emitted);
+}
+
+typedef struct cluster {
+   GLuint start, end;       /* triangles */
+   float  center[3];        /* area weighted */
+   float  normal[3];
+   float  key;
+} Cluster;
+
+static int compareClusters(const void *a, const void *b)
+{
+   const Cluster *ca = (const Cluster *) a, *cb = (const Cluster *) b;
+
+   if (ca->key != cb->key)
+      return ca->key > cb->key ? -1 : 1;
+   return ca->start < cb->start ? -1 : 1;
+}
+
+/*  Misses of one triangle in a running simulation.  */
+static int triangleMisses(const GLuint *tri, GLuint *stamp, GLuint *time)
+{
+   int i, misses = 0;
+
+   for (i = 0; i < 3; i++) {
+      if (*time - stamp[tri[i]] > MESHOPT_CACHE_SIZE) {
+         stamp[tri[i]] = (*time)++;
+         misses++;
+      }
+   }
+   return misses;
+}
+
+/*  Advancing the clock past the cache size empties the cache.  */
+#define FLUSH(time) ((time) += MESHOPT_CACHE_SIZE + 1)
+
+GLuint meshoptOverdraw(GLuint *indices, GLuint count,
+                       const GLfloat *positions, int stride,
+                       GLuint vertexCount, float threshold)
+{
+   GLuint tris = count / 3, t, s, e, hardCount, n, k;
+   GLuint *hard, *stamp, *sorted, time;
+   Cluster *clusters;
+   double meshArea = 0, meshCenter[3] = { 0, 0, 0 };
+   int i;
+
+   if (tris == 0)
+      return 0;
+   hard = (GLuint *) allocate((tris + 1) * sizeof(GLuint));
+   clusters = (Cluster *) allocate(tris * sizeof(Cluster));
+   stamp = (GLuint *) allocate(vertexCount * sizeof(GLuint));
+   memset(stamp, 0, vertexCount * sizeof(GLuint));
+   time = MESHOPT_CACHE_SIZE + 1;
+
+/*  hard boundaries: where the cache order itself starts over  */
+   hardCount = 0;
+   for (t = 0; t < tris; t++)
+      if (triangleMisses(indices + t * 3, stamp, &time) == 3)
+         hard[hardCount++] = t;
+   hard[hardCount] = tris;
+
+/*  soft boundaries: cut a hard cluster wherever the part since the
+ *  last cut already has an ACMR close to that of the whole
+ */
+   n = 0;
+   for (k = 0; k < hardCount; k++) {
+      GLuint misses = 0, runMisses = 0, runTris = 0;
+      float limit;
+
+      s = hard[k];
+      e = hard[k + 1];
+      FLUSH(time);
+      for (t = s; t < e; t++)
+         misses += triangleMisses(indices + t * 3, stamp, &time);
+      limit = threshold * misses / (e - s);
+
+      FLUSH(time);
+      clusters[n].start = s;
+      for (t = s; t < e; t++) {
+         runMisses += triangleMisses(indices + t * 3, stamp, &time);
+         runTris++;
+         if (t + 1 < e && (float) runMisses / runTris <= limit) {
+            clusters[n++].end = t + 1;
+            clusters[n].start = t + 1;
+            FLUSH(time);
+            runMisses = runTris = 0;
+         }
+      }
+      clusters[n++].end = e;
+   }
+
+/*  sort key: how far the cluster's centroid lies along its own
+ *  normal from the centroid of the mesh
+ */
+   for (k = 0; k < n; k++) {
+      Cluster *cl = &clusters[k];
+      double area = 0, c[3] = { 0, 0, 0 }, nrm[3] = { 0, 0, 0 }, len;
+
+      for (t = cl->start; t < cl->end; t++) {
+         const GLfloat *p0 = positions + indices[t * 3] * stride;
+         const GLfloat *p1 = positions + indices[t * 3 + 1] * stride;
+         const GLfloat *p2 = positions + indices[t * 3 + 2] * stride;
+         double u[3], w[3], fn[3], a;
+
+         for (i = 0; i < 3; i++) {
+            u[i] = p1[i] - p0[i];
+            w[i] = p2[i] - p0[i];
+         }
+         fn[0] = u[1] * w[2] - u[2] * w[1];
+         fn[1] = u[2] * w[0] - u[0] * w[2];
+         fn[2] = u[0] * w[1] - u[1] * w[0];
+         a = sqrt(fn[0] * fn[0] + fn[1] * fn[1] + fn[2] * fn[2]);
+         for (i = 0; i < 3; i++) {
+            c[i] += a * (p0[i] + p1[i] + p2[i]) / 3;
+            nrm[i] += fn[i];
+         }
+         area += a;
+      }
+      for (i = 0; i < 3; i++)
+         meshCenter[i] += c[i];
+      meshArea += area;
+
+      len = sqrt(nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2]);
+      for (i = 0; i < 3; i++) {
+         cl->center[i] = (float) (area > 0 ? c[i] / area : 0);
+         cl->normal[i] = (float) (len > 0 ? nrm[i] / len : 0);
+      }
+   }
+   if (meshArea > 0)
+      for (i = 0; i < 3; i++)
+         meshCenter[i] /= meshArea;
+   for (k = 0; k < n; k++) {
+      Cluster *cl = &clusters[k];
+
+      cl->key = 0;
+      for (i = 0; i < 3; i++)
+         cl->key += (float) ((cl->center[i] - meshCenter[i]) * cl->normal[i]);
+   }
+   qsort(clusters, n, sizeof(Cluster), compareClusters);
+
+   sorted = (GLuint *) allocate(tris * 3 * sizeof(GLuint));
+   for (t = 0, k = 0; k < n; k++) {
+      GLuint size = (clusters[k].end - clusters[k].start) * 3;
+
+      memcpy(sorted + t, indices + clusters[k].start * 3,
+             size * sizeof(GLuint));
+      t += size;
+   }
+   memcpy(indices, sorted, tris * 3 * sizeof(GLuint));
+
+   free(sorted);
+   free(hard);
+   free(stamp);
+   free(clusters);
+   return n;
+}
+
+/*  Append range r of b to dst as a triangle list, dropping degenerate
+ *  triangles; returns the number of indices written.
+ */
+static GLuint triangleList(GLuint *dst, const MeshBuilder *b,
+                           const MeshRange *r)
+{
+   const GLuint *s = b->indices + r->first;
+   GLuint n = 0, a, c, d;
+   GLsizei i;
+
+   for (i = 0; i + 2 < r->count; i++) {
+      if (r->mode == GL_TRIANGLES) {
+         if (i % 3)
+            continue;
+         a = s[i]; c = s[i + 1]; d = s[i + 2];
+      }
+      else if (r->mode == GL_TRIANGLE_FAN) {
+         a = s[0]; c = s[i + 1]; d = s[i + 2];
+      }
+      else if (i & 1) {       /* strip: odd triangles are wound back */
+         a = s[i + 1]; c = s[i]; d = s[i + 2];
+      }
+      else {
+         a = s[i]; c = s[i + 1]; d = s[i + 2];
+      }
+      if (a == c || c == d || a == d)
+         continue;
+      dst[n++] = a;
+      dst[n++] = c;
+      dst[n++] = d;
+   }
+   return n;
+}
+
+static int isTriangles(GLenum mode)
+{
+   return mode == GL_TRIANGLES || mode == GL_TRIANGLE_STRIP ||
+          mode == GL_TRIANGLE_FAN;
+}
+
+void meshOptimize(MeshBuilder *b, MeshOptStats *stats)
+{
+   GLuint *indices, *before, *after, *remap;
+   GLuint total = 0, n, beforeCount = 0, afterCount = 0, clusters = 0;
+   GLuint k, used;
+   GLfloat *verts;
+   int i, fpv = b->floatsPerVertex;
+
+   initScores();
+/*  a strip of n indices makes at most n - 2 triangles  */
+   for (i = 0; i < b->rangeCount; i++)
+      total += isTriangles(b->ranges[i].mode) ? b->ranges[i].count * 3 :
+                                                b->ranges[i].count;
+   indices = (GLuint *) allocate(total * sizeof(GLuint));
+   before = (GLuint *) allocate(total * sizeof(GLuint));
+   after = (GLuint *) allocate(total * sizeof(GLuint));
+
+   n = 0;
+   for (i = 0; i < b->rangeCount; i++) {
+      MeshRange *r = &b->ranges[i];
+      GLuint count;
+
+      if (!isTriangles(r->mode)) {
+         memcpy(indices + n, b->indices + r->first, r->count * sizeof(GLuint));
+         r->first = n;
+         n += r->count;
+         continue;
+      }
+      count = triangleList(before + beforeCount, b, r);
+      meshoptVertexCache(indices + n, before + beforeCount, count,
+                         b->vertexCount);
+      clusters += meshoptOverdraw(indices + n, count, b->verts, fpv,
+                                  b->vertexCount,
+                                  MESHOPT_OVERDRAW_THRESHOLD);
+      memcpy(after + afterCount, indices + n, count * sizeof(GLuint));
+      beforeCount += count;
+      afterCount += count;
+      r->mode = GL_TRIANGLES;
+      r->first = n;
+      r->count = count;
+      n += count;
+   }
+
+/*  vertex fetch: number vertices in order of first use, dropping
+ *  those no range refers to
+ */
+   remap = (GLuint *) allocate(b->vertexCount * sizeof(GLuint));
+   memset(remap, 0xff, b->vertexCount * sizeof(GLuint));
+   verts = (GLfloat *) allocate(b->maxVerts * fpv * sizeof(GLfloat));
+   used = 0;
+   for (k = 0; k < n; k++) {
+      GLuint v = indices[k];
+
+      if (remap[v] == (GLuint) ~0) {
+         remap[v] = used;
+         memcpy(verts + used * fpv, b->verts + v * fpv,
+                fpv * sizeof(GLfloat));
+         used++;
+      }
+      indices[k] = remap[v];
+   }
+
+   if (stats) {
+      GLuint tris = beforeCount / 3, missesBefore, missesAfter;
+      GLuint referenced = 0;
+
+      for (k = 0; k < afterCount; k++)
+         after[k] = remap[after[k]];
+      for (k = 0; k < beforeCount; k++)
+         before[k] = remap[before[k]];
+      memset(remap, 0, used * sizeof(GLuint));
+      for (k = 0; k < afterCount; k++)
+         if (remap[after[k]]++ == 0)
+            referenced++;
+      missesBefore = meshoptCacheMisses(before, beforeCount, used,
+                                        MESHOPT_CACHE_SIZE);
+      missesAfter = meshoptCacheMisses(after, afterCount, used,
+                                       MESHOPT_CACHE_SIZE);
+      stats->triangles = tris;
+      stats->vertices = used;
+      stats->clusters = clusters;
+      stats->acmrBefore = tris ? (float) missesBefore / tris : 0;
+      stats->acmrAfter = tris ? (float) missesAfter / tris : 0;
+      stats->atvrBefore = referenced ? (float) missesBefore / referenced : 0;
+      stats->atvrAfter = referenced ? (float) missesAfter / referenced : 0;
+   }
+
+   free(b->verts);
+   b->verts = verts;
+   b->vertexCount = used;
+   free(b->indices);
+   b->indices = indices;
+   b->indexCount = n;
+   b->maxIndices = total;
+   free(before);
+   free(after);
+   free(remap);
+}
+
+typedef struct optimizejob {
+   MeshBuilder  **builders;
+   MeshOptStats  *stats;
+} OptimizeJob;
+
+static void optimizeJob(int index, void *user)
+{
+   OptimizeJob *job = (OptimizeJob *) user;
+
+   meshOptimize(job->builders[index], job->stats ? &job->stats[index] : NULL);
+}
+
+void meshOptimizeAll(MeshBuilder **b, MeshOptStats *stats, int count)
+{
+   OptimizeJob job;
+
+   initScores();
+   job.builders = b;
+   job.stats = stats;
+   jobsParallelFor(count, optimizeJob, &job);
+}
+
+void meshoptPrintStats(const char *name, const MeshOptStats *stats)
+{
+   printf("%s: %u triangles, %u vertices, %u clusters\n", name,
+          stats->triangles, stats->vertices, stats->clusters);
+   printf("   ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+          stats->acmrBefore, stats->acmrAfter,
+          stats->atvrBefore, stats->atvrAfter);
+}
@@ -0,0 +1,73 @@
+/*
+ *  meshopt.h
+ *  Index and vertex reordering for meshes built with a MeshBuilder.
+ *  Generated geometry comes out row by row, which keeps few vertices
+ *  in the post-transform cache.  meshOptimize() rewrites the triangle
+ *  ranges of a builder in three passes:
+ *
+ *     vertex cache  Forsyth's greedy ordering: triangles whose
+ *                   vertices are recently used, or have few triangles
+ *                   left, are emitted first.
+ *     overdraw      the cache friendly order is cut into clusters,
+ *                   which are sorted so that those facing away from
+ *                   the center of the mesh, and so likely to occlude
+ *                   the others, are drawn first.
+ *     vertex fetch  vertices are renumbered in the order they are
+ *                   first used, so the vertex buffer is read forward.
+ *
+ *  Triangle strips are converted to triangle lists; other ranges are
+ *  kept as they are.  The quality of an index order is measured with
+ *  a FIFO cache simulation: ACMR is transformed vertices per triangle
+ *  (0.5 is the ideal for a large regular grid, 3 the worst) and ATVR
+ *  is transformed vertices per vertex (1 is the ideal).
+ */
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include "mesh.h"
+
+/*  size of the simulated FIFO cache  */
+#define MESHOPT_CACHE_SIZE 16
+
+/*  a cluster is cut when its ACMR falls to this fraction of the ACMR
+ *  of the order it was taken from
+ */
+#define MESHOPT_OVERDRAW_THRESHOLD 1.05f
+
+typedef struct meshoptstats {
+   GLuint triangles;
+   GLuint vertices;
+   GLuint clusters;
+   float  acmrBefore, atvrBefore;
+   float  acmrAfter, atvrAfter;
+} MeshOptStats;
+
+/*  Simulate a FIFO cache of cacheSize entries over a triangle list;
+ *  returns the number of cache misses.
+ */
+GLuint meshoptCacheMisses(const GLuint *indices, GLuint count,
+                          GLuint vertexCount, int cacheSize);
+
+/*  Reorder the triangles of a triangle list for the vertex cache.
+ *  dst and indices may not overlap.
+ */
+void meshoptVertexCache(GLuint *dst, const GLuint *indices, GLuint count,
+                        GLuint vertexCount);
+
+/*  Reorder cache optimized triangles to reduce overdraw.  Positions
+ *  are read as 3 floats every stride floats.  Returns the number of
+ *  clusters.
+ */
+GLuint meshoptOverdraw(GLuint *indices, GLuint count,
+                       const GLfloat *positions, int stride,
+                       GLuint vertexCount, float threshold);
+
+/*  Optimize every triangle range of b in place.  stats may be NULL.  */
+void meshOptimize(MeshBuilder *b, MeshOptStats *stats);
+
+/*  Optimize several builders, one job per builder (see jobs.h).  */
+void meshOptimizeAll(MeshBuilder **b, MeshOptStats *stats, int count);
+
+void meshoptPrintStats(const char *name, const MeshOptStats *stats);
+
+#endif
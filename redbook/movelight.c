@@ -49,12 +49,195 @@
  *  Interaction:  pressing the left mouse button alters
  *  the modeling transformation (x rotation) by 30 degrees.
  *  The scene is then redrawn with the light in a new position.
+ *
+ *  Press 'h' to stand the torus over a floor of pillars and cast
+ *  shadows from the light with a cube shadow map, and 'd' to light it
+ *  instead by a sun, with cascaded shadow maps, which the mouse turns
+ *  around the vertical.  'a' turns the torus, the only dynamic caster,
+ *  in fixed ticks of a game loop (loop.h); the pillars are static and
+ *  their maps are drawn again only when the light moves.  '+' and '-'
+ *  change the number of pillars, 's' prints what the last update drew
+ *  and 'b' times updates with nothing, the torus and the light moving,
+ *  for growing numbers of pillars.
  */
+#define GL_GLEXT_PROTOTYPES
 #include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include "loop.h"
+#include "shadow.h"
+#include "timer.h"
+
+#define MIN_PILLARS   16
+#define MAX_PILLARS   4096
+#define LIGHT_RANGE   12.0
+#define SUN_DISTANCE  20.0
+#define BENCH_FRAMES  10
+#define TICK_RATE     60.0
+#define FRAME_RATE    60.0
+#define TURN_SPEED    120.0     /* degrees a second */
+#define PI_           3.14159265358979323846
 
 static int spin = 0;
 
+typedef struct pillar {
+   GLfloat x, z, size;
+} Pillar;
+
+static ShadowMaps pointShadows, sunShadows;
+static int shadowed = 0, directional = 0, turning = 0;
+static Pillar pillars[MAX_PILLARS];
+static int pillarCount = 256;
+static GLfloat torusAngle = 0.0, lastTorusAngle = 0.0;
+static GLfloat drawnAngle = 0.0;          /* between the two */
+static int torusCaster;
+static GameLoop loop;
+
+static void drawTorus(void *data)
+{
+   glRotatef(drawnAngle, 0.0, 1.0, 0.0);
+   glutSolidTorus (0.275, 0.85, 8, 15);
+}
+
+static void drawPillar(void *data)
+{
+   const Pillar *p = (const Pillar *) data;
+
+   glTranslatef(p->x, -1.5 + 0.15, p->z);
+   glScalef(p->size, 0.3, p->size);
+   glutSolidCube(1.0);
+}
+
+static void drawFloor(void)
+{
+   glNormal3f(0.0, 1.0, 0.0);
+   glBegin(GL_QUADS);
+   glVertex3f(-6.0, -1.5, 6.0);
+   glVertex3f(6.0, -1.5, 6.0);
+   glVertex3f(6.0, -1.5, -6.0);
+   glVertex3f(-6.0, -1.5, -6.0);
+   glEnd();
+}
+
+/*  The pillars on a square grid, and the casters of both kinds of
+ *  light.
+ */
+static void placePillars(void)
+{
+   ShadowMaps *maps[2] = { &pointShadows, &sunShadows };
+   GLfloat center[3] = { 0.0, 0.0, 0.0 };
+   int side = (int) ceil(sqrt((double) pillarCount));
+   GLfloat spacing = 10.0 / side;
+   int i, m;
+
+   for (i = 0; i < pillarCount; i++) {
+      pillars[i].x = -5.0 + spacing * (i % side + 0.5);
+      pillars[i].z = -5.0 + spacing * (i / side + 0.5);
+      pillars[i].size = spacing * 0.4;
+   }
+   for (m = 0; m < 2; m++) {
+      shadowClearCasters(maps[m]);
+      torusCaster = shadowAddCaster(maps[m], drawTorus, NULL, center,
+                                    1.125, 1);
+      for (i = 0; i < pillarCount; i++) {
+         GLfloat c[3], r = pillars[i].size * 0.5;
+
+         c[0] = pillars[i].x;
+         c[1] = -1.5 + 0.15;
+         c[2] = pillars[i].z;
+         shadowAddCaster(maps[m], drawPillar, &pillars[i], c,
+                         sqrt(2.0 * r * r + 0.15 * 0.15), 0);
+      }
+   }
+}
+
+/*  Where light 0 is, in world coordinates, for the spin.  */
+static void lightPosition(GLfloat light[3])
+{
+   GLdouble a = spin * PI_ / 180.0;
+
+   light[0] = 0.0;
+   light[1] = 1.5 - 1.5 * sin(a);
+   light[2] = 1.5 * cos(a);
+}
+
+static void sunDirection(GLfloat light[3])
+{
+   GLdouble a = spin * PI_ / 180.0;
+
+   light[0] = 0.6 * sin(a);
+   light[1] = 1.0;
+   light[2] = 0.6 * cos(a);
+}
+
+static ShadowMaps *currentShadows(void)
+{
+   return directional ? &sunShadows : &pointShadows;
+}
+
+/*  The torus over the pillars, lit with shadows; the modelview matrix
+ *  is the eye's view.
+ */
+static void drawShadowed(void)
+{
+   ShadowMaps *s = currentShadows();
+   GLfloat light[3];
+   int i;
+
+   if (directional) {
+      GLfloat position[4];
+
+      sunDirection(light);
+      position[0] = light[0];
+      position[1] = light[1];
+      position[2] = light[2];
+      position[3] = 0.0;
+      glLightfv (GL_LIGHT0, GL_POSITION, position);
+      shadowSetLight(s, light, SUN_DISTANCE);
+   } else {
+      lightPosition(light);
+      shadowSetLight(s, light, LIGHT_RANGE);
+   }
+   shadowUpdate(s);
+
+   shadowBegin(s);
+   drawFloor();
+   for (i = 0; i < pillarCount; i++) {
+      glPushMatrix();
+      drawPillar(&pillars[i]);
+      glPopMatrix();
+   }
+   glPushMatrix();
+   drawTorus(NULL);
+   glPopMatrix();
+   shadowEnd();
+}
+
+static void turn(double dt)
+{
+   lastTorusAngle = torusAngle;
+   torusAngle += TURN_SPEED * dt;
+   if (lastTorusAngle >= 360.0) {
+      torusAngle -= 360.0;
+      lastTorusAngle -= 360.0;
+   }
+}
+
+/*  Draw the torus at angle from now on, and tell the shadow maps if
+ *  that moved it.
+ */
+static void placeTorus(GLfloat angle)
+{
+   GLfloat center[3] = { 0.0, 0.0, 0.0 };
+
+   if (angle == drawnAngle)
+      return;
+   drawnAngle = angle;
+   shadowMoveCaster(&pointShadows, torusCaster, center);
+   shadowMoveCaster(&sunShadows, torusCaster, center);
+}
+
 /*  Initialize material property, light source, lighting model,
  *  and depth buffer.
  */
@@ -65,6 +248,11 @@ void init(void)
    glEnable(GL_LIGHTING);
    glEnable(GL_LIGHT0);
    glEnable(GL_DEPTH_TEST);
+
+   shadowInit(&pointShadows, SHADOW_POINT, 512, 1);
+   shadowInit(&sunShadows, SHADOW_DIRECTIONAL, 1024, 3);
+   placePillars();
+   loopInit(&loop, TICK_RATE, FRAME_RATE, turn);
 }
 
 /*  Here is where the light position is reset after the modeling
@@ -76,6 +264,8 @@ void display(void)
 {
    GLfloat position[] = { 0.0, 0.0, 1.5, 1.0 };
 
+   placeTorus(lastTorusAngle + (torusAngle - lastTorusAngle) *
+              (GLfloat) loopAlpha(&loop));
    glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
    glPushMatrix ();
    gluLookAt (0.0, 0.0, 5.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0);
@@ -88,11 +278,15 @@ void display(void)
    glTranslated (0.0, 0.0, 1.5);
    glDisable (GL_LIGHTING);
    glColor3f (0.0, 1.0, 1.0);
-   glutWireCube (0.1);
+   if (!(shadowed && directional))
+      glutWireCube (0.1);
    glEnable (GL_LIGHTING);
    glPopMatrix ();
 
-   glutSolidTorus (0.275, 0.85, 8, 15);
+   if (shadowed)
+      drawShadowed ();
+   else
+      drawTorus (NULL);
    glPopMatrix ();
    glFlush ();
 }
@@ -121,10 +315,118 @@ void mouse(int button, int state, int x, int y)
    }
 }
 
+/*  Time an update, brought up to date first, with nothing changed,
+ *  with the torus turned, and with the light moved.
+ */
+static void benchUpdates(ShadowMaps *s, double ms[3], int drawn[3])
+{
+   GLfloat light[3];
+   int i, k, saved = spin;
+
+   for (k = 0; k < 3; k++) {
+      shadowUpdate(s);
+      glFinish();
+      ms[k] = 0.0;
+      drawn[k] = 0;
+      for (i = 0; i < BENCH_FRAMES; i++) {
+         double t0;
+
+         if (k == 1) {
+            turn(1.0 / TICK_RATE);
+            placeTorus(torusAngle);
+         } else if (k == 2) {
+            spin = (spin + 1) % 360;
+            if (directional)
+               sunDirection(light);
+            else
+               lightPosition(light);
+            shadowSetLight(s, light, directional ? SUN_DISTANCE :
+                           LIGHT_RANGE);
+         }
+         t0 = timerSeconds();
+         shadowUpdate(s);
+         glFinish();
+         ms[k] += (timerSeconds() - t0) * 1000.0 / BENCH_FRAMES;
+         drawn[k] += s->stats.drawn;
+      }
+      drawn[k] /= BENCH_FRAMES;
+   }
+   spin = saved;
+}
+
+static void shadowBenchmark(void)
+{
+   ShadowMaps *s = currentShadows();
+   int saved = pillarCount, drawn[3];
+   double ms[3];
+
+   if (!shadowSupported(s)) {
+      printf("shadow maps need OpenGL 3.3\n");
+      return;
+   }
+   printf("%s shadows, ms per update (casters drawn)\n",
+          directional ? "cascaded sun" : "point light cube");
+   printf("pillars       still          torus turns     light moves\n");
+   glPushMatrix();
+   gluLookAt (0.0, 0.0, 5.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0);
+   for (pillarCount = 64; pillarCount <= MAX_PILLARS; pillarCount *= 4) {
+      placePillars();
+      benchUpdates(s, ms, drawn);
+      printf("%7d  %8.3f (%5d)  %8.3f (%5d)  %8.3f (%5d)\n", pillarCount,
+             ms[0], drawn[0], ms[1], drawn[1], ms[2], drawn[2]);
+   }
+   glPopMatrix();
+   pillarCount = saved;
+   placePillars();
+   glutPostRedisplay();
+}
+
 void keyboard(unsigned char key, int x, int y)
 {
    switch (key) {
+      case 'h':
+         shadowed = !shadowed;
+         if (shadowed && !shadowSupported(currentShadows())) {
+            printf("shadow maps need OpenGL 3.3\n");
+            shadowed = 0;
+         }
+         glutPostRedisplay();
+         break;
+      case 'd':
+         directional = !directional;
+         glutPostRedisplay();
+         break;
+      case 'a':
+         turning = !turning;
+         if (turning)
+            loopStart(&loop);
+         else
+            loopStop(&loop);
+         break;
+      case '+':
+         if (pillarCount < MAX_PILLARS)
+            pillarCount *= 2;
+         placePillars();
+         printf("%d pillars\n", pillarCount);
+         glutPostRedisplay();
+         break;
+      case '-':
+         if (pillarCount > MIN_PILLARS)
+            pillarCount /= 2;
+         placePillars();
+         printf("%d pillars\n", pillarCount);
+         glutPostRedisplay();
+         break;
+      case 's':
+         shadowPrintStats(directional ? "sun" : "point light",
+                          currentShadows());
+         break;
+      case 'b':
+         shadowBenchmark();
+         break;
       case 27:
+         shadowFree(&pointShadows);
+         shadowFree(&sunShadows);
          exit(0);
          break;
    }
@@ -0,0 +1,597 @@
+/*
+ *  occlusion.c
+ *  Occlusion culling with a CPU depth buffer.  See occlusion.h.
+ *
+ *  A buffer is drawn by one job, which sets up the occluder
+ *  triangles in chunks and then draws the buffer in bands of rows,
+ *  each on the pool when there are enough triangles.  Each band
+ *  clears its rows, draws every triangle that touches them and
+ *  builds the pyramid levels that lie within it; the few levels
+ *  above are built at the end.  Edges are walked in 1/16 pixel fixed
+ *  point as in raster.c.
+ */
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "occlusion.h"
+#include "jobs.h"
+#include "timer.h"
+
+#define SUBPIXEL     16
+#define CHUNK_SIZE   256        /* occluder triangles set up by one job */
+#define BAND_LEVELS  4          /* pyramid levels within a band */
+
+typedef struct otriangle {
+   int     x[3], y[3];          /* window coordinates, in SUBPIXEL units */
+   int     minx, miny, maxx, maxy;      /* pixels that may be covered */
+   GLfloat z, zx, zy;           /* farthest depth over pixel 0, 0, and
+                                   its steps */
+   GLfloat zmax;                /* farthest vertex */
+} OTriangle;
+
+typedef struct ochunk {
+   OTriangle *tris;
+   unsigned   count, max;
+} OChunk;
+
+typedef struct overtex {
+   GLfloat clip[4];
+} OVertex;
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("occlusion: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+void occlusionInit(OcclusionBuffer *o, int width, int height)
+{
+   int w, h, i;
+
+   memset(o, 0, sizeof(OcclusionBuffer));
+   if (width > OCCLUSION_MAX_SIZE)
+      width = OCCLUSION_MAX_SIZE;
+   if (height > OCCLUSION_MAX_SIZE)
+      height = OCCLUSION_MAX_SIZE;
+   w = (width + OCCLUSION_BAND - 1) / OCCLUSION_BAND * OCCLUSION_BAND;
+   h = (height + OCCLUSION_BAND - 1) / OCCLUSION_BAND * OCCLUSION_BAND;
+   if (w <= 0)
+      w = OCCLUSION_BAND;
+   if (h <= 0)
+      h = OCCLUSION_BAND;
+   o->width = w;
+   o->height = h;
+   for (;;) {
+      o->levelWidth[o->levels] = w;
+      o->levelHeight[o->levels] = h;
+      o->depth[o->levels] = (GLfloat *)
+         allocate(NULL, (size_t) w * h * sizeof(GLfloat));
+      for (i = 0; i < w * h; i++)
+         o->depth[o->levels][i] = 1.0;
+      o->levels++;
+      if (w == 1 && h == 1)
+         break;
+      w = (w + 1) / 2;
+      h = (h + 1) / 2;
+   }
+   o->parallelMin = OCCLUSION_PARALLEL_MIN;
+   o->group = (JobGroup *) allocate(NULL, sizeof(JobGroup));
+   o->group->pending = 0;
+}
+
+void occlusionFree(OcclusionBuffer *o)
+{
+   int i;
+
+   occlusionEnd(o);
+   for (i = 0; i < o->levels; i++)
+      free(o->depth[i]);
+   for (i = 0; i < o->maxChunks; i++)
+      free(o->chunks[i].tris);
+   free(o->chunks);
+   free(o->occluders);
+   free(o->first);
+   free(o->group);
+   memset(o, 0, sizeof(OcclusionBuffer));
+}
+
+void occlusionAddOccluder(OcclusionBuffer *o, const GLfloat matrix[16],
+                          const GLfloat *vertices, const GLuint *indices,
+                          int count)
+{
+   Occluder *oc;
+
+   if (o->occluderCount == o->maxOccluders) {
+      o->maxOccluders = o->maxOccluders ? o->maxOccluders * 2 : 16;
+      o->occluders = (Occluder *)
+         allocate(o->occluders, o->maxOccluders * sizeof(Occluder));
+   }
+   oc = &o->occluders[o->occluderCount++];
+   memcpy(oc->matrix, matrix, sizeof(oc->matrix));
+   oc->vertices = vertices;
+   oc->indices = indices;
+   oc->count = count;
+}
+
+static void transform(GLfloat r[4], const GLfloat m[16], const GLfloat v[3])
+{
+   int i;
+
+   for (i = 0; i < 4; i++)
+      r[i] = m[i] * v[0] + m[4 + i] * v[1] + m[8 + i] * v[2] + m[12 + i];
+}
+
+/*
+ *  Triangle setup
+ */
+static int floorDiv(int a, int b)
+{
+   return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static void setup(const OcclusionBuffer *o, OChunk *ch, const OVertex *v0,
+                  const OVertex *v1, const OVertex *v2)
+{
+   const OVertex *v[3];
+   OTriangle *t;
+   GLfloat x[3], y[3], z[3], dx1, dy1, dx2, dy2, dz1, dz2, area;
+   long long sarea;
+   int i;
+
+   v[0] = v0;
+   v[1] = v1;
+   v[2] = v2;
+   if (ch->count == ch->max) {
+      ch->max = ch->max ? ch->max * 2 : 256;
+      ch->tris = (OTriangle *)
+         allocate(ch->tris, ch->max * sizeof(OTriangle));
+   }
+   t = &ch->tris[ch->count];
+   for (i = 0; i < 3; i++) {
+      GLfloat w = 1.0f / v[i]->clip[3];
+
+      x[i] = (v[i]->clip[0] * w * 0.5f + 0.5f) * o->width;
+      y[i] = (v[i]->clip[1] * w * 0.5f + 0.5f) * o->height;
+      z[i] = v[i]->clip[2] * w * 0.5f + 0.5f;
+      t->x[i] = (int) floor(x[i] * SUBPIXEL + 0.5f);
+      t->y[i] = (int) floor(y[i] * SUBPIXEL + 0.5f);
+   }
+
+/*  back faces are hidden by the front faces of the same occluder  */
+   sarea = (long long) (t->x[1] - t->x[0]) * (t->y[2] - t->y[0]) -
+           (long long) (t->x[2] - t->x[0]) * (t->y[1] - t->y[0]);
+   if (sarea <= 0)
+      return;
+
+   t->minx = t->maxx = t->x[0];
+   t->miny = t->maxy = t->y[0];
+   t->zmax = z[0];
+   for (i = 1; i < 3; i++) {
+      if (t->x[i] < t->minx) t->minx = t->x[i];
+      if (t->x[i] > t->maxx) t->maxx = t->x[i];
+      if (t->y[i] < t->miny) t->miny = t->y[i];
+      if (t->y[i] > t->maxy) t->maxy = t->y[i];
+      if (z[i] > t->zmax) t->zmax = z[i];
+   }
+   t->minx = floorDiv(t->minx, SUBPIXEL);
+   t->miny = floorDiv(t->miny, SUBPIXEL);
+   t->maxx = floorDiv(t->maxx, SUBPIXEL);
+   t->maxy = floorDiv(t->maxy, SUBPIXEL);
+   if (t->minx < 0) t->minx = 0;
+   if (t->miny < 0) t->miny = 0;
+   if (t->maxx > o->width - 1) t->maxx = o->width - 1;
+   if (t->maxy > o->height - 1) t->maxy = o->height - 1;
+   if (t->minx > t->maxx || t->miny > t->maxy)
+      return;
+
+/*  depth plane through the snapped vertices, in pixels  */
+   for (i = 0; i < 3; i++) {
+      x[i] = (GLfloat) t->x[i] / SUBPIXEL;
+      y[i] = (GLfloat) t->y[i] / SUBPIXEL;
+   }
+   dx1 = x[1] - x[0]; dy1 = y[1] - y[0]; dz1 = z[1] - z[0];
+   dx2 = x[2] - x[0]; dy2 = y[2] - y[0]; dz2 = z[2] - z[0];
+   area = dx1 * dy2 - dx2 * dy1;
+   t->zx = (dz1 * dy2 - dz2 * dy1) / area;
+   t->zy = (dz2 * dx1 - dz1 * dx2) / area;
+   t->z = z[0] + t->zx * (0.5f - x[0]) + t->zy * (0.5f - y[0]) +
+          0.5f * (fabsf(t->zx) + fabsf(t->zy));
+   ch->count++;
+}
+
+/*  Sutherland-Hodgman against one clip plane, as in raster.c.  */
+static int clipPlane(OVertex *out, const OVertex *in, int n, int axis,
+                     GLfloat sign)
+{
+   int i, m = 0;
+
+   for (i = 0; i < n; i++) {
+      const OVertex *a = &in[i], *b = &in[(i + 1) % n];
+      GLfloat da = a->clip[3] - sign * a->clip[axis];
+      GLfloat db = b->clip[3] - sign * b->clip[axis];
+
+      if (da >= 0)
+         out[m++] = *a;
+      if ((da >= 0) != (db >= 0)) {
+         GLfloat s = da / (da - db);
+         int k;
+
+         for (k = 0; k < 4; k++)
+            out[m].clip[k] = a->clip[k] + s * (b->clip[k] - a->clip[k]);
+         m++;
+      }
+   }
+   return m;
+}
+
+static int outcode(const OVertex *v)
+{
+   int code = 0, axis;
+
+   for (axis = 0; axis < 3; axis++) {
+      if (v->clip[axis] < -v->clip[3])
+         code |= 1 << (axis * 2);
+      if (v->clip[axis] > v->clip[3])
+         code |= 2 << (axis * 2);
+   }
+   return code;
+}
+
+static void triangle(const OcclusionBuffer *o, OChunk *ch,
+                     const OVertex *a, const OVertex *b, const OVertex *d)
+{
+   OVertex poly[2][9];
+   int ca = outcode(a), cb = outcode(b), cd = outcode(d);
+   int n = 3, k, plane, cur = 0;
+
+   if (ca & cb & cd)
+      return;
+   if ((ca | cb | cd) == 0) {
+      setup(o, ch, a, b, d);
+      return;
+   }
+   poly[0][0] = *a;
+   poly[0][1] = *b;
+   poly[0][2] = *d;
+   for (plane = 0; plane < 6 && n >= 3; plane++) {
+      if (((ca | cb | cd) & (1 << plane)) == 0)
+         continue;
+      n = clipPlane(poly[!cur], poly[cur], n, plane / 2,
+                    (plane & 1) ? 1.0f : -1.0f);
+      cur = !cur;
+   }
+   for (k = 1; k + 1 < n; k++)
+      setup(o, ch, &poly[cur][0], &poly[cur][k], &poly[cur][k + 1]);
+}
+
+static void setupChunk(int index, void *user)
+{
+   OcclusionBuffer *o = (OcclusionBuffer *) user;
+   OChunk *ch = &o->chunks[index];
+   unsigned first = index * CHUNK_SIZE;
+   unsigned last = first + CHUNK_SIZE, i;
+   int lo = 0, hi = o->occluderCount - 1;
+
+   if (last > o->first[o->occluderCount])
+      last = o->first[o->occluderCount];
+   ch->count = 0;
+
+/*  the last occluder that starts at or before the chunk  */
+   while (lo < hi) {
+      int mid = (lo + hi + 1) / 2;
+
+      if (o->first[mid] <= first)
+         lo = mid;
+      else
+         hi = mid - 1;
+   }
+   for (i = first; i < last; i++) {
+      const Occluder *oc;
+      const GLuint *idx;
+      OVertex v[3];
+      int k;
+
+      while (i >= o->first[lo + 1])
+         lo++;
+      oc = &o->occluders[lo];
+      idx = oc->indices + (i - o->first[lo]) * 3;
+      for (k = 0; k < 3; k++)
+         transform(v[k].clip, oc->matrix, oc->vertices + idx[k] * 3);
+      triangle(o, ch, &v[0], &v[1], &v[2]);
+   }
+}
+
+/*
+ *  Drawing
+ */
+
+/*  An edge that crosses the drawn rectangle, stepped in 32 bit
+ *  integers.
+ */
+typedef struct edge {
+   int e;                       /* value at the first pixel of the row */
+   int dx, dy;                  /* steps for one pixel right and up */
+#ifdef __SSE2__
+   __m128i step;                /* 0, dx, 2 dx, 3 dx */
+#endif
+} Edge;
+
+/*  Keep the nearer of the stored depth and z in the four pixels from
+ *  d that are inside all the edges.
+ */
+static void draw4(GLfloat *d, const Edge *edges, int count, const int e[3],
+                  GLfloat z, GLfloat zx, GLfloat zmax)
+{
+#ifdef __SSE2__
+   __m128i m = _mm_set1_epi32(-1), minus1 = _mm_set1_epi32(-1);
+   __m128 zv, old, mask;
+   int i;
+
+   for (i = 0; i < count; i++) {
+      __m128i v = _mm_add_epi32(_mm_set1_epi32(e[i]), edges[i].step);
+
+      m = _mm_and_si128(m, _mm_cmpgt_epi32(v, minus1));
+   }
+   mask = _mm_castsi128_ps(m);
+   zv = _mm_add_ps(_mm_set1_ps(z),
+                   _mm_mul_ps(_mm_set1_ps(zx), _mm_setr_ps(0, 1, 2, 3)));
+   zv = _mm_min_ps(zv, _mm_set1_ps(zmax));
+   old = _mm_loadu_ps(d);
+   _mm_storeu_ps(d, _mm_or_ps(_mm_and_ps(mask, _mm_min_ps(old, zv)),
+                              _mm_andnot_ps(mask, old)));
+#else
+   int i, j;
+
+   for (j = 0; j < 4; j++) {
+      GLfloat v = z + j * zx;
+
+      for (i = 0; i < count; i++)
+         if (e[i] + j * edges[i].dx < 0)
+            break;
+      if (i < count)
+         continue;
+      if (v > zmax)
+         v = zmax;
+      if (v < d[j])
+         d[j] = v;
+   }
+#endif
+}
+
+/*  Draw the rows from y0 to y1 of a triangle.  The drawn rectangle
+ *  is widened to groups of four pixels, which the buffer width, a
+ *  multiple of OCCLUSION_BAND, always holds.
+ */
+static void drawTriangle(OcclusionBuffer *o, const OTriangle *t,
+                         int by0, int by1)
+{
+   Edge edges[3];
+   int x0 = t->minx & ~3, x1 = t->maxx | 3;
+   int y0 = t->miny > by0 ? t->miny : by0;
+   int y1 = t->maxy < by1 ? t->maxy : by1;
+   int count = 0, i, x, y;
+
+   if (y0 > y1)
+      return;
+
+/*  the edge from vertex i to the next is positive inside  */
+   for (i = 0; i < 3; i++) {
+      int j = (i + 1) % 3;
+      long long a = t->y[i] - t->y[j], b = t->x[j] - t->x[i];
+      long long e, lo, hi, sx, sy;
+
+      e = a * ((long long) x0 * SUBPIXEL + SUBPIXEL / 2 - t->x[i]) +
+          b * ((long long) y0 * SUBPIXEL + SUBPIXEL / 2 - t->y[i]);
+      sx = a * SUBPIXEL * (x1 - x0);
+      sy = b * SUBPIXEL * (y1 - y0);
+      lo = e + (sx < 0 ? sx : 0) + (sy < 0 ? sy : 0);
+      hi = e + (sx > 0 ? sx : 0) + (sy > 0 ? sy : 0);
+      if (hi < 0)
+         return;
+      if (lo >= 0)
+         continue;
+      edges[count].e = (int) e;
+      edges[count].dx = (int) (a * SUBPIXEL);
+      edges[count].dy = (int) (b * SUBPIXEL);
+#ifdef __SSE2__
+      edges[count].step = _mm_setr_epi32(0, edges[count].dx,
+                                         2 * edges[count].dx,
+                                         3 * edges[count].dx);
+#endif
+      count++;
+   }
+
+   for (y = y0; y <= y1; y++) {
+      GLfloat *row = o->depth[0] + y * o->width;
+      int e[3];
+
+      for (i = 0; i < count; i++)
+         e[i] = edges[i].e + (y - y0) * edges[i].dy;
+      for (x = x0; x <= x1; x += 4) {
+         draw4(row + x, edges, count, e, t->z + t->zx * x + t->zy * y,
+               t->zx, t->zmax);
+         for (i = 0; i < count; i++)
+            e[i] += 4 * edges[i].dx;
+      }
+   }
+}
+
+/*  Rows r0 to r1 - 1 of a pyramid level from the level below.  */
+static void reduce(OcclusionBuffer *o, int level, int r0, int r1)
+{
+   const GLfloat *src = o->depth[level - 1];
+   GLfloat *dst = o->depth[level];
+   int sw = o->levelWidth[level - 1], sh = o->levelHeight[level - 1];
+   int w = o->levelWidth[level], x, y;
+
+   for (y = r0; y < r1; y++) {
+      const GLfloat *a = src + 2 * y * sw;
+      const GLfloat *b = 2 * y + 1 < sh ? a + sw : a;
+
+      for (x = 0; x < w; x++) {
+         int x1 = 2 * x + 1 < sw ? 2 * x + 1 : 2 * x;
+         GLfloat m = a[2 * x];
+
+         if (a[x1] > m) m = a[x1];
+         if (b[2 * x] > m) m = b[2 * x];
+         if (b[x1] > m) m = b[x1];
+         dst[y * w + x] = m;
+      }
+   }
+}
+
+static void drawBand(int index, void *user)
+{
+   OcclusionBuffer *o = (OcclusionBuffer *) user;
+   int y0 = index * OCCLUSION_BAND, y1 = y0 + OCCLUSION_BAND - 1;
+   GLfloat *d = o->depth[0] + y0 * o->width;
+   int i, k;
+   unsigned j;
+
+   for (i = 0; i < OCCLUSION_BAND * o->width; i++)
+      d[i] = 1.0;
+   for (i = 0; i < o->chunkCount; i++) {
+      const OChunk *ch = &o->chunks[i];
+
+      for (j = 0; j < ch->count; j++) {
+         const OTriangle *t = &ch->tris[j];
+
+         if (t->maxy >= y0 && t->miny <= y1)
+            drawTriangle(o, t, y0, y1);
+      }
+   }
+   for (k = 1; k <= BAND_LEVELS && k < o->levels; k++)
+      reduce(o, k, y0 >> k, (y1 + 1) >> k);
+}
+
+static void drawBuffer(int index, void *user)
+{
+   OcclusionBuffer *o = (OcclusionBuffer *) user;
+   int bands = o->height / OCCLUSION_BAND, i;
+   double start = timerSeconds();
+
+   if (o->first[o->occluderCount] >= o->parallelMin) {
+      jobsParallelFor(o->chunkCount, setupChunk, o);
+      jobsParallelFor(bands, drawBand, o);
+   } else {
+      for (i = 0; i < o->chunkCount; i++)
+         setupChunk(i, o);
+      for (i = 0; i < bands; i++)
+         drawBand(i, o);
+   }
+   for (i = BAND_LEVELS + 1; i < o->levels; i++)
+      reduce(o, i, 0, o->levelHeight[i]);
+
+   o->triangles = 0;
+   for (i = 0; i < o->chunkCount; i++)
+      o->triangles += o->chunks[i].count;
+   o->drawTime = (timerSeconds() - start) * 1000.0;
+}
+
+void occlusionBegin(OcclusionBuffer *o)
+{
+   unsigned total = 0;
+   int i;
+
+   if (o->drawing)
+      occlusionEnd(o);
+   o->first = (unsigned *)
+      allocate(o->first, (o->occluderCount + 1) * sizeof(unsigned));
+   for (i = 0; i < o->occluderCount; i++) {
+      o->first[i] = total;
+      total += o->occluders[i].count / 3;
+   }
+   o->first[o->occluderCount] = total;
+
+   o->chunkCount = (total + CHUNK_SIZE - 1) / CHUNK_SIZE;
+   if (o->chunkCount > o->maxChunks) {
+      o->chunks = (OChunk *)
+         allocate(o->chunks, o->chunkCount * sizeof(OChunk));
+      memset(o->chunks + o->maxChunks, 0,
+             (o->chunkCount - o->maxChunks) * sizeof(OChunk));
+      o->maxChunks = o->chunkCount;
+   }
+   o->drawing = 1;
+   jobsSubmit(o->group, 1, drawBuffer, o);
+}
+
+void occlusionEnd(OcclusionBuffer *o)
+{
+   if (o->drawing) {
+      jobsWait(o->group);
+      o->drawing = 0;
+   }
+   o->occluderCount = 0;
+   o->tested = o->culled = 0;
+}
+
+int occlusionTestBox(OcclusionBuffer *o, const GLfloat matrix[16],
+                     const GLfloat min[3], const GLfloat max[3])
+{
+   GLfloat x0 = 1e30f, y0 = 1e30f, x1 = -1e30f, y1 = -1e30f, zmin = 1e30f;
+   int ix0, iy0, ix1, iy1, level, w, x, y, i;
+   const GLfloat *d;
+
+   o->tested++;
+   for (i = 0; i < 8; i++) {
+      GLfloat p[3], c[4], sx, sy, sz;
+
+      p[0] = (i & 1) ? max[0] : min[0];
+      p[1] = (i & 2) ? max[1] : min[1];
+      p[2] = (i & 4) ? max[2] : min[2];
+      transform(c, matrix, p);
+      if (c[3] <= 0 || c[2] < -c[3])
+         return 1;
+      sx = (c[0] / c[3] * 0.5f + 0.5f) * o->width;
+      sy = (c[1] / c[3] * 0.5f + 0.5f) * o->height;
+      sz = c[2] / c[3] * 0.5f + 0.5f;
+      if (sx < x0) x0 = sx;
+      if (sx > x1) x1 = sx;
+      if (sy < y0) y0 = sy;
+      if (sy > y1) y1 = sy;
+      if (sz < zmin) zmin = sz;
+   }
+   if (x1 < 0 || y1 < 0 || x0 >= o->width || y0 >= o->height || zmin > 1) {
+      o->culled++;
+      return 0;
+   }
+   ix0 = x0 < 0 ? 0 : (int) x0;
+   iy0 = y0 < 0 ? 0 : (int) y0;
+   ix1 = x1 >= o->width ? o->width - 1 : (int) x1;
+   iy1 = y1 >= o->height ? o->height - 1 : (int) y1;
+
+   for (level = 0; level < o->levels - 1; level++)
+      if ((ix1 >> level) - (ix0 >> level) <= 1 &&
+          (iy1 >> level) - (iy0 >> level) <= 1)
+         break;
+   d = o->depth[level];
+   w = o->levelWidth[level];
+   for (y = iy0 >> level; y <= iy1 >> level; y++)
+      for (x = ix0 >> level; x <= ix1 >> level; x++)
+         if (zmin <= d[y * w + x])
+            return 1;
+   o->culled++;
+   return 0;
+}
+
+void occlusionGLMatrix(GLfloat m[16])
+{
+   GLfloat p[16], mv[16];
+   int i, j;
+
+   glGetFloatv(GL_PROJECTION_MATRIX, p);
+   glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+   for (i = 0; i < 4; i++)
+      for (j = 0; j < 4; j++)
+         m[i * 4 + j] = p[j] * mv[i * 4] + p[4 + j] * mv[i * 4 + 1] +
+                        p[8 + j] * mv[i * 4 + 2] + p[12 + j] * mv[i * 4 + 3];
+}
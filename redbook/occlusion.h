@@ -0,0 +1,98 @@
+/*
+ *  occlusion.h
+ *  Occlusion culling against a small depth buffer drawn on the CPU.
+ *  A few large objects that hide others (walls, terrain, buildings)
+ *  are added as occluders, and occlusionBegin() draws them into a
+ *  low resolution depth buffer on the worker pool (jobs.h), four
+ *  pixels at a time with SSE2 where it is available.  Above the
+ *  buffer is a pyramid in which each texel holds the farthest depth
+ *  of the four below it.  After occlusionEnd(), occlusionTestBox()
+ *  projects a box, picks the level at which the box covers at most
+ *  two texels across and reports the box hidden if its nearest
+ *  point is behind all of them.
+ *
+ *  occlusionBegin() returns at once.  A program can draw the buffer
+ *  for the next frame while GL renders this one and wait for it at
+ *  the start of the next display; the buffer is then one frame old,
+ *  which is exact for occluders and a camera that have not moved.
+ *
+ *  Coverage is sampled at pixel centers, as GL does, and each pixel
+ *  keeps the farthest depth of the occluder over the whole pixel, so
+ *  a box is only culled wrongly where it shows less than half a
+ *  buffer pixel past the edge of an occluder.
+ */
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#define OCCLUSION_WIDTH         256
+#define OCCLUSION_HEIGHT        128
+#define OCCLUSION_MAX_SIZE      1024
+#define OCCLUSION_BAND          16      /* rows drawn by one job */
+#define OCCLUSION_MAX_LEVELS    11
+#define OCCLUSION_PARALLEL_MIN  256     /* triangles */
+
+/*  A triangle mesh, as packed x, y, z vertices and indices, with the
+ *  matrix from its object coordinates to clip coordinates.  The
+ *  arrays are read until occlusionEnd().  Front faces wind
+ *  counterclockwise, as in GL, and back faces are skipped, so an
+ *  occluder should be closed or only seen from the front.
+ */
+typedef struct occluder {
+   GLfloat         matrix[16];
+   const GLfloat  *vertices;
+   const GLuint   *indices;
+   int             count;               /* indices */
+} Occluder;
+
+typedef struct occlusionbuffer {
+   int                width, height, levels;
+   GLfloat           *depth[OCCLUSION_MAX_LEVELS];   /* window z, 0 near */
+   int                levelWidth[OCCLUSION_MAX_LEVELS];
+   int                levelHeight[OCCLUSION_MAX_LEVELS];
+
+   Occluder          *occluders;
+   int                occluderCount, maxOccluders;
+   unsigned          *first;            /* first triangle of each */
+   struct ochunk     *chunks;           /* set up triangles */
+   int                chunkCount, maxChunks;
+   unsigned           parallelMin;      /* triangles from which the
+                                           buffer is drawn by several
+                                           jobs */
+   int                drawing;          /* between begin and end */
+   struct jobgroup   *group;
+
+   unsigned           triangles;        /* drawn in the last buffer */
+   double             drawTime;         /* ms to draw the last buffer */
+   unsigned           tested, culled;   /* boxes since occlusionEnd() */
+} OcclusionBuffer;
+
+/*  The buffer covers the whole viewport whatever its shape; width
+ *  and height are rounded up to a multiple of OCCLUSION_BAND.
+ */
+void occlusionInit(OcclusionBuffer *o, int width, int height);
+void occlusionFree(OcclusionBuffer *o);
+
+void occlusionAddOccluder(OcclusionBuffer *o, const GLfloat matrix[16],
+                          const GLfloat *vertices, const GLuint *indices,
+                          int count);
+
+/*  Start drawing the occluders added since occlusionEnd().  Boxes
+ *  must not be tested, nor occluders added, until the next
+ *  occlusionEnd(), which waits for the buffer.
+ */
+void occlusionBegin(OcclusionBuffer *o);
+void occlusionEnd(OcclusionBuffer *o);
+
+/*  Whether any of the box from min to max, under matrix (object to
+ *  clip coordinates), may be visible.  Boxes that cross the near
+ *  plane are visible; boxes outside the view are not.
+ */
+int occlusionTestBox(OcclusionBuffer *o, const GLfloat matrix[16],
+                     const GLfloat min[3], const GLfloat max[3]);
+
+/*  The projection matrix times the modelview matrix of the current
+ *  GL context, for occluders and boxes drawn with that state.
+ */
+void occlusionGLMatrix(GLfloat m[16]);
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ *  optimize.c
+ *  This program demonstrates mesh optimization.  A sphere, a
+ *  cylinder, a disk and a Bezier patch are generated the way the
+ *  GLU quadrics and the evaluators tessellate them, band by band,
+ *  and are then reordered for the post-transform vertex cache, for
+ *  overdraw and for vertex fetch.  The meshes are optimized at load
+ *  time, one job per mesh on a pool of worker threads.
+ *
+ *  Press "o" to switch between the original and the optimized
+ *  meshes, "s" to print the cache statistics of each mesh and "b"
+ *  to time drawing both versions.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mesh.h"
+#include "meshopt.h"
+#include "shapes.h"
+#include "jobs.h"
+#include "timer.h"
+
+#ifdef GL_VERSION_1_5
+#define NUM_SHAPES 4
+#define BENCH_FRAMES 200
+
+static const char *names[NUM_SHAPES] = {
+   "sphere", "cylinder", "disk", "patch"
+};
+
+static const GLfloat ctrlpoints[4][4][3] = {
+   { {-1.5, -1.5, 4.0}, {-0.5, -1.5, 2.0},
+     {0.5, -1.5, -1.0}, {1.5, -1.5, 2.0}},
+   { {-1.5, -0.5, 1.0}, {-0.5, -0.5, 3.0},
+     {0.5, -0.5, 0.0}, {1.5, -0.5, -1.0}},
+   { {-1.5, 0.5, 4.0}, {-0.5, 0.5, 0.0},
+     {0.5, 0.5, 3.0}, {1.5, 0.5, 4.0}},
+   { {-1.5, 1.5, -2.0}, {-0.5, 1.5, -2.0},
+     {0.5, 1.5, 0.0}, {1.5, 1.5, -1.0}}
+};
+
+static Mesh original[NUM_SHAPES], optimized[NUM_SHAPES];
+static MeshOptStats stats[NUM_SHAPES];
+static int showOptimized = 1;
+
+static void buildShape(MeshBuilder *b, int i)
+{
+   meshBuilderInit(b, MESH_NORMAL);
+   switch (i) {
+   case 0:
+      shapeSphere(b, 0.75, 64, 48);
+      break;
+   case 1:
+      shapeCylinder(b, 0.5, 0.3, 1.0, 64, 16);
+      break;
+   case 2:
+      shapeDisk(b, 0.25, 1.0, 64, 8);
+      break;
+   case 3:
+      shapeBezierPatch(b, ctrlpoints, 48, 48);
+      break;
+   }
+}
+
+static void init(void)
+{
+   GLfloat mat_ambient[] = { 0.5, 0.5, 0.5, 1.0 };
+   GLfloat mat_specular[] = { 1.0, 1.0, 1.0, 1.0 };
+   GLfloat mat_shininess[] = { 50.0 };
+   GLfloat light_position[] = { 1.0, 1.0, 1.0, 0.0 };
+   MeshBuilder b[NUM_SHAPES], *bp[NUM_SHAPES];
+   double start;
+   int i;
+
+   for (i = 0; i < NUM_SHAPES; i++) {
+      buildShape(&b[i], i);
+      meshCompile(&original[i], &b[i]);
+      bp[i] = &b[i];
+   }
+   start = timerSeconds();
+   meshOptimizeAll(bp, stats, NUM_SHAPES);
+   printf("optimized %d meshes in %.2f ms on %d threads\n", NUM_SHAPES,
+          (timerSeconds() - start) * 1000.0, jobsThreadCount() + 1);
+   for (i = 0; i < NUM_SHAPES; i++) {
+      meshCompile(&optimized[i], &b[i]);
+      meshBuilderFree(&b[i]);
+   }
+
+   glClearColor(0.0, 0.0, 0.0, 0.0);
+   glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
+   glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
+   glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
+   glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+   glEnable(GL_LIGHTING);
+   glEnable(GL_LIGHT0);
+   glEnable(GL_DEPTH_TEST);
+   glEnable(GL_NORMALIZE);
+}
+
+static void drawShapes(const Mesh *meshes)
+{
+   glPushMatrix();
+   glTranslatef(-1.0, -1.0, 0.0);
+   meshDraw(&meshes[0]);
+
+   glTranslatef(0.0, 2.0, 0.0);
+   glPushMatrix();
+   glRotatef(300.0, 1.0, 0.0, 0.0);
+   meshDraw(&meshes[1]);
+   glPopMatrix();
+
+   glTranslatef(2.0, -2.0, 0.0);
+   meshDraw(&meshes[2]);
+
+   glTranslatef(0.0, 2.0, 0.0);
+   glRotatef(85.0, 1.0, 1.0, 1.0);
+   glScalef(0.3, 0.3, 0.3);
+   meshDraw(&meshes[3]);
+   glPopMatrix();
+}
+
+void display(void)
+{
+   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+   drawShapes(showOptimized ? optimized : original);
+   glFlush();
+}
+
+static double timeShapes(const Mesh *meshes)
+{
+   double start;
+   int i;
+
+   glFinish();
+   start = timerSeconds();
+   for (i = 0; i < BENCH_FRAMES; i++)
+      drawShapes(meshes);
+   glFinish();
+   return (timerSeconds() - start) * 1000.0 / BENCH_FRAMES;
+}
+
+static void benchmark(void)
+{
+   printf("original:  %.3f ms per frame\n", timeShapes(original));
+   printf("optimized: %.3f ms per frame\n", timeShapes(optimized));
+   glutPostRedisplay();
+}
+
+void reshape(int w, int h)
+{
+   glViewport(0, 0, (GLsizei) w, (GLsizei) h);
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   if (w <= h)
+      glOrtho(-2.5, 2.5, -2.5*(GLfloat)h/(GLfloat)w,
+         2.5*(GLfloat)h/(GLfloat)w, -10.0, 10.0);
+   else
+      glOrtho(-2.5*(GLfloat)w/(GLfloat)h,
+         2.5*(GLfloat)w/(GLfloat)h, -2.5, 2.5, -10.0, 10.0);
+   glMatrixMode(GL_MODELVIEW);
+   glLoadIdentity();
+}
+
+void keyboard(unsigned char key, int x, int y)
+{
+   int i;
+
+   switch (key) {
+      case 'o':
+      case 'O':
+         showOptimized = !showOptimized;
+         printf("drawing %s meshes\n",
+                showOptimized ? "optimized" : "original");
+         glutPostRedisplay();
+         break;
+      case 's':
+      case 'S':
+         for (i = 0; i < NUM_SHAPES; i++)
+            meshoptPrintStats(names[i], &stats[i]);
+         break;
+      case 'b':
+      case 'B':
+         benchmark();
+         break;
+      case 27:
+         exit(0);
+         break;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   glutInit(&argc, argv);
+   glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB | GLUT_DEPTH);
+   glutInitWindowSize(500, 500);
+   glutInitWindowPosition(100, 100);
+   glutCreateWindow(argv[0]);
+   init();
+   glutDisplayFunc(display);
+   glutReshapeFunc(reshape);
+   glutKeyboardFunc(keyboard);
+   glutMainLoop();
+   return 0;
+}
+#else
+int main(int argc, char** argv)
+{
+    fprintf (stderr, "This program demonstrates a feature which is not in OpenGL before Version 1.5.\n");
+    fprintf (stderr, "If your implementation has the ARB_vertex_buffer_object extension,\n");
+    fprintf (stderr, "you may be able to modify this program to make it run.\n");
+    return 0;
+}
+#endif
@@ -0,0 +1,1604 @@
+/*
+ *  raster.c
+ *  Tiled software rasterizer.  See raster.h.
+ *
+ *  Window coordinates are snapped to 1/16 pixel and triangles are
+ *  walked with integer edge functions, with a top-left style rule so
+ *  that pixels on an edge shared by two triangles are drawn once.
+ *  Per tile, an edge that does not cross the tile is either dropped
+ *  (the tile is inside it) or rejects the triangle; the edges that
+ *  are left are small enough for 32 bit arithmetic and are stepped
+ *  four pixels at a time, with SSE2 where it is available.
+ *  Depth, 1/w and the attributes divided by w are interpolated as
+ *  planes in window space, which makes the attributes perspective
+ *  correct.
+ */
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "raster.h"
+#include "jobs.h"
+
+#define SUBPIXEL 16             /* fixed point steps per pixel */
+
+/*  interpolated vertex attributes  */
+#define ATTR_R    0
+#define ATTR_S    4
+#define ATTR_T    5
+#define ATTR_FOG  6             /* distance from the eye */
+#define NATTR     7
+
+/*  planes of a set up triangle  */
+#define PLANE_Z     0
+#define PLANE_INVW  1
+#define PLANE_ATTR  2
+#define NPLANES     (PLANE_ATTR + NATTR)
+
+typedef struct rvertex {
+   GLfloat clip[4];
+   GLfloat attr[NATTR];
+} RVertex;
+
+/*  State read while drawing fragments.  A copy is made whenever it
+ *  changes between queued triangles.
+ */
+typedef struct fragstate {
+   int     depthTest, depthMask;
+   GLenum  depthFunc;
+   int     stencilTest;
+   GLenum  stencilFunc;
+   GLint   stencilRef;
+   GLuint  stencilValueMask, stencilWriteMask;
+   GLenum  stencilFail, stencilZFail, stencilZPass;
+   int     blend;
+   GLenum  blendSrc, blendDst;
+   int     texture;
+   GLenum  texEnv, wrapS, wrapT, filter;
+   int     fog;
+   GLenum  fogMode;
+   GLfloat fogDensity, fogStart, fogEnd, fogColor[4];
+} FragState;
+
+typedef struct rtriangle {
+   int     x[3], y[3];          /* window coordinates, in SUBPIXEL units */
+   int     minx, miny, maxx, maxy;      /* pixels that may be covered */
+   int     flat;                /* color is color[], not interpolated */
+   int     state;
+   GLfloat color[4];
+   GLfloat plane[NPLANES][3];   /* a * x + b * y + c at pixel centers */
+} RTriangle;
+
+typedef struct bin {
+   unsigned *tris;
+   unsigned  count, max;
+} Bin;
+
+typedef struct rlight {
+   int     enabled;
+   GLfloat ambient[4], diffuse[4], specular[4];
+   GLfloat position[4];         /* eye coordinates */
+   GLfloat constant, linear, quadratic;
+} RLight;
+
+typedef struct rmaterial {
+   GLfloat ambient[4], diffuse[4], specular[4], emission[4];
+   GLfloat shininess;
+} RMaterial;
+
+struct rastercontext {
+   int        width, height;
+   GLubyte   *color;
+   GLfloat   *depth;
+   GLubyte   *stencil;
+   GLint      viewport[4];
+   GLfloat    clearColor[4], clearDepth;
+   GLint      clearStencil;
+
+   GLenum     matrixMode;
+   GLfloat    stack[2][RASTER_STACK][16];   /* modelview, projection */
+   int        top[2];
+   GLfloat    normalMatrix[9];
+   int        normalDirty;
+
+   int        lighting, normalize, cullFace;
+   GLenum     cullMode, shadeModel;
+   RLight     lights[RASTER_LIGHTS];
+   GLfloat    lightModelAmbient[4];
+   RMaterial  material;
+   GLfloat    current[4], normal[3], texCoord[2];
+
+   FragState  state;
+   int        stateDirty;
+   FragState *states;
+   int        stateCount, maxStates;
+
+   GLubyte   *texels;
+   GLsizei    texWidth, texHeight;
+
+   GLenum     mode;
+   RVertex   *verts;
+   int        vertCount, maxVerts;
+   const GLfloat *vertexPointer, *normalPointer, *colorPointer, *texPointer;
+   int        vertexSize, colorSize;
+   int        vertexStride, normalStride, colorStride, texStride;
+
+   RTriangle *tris;
+   unsigned   triCount, maxTris;
+   int        tilesX, tilesY;
+   Bin       *bins;
+};
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("raster: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+static void set4(GLfloat *d, GLfloat a, GLfloat b, GLfloat c, GLfloat e)
+{
+   d[0] = a; d[1] = b; d[2] = c; d[3] = e;
+}
+
+static void identity(GLfloat m[16])
+{
+   memset(m, 0, 16 * sizeof(GLfloat));
+   m[0] = m[5] = m[10] = m[15] = 1.0;
+}
+
+RasterContext *rasterCreate(int width, int height)
+{
+   RasterContext *c;
+   int i;
+
+   if (width < 1 || height < 1 ||
+       width > RASTER_MAX_SIZE || height > RASTER_MAX_SIZE) {
+      printf("rasterCreate: bad size %d x %d\n", width, height);
+      return NULL;
+   }
+   c = (RasterContext *) allocate(NULL, sizeof(RasterContext));
+   memset(c, 0, sizeof(*c));
+   c->width = width;
+   c->height = height;
+   c->color = (GLubyte *) allocate(NULL, (size_t) width * height * 4);
+   c->depth = (GLfloat *) allocate(NULL,
+                                   (size_t) width * height * sizeof(GLfloat));
+   c->stencil = (GLubyte *) allocate(NULL, (size_t) width * height);
+   memset(c->color, 0, (size_t) width * height * 4);
+   for (i = 0; i < width * height; i++)
+      c->depth[i] = 1.0;
+   memset(c->stencil, 0, (size_t) width * height);
+   c->viewport[2] = width;
+   c->viewport[3] = height;
+   c->clearDepth = 1.0;
+
+   c->matrixMode = GL_MODELVIEW;
+   identity(c->stack[0][0]);
+   identity(c->stack[1][0]);
+   c->normalDirty = 1;
+
+   c->cullMode = GL_BACK;
+   c->shadeModel = GL_SMOOTH;
+   for (i = 0; i < RASTER_LIGHTS; i++) {
+      RLight *l = &c->lights[i];
+
+      set4(l->ambient, 0.0, 0.0, 0.0, 1.0);
+      if (i == 0) {
+         set4(l->diffuse, 1.0, 1.0, 1.0, 1.0);
+         set4(l->specular, 1.0, 1.0, 1.0, 1.0);
+      }
+      else {
+         set4(l->diffuse, 0.0, 0.0, 0.0, 1.0);
+         set4(l->specular, 0.0, 0.0, 0.0, 1.0);
+      }
+      set4(l->position, 0.0, 0.0, 1.0, 0.0);
+      l->constant = 1.0;
+   }
+   set4(c->lightModelAmbient, 0.2, 0.2, 0.2, 1.0);
+   set4(c->material.ambient, 0.2, 0.2, 0.2, 1.0);
+   set4(c->material.diffuse, 0.8, 0.8, 0.8, 1.0);
+   set4(c->material.specular, 0.0, 0.0, 0.0, 1.0);
+   set4(c->material.emission, 0.0, 0.0, 0.0, 1.0);
+   set4(c->current, 1.0, 1.0, 1.0, 1.0);
+   c->normal[2] = 1.0;
+
+   c->state.depthFunc = GL_LESS;
+   c->state.depthMask = 1;
+   c->state.stencilFunc = GL_ALWAYS;
+   c->state.stencilValueMask = c->state.stencilWriteMask = 0xff;
+   c->state.stencilFail = c->state.stencilZFail =
+      c->state.stencilZPass = GL_KEEP;
+   c->state.blendSrc = GL_ONE;
+   c->state.blendDst = GL_ZERO;
+   c->state.texEnv = GL_MODULATE;
+   c->state.wrapS = c->state.wrapT = GL_REPEAT;
+   c->state.filter = GL_LINEAR;
+   c->state.fogMode = GL_EXP;
+   c->state.fogDensity = 1.0;
+   c->state.fogEnd = 1.0;
+   c->stateDirty = 1;
+
+   c->tilesX = (width + RASTER_TILE - 1) / RASTER_TILE;
+   c->tilesY = (height + RASTER_TILE - 1) / RASTER_TILE;
+   c->bins = (Bin *) allocate(NULL, c->tilesX * c->tilesY * sizeof(Bin));
+   memset(c->bins, 0, c->tilesX * c->tilesY * sizeof(Bin));
+   return c;
+}
+
+void rasterDestroy(RasterContext *c)
+{
+   int i;
+
+   if (c == NULL)
+      return;
+   for (i = 0; i < c->tilesX * c->tilesY; i++)
+      free(c->bins[i].tris);
+   free(c->bins);
+   free(c->tris);
+   free(c->verts);
+   free(c->states);
+   free(c->texels);
+   free(c->color);
+   free(c->depth);
+   free(c->stencil);
+   free(c);
+}
+
+/*  Fragment state changes: the state is copied for the next triangle.  */
+#define FRAG_STATE(c) ((c)->stateDirty = 1, &(c)->state)
+
+/*
+ *  Matrices
+ */
+static GLfloat *current(RasterContext *c)
+{
+   int k = c->matrixMode == GL_PROJECTION;
+
+   if (k == 0)
+      c->normalDirty = 1;
+   return c->stack[k][c->top[k]];
+}
+
+static void multiply(GLfloat r[16], const GLfloat a[16], const GLfloat b[16])
+{
+   GLfloat t[16];
+   int i, j;
+
+   for (i = 0; i < 4; i++)
+      for (j = 0; j < 4; j++)
+         t[j * 4 + i] = a[i] * b[j * 4] + a[4 + i] * b[j * 4 + 1] +
+                        a[8 + i] * b[j * 4 + 2] + a[12 + i] * b[j * 4 + 3];
+   memcpy(r, t, sizeof(t));
+}
+
+void rasterMatrixMode(RasterContext *c, GLenum mode)
+{
+   c->matrixMode = mode;
+}
+
+void rasterLoadIdentity(RasterContext *c)
+{
+   identity(current(c));
+}
+
+void rasterLoadMatrixf(RasterContext *c, const GLfloat m[16])
+{
+   memcpy(current(c), m, 16 * sizeof(GLfloat));
+}
+
+void rasterMultMatrixf(RasterContext *c, const GLfloat m[16])
+{
+   GLfloat *t = current(c);
+
+   multiply(t, t, m);
+}
+
+void rasterPushMatrix(RasterContext *c)
+{
+   int k = c->matrixMode == GL_PROJECTION;
+
+   if (c->top[k] + 1 < RASTER_STACK) {
+      memcpy(c->stack[k][c->top[k] + 1], c->stack[k][c->top[k]],
+             16 * sizeof(GLfloat));
+      c->top[k]++;
+   }
+}
+
+void rasterPopMatrix(RasterContext *c)
+{
+   int k = c->matrixMode == GL_PROJECTION;
+
+   if (c->top[k] > 0) {
+      c->top[k]--;
+      if (k == 0)
+         c->normalDirty = 1;
+   }
+}
+
+void rasterTranslatef(RasterContext *c, GLfloat x, GLfloat y, GLfloat z)
+{
+   GLfloat m[16];
+
+   identity(m);
+   m[12] = x; m[13] = y; m[14] = z;
+   rasterMultMatrixf(c, m);
+}
+
+void rasterRotatef(RasterContext *c, GLfloat angle,
+                   GLfloat x, GLfloat y, GLfloat z)
+{
+   GLfloat m[16], len = (GLfloat) sqrt(x * x + y * y + z * z);
+   GLfloat s, co, k;
+
+   if (len == 0)
+      return;
+   x /= len; y /= len; z /= len;
+   s = (GLfloat) sin(angle * 3.14159265358979323846 / 180.0);
+   co = (GLfloat) cos(angle * 3.14159265358979323846 / 180.0);
+   k = 1 - co;
+   identity(m);
+   m[0] = x * x * k + co;     m[4] = x * y * k - z * s;  m[8] = x * z * k + y * s;
+   m[1] = y * x * k + z * s;  m[5] = y * y * k + co;     m[9] = y * z * k - x * s;
+   m[2] = x * z * k - y * s;  m[6] = y * z * k + x * s;  m[10] = z * z * k + co;
+   rasterMultMatrixf(c, m);
+}
+
+void rasterScalef(RasterContext *c, GLfloat x, GLfloat y, GLfloat z)
+{
+   GLfloat m[16];
+
+   identity(m);
+   m[0] = x; m[5] = y; m[10] = z;
+   rasterMultMatrixf(c, m);
+}
+
+void rasterOrtho(RasterContext *c, GLfloat l, GLfloat r, GLfloat b,
+                 GLfloat t, GLfloat n, GLfloat f)
+{
+   GLfloat m[16];
+
+   identity(m);
+   m[0] = 2 / (r - l);
+   m[5] = 2 / (t - b);
+   m[10] = -2 / (f - n);
+   m[12] = -(r + l) / (r - l);
+   m[13] = -(t + b) / (t - b);
+   m[14] = -(f + n) / (f - n);
+   rasterMultMatrixf(c, m);
+}
+
+void rasterFrustum(RasterContext *c, GLfloat l, GLfloat r, GLfloat b,
+                   GLfloat t, GLfloat n, GLfloat f)
+{
+   GLfloat m[16];
+
+   memset(m, 0, sizeof(m));
+   m[0] = 2 * n / (r - l);
+   m[5] = 2 * n / (t - b);
+   m[8] = (r + l) / (r - l);
+   m[9] = (t + b) / (t - b);
+   m[10] = -(f + n) / (f - n);
+   m[11] = -1;
+   m[14] = -2 * f * n / (f - n);
+   rasterMultMatrixf(c, m);
+}
+
+void rasterPerspective(RasterContext *c, GLfloat fovy, GLfloat aspect,
+                       GLfloat n, GLfloat f)
+{
+   GLfloat t = n * (GLfloat) tan(fovy * 3.14159265358979323846 / 360.0);
+
+   rasterFrustum(c, -t * aspect, t * aspect, -t, t, n, f);
+}
+
+static void normalize3(GLfloat v[3])
+{
+   GLfloat len = (GLfloat) sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+
+   if (len > 0) {
+      v[0] /= len; v[1] /= len; v[2] /= len;
+   }
+}
+
+static void cross3(GLfloat r[3], const GLfloat a[3], const GLfloat b[3])
+{
+   r[0] = a[1] * b[2] - a[2] * b[1];
+   r[1] = a[2] * b[0] - a[0] * b[2];
+   r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+void rasterLookAt(RasterContext *c, GLfloat ex, GLfloat ey, GLfloat ez,
+                  GLfloat cx, GLfloat cy, GLfloat cz,
+                  GLfloat ux, GLfloat uy, GLfloat uz)
+{
+   GLfloat f[3], up[3], s[3], u[3], m[16];
+
+   f[0] = cx - ex; f[1] = cy - ey; f[2] = cz - ez;
+   up[0] = ux; up[1] = uy; up[2] = uz;
+   normalize3(f);
+   cross3(s, f, up);
+   normalize3(s);
+   cross3(u, s, f);
+   identity(m);
+   m[0] = s[0]; m[4] = s[1]; m[8] = s[2];
+   m[1] = u[0]; m[5] = u[1]; m[9] = u[2];
+   m[2] = -f[0]; m[6] = -f[1]; m[10] = -f[2];
+   rasterMultMatrixf(c, m);
+   rasterTranslatef(c, -ex, -ey, -ez);
+}
+
+/*  Inverse transpose of the modelview's upper 3 x 3, row major.  */
+static void updateNormalMatrix(RasterContext *c)
+{
+   const GLfloat *m = c->stack[0][c->top[0]];
+   GLfloat *n = c->normalMatrix;
+   GLfloat det;
+
+   n[0] = m[5] * m[10] - m[9] * m[6];
+   n[1] = m[9] * m[2] - m[1] * m[10];
+   n[2] = m[1] * m[6] - m[5] * m[2];
+   n[3] = m[8] * m[6] - m[4] * m[10];
+   n[4] = m[0] * m[10] - m[8] * m[2];
+   n[5] = m[4] * m[2] - m[0] * m[6];
+   n[6] = m[4] * m[9] - m[8] * m[5];
+   n[7] = m[8] * m[1] - m[0] * m[9];
+   n[8] = m[0] * m[5] - m[4] * m[1];
+   det = m[0] * n[0] + m[4] * n[1] + m[8] * n[2];
+   if (det != 0) {
+      int i;
+
+      for (i = 0; i < 9; i++)
+         n[i] /= det;
+   }
+   c->normalDirty = 0;
+}
+
+static void transform(GLfloat r[4], const GLfloat m[16], const GLfloat v[4])
+{
+   r[0] = m[0] * v[0] + m[4] * v[1] + m[8] * v[2] + m[12] * v[3];
+   r[1] = m[1] * v[0] + m[5] * v[1] + m[9] * v[2] + m[13] * v[3];
+   r[2] = m[2] * v[0] + m[6] * v[1] + m[10] * v[2] + m[14] * v[3];
+   r[3] = m[3] * v[0] + m[7] * v[1] + m[11] * v[2] + m[15] * v[3];
+}
+
+/*
+ *  State
+ */
+void rasterViewport(RasterContext *c, GLint x, GLint y,
+                    GLsizei width, GLsizei height)
+{
+   c->viewport[0] = x;
+   c->viewport[1] = y;
+   c->viewport[2] = width;
+   c->viewport[3] = height;
+}
+
+static void enable(RasterContext *c, GLenum cap, int on)
+{
+   if (cap >= GL_LIGHT0 && cap < GL_LIGHT0 + RASTER_LIGHTS) {
+      c->lights[cap - GL_LIGHT0].enabled = on;
+      return;
+   }
+   switch (cap) {
+   case GL_LIGHTING:
+      c->lighting = on;
+      break;
+   case GL_NORMALIZE:
+      c->normalize = on;
+      break;
+   case GL_CULL_FACE:
+      c->cullFace = on;
+      break;
+   case GL_DEPTH_TEST:
+      FRAG_STATE(c)->depthTest = on;
+      break;
+   case GL_STENCIL_TEST:
+      FRAG_STATE(c)->stencilTest = on;
+      break;
+   case GL_BLEND:
+      FRAG_STATE(c)->blend = on;
+      break;
+   case GL_TEXTURE_2D:
+      FRAG_STATE(c)->texture = on;
+      break;
+   case GL_FOG:
+      FRAG_STATE(c)->fog = on;
+      break;
+   default:
+      break;
+   }
+}
+
+void rasterEnable(RasterContext *c, GLenum cap)
+{
+   enable(c, cap, 1);
+}
+
+void rasterDisable(RasterContext *c, GLenum cap)
+{
+   enable(c, cap, 0);
+}
+
+void rasterClearColor(RasterContext *c, GLfloat r, GLfloat g, GLfloat b,
+                      GLfloat a)
+{
+   set4(c->clearColor, r, g, b, a);
+}
+
+void rasterClearDepth(RasterContext *c, GLfloat depth)
+{
+   c->clearDepth = depth;
+}
+
+void rasterClearStencil(RasterContext *c, GLint s)
+{
+   c->clearStencil = s;
+}
+
+static GLubyte toByte(GLfloat f)
+{
+   if (f <= 0)
+      return 0;
+   if (f >= 1)
+      return 255;
+   return (GLubyte) (f * 255 + 0.5f);
+}
+
+void rasterClear(RasterContext *c, GLbitfield mask)
+{
+   int i, n = c->width * c->height;
+
+   rasterFinish(c);
+   if (mask & GL_COLOR_BUFFER_BIT) {
+      GLubyte rgba[4];
+
+      for (i = 0; i < 4; i++)
+         rgba[i] = toByte(c->clearColor[i]);
+      for (i = 0; i < n; i++)
+         memcpy(c->color + i * 4, rgba, 4);
+   }
+   if (mask & GL_DEPTH_BUFFER_BIT) {
+      for (i = 0; i < n; i++)
+         c->depth[i] = c->clearDepth;
+   }
+   if (mask & GL_STENCIL_BUFFER_BIT)
+      memset(c->stencil, c->clearStencil & 0xff, n);
+}
+
+void rasterShadeModel(RasterContext *c, GLenum mode)
+{
+   c->shadeModel = mode;
+}
+
+void rasterCullFace(RasterContext *c, GLenum mode)
+{
+   c->cullMode = mode;
+}
+
+void rasterDepthFunc(RasterContext *c, GLenum func)
+{
+   FRAG_STATE(c)->depthFunc = func;
+}
+
+void rasterDepthMask(RasterContext *c, GLboolean flag)
+{
+   FRAG_STATE(c)->depthMask = flag != 0;
+}
+
+void rasterBlendFunc(RasterContext *c, GLenum sfactor, GLenum dfactor)
+{
+   FragState *s = FRAG_STATE(c);
+
+   s->blendSrc = sfactor;
+   s->blendDst = dfactor;
+}
+
+void rasterStencilFunc(RasterContext *c, GLenum func, GLint ref, GLuint mask)
+{
+   FragState *s = FRAG_STATE(c);
+
+   s->stencilFunc = func;
+   s->stencilRef = ref < 0 ? 0 : ref > 255 ? 255 : ref;
+   s->stencilValueMask = mask & 0xff;
+}
+
+void rasterStencilOp(RasterContext *c, GLenum fail, GLenum zfail,
+                     GLenum zpass)
+{
+   FragState *s = FRAG_STATE(c);
+
+   s->stencilFail = fail;
+   s->stencilZFail = zfail;
+   s->stencilZPass = zpass;
+}
+
+void rasterStencilMask(RasterContext *c, GLuint mask)
+{
+   FRAG_STATE(c)->stencilWriteMask = mask & 0xff;
+}
+
+void rasterLightfv(RasterContext *c, GLenum light, GLenum pname,
+                   const GLfloat *params)
+{
+   RLight *l;
+
+   if (light < GL_LIGHT0 || light >= GL_LIGHT0 + RASTER_LIGHTS)
+      return;
+   l = &c->lights[light - GL_LIGHT0];
+   switch (pname) {
+   case GL_AMBIENT:
+      memcpy(l->ambient, params, 4 * sizeof(GLfloat));
+      break;
+   case GL_DIFFUSE:
+      memcpy(l->diffuse, params, 4 * sizeof(GLfloat));
+      break;
+   case GL_SPECULAR:
+      memcpy(l->specular, params, 4 * sizeof(GLfloat));
+      break;
+   case GL_POSITION:
+      transform(l->position, c->stack[0][c->top[0]], params);
+      break;
+   default:
+      rasterLightf(c, light, pname, params[0]);
+      break;
+   }
+}
+
+void rasterLightf(RasterContext *c, GLenum light, GLenum pname, GLfloat param)
+{
+   RLight *l;
+
+   if (light < GL_LIGHT0 || light >= GL_LIGHT0 + RASTER_LIGHTS)
+      return;
+   l = &c->lights[light - GL_LIGHT0];
+   switch (pname) {
+   case GL_CONSTANT_ATTENUATION:
+      l->constant = param;
+      break;
+   case GL_LINEAR_ATTENUATION:
+      l->linear = param;
+      break;
+   case GL_QUADRATIC_ATTENUATION:
+      l->quadratic = param;
+      break;
+   default:
+      break;
+   }
+}
+
+void rasterLightModelfv(RasterContext *c, GLenum pname, const GLfloat *params)
+{
+   if (pname == GL_LIGHT_MODEL_AMBIENT)
+      memcpy(c->lightModelAmbient, params, 4 * sizeof(GLfloat));
+}
+
+/*  Only the front material is kept; lighting is one-sided.  */
+void rasterMaterialfv(RasterContext *c, GLenum face, GLenum pname,
+                      const GLfloat *params)
+{
+   RMaterial *m = &c->material;
+
+   if (face == GL_BACK)
+      return;
+   switch (pname) {
+   case GL_AMBIENT:
+      memcpy(m->ambient, params, 4 * sizeof(GLfloat));
+      break;
+   case GL_DIFFUSE:
+      memcpy(m->diffuse, params, 4 * sizeof(GLfloat));
+      break;
+   case GL_AMBIENT_AND_DIFFUSE:
+      memcpy(m->ambient, params, 4 * sizeof(GLfloat));
+      memcpy(m->diffuse, params, 4 * sizeof(GLfloat));
+      break;
+   case GL_SPECULAR:
+      memcpy(m->specular, params, 4 * sizeof(GLfloat));
+      break;
+   case GL_EMISSION:
+      memcpy(m->emission, params, 4 * sizeof(GLfloat));
+      break;
+   default:
+      rasterMaterialf(c, face, pname, params[0]);
+      break;
+   }
+}
+
+void rasterMaterialf(RasterContext *c, GLenum face, GLenum pname,
+                     GLfloat param)
+{
+   if (face != GL_BACK && pname == GL_SHININESS)
+      c->material.shininess = param;
+}
+
+void rasterFogi(RasterContext *c, GLenum pname, GLint param)
+{
+   rasterFogf(c, pname, (GLfloat) param);
+}
+
+void rasterFogf(RasterContext *c, GLenum pname, GLfloat param)
+{
+   FragState *s = FRAG_STATE(c);
+
+   switch (pname) {
+   case GL_FOG_MODE:
+      s->fogMode = (GLenum) param;
+      break;
+   case GL_FOG_DENSITY:
+      s->fogDensity = param;
+      break;
+   case GL_FOG_START:
+      s->fogStart = param;
+      break;
+   case GL_FOG_END:
+      s->fogEnd = param;
+      break;
+   default:
+      break;
+   }
+}
+
+void rasterFogfv(RasterContext *c, GLenum pname, const GLfloat *params)
+{
+   if (pname == GL_FOG_COLOR)
+      memcpy(FRAG_STATE(c)->fogColor, params, 4 * sizeof(GLfloat));
+   else
+      rasterFogf(c, pname, params[0]);
+}
+
+/*  Queued triangles sample the texture when they are drawn, so they
+ *  are drawn before it is replaced.
+ */
+void rasterTexImage2D(RasterContext *c, GLsizei width, GLsizei height,
+                      const GLubyte *pixels)
+{
+   rasterFinish(c);
+   c->texels = (GLubyte *) allocate(c->texels, (size_t) width * height * 4);
+   memcpy(c->texels, pixels, (size_t) width * height * 4);
+   c->texWidth = width;
+   c->texHeight = height;
+}
+
+void rasterTexParameteri(RasterContext *c, GLenum pname, GLint param)
+{
+   switch (pname) {
+   case GL_TEXTURE_WRAP_S:
+      FRAG_STATE(c)->wrapS = (GLenum) param;
+      break;
+   case GL_TEXTURE_WRAP_T:
+      FRAG_STATE(c)->wrapT = (GLenum) param;
+      break;
+   case GL_TEXTURE_MAG_FILTER:
+      FRAG_STATE(c)->filter = (GLenum) param;
+      break;
+   default:
+      break;
+   }
+}
+
+void rasterTexEnvi(RasterContext *c, GLenum mode)
+{
+   FRAG_STATE(c)->texEnv = mode;
+}
+
+/*
+ *  Vertices
+ */
+static void light(const RasterContext *c, const GLfloat eye[4],
+                  const GLfloat normal[3], GLfloat color[4])
+{
+   const RMaterial *m = &c->material;
+   const GLfloat *nm = c->normalMatrix;
+   GLfloat n[3];
+   int i, k;
+
+   n[0] = nm[0] * normal[0] + nm[1] * normal[1] + nm[2] * normal[2];
+   n[1] = nm[3] * normal[0] + nm[4] * normal[1] + nm[5] * normal[2];
+   n[2] = nm[6] * normal[0] + nm[7] * normal[1] + nm[8] * normal[2];
+   if (c->normalize)
+      normalize3(n);
+
+   for (k = 0; k < 3; k++)
+      color[k] = m->emission[k] + m->ambient[k] * c->lightModelAmbient[k];
+   for (i = 0; i < RASTER_LIGHTS; i++) {
+      const RLight *l = &c->lights[i];
+      GLfloat v[3], h[3], atten = 1.0, nl, nh;
+
+      if (!l->enabled)
+         continue;
+      if (l->position[3] != 0) {
+         GLfloat d;
+
+         for (k = 0; k < 3; k++)
+            v[k] = l->position[k] / l->position[3] - eye[k] / eye[3];
+         d = (GLfloat) sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+         atten = 1 / (l->constant + l->linear * d + l->quadratic * d * d);
+      }
+      else {
+         for (k = 0; k < 3; k++)
+            v[k] = l->position[k];
+      }
+      normalize3(v);
+      nl = n[0] * v[0] + n[1] * v[1] + n[2] * v[2];
+      for (k = 0; k < 3; k++)
+         color[k] += atten * l->ambient[k] * m->ambient[k];
+      if (nl <= 0)
+         continue;
+      h[0] = v[0]; h[1] = v[1]; h[2] = v[2] + 1;
+      normalize3(h);
+      nh = n[0] * h[0] + n[1] * h[1] + n[2] * h[2];
+      nh = nh > 0 ? (GLfloat) pow(nh, m->shininess) : 0;
+      for (k = 0; k < 3; k++)
+         color[k] += atten * (nl * l->diffuse[k] * m->diffuse[k] +
+                              nh * l->specular[k] * m->specular[k]);
+   }
+   color[3] = m->diffuse[3];
+   for (k = 0; k < 4; k++)
+      color[k] = color[k] < 0 ? 0 : color[k] > 1 ? 1 : color[k];
+}
+
+static RVertex *newVertex(RasterContext *c)
+{
+   if (c->vertCount == c->maxVerts) {
+      c->maxVerts = c->maxVerts ? c->maxVerts * 2 : 256;
+      c->verts = (RVertex *) allocate(c->verts, c->maxVerts * sizeof(RVertex));
+   }
+   return &c->verts[c->vertCount++];
+}
+
+static void processVertex(RasterContext *c, const GLfloat pos[4],
+                          const GLfloat normal[3], const GLfloat color[4],
+                          const GLfloat tex[2])
+{
+   RVertex *v = newVertex(c);
+   GLfloat eye[4];
+
+   transform(eye, c->stack[0][c->top[0]], pos);
+   transform(v->clip, c->stack[1][c->top[1]], eye);
+   if (c->lighting) {
+      if (c->normalDirty)
+         updateNormalMatrix(c);
+      light(c, eye, normal, &v->attr[ATTR_R]);
+   }
+   else
+      memcpy(&v->attr[ATTR_R], color, 4 * sizeof(GLfloat));
+   v->attr[ATTR_S] = tex[0];
+   v->attr[ATTR_T] = tex[1];
+   v->attr[ATTR_FOG] = (GLfloat) fabs(eye[2]);
+}
+
+void rasterColor3f(RasterContext *c, GLfloat r, GLfloat g, GLfloat b)
+{
+   set4(c->current, r, g, b, 1.0);
+}
+
+void rasterColor4f(RasterContext *c, GLfloat r, GLfloat g, GLfloat b,
+                   GLfloat a)
+{
+   set4(c->current, r, g, b, a);
+}
+
+void rasterNormal3f(RasterContext *c, GLfloat x, GLfloat y, GLfloat z)
+{
+   c->normal[0] = x; c->normal[1] = y; c->normal[2] = z;
+}
+
+void rasterTexCoord2f(RasterContext *c, GLfloat s, GLfloat t)
+{
+   c->texCoord[0] = s; c->texCoord[1] = t;
+}
+
+void rasterVertex3f(RasterContext *c, GLfloat x, GLfloat y, GLfloat z)
+{
+   GLfloat p[4];
+
+   set4(p, x, y, z, 1.0);
+   processVertex(c, p, c->normal, c->current, c->texCoord);
+}
+
+void rasterVertex2f(RasterContext *c, GLfloat x, GLfloat y)
+{
+   rasterVertex3f(c, x, y, 0.0);
+}
+
+/*
+ *  Triangle setup
+ */
+static int floorDiv(int a, int b)
+{
+   return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static void plane(GLfloat p[3], const GLfloat x[3], const GLfloat y[3],
+                  const GLfloat q[3], GLfloat area)
+{
+   GLfloat dx1 = x[1] - x[0], dy1 = y[1] - y[0];
+   GLfloat dx2 = x[2] - x[0], dy2 = y[2] - y[0];
+   GLfloat dq1 = q[1] - q[0], dq2 = q[2] - q[0];
+
+   p[0] = (dq1 * dy2 - dq2 * dy1) / area;
+   p[1] = (dq2 * dx1 - dq1 * dx2) / area;
+   p[2] = q[0] - p[0] * x[0] - p[1] * y[0];
+}
+
+static void setup(RasterContext *c, const RVertex *v0, const RVertex *v1,
+                  const RVertex *v2, const GLfloat *flat)
+{
+   const RVertex *v[3];
+   RTriangle *t;
+   GLfloat invw[3], wz[3], fx[3], fy[3], q[3], area;
+   int x[3], y[3], i, k, minX, maxX, minY, maxY;
+   long long a2;
+
+   v[0] = v0; v[1] = v1; v[2] = v2;
+   for (i = 0; i < 3; i++) {
+      GLfloat wx, wy;
+
+      invw[i] = 1 / v[i]->clip[3];
+      wx = (v[i]->clip[0] * invw[i] * 0.5f + 0.5f) * c->viewport[2] +
+           c->viewport[0];
+      wy = (v[i]->clip[1] * invw[i] * 0.5f + 0.5f) * c->viewport[3] +
+           c->viewport[1];
+      wz[i] = v[i]->clip[2] * invw[i] * 0.5f + 0.5f;
+      x[i] = (int) floor(wx * SUBPIXEL + 0.5f);
+      y[i] = (int) floor(wy * SUBPIXEL + 0.5f);
+   }
+   a2 = (long long) (x[1] - x[0]) * (y[2] - y[0]) -
+        (long long) (x[2] - x[0]) * (y[1] - y[0]);
+   if (a2 == 0)
+      return;
+   if (c->cullFace &&
+       (c->cullMode == GL_FRONT_AND_BACK ||
+        (c->cullMode == GL_BACK) == (a2 < 0)))
+      return;
+   if (a2 < 0) {
+      const RVertex *tv = v[1];
+      GLfloat tf;
+      int ti;
+
+      v[1] = v[2]; v[2] = tv;
+      ti = x[1]; x[1] = x[2]; x[2] = ti;
+      ti = y[1]; y[1] = y[2]; y[2] = ti;
+      tf = invw[1]; invw[1] = invw[2]; invw[2] = tf;
+      tf = wz[1]; wz[1] = wz[2]; wz[2] = tf;
+   }
+
+/*  pixels whose centers are inside the bounds, on the buffer  */
+   minX = maxX = x[0];
+   minY = maxY = y[0];
+   for (i = 1; i < 3; i++) {
+      if (x[i] < minX) minX = x[i];
+      if (x[i] > maxX) maxX = x[i];
+      if (y[i] < minY) minY = y[i];
+      if (y[i] > maxY) maxY = y[i];
+   }
+   minX = floorDiv(minX - SUBPIXEL / 2 + SUBPIXEL - 1, SUBPIXEL);
+   minY = floorDiv(minY - SUBPIXEL / 2 + SUBPIXEL - 1, SUBPIXEL);
+   maxX = floorDiv(maxX - SUBPIXEL / 2, SUBPIXEL);
+   maxY = floorDiv(maxY - SUBPIXEL / 2, SUBPIXEL);
+   if (minX < 0) minX = 0;
+   if (minY < 0) minY = 0;
+   if (maxX > c->width - 1) maxX = c->width - 1;
+   if (maxY > c->height - 1) maxY = c->height - 1;
+   if (minX > maxX || minY > maxY)
+      return;
+
+   if (c->stateDirty) {
+      if (c->stateCount == c->maxStates) {
+         c->maxStates = c->maxStates ? c->maxStates * 2 : 16;
+         c->states = (FragState *)
+            allocate(c->states, c->maxStates * sizeof(FragState));
+      }
+      c->states[c->stateCount++] = c->state;
+      c->stateDirty = 0;
+   }
+   if (c->triCount == c->maxTris) {
+      c->maxTris = c->maxTris ? c->maxTris * 2 : 1024;
+      c->tris = (RTriangle *) allocate(c->tris,
+                                       c->maxTris * sizeof(RTriangle));
+   }
+   t = &c->tris[c->triCount++];
+   for (i = 0; i < 3; i++) {
+      t->x[i] = x[i];
+      t->y[i] = y[i];
+      fx[i] = (GLfloat) x[i] / SUBPIXEL;
+      fy[i] = (GLfloat) y[i] / SUBPIXEL;
+   }
+   t->minx = minX; t->maxx = maxX;
+   t->miny = minY; t->maxy = maxY;
+   t->state = c->stateCount - 1;
+   t->flat = flat != NULL;
+   if (flat)
+      memcpy(t->color, flat, 4 * sizeof(GLfloat));
+
+   area = (GLfloat) a2 / (SUBPIXEL * SUBPIXEL);
+   if (area < 0)
+      area = -area;
+   plane(t->plane[PLANE_Z], fx, fy, wz, area);
+   plane(t->plane[PLANE_INVW], fx, fy, invw, area);
+   for (k = 0; k < NATTR; k++) {
+      for (i = 0; i < 3; i++)
+         q[i] = v[i]->attr[k] * invw[i];
+      plane(t->plane[PLANE_ATTR + k], fx, fy, q, area);
+   }
+}
+
+/*  Sutherland-Hodgman against one clip plane, given as the sign and
+ *  coordinate of the test  -w <= x  or  x <= w.
+ */
+static int clipPlane(RVertex *out, const RVertex *in, int n, int axis,
+                     GLfloat sign)
+{
+   int i, m = 0;
+
+   for (i = 0; i < n; i++) {
+      const RVertex *a = &in[i], *b = &in[(i + 1) % n];
+      GLfloat da = a->clip[3] - sign * a->clip[axis];
+      GLfloat db = b->clip[3] - sign * b->clip[axis];
+
+      if (da >= 0)
+         out[m++] = *a;
+      if ((da >= 0) != (db >= 0)) {
+         GLfloat s = da / (da - db);
+         RVertex *v = &out[m++];
+         int k;
+
+         for (k = 0; k < 4; k++)
+            v->clip[k] = a->clip[k] + s * (b->clip[k] - a->clip[k]);
+         for (k = 0; k < NATTR; k++)
+            v->attr[k] = a->attr[k] + s * (b->attr[k] - a->attr[k]);
+      }
+   }
+   return m;
+}
+
+static int outcode(const RVertex *v)
+{
+   int code = 0, axis;
+
+   for (axis = 0; axis < 3; axis++) {
+      if (v->clip[axis] < -v->clip[3])
+         code |= 1 << (axis * 2);
+      if (v->clip[axis] > v->clip[3])
+         code |= 2 << (axis * 2);
+   }
+   return code;
+}
+
+static void triangle(RasterContext *c, const RVertex *a, const RVertex *b,
+                     const RVertex *d, const RVertex *provoking)
+{
+   RVertex poly[2][9];
+   const GLfloat *flat = NULL;
+   int ca = outcode(a), cb = outcode(b), cd = outcode(d);
+   int n = 3, k, plane, cur = 0;
+
+   if (c->shadeModel == GL_FLAT)
+      flat = &provoking->attr[ATTR_R];
+   if (ca & cb & cd)
+      return;
+   if ((ca | cb | cd) == 0) {
+      setup(c, a, b, d, flat);
+      return;
+   }
+   poly[0][0] = *a;
+   poly[0][1] = *b;
+   poly[0][2] = *d;
+   for (plane = 0; plane < 6 && n >= 3; plane++) {
+      if (((ca | cb | cd) & (1 << plane)) == 0)
+         continue;
+      n = clipPlane(poly[!cur], poly[cur], n, plane / 2,
+                    (plane & 1) ? 1.0f : -1.0f);
+      cur = !cur;
+   }
+   for (k = 1; k + 1 < n; k++)
+      setup(c, &poly[cur][0], &poly[cur][k], &poly[cur][k + 1], flat);
+}
+
+/*  Assemble triangles from n processed vertices, through indices
+ *  when they are given.  The provoking vertex for flat shading is
+ *  the one OpenGL uses.
+ */
+static void assemble(RasterContext *c, GLenum mode, const GLuint *indices,
+                     int n)
+{
+   const RVertex *v = c->verts;
+   int i;
+
+#define V(i) (&v[indices ? indices[i] : (GLuint) (i)])
+   switch (mode) {
+   case GL_TRIANGLES:
+      for (i = 0; i + 2 < n; i += 3)
+         triangle(c, V(i), V(i + 1), V(i + 2), V(i + 2));
+      break;
+   case GL_TRIANGLE_STRIP:
+      for (i = 0; i + 2 < n; i++) {
+         if (i & 1)
+            triangle(c, V(i + 1), V(i), V(i + 2), V(i + 2));
+         else
+            triangle(c, V(i), V(i + 1), V(i + 2), V(i + 2));
+      }
+      break;
+   case GL_TRIANGLE_FAN:
+      for (i = 1; i + 1 < n; i++)
+         triangle(c, V(0), V(i), V(i + 1), V(i + 1));
+      break;
+   case GL_POLYGON:
+      for (i = 1; i + 1 < n; i++)
+         triangle(c, V(0), V(i), V(i + 1), V(0));
+      break;
+   case GL_QUADS:
+      for (i = 0; i + 3 < n; i += 4) {
+         triangle(c, V(i), V(i + 1), V(i + 2), V(i + 3));
+         triangle(c, V(i), V(i + 2), V(i + 3), V(i + 3));
+      }
+      break;
+   case GL_QUAD_STRIP:
+      for (i = 0; i + 3 < n; i += 2) {
+         triangle(c, V(i), V(i + 1), V(i + 3), V(i + 3));
+         triangle(c, V(i), V(i + 3), V(i + 2), V(i + 3));
+      }
+      break;
+   default:
+      break;
+   }
+#undef V
+}
+
+void rasterBegin(RasterContext *c, GLenum mode)
+{
+   c->mode = mode;
+   c->vertCount = 0;
+}
+
+void rasterEnd(RasterContext *c)
+{
+   assemble(c, c->mode, NULL, c->vertCount);
+   c->vertCount = 0;
+}
+
+void rasterVertexPointer(RasterContext *c, GLint size, GLsizei stride,
+                         const GLfloat *pointer)
+{
+   c->vertexPointer = pointer;
+   c->vertexSize = size;
+   c->vertexStride = stride ? stride : size * (int) sizeof(GLfloat);
+}
+
+void rasterNormalPointer(RasterContext *c, GLsizei stride,
+                         const GLfloat *pointer)
+{
+   c->normalPointer = pointer;
+   c->normalStride = stride ? stride : 3 * (int) sizeof(GLfloat);
+}
+
+void rasterColorPointer(RasterContext *c, GLint size, GLsizei stride,
+                        const GLfloat *pointer)
+{
+   c->colorPointer = pointer;
+   c->colorSize = size;
+   c->colorStride = stride ? stride : size * (int) sizeof(GLfloat);
+}
+
+void rasterTexCoordPointer(RasterContext *c, GLsizei stride,
+                           const GLfloat *pointer)
+{
+   c->texPointer = pointer;
+   c->texStride = stride ? stride : 2 * (int) sizeof(GLfloat);
+}
+
+#define ELEMENT(p, stride, i) \
+   ((const GLfloat *) ((const char *) (p) + (size_t) (stride) * (i)))
+
+/*  Process array elements first .. first + count - 1.  */
+static void processArrays(RasterContext *c, GLint first, GLsizei count)
+{
+   GLint i;
+
+   c->vertCount = 0;
+   for (i = first; i < first + count; i++) {
+      const GLfloat *p = ELEMENT(c->vertexPointer, c->vertexStride, i);
+      GLfloat pos[4], color[4];
+      const GLfloat *normal = c->normal, *tex = c->texCoord;
+
+      set4(pos, p[0], p[1], c->vertexSize > 2 ? p[2] : 0.0f, 1.0);
+      memcpy(color, c->current, sizeof(color));
+      if (c->colorPointer) {
+         const GLfloat *q = ELEMENT(c->colorPointer, c->colorStride, i);
+
+         color[0] = q[0]; color[1] = q[1]; color[2] = q[2];
+         if (c->colorSize > 3)
+            color[3] = q[3];
+      }
+      if (c->normalPointer)
+         normal = ELEMENT(c->normalPointer, c->normalStride, i);
+      if (c->texPointer)
+         tex = ELEMENT(c->texPointer, c->texStride, i);
+      processVertex(c, pos, normal, color, tex);
+   }
+}
+
+void rasterDrawArrays(RasterContext *c, GLenum mode, GLint first,
+                      GLsizei count)
+{
+   if (c->vertexPointer == NULL || count <= 0)
+      return;
+   processArrays(c, first, count);
+   assemble(c, mode, NULL, count);
+   c->vertCount = 0;
+}
+
+void rasterDrawElements(RasterContext *c, GLenum mode, GLsizei count,
+                        const GLuint *indices)
+{
+   GLuint max = 0;
+   GLsizei i;
+
+   if (c->vertexPointer == NULL || count <= 0)
+      return;
+   for (i = 0; i < count; i++)
+      if (indices[i] > max)
+         max = indices[i];
+   processArrays(c, 0, max + 1);
+   assemble(c, mode, indices, count);
+   c->vertCount = 0;
+}
+
+/*
+ *  Fragments
+ */
+static int compare(GLenum func, GLfloat a, GLfloat b)
+{
+   switch (func) {
+   case GL_NEVER:    return 0;
+   case GL_LESS:     return a < b;
+   case GL_EQUAL:    return a == b;
+   case GL_LEQUAL:   return a <= b;
+   case GL_GREATER:  return a > b;
+   case GL_NOTEQUAL: return a != b;
+   case GL_GEQUAL:   return a >= b;
+   default:          return 1;
+   }
+}
+
+static void stencilOp(const FragState *s, GLenum op, GLubyte *p)
+{
+   unsigned v = *p;
+
+   switch (op) {
+   case GL_ZERO:
+      v = 0;
+      break;
+   case GL_REPLACE:
+      v = (unsigned) s->stencilRef;
+      break;
+   case GL_INCR:
+      v = v < 255 ? v + 1 : 255;
+      break;
+   case GL_DECR:
+      v = v > 0 ? v - 1 : 0;
+      break;
+   case GL_INVERT:
+      v = ~v & 0xff;
+      break;
+   default:
+      return;
+   }
+   *p = (GLubyte) ((*p & ~s->stencilWriteMask) | (v & s->stencilWriteMask));
+}
+
+static int wrap(GLenum mode, int i, int size)
+{
+   if (mode == GL_REPEAT) {
+      i %= size;
+      return i < 0 ? i + size : i;
+   }
+   return i < 0 ? 0 : i >= size ? size - 1 : i;
+}
+
+static void texel(const RasterContext *c, int i, int j, GLfloat out[4])
+{
+   const GLubyte *p = c->texels + ((size_t) j * c->texWidth + i) * 4;
+   int k;
+
+   for (k = 0; k < 4; k++)
+      out[k] = p[k] * (1.0f / 255);
+}
+
+static void sample(const RasterContext *c, const FragState *st,
+                   GLfloat s, GLfloat t, GLfloat out[4])
+{
+   GLfloat u = s * c->texWidth, v = t * c->texHeight;
+
+   if (st->filter == GL_NEAREST) {
+      texel(c, wrap(st->wrapS, (int) floor(u), c->texWidth),
+            wrap(st->wrapT, (int) floor(v), c->texHeight), out);
+   }
+   else {
+      GLfloat t00[4], t10[4], t01[4], t11[4], fu, fv;
+      int i0, j0, i1, j1, k;
+
+      u -= 0.5f;
+      v -= 0.5f;
+      i0 = (int) floor(u);
+      j0 = (int) floor(v);
+      fu = u - i0;
+      fv = v - j0;
+      i1 = wrap(st->wrapS, i0 + 1, c->texWidth);
+      j1 = wrap(st->wrapT, j0 + 1, c->texHeight);
+      i0 = wrap(st->wrapS, i0, c->texWidth);
+      j0 = wrap(st->wrapT, j0, c->texHeight);
+      texel(c, i0, j0, t00);
+      texel(c, i1, j0, t10);
+      texel(c, i0, j1, t01);
+      texel(c, i1, j1, t11);
+      for (k = 0; k < 4; k++)
+         out[k] = (t00[k] * (1 - fu) + t10[k] * fu) * (1 - fv) +
+                  (t01[k] * (1 - fu) + t11[k] * fu) * fv;
+   }
+}
+
+static GLfloat factor(GLenum f, const GLfloat src[4], const GLfloat dst[4],
+                      int k)
+{
+   switch (f) {
+   case GL_ZERO:                return 0;
+   case GL_SRC_COLOR:           return src[k];
+   case GL_ONE_MINUS_SRC_COLOR: return 1 - src[k];
+   case GL_DST_COLOR:           return dst[k];
+   case GL_ONE_MINUS_DST_COLOR: return 1 - dst[k];
+   case GL_SRC_ALPHA:           return src[3];
+   case GL_ONE_MINUS_SRC_ALPHA: return 1 - src[3];
+   case GL_DST_ALPHA:           return dst[3];
+   case GL_ONE_MINUS_DST_ALPHA: return 1 - dst[3];
+   default:                     return 1;
+   }
+}
+
+static GLfloat evaluate(const GLfloat p[3], GLfloat x, GLfloat y)
+{
+   return p[0] * x + p[1] * y + p[2];
+}
+
+static void fragment(const RasterContext *c, const RTriangle *t,
+                     const FragState *st, int x, int y)
+{
+   size_t idx = (size_t) y * c->width + x;
+   GLfloat px = x + 0.5f, py = y + 0.5f;
+   GLfloat z = evaluate(t->plane[PLANE_Z], px, py);
+   GLfloat color[4], w = 0;
+   GLubyte *out;
+   int k;
+
+   z = z < 0 ? 0 : z > 1 ? 1 : z;
+   if (st->stencilTest) {
+      GLuint m = st->stencilValueMask;
+
+      if (!compare(st->stencilFunc, (GLfloat) (st->stencilRef & m),
+                   (GLfloat) (c->stencil[idx] & m))) {
+         stencilOp(st, st->stencilFail, &c->stencil[idx]);
+         return;
+      }
+   }
+   if (st->depthTest) {
+      if (!compare(st->depthFunc, z, c->depth[idx])) {
+         if (st->stencilTest)
+            stencilOp(st, st->stencilZFail, &c->stencil[idx]);
+         return;
+      }
+      if (st->depthMask)
+         c->depth[idx] = z;
+   }
+   if (st->stencilTest)
+      stencilOp(st, st->stencilZPass, &c->stencil[idx]);
+
+   if (!t->flat || st->texture || st->fog)
+      w = 1 / evaluate(t->plane[PLANE_INVW], px, py);
+   if (t->flat)
+      memcpy(color, t->color, sizeof(color));
+   else
+      for (k = 0; k < 4; k++)
+         color[k] = evaluate(t->plane[PLANE_ATTR + ATTR_R + k], px, py) * w;
+
+   if (st->texture && c->texels) {
+      GLfloat tex[4];
+
+      sample(c, st, evaluate(t->plane[PLANE_ATTR + ATTR_S], px, py) * w,
+             evaluate(t->plane[PLANE_ATTR + ATTR_T], px, py) * w, tex);
+      switch (st->texEnv) {
+      case GL_REPLACE:
+         memcpy(color, tex, sizeof(color));
+         break;
+      case GL_DECAL:
+         for (k = 0; k < 3; k++)
+            color[k] = color[k] * (1 - tex[3]) + tex[k] * tex[3];
+         break;
+      default:
+         for (k = 0; k < 4; k++)
+            color[k] *= tex[k];
+         break;
+      }
+   }
+   if (st->fog) {
+      GLfloat d = evaluate(t->plane[PLANE_ATTR + ATTR_FOG], px, py) * w;
+      GLfloat f;
+
+      if (st->fogMode == GL_LINEAR)
+         f = (st->fogEnd - d) / (st->fogEnd - st->fogStart);
+      else if (st->fogMode == GL_EXP2)
+         f = (GLfloat) exp(-(st->fogDensity * d) * (st->fogDensity * d));
+      else
+         f = (GLfloat) exp(-st->fogDensity * d);
+      f = f < 0 ? 0 : f > 1 ? 1 : f;
+      for (k = 0; k < 3; k++)
+         color[k] = f * color[k] + (1 - f) * st->fogColor[k];
+   }
+
+   out = c->color + idx * 4;
+   if (st->blend) {
+      GLfloat dst[4], src[4];
+
+      for (k = 0; k < 4; k++) {
+         src[k] = color[k] < 0 ? 0 : color[k] > 1 ? 1 : color[k];
+         dst[k] = out[k] * (1.0f / 255);
+      }
+      for (k = 0; k < 4; k++)
+         color[k] = src[k] * factor(st->blendSrc, src, dst, k) +
+                    dst[k] * factor(st->blendDst, src, dst, k);
+   }
+   for (k = 0; k < 4; k++)
+      out[k] = toByte(color[k]);
+}
+
+/*  An edge that crosses the tile, stepped in 32 bit integers.  */
+typedef struct edge {
+   int e;                       /* value at the first pixel of the row */
+   int dx, dy;                  /* steps for one pixel right and up */
+#ifdef __SSE2__
+   __m128i step;                /* 0, dx, 2 dx, 3 dx */
+#endif
+} Edge;
+
+/*  Coverage of four pixels from x, one bit each.  */
+static int cover4(const Edge *edges, int count, int e[3])
+{
+#ifdef __SSE2__
+   __m128i m = _mm_set1_epi32(-1), minus1 = _mm_set1_epi32(-1);
+   int i;
+
+   for (i = 0; i < count; i++) {
+      __m128i v = _mm_add_epi32(_mm_set1_epi32(e[i]), edges[i].step);
+
+      m = _mm_and_si128(m, _mm_cmpgt_epi32(v, minus1));
+   }
+   return _mm_movemask_ps(_mm_castsi128_ps(m));
+#else
+   int i, j, mask = 15;
+
+   for (i = 0; i < count; i++)
+      for (j = 0; j < 4; j++)
+         if (e[i] + j * edges[i].dx < 0)
+            mask &= ~(1 << j);
+   return mask;
+#endif
+}
+
+static void drawTriangle(RasterContext *c, const RTriangle *t,
+                         int tx0, int ty0, int tx1, int ty1)
+{
+   const FragState *st = &c->states[t->state];
+   Edge edges[3];
+   int x0 = t->minx > tx0 ? t->minx : tx0;
+   int y0 = t->miny > ty0 ? t->miny : ty0;
+   int x1 = t->maxx < tx1 ? t->maxx : tx1;
+   int y1 = t->maxy < ty1 ? t->maxy : ty1;
+   int count = 0, i, x, y;
+
+   if (x0 > x1 || y0 > y1)
+      return;
+
+/*  the edge from vertex i to the next is positive inside  */
+   for (i = 0; i < 3; i++) {
+      int j = (i + 1) % 3;
+      long long a = t->y[i] - t->y[j], b = t->x[j] - t->x[i];
+      long long e, lo, hi, sx, sy;
+
+      e = a * ((long long) x0 * SUBPIXEL + SUBPIXEL / 2 - t->x[i]) +
+          b * ((long long) y0 * SUBPIXEL + SUBPIXEL / 2 - t->y[i]);
+      if (!(a > 0 || (a == 0 && b < 0)))
+         e -= 1;
+      sx = a * SUBPIXEL * (x1 - x0);
+      sy = b * SUBPIXEL * (y1 - y0);
+      lo = e + (sx < 0 ? sx : 0) + (sy < 0 ? sy : 0);
+      hi = e + (sx > 0 ? sx : 0) + (sy > 0 ? sy : 0);
+      if (hi < 0)
+         return;
+      if (lo >= 0)
+         continue;
+      edges[count].e = (int) e;
+      edges[count].dx = (int) (a * SUBPIXEL);
+      edges[count].dy = (int) (b * SUBPIXEL);
+#ifdef __SSE2__
+      edges[count].step = _mm_setr_epi32(0, edges[count].dx,
+                                         2 * edges[count].dx,
+                                         3 * edges[count].dx);
+#endif
+      count++;
+   }
+
+   for (y = y0; y <= y1; y++) {
+      int e[3];
+
+      for (i = 0; i < count; i++)
+         e[i] = edges[i].e + (y - y0) * edges[i].dy;
+      for (x = x0; x <= x1; x += 4) {
+         int mask = count ? cover4(edges, count, e) : 15, j;
+
+         if (x + 4 > x1 + 1)
+            mask &= (1 << (x1 + 1 - x)) - 1;
+         for (j = 0; mask; j++, mask >>= 1)
+            if (mask & 1)
+               fragment(c, t, st, x + j, y);
+         for (i = 0; i < count; i++)
+            e[i] += 4 * edges[i].dx;
+      }
+   }
+}
+
+static void drawTile(int index, void *user)
+{
+   RasterContext *c = (RasterContext *) user;
+   const Bin *b = &c->bins[index];
+   int tx0 = (index % c->tilesX) * RASTER_TILE;
+   int ty0 = (index / c->tilesX) * RASTER_TILE;
+   int tx1 = tx0 + RASTER_TILE - 1, ty1 = ty0 + RASTER_TILE - 1;
+   unsigned i;
+
+   for (i = 0; i < b->count; i++)
+      drawTriangle(c, &c->tris[b->tris[i]], tx0, ty0, tx1, ty1);
+}
+
+void rasterFinish(RasterContext *c)
+{
+   unsigned i;
+   int tx, ty;
+
+   if (c->triCount == 0)
+      return;
+   for (i = 0; i < c->triCount; i++) {
+      const RTriangle *t = &c->tris[i];
+
+      for (ty = t->miny / RASTER_TILE; ty <= t->maxy / RASTER_TILE; ty++) {
+         for (tx = t->minx / RASTER_TILE; tx <= t->maxx / RASTER_TILE; tx++) {
+            Bin *b = &c->bins[ty * c->tilesX + tx];
+
+            if (b->count == b->max) {
+               b->max = b->max ? b->max * 2 : 64;
+               b->tris = (unsigned *)
+                  allocate(b->tris, b->max * sizeof(unsigned));
+            }
+            b->tris[b->count++] = i;
+         }
+      }
+   }
+   jobsParallelFor(c->tilesX * c->tilesY, drawTile, c);
+
+   for (i = 0; i < (unsigned) (c->tilesX * c->tilesY); i++)
+      c->bins[i].count = 0;
+   c->triCount = 0;
+   c->stateCount = 0;
+   c->stateDirty = 1;
+}
+
+const GLubyte *rasterPixels(RasterContext *c)
+{
+   rasterFinish(c);
+   return c->color;
+}
@@ -0,0 +1,137 @@
+/*
+ *  raster.h
+ *  A software rasterizer for the part of the fixed-function pipeline
+ *  the examples use, so that they can be rendered without a GPU or a
+ *  window system: depth and stencil tests, flat and smooth shading,
+ *  per vertex lighting, one 2D texture with repeat and clamp wrapping,
+ *  fog and blending.  The calls follow the GL calls of the same name
+ *  and take the same enums.
+ *
+ *  Primitives are transformed, lit and clipped as they are given, and
+ *  queued as set up triangles.  rasterFinish() (and anything that
+ *  reads or clears the buffers) bins the queued triangles into
+ *  RASTER_TILE square tiles and rasterizes the tiles in parallel on
+ *  the worker pool (jobs.h).  Each tile draws its triangles in the
+ *  order they were given, so the image does not depend on the number
+ *  of threads: the same calls give the same bytes on any machine with
+ *  IEEE single precision arithmetic.
+ *
+ *  Differences from OpenGL: there are no mipmaps and the texture is
+ *  always sampled with its magnification filter; GL_CLAMP clamps to
+ *  the edge texels; lights have no spot cone; the viewer is at
+ *  infinity and lighting is one-sided.
+ */
+#ifndef RASTER_H
+#define RASTER_H
+
+#define RASTER_MAX_SIZE  4096   /* largest width or height */
+#define RASTER_TILE      32
+#define RASTER_LIGHTS    8
+#define RASTER_STACK     32     /* matrix stack depth */
+
+typedef struct rastercontext RasterContext;
+
+RasterContext *rasterCreate(int width, int height);
+void rasterDestroy(RasterContext *c);
+
+/*  Draw everything queued.  */
+void rasterFinish(RasterContext *c);
+
+/*  The color buffer after rasterFinish(): RGBA bytes, rows from the
+ *  bottom, as glReadPixels() returns them.
+ */
+const GLubyte *rasterPixels(RasterContext *c);
+
+void rasterViewport(RasterContext *c, GLint x, GLint y,
+                    GLsizei width, GLsizei height);
+void rasterEnable(RasterContext *c, GLenum cap);
+void rasterDisable(RasterContext *c, GLenum cap);
+
+void rasterClearColor(RasterContext *c, GLfloat r, GLfloat g, GLfloat b,
+                      GLfloat a);
+void rasterClearDepth(RasterContext *c, GLfloat depth);
+void rasterClearStencil(RasterContext *c, GLint s);
+void rasterClear(RasterContext *c, GLbitfield mask);
+
+void rasterShadeModel(RasterContext *c, GLenum mode);
+void rasterCullFace(RasterContext *c, GLenum mode);
+void rasterDepthFunc(RasterContext *c, GLenum func);
+void rasterDepthMask(RasterContext *c, GLboolean flag);
+void rasterBlendFunc(RasterContext *c, GLenum sfactor, GLenum dfactor);
+void rasterStencilFunc(RasterContext *c, GLenum func, GLint ref,
+                       GLuint mask);
+void rasterStencilOp(RasterContext *c, GLenum fail, GLenum zfail,
+                     GLenum zpass);
+void rasterStencilMask(RasterContext *c, GLuint mask);
+
+void rasterMatrixMode(RasterContext *c, GLenum mode);
+void rasterLoadIdentity(RasterContext *c);
+void rasterLoadMatrixf(RasterContext *c, const GLfloat m[16]);
+void rasterMultMatrixf(RasterContext *c, const GLfloat m[16]);
+void rasterPushMatrix(RasterContext *c);
+void rasterPopMatrix(RasterContext *c);
+void rasterTranslatef(RasterContext *c, GLfloat x, GLfloat y, GLfloat z);
+void rasterRotatef(RasterContext *c, GLfloat angle,
+                   GLfloat x, GLfloat y, GLfloat z);
+void rasterScalef(RasterContext *c, GLfloat x, GLfloat y, GLfloat z);
+void rasterOrtho(RasterContext *c, GLfloat left, GLfloat right,
+                 GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar);
+void rasterFrustum(RasterContext *c, GLfloat left, GLfloat right,
+                   GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar);
+void rasterPerspective(RasterContext *c, GLfloat fovy, GLfloat aspect,
+                       GLfloat zNear, GLfloat zFar);
+void rasterLookAt(RasterContext *c, GLfloat eyex, GLfloat eyey, GLfloat eyez,
+                  GLfloat centerx, GLfloat centery, GLfloat centerz,
+                  GLfloat upx, GLfloat upy, GLfloat upz);
+
+/*  GL_POSITION is transformed by the modelview matrix when it is set,
+ *  as glLightfv() does.
+ */
+void rasterLightfv(RasterContext *c, GLenum light, GLenum pname,
+                   const GLfloat *params);
+void rasterLightf(RasterContext *c, GLenum light, GLenum pname,
+                  GLfloat param);
+void rasterLightModelfv(RasterContext *c, GLenum pname,
+                        const GLfloat *params);
+void rasterMaterialfv(RasterContext *c, GLenum face, GLenum pname,
+                      const GLfloat *params);
+void rasterMaterialf(RasterContext *c, GLenum face, GLenum pname,
+                     GLfloat param);
+
+void rasterFogi(RasterContext *c, GLenum pname, GLint param);
+void rasterFogf(RasterContext *c, GLenum pname, GLfloat param);
+void rasterFogfv(RasterContext *c, GLenum pname, const GLfloat *params);
+
+/*  The texture image is RGBA bytes with rows packed.  */
+void rasterTexImage2D(RasterContext *c, GLsizei width, GLsizei height,
+                      const GLubyte *pixels);
+void rasterTexParameteri(RasterContext *c, GLenum pname, GLint param);
+void rasterTexEnvi(RasterContext *c, GLenum mode);
+
+void rasterBegin(RasterContext *c, GLenum mode);
+void rasterEnd(RasterContext *c);
+void rasterVertex2f(RasterContext *c, GLfloat x, GLfloat y);
+void rasterVertex3f(RasterContext *c, GLfloat x, GLfloat y, GLfloat z);
+void rasterColor3f(RasterContext *c, GLfloat r, GLfloat g, GLfloat b);
+void rasterColor4f(RasterContext *c, GLfloat r, GLfloat g, GLfloat b,
+                   GLfloat a);
+void rasterNormal3f(RasterContext *c, GLfloat x, GLfloat y, GLfloat z);
+void rasterTexCoord2f(RasterContext *c, GLfloat s, GLfloat t);
+
+/*  Float vertex arrays; strides are in bytes, 0 for packed, and a
+ *  NULL pointer disables the array.
+ */
+void rasterVertexPointer(RasterContext *c, GLint size, GLsizei stride,
+                         const GLfloat *pointer);
+void rasterNormalPointer(RasterContext *c, GLsizei stride,
+                         const GLfloat *pointer);
+void rasterColorPointer(RasterContext *c, GLint size, GLsizei stride,
+                        const GLfloat *pointer);
+void rasterTexCoordPointer(RasterContext *c, GLsizei stride,
+                           const GLfloat *pointer);
+void rasterDrawArrays(RasterContext *c, GLenum mode, GLint first,
+                      GLsizei count);
+void rasterDrawElements(RasterContext *c, GLenum mode, GLsizei count,
+                        const GLuint *indices);
+
+#endif
@@ -50,317 +50,1340 @@
  * w/W - Rotate wrist
  * f/F - Open/close end effector fingers
  * g/G - Grab/release sphere (pega/solta a esfera)
+ * o/O - Toggle occlusion culling, printing how many parts the box hid
+ * p/P - Time a field of boxes with and without occlusion culling
+ * l/L - Toggle level of detail of the spheres and print its statistics
+ * k/K - Reach for the sphere on the floor by inverse kinematics
+ * j/J - Time the inverse kinematics solvers on many arms
+ * n/N - Crossfade to the next animation clip: pick and place, wave, none
+ * u/U - Toggle a sway added on top of the animation
+ * v/V - Time the animation of many arms and print the clip sizes
+ * x/X - Time importing, loading and placing a scene of a million nodes
+ * c/C - Time the entity store with a million entities
+ * d/D - Time drawing thousands of robots by indirect, instanced and
+ *       single draws
+ * m/M - Toggle low latency mode and print the input latency
+ * i/I - Print the input latency, from each key to the frame showing it
  * ESC - Exit
  */
+#define GL_GLEXT_PROTOTYPES
 #include <GL/glut.h>
+#include <math.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "anim.h"
+#include "chain.h"
+#include "ecs.h"
+#include "indirect.h"
+#include "input.h"
+#include "jobs.h"
+#include "lod.h"
+#include "loop.h"
+#include "occlusion.h"
+#include "scenefile.h"
+#include "shapes.h"
+#include "timer.h"
+
+#define PI_ 3.14159265358979323846
+
+#ifdef GL_VERSION_1_5
+
+#define BENCH_GRID 32       /* boxes on a side */
+#define BENCH_FRAMES 10
+#define IK_BENCH_CHAINS 4096
+#define ANIM_BENCH_INSTANCES 4096
+#define ANIM_RATE 30        /* authored frames per second */
+#define ARM_TRACKS 6        /* the joints of the arm and the fingers */
+#define SCENE_BENCH_NODES 1000000
+#define ECS_BENCH_ENTITIES 1000000
+#define ECS_BENCH_FRAMES 10
+#define CROWD_GRID 82       /* robots on a side, 15 parts each */
 
 // Ângulos de rotação para cada junta do robô
-static int base = 0;       // Rotação da base (horizontal)
-static int shoulder = 0;   // Junta do ombro (braço superior)
-static int elbow = 0;      // Junta do cotovelo
-static int twist = 0;      // Torção do antebraço (rotação no próprio eixo)
-static int wrist = 0;      // Junta do pulso
+static GLfloat base = 0;      // Rotação da base (horizontal)
+static GLfloat shoulder = 0;  // Junta do ombro (braço superior)
+static GLfloat elbow = 0;     // Junta do cotovelo
+static GLfloat twist = 0;     // Torção do antebraço (rotação no próprio eixo)
+static GLfloat wrist = 0;     // Junta do pulso
 static int fingers = 0;    // Abertura dos dedos do end effector
 
 // Estado de controle da esfera
 static int grabbed = 0;    // 0 = esfera livre, 1 = esfera na mão do robô
+static GLfloat floorSphere[3];    /* from the scene */
 
-void init(void)
+/*  The parts of the robot, the spheres and the box, their sizes,
+ *  colors and places, are a scene, imported when the program starts.
+ */
+static const char robotScene[] =
+   "material gray 0.3 0.3 0.3\n"
+   "material red 1 0 0\n"
+   "material green 0 1 0\n"
+   "material blue 0 0 1\n"
+   "material yellow 1 1 0\n"
+   "material amber 1 0.8 0\n"
+   "material ball 0.8 0.2 0.2\n"
+   "material wood 0.6 0.4 0.2\n"
+   "material lid 0.5 0.35 0.15\n"
+   "mesh cube\n"
+   "mesh sphere\n"
+   "joint base\n"
+   "joint shoulder\n"
+   "joint elbow\n"
+   "joint twist\n"
+   "joint wrist\n"
+   "joint fingers\n"
+   "node base - joint base 0 1 0\n"
+   "node floor base translate 0 -1.5 0 scale 2 0.3 1.5"
+      " mesh cube material gray\n"
+   "node shoulder base translate 0 -1.35 0 joint shoulder 0 0 1\n"
+   "node upperArm shoulder translate 0 1 0 scale 0.4 2 0.4"
+      " mesh cube material red\n"
+   "node elbow upperArm translate 0 1 0 joint elbow 0 0 1\n"
+   "node forearm elbow translate 0 1 0 joint twist 0 1 0"
+      " scale 0.35 2 0.35 mesh cube material green\n"
+   "node wrist forearm translate 0 1 0 joint wrist 0 0 1\n"
+   "node hand wrist translate 0 0.4 0 scale 0.3 0.8 0.3"
+      " mesh cube material blue\n"
+   "node gripper hand translate 0 0.4 0\n"
+   "# each finger opens about the gripper, in two segments\n"
+   "node finger1 gripper joint fingers 0 0 1\n"
+   "node finger1a finger1 translate -0.15 0.25 0 rotate -20 0 0 1"
+      " scale 0.12 0.5 0.12 mesh cube material yellow\n"
+   "node finger1b finger1 translate -0.15 0.5 0 rotate -15 0 0 1\n"
+   "node finger1tip finger1b translate 0 0.2 0 scale 0.1 0.4 0.1"
+      " mesh cube material amber\n"
+   "node finger2 gripper joint fingers 0 0 -1\n"
+   "node finger2a finger2 translate 0.15 0.25 0 rotate 20 0 0 1"
+      " scale 0.12 0.5 0.12 mesh cube material yellow\n"
+   "node finger2b finger2 translate 0.15 0.5 0 rotate 15 0 0 1\n"
+   "node finger2tip finger2b translate 0 0.2 0 scale 0.1 0.4 0.1"
+      " mesh cube material amber\n"
+   "node heldSphere gripper translate 0 0.5 0 mesh sphere material ball\n"
+   "node floorSphere - translate 3.5 -0.8 0 mesh sphere material ball\n"
+   "# the box, with its lid open 110 degrees about the back edge\n"
+   "node box - translate -3 -1.2 0\n"
+   "node boxBottom box scale 1.2 0.8 1.2 mesh cube material wood occluder\n"
+   "node boxFront box translate 0 0.4 0.6 scale 1.2 0.8 0.05"
+      " mesh cube material wood occluder\n"
+   "node boxBack box translate 0 0.4 -0.6 scale 1.2 0.8 0.05"
+      " mesh cube material wood occluder\n"
+   "node boxLeft box translate -0.6 0.4 0 scale 0.05 0.8 1.2"
+      " mesh cube material wood occluder\n"
+   "node boxRight box translate 0.6 0.4 0 scale 0.05 0.8 1.2"
+      " mesh cube material wood occluder\n"
+   "node lid box translate 0 0.8 -0.6 rotate -110 1 0 0\n"
+   "node lidPanel lid translate 0 0 0.6 scale 1.2 0.05 1.2"
+      " mesh cube material lid occluder\n";
+
+static const char *jointNames[ARM_TRACKS] = {
+   "base", "shoulder", "elbow", "twist", "wrist", "fingers"
+};
+static SceneFile scene;
+static int sceneJoints[ARM_TRACKS];
+static int cubeMesh, sphereMesh, boxNode;
+
+/*  Each part drawn, and the sphere, is an entity, placed by a node of
+ *  the scene.  The sphere is one entity, placed by the node between
+ *  the fingers while it is grabbed and by the one on the floor while
+ *  it is not.
+ */
+typedef struct part {
+   int      mesh, flags;           /* of the scene */
+   GLfloat  color[4], scale[3];
+   int      level;                 /* of detail */
+} Part;
+
+typedef struct ball {
+   int  floorNode, heldNode;
+} Ball;
+
+static EcsWorld entities;
+static int transformComponent, partComponent, linkComponent, ballComponent;
+
+/*  The arm as a joint chain, from the base to the wrist, for forward
+ *  and inverse kinematics.  Its tip is the center of the sphere held
+ *  between the fingers.
+ */
+static Chain arm;
+static GLfloat *armAngles[5] = { &base, &shoulder, &elbow, &twist, &wrist };
+
+/*  Authored motions, with a track for each joint of the arm and one
+ *  for the fingers, played by a fixed timestep loop while they run.
+ */
+enum { CLIP_PICK, CLIP_WAVE, CLIPS };
+static const char *clipNames[CLIPS] = { "pick and place", "wave" };
+static AnimClip clips[CLIPS], sway;
+static AnimInstance armAnim;
+static int playing = -1;
+static GameLoop loop;
+
+/*  Parts are tested against an occlusion buffer of the box, drawn on
+ *  worker threads while the previous frame renders.  The buffer is
+ *  stale after the window is reshaped, until the next frame.
+ */
+static OcclusionBuffer occlusion;
+static int culling = 1, occlusionStale = 1;
+
+/*  The spheres are drawn at a level of detail chosen from their size
+ *  on screen; each keeps its level between frames.
+ */
+static LodManager lod;
+static LodMesh sphereLod;
+static int fieldLevels[BENCH_GRID * BENCH_GRID];
+
+/*  Keys are queued as they arrive and applied when the next frame is
+ *  drawn, which records how long each took to reach the screen.
+ */
+static InputQueue input;
+
+/*  The robot drawn over and over for the draw call benchmark: its
+ *  cubes and spheres are the two meshes of an indirect batch.
+ */
+static IndirectBatch crowd;
+static int crowdCube, crowdSphere;
+
+static const GLfloat cubeVertices[8][3] = {
+   { -0.5, -0.5, -0.5 }, { 0.5, -0.5, -0.5 },
+   { -0.5,  0.5, -0.5 }, { 0.5,  0.5, -0.5 },
+   { -0.5, -0.5,  0.5 }, { 0.5, -0.5,  0.5 },
+   { -0.5,  0.5,  0.5 }, { 0.5,  0.5,  0.5 }
+};
+static const GLuint cubeIndices[36] = {
+   0, 2, 1,  1, 2, 3,   4, 5, 6,  5, 7, 6,
+   0, 1, 4,  1, 5, 4,   2, 6, 3,  3, 6, 7,
+   0, 4, 2,  2, 4, 6,   1, 3, 5,  3, 7, 5
+};
+
+/*  Whether a box of the given half size around the origin of the
+ *  current modelview matrix may be visible.
+ */
+static int visible(GLfloat size)
 {
-   glEnable(GL_DEPTH_TEST);
-   glClearColor(0.0, 0.0, 0.0, 0.0);
-   glShadeModel(GL_FLAT);
+   GLfloat m[16], min[3], max[3];
+
+   if (!culling || occlusionStale)
+      return 1;
+   occlusionGLMatrix(m);
+   min[0] = min[1] = min[2] = -size;
+   max[0] = max[1] = max[2] = size;
+   return occlusionTestBox(&occlusion, m, min, max);
 }
 
-void display(void)
+/*  A unit cube in the current color with a white outline.  The
+ *  static parts of the scene are occluders for the next frame.
+ */
+static void drawCube(int occluder)
 {
-   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-   
-   glPushMatrix();
-   
-   // BASE RETANGULAR (chão) - rotaciona horizontalmente
-   glRotatef((GLfloat)base, 0.0, 1.0, 0.0);  // Rotação horizontal (eixo Y)
-   
-   glPushMatrix();
-   glTranslatef(0.0, -1.5, 0.0);  // Posiciona a base no chão
-   glScalef(2.0, 0.3, 1.5);       // Base retangular larga
-   glColor3f(0.3, 0.3, 0.3);      // Cinza escuro
-   glutSolidCube(1.0);
-   glColor3f(1, 1, 1);            // Wireframe branco
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   // SHOULDER (braço superior) - rotaciona verticalmente
-   glTranslatef(0.0, -1.35, 0.0); // Posiciona acima da base
-   glRotatef((GLfloat)shoulder, 0.0, 0.0, 1.0);  // Rotação do ombro (eixo Z)
-   glTranslatef(0.0, 1.0, 0.0);   // Desloca para desenhar o braço
-   
-   glPushMatrix();
-   glScalef(0.4, 2.0, 0.4);       // Braço vertical e fino
-   glColor3f(1.0, 0.0, 0.0);      // Vermelho
-   glutSolidCube(1.0);
-   glColor3f(1, 1, 1);
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   // ELBOW (antebraço) - rotaciona no final do shoulder
-   glTranslatef(0.0, 1.0, 0.0);   // Move para o topo do braço superior
-   glRotatef((GLfloat)elbow, 0.0, 0.0, 1.0);     // Rotação do cotovelo (eixo Z)
-   glTranslatef(0.0, 1.0, 0.0);   // Desloca para desenhar o antebraço
-   
-   // TWIST (torção do antebraço) - rotaciona no próprio eixo
-   glRotatef((GLfloat)twist, 0.0, 1.0, 0.0);     // Rotação de torção (eixo Y)
-   
-   glPushMatrix();
-   glScalef(0.35, 2.0, 0.35);     // Antebraço um pouco mais fino
-   glColor3f(0.0, 1.0, 0.0);      // Verde
-   glutSolidCube(1.0);
-   glColor3f(1, 1, 1);
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   // WRIST (pulso) - rotaciona no final do elbow
-   glTranslatef(0.0, 1.0, 0.0);   // Move para o topo do antebraço
-   glRotatef((GLfloat)wrist, 0.0, 0.0, 1.0);     // Rotação do pulso (eixo Z)
-   glTranslatef(0.0, 0.4, 0.0);   // Desloca para desenhar o pulso
-   
-   glPushMatrix();
-   glScalef(0.3, 0.8, 0.3);       // Pulso pequeno
-   glColor3f(0.0, 0.0, 1.0);      // Azul
-   glutSolidCube(1.0);
-   glColor3f(1, 1, 1);
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   // END EFFECTOR (garra com 2 dedos, cada um com 2 segmentos)
-   glTranslatef(0.0, 0.4, 0.0);   // Move para o topo do pulso
-   
-   // DEDO 1 (esquerdo)
-   glPushMatrix();
-   glRotatef((GLfloat)fingers, 0.0, 0.0, 1.0);   // Abre/fecha rotacionando em Z
-   
-   // Primeiro segmento do dedo 1
-   glTranslatef(-0.15, 0.25, 0.0);
-   glPushMatrix();
-   glRotatef(-20.0, 0.0, 0.0, 1.0);  // Inclina levemente
-   glScalef(0.12, 0.5, 0.12);
-   glColor3f(1.0, 1.0, 0.0);      // Amarelo
-   glutSolidCube(1.0);
-   glColor3f(1, 1, 1);
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   // Segundo segmento do dedo 1
-   glTranslatef(0.0, 0.25, 0.0);
-   glRotatef(-15.0, 0.0, 0.0, 1.0);  // Inclina mais
-   glTranslatef(0.0, 0.2, 0.0);
-   glScalef(0.1, 0.4, 0.1);
-   glColor3f(1.0, 0.8, 0.0);      // Amarelo mais escuro
-   glutSolidCube(1.0);
-   glColor3f(1, 1, 1);
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   // DEDO 2 (direito)
-   glPushMatrix();
-   glRotatef(-(GLfloat)fingers, 0.0, 0.0, 1.0);  // Abre/fecha no sentido oposto
-   
-   // Primeiro segmento do dedo 2
-   glTranslatef(0.15, 0.25, 0.0);
-   glPushMatrix();
-   glRotatef(20.0, 0.0, 0.0, 1.0);   // Inclina levemente (oposto)
-   glScalef(0.12, 0.5, 0.12);
-   glColor3f(1.0, 1.0, 0.0);      // Amarelo
+   if (occluder) {
+      GLfloat m[16];
+
+      occlusionGLMatrix(m);
+      occlusionAddOccluder(&occlusion, m, cubeVertices[0], cubeIndices, 36);
+   }
+   if (!visible(0.5))
+      return;
    glutSolidCube(1.0);
    glColor3f(1, 1, 1);
    glutWireCube(1.001);
-   glPopMatrix();
-   
-   // Segundo segmento do dedo 2
-   glTranslatef(0.0, 0.25, 0.0);
-   glRotatef(15.0, 0.0, 0.0, 1.0);   // Inclina mais (oposto)
-   glTranslatef(0.0, 0.2, 0.0);
-   glScalef(0.1, 0.4, 0.1);
-   glColor3f(1.0, 0.8, 0.0);      // Amarelo mais escuro
-   glutSolidCube(1.0);
+}
+
+static void drawSphere(int *level)
+{
+   int i, slices, stacks;
+
+   if (!visible(0.501))
+      return;
+   i = lodDraw(&lod, &sphereLod, level);
+   slices = sphereLod.u[i] < 12 ? sphereLod.u[i] : 12;
+   stacks = sphereLod.v[i] < 12 ? sphereLod.v[i] : 12;
    glColor3f(1, 1, 1);
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   // ESFERA (desenhada aqui se estiver na mão - grabbed == 1)
-   // A esfera segue a transformação hierárquica da mão
-   if (grabbed == 1) {
+   glutWireSphere(0.501, slices, stacks);
+}
+
+/*  The box of the field, which is all cubes.  */
+static void drawBoxPart(const SceneFile *s, int node, void *user)
+{
+   drawCube(s->nodes[node].flags & SCENE_OCCLUDER);
+}
+
+/*
+ *  Systems, each run on the chunks of the entities with the
+ *  components it needs.
+ */
+static void grabSystem(EcsChunk *c, void *user)
+{
+   const Ball *ball = (const Ball *) ecsColumn(c, ballComponent);
+   int *node = (int *) ecsColumn(c, linkComponent), i;
+
+   for (i = 0; i < c->count; i++)
+      node[i] = grabbed ? ball[i].heldNode : ball[i].floorNode;
+}
+
+static void placeSystem(EcsChunk *c, void *user)
+{
+   const SceneFile *s = (const SceneFile *) user;
+   const int *node = (const int *) ecsColumn(c, linkComponent);
+   GLfloat *m = (GLfloat *) ecsColumn(c, transformComponent);
+   int i;
+
+   for (i = 0; i < c->count; i++)
+      memcpy(m + i * 16, s->world + node[i] * 16, 16 * sizeof(GLfloat));
+}
+
+static void drawSystem(EcsChunk *c, void *user)
+{
+   const GLfloat *m = (const GLfloat *) ecsColumn(c, transformComponent);
+   Part *part = (Part *) ecsColumn(c, partComponent);
+   int i;
+
+   for (i = 0; i < c->count; i++) {
+      Part *p = &part[i];
+
       glPushMatrix();
-      glTranslatef(0.0, 0.5, 0.0);    // Posiciona entre os dedos
-      glColor3f(0.8, 0.2, 0.2);       // Vermelho escuro
-      glutSolidSphere(0.5, 20, 20);   // Esfera com raio 0.5
-      glColor3f(1, 1, 1);             // Wireframe branco
-      glutWireSphere(0.501, 12, 12);
+      glMultMatrixf(m + i * 16);
+      glScalef(p->scale[0], p->scale[1], p->scale[2]);
+      glColor4fv(p->color);
+      if (p->mesh == cubeMesh)
+         drawCube(p->flags & SCENE_OCCLUDER);
+      else if (p->mesh == sphereMesh)
+         drawSphere(&p->level);
       glPopMatrix();
    }
-   
-   glPopMatrix();
-   
-   glPopMatrix();
-   
-   // ESFERA (no chão, só aparece se grabbed == 0)
-   if (grabbed == 0) {
-      glPushMatrix();
-      glTranslatef(3.5, -0.8, 0.0);   // Posiciona ao lado direito do robô
-      glColor3f(0.8, 0.2, 0.2);       // Vermelho escuro
-      glutSolidSphere(0.5, 20, 20);   // Esfera com raio 0.5
-      glColor3f(1, 1, 1);             // Wireframe branco
-      glutWireSphere(0.501, 12, 12);
-      glPopMatrix();
+}
+
+/*  A pose of the arm with the tip at the target, pointing as near
+ *  straight down as it reaches, or as close as it gets from the pose
+ *  before.
+ */
+static void poseAt(GLfloat *angles, const GLfloat *before,
+                   GLfloat x, GLfloat y, GLfloat z)
+{
+   GLfloat target[3], approach;
+
+   target[0] = x;
+   target[1] = y;
+   target[2] = z;
+   memcpy(angles, before, 5 * sizeof(GLfloat));
+   for (approach = 180.0; approach >= 90.0; approach -= 15.0)
+      if (chainSolveAnalytic(&arm, angles, target, approach) >= 0)
+         return;
+   chainSolveDLS(&arm, angles, target, CHAIN_DAMPING, NULL);
+}
+
+static void keyPose(GLfloat *poses, int frame, const GLfloat *angles,
+                    GLfloat fingerAngle)
+{
+   GLfloat *q = poses + frame * ARM_TRACKS * 4;
+   int i;
+
+   for (i = 0; i < 5; i++)
+      animHinge(q + i * 4, arm.joints[i].axis, angles[i]);
+   animHinge(q + 20, 2, fingerAngle);
+}
+
+/*  The clips are authored as poses at ANIM_RATE: pick and place eases
+ *  between key poses found by inverse kinematics, the wave and the
+ *  sway are periodic.  The sway is a difference from the identity,
+ *  to be added on top of another clip.
+ */
+static void buildClips(void)
+{
+   static const GLfloat rest[6] = { 0, 0, 0, 0, 0, 0 };
+   static const GLfloat times[8] = {
+      0.0, 1.0, 2.0, 2.5, 3.5, 5.0, 5.5, 7.0
+   };
+   GLfloat keys[8][6], *poses, a[6], t, w;
+   int frames, f, k, i;
+
+   memcpy(keys[0], rest, sizeof(rest));
+   poseAt(keys[1], keys[0], floorSphere[0], floorSphere[1] + 0.8, 0.0);
+   keys[1][5] = 30.0;
+   poseAt(keys[2], keys[1], floorSphere[0], floorSphere[1], 0.0);
+   keys[2][5] = 30.0;
+   memcpy(keys[3], keys[2], sizeof(keys[2]));
+   keys[3][5] = 5.0;
+   poseAt(keys[4], keys[3], 3.0, 0.5, 0.0);
+   keys[4][5] = 5.0;
+   poseAt(keys[5], keys[4], -3.0, 0.0, 0.0);
+   keys[5][5] = 5.0;
+   memcpy(keys[6], keys[5], sizeof(keys[5]));
+   keys[6][5] = 30.0;
+   memcpy(keys[7], rest, sizeof(rest));
+
+   frames = (int) (times[7] * ANIM_RATE) + 1;
+   poses = (GLfloat *) malloc((frames > 4 * ANIM_RATE ? frames :
+                               4 * ANIM_RATE + 1) * ARM_TRACKS * 4 *
+                              sizeof(GLfloat));
+   if (poses == NULL) {
+      printf("robot: out of memory\n");
+      exit(1);
    }
-   
-   // CAIXA COM TAMPA ABERTA (ao lado do robô)
-   glPushMatrix();
-   glTranslatef(-3.0, -1.2, 0.0);  // Posiciona ao lado esquerdo do robô
-   
-   // Base da caixa
-   glPushMatrix();
-   glScalef(1.2, 0.8, 1.2);
-   glColor3f(0.6, 0.4, 0.2);       // Marrom
-   glutSolidCube(1.0);
-   glColor3f(1, 1, 1);
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   // Parede frontal
-   glPushMatrix();
-   glTranslatef(0.0, 0.4, 0.6);
-   glScalef(1.2, 0.8, 0.05);
-   glColor3f(0.6, 0.4, 0.2);
-   glutSolidCube(1.0);
-   glColor3f(1, 1, 1);
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   // Parede traseira
-   glPushMatrix();
-   glTranslatef(0.0, 0.4, -0.6);
-   glScalef(1.2, 0.8, 0.05);
-   glColor3f(0.6, 0.4, 0.2);
-   glutSolidCube(1.0);
-   glColor3f(1, 1, 1);
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   // Parede esquerda
-   glPushMatrix();
-   glTranslatef(-0.6, 0.4, 0.0);
-   glScalef(0.05, 0.8, 1.2);
-   glColor3f(0.6, 0.4, 0.2);
-   glutSolidCube(1.0);
-   glColor3f(1, 1, 1);
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   // Parede direita
-   glPushMatrix();
-   glTranslatef(0.6, 0.4, 0.0);
-   glScalef(0.05, 0.8, 1.2);
-   glColor3f(0.6, 0.4, 0.2);
-   glutSolidCube(1.0);
-   glColor3f(1, 1, 1);
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   // Tampa (aberta, rotacionada 110 graus para trás)
-   glPushMatrix();
-   glTranslatef(0.0, 0.8, -0.6);   // Posiciona na borda traseira
-   glRotatef(-110.0, 1.0, 0.0, 0.0); // Rotaciona para trás (tampa aberta)
-   glTranslatef(0.0, 0.0, 0.6);    // Ajusta pivô
-   glScalef(1.2, 0.05, 1.2);
-   glColor3f(0.5, 0.35, 0.15);     // Marrom mais escuro
-   glutSolidCube(1.0);
-   glColor3f(1, 1, 1);
-   glutWireCube(1.001);
-   glPopMatrix();
-   
-   glPopMatrix();
-   
-   glutSwapBuffers();
+   for (f = k = 0; f < frames; f++) {
+      t = (GLfloat) f / ANIM_RATE;
+      while (k < 6 && t > times[k + 1])
+         k++;
+      w = (t - times[k]) / (times[k + 1] - times[k]);
+      w = w * w * (3 - 2 * w);
+      for (i = 0; i < 6; i++)
+         a[i] = keys[k][i] + (keys[k + 1][i] - keys[k][i]) * w;
+      keyPose(poses, f, a, a[5]);
+   }
+   animClipBuild(&clips[CLIP_PICK], ARM_TRACKS, frames, ANIM_RATE, 0,
+                 poses, ANIM_TOLERANCE);
+
+   frames = 4 * ANIM_RATE + 1;
+   for (f = 0; f < frames; f++) {
+      t = (GLfloat) (2.0 * PI_ * f / (frames - 1));
+      a[0] = 40.0f * (GLfloat) sin(t);
+      a[1] = -20.0f;
+      a[2] = -40.0f + 10.0f * (GLfloat) sin(2 * t);
+      a[3] = 0.0f;
+      a[4] = 30.0f * (GLfloat) sin(4 * t);
+      keyPose(poses, f, a, 15.0f + 15.0f * (GLfloat) sin(4 * t));
+   }
+   animClipBuild(&clips[CLIP_WAVE], ARM_TRACKS, frames, ANIM_RATE, 1,
+                 poses, ANIM_TOLERANCE);
+
+   frames = 3 * ANIM_RATE + 1;
+   for (f = 0; f < frames; f++) {
+      t = (GLfloat) (2.0 * PI_ * f / (frames - 1));
+      a[0] = a[3] = 0.0f;
+      a[1] = 4.0f * (GLfloat) sin(t);
+      a[2] = -6.0f * (GLfloat) sin(t);
+      a[4] = 5.0f * (GLfloat) sin(t + 1.0);
+      keyPose(poses, f, a, 0.0f);
+   }
+   animClipBuild(&sway, ARM_TRACKS, frames, ANIM_RATE, 1, poses,
+                 ANIM_TOLERANCE);
+   free(poses);
 }
 
-void reshape(int w, int h)
+static void animate(double dt);
+
+/*  An entity for a node with a mesh, drawn as the node says.  */
+static EcsEntity makePart(int node, EcsMask mask)
 {
-   glViewport(0, 0, (GLsizei)w, (GLsizei)h);
-   glMatrixMode(GL_PROJECTION);
-   glLoadIdentity();
-   gluPerspective(65.0, (GLfloat)w / (GLfloat)h, 1.0, 30.0);
-   glMatrixMode(GL_MODELVIEW);
-   glLoadIdentity();
-   
-   // Posiciona a câmera para ver o robô inteiro e os objetos ao lado
-   gluLookAt(4.0, 2.0, 8.0,   // Posição da câmera (mais afastada e mais alta)
-             0.0, 0.5, 0.0,    // Olha para o centro da cena
-             0.0, 1.0, 0.0);   // Vetor "up"
+   const SceneNode *n = &scene.nodes[node];
+   EcsEntity e = ecsCreate(&entities, mask | ECS_BIT(transformComponent) |
+                           ECS_BIT(partComponent) | ECS_BIT(linkComponent));
+   Part *p = (Part *) ecsGet(&entities, e, partComponent);
+   int i;
+
+   p->mesh = n->mesh;
+   p->flags = n->flags;
+   p->level = -1;
+   for (i = 0; i < 4; i++)
+      p->color[i] = n->material >= 0 ?
+                    scene.materials[n->material].color[i] : 1.0f;
+   for (i = 0; i < 3; i++)
+      p->scale[i] = n->scale[i];
+   *(int *) ecsGet(&entities, e, linkComponent) = node;
+   return e;
 }
 
-void keyboard(unsigned char key, int x, int y)
+static void loadScene(void)
 {
-   switch (key)
+   void *data;
+   size_t bytes;
+   int heldNode, floorNode, i;
+   EcsEntity sphere;
+   Ball *ball;
+
+   if (!sceneFileImport(robotScene, &data, &bytes) ||
+       !sceneFileLoadMemory(&scene, data, bytes))
+      exit(1);
+   cubeMesh = sceneFileFindMesh(&scene, "cube");
+   sphereMesh = sceneFileFindMesh(&scene, "sphere");
+   heldNode = sceneFileFindNode(&scene, "heldSphere");
+   floorNode = sceneFileFindNode(&scene, "floorSphere");
+   boxNode = sceneFileFindNode(&scene, "box");
+   for (i = 0; i < ARM_TRACKS; i++)
+      sceneJoints[i] = sceneFileFindJoint(&scene, jointNames[i]);
+   for (i = 0; i < 3; i++)
+      floorSphere[i] = scene.nodes[floorNode].translate[i];
+
+   ecsInit(&entities);
+   transformComponent = ecsComponent(&entities, 16 * sizeof(GLfloat),
+                                     "transform");
+   partComponent = ecsComponent(&entities, sizeof(Part), "part");
+   linkComponent = ecsComponent(&entities, sizeof(int), "link");
+   ballComponent = ecsComponent(&entities, sizeof(Ball), "ball");
+   for (i = 0; i < scene.nodeCount; i++)
+      if (scene.nodes[i].mesh >= 0 && i != heldNode && i != floorNode)
+         makePart(i, 0);
+   sphere = makePart(floorNode, ECS_BIT(ballComponent));
+   ball = (Ball *) ecsGet(&entities, sphere, ballComponent);
+   ball->floorNode = floorNode;
+   ball->heldNode = heldNode;
+}
+
+void init(void)
+{
+   int i;
+
+   glEnable(GL_DEPTH_TEST);
+   glClearColor(0.0, 0.0, 0.0, 0.0);
+   glShadeModel(GL_FLAT);
+   occlusionInit(&occlusion, OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+   lodInit(&lod);
+   lodSphere(&sphereLod, 0.5, 20, 20);
+   inputInit(&input);
+   loadScene();
+
+   chainInit(&arm);
+   chainAddJoint(&arm, 0.0, 0.0, 0.0, 1, -180.0, 180.0);    /* base */
+   chainAddJoint(&arm, 0.0, -1.35, 0.0, 2, -120.0, 120.0);  /* shoulder */
+   chainAddJoint(&arm, 0.0, 2.0, 0.0, 2, -150.0, 150.0);    /* elbow */
+   chainAddJoint(&arm, 0.0, 1.0, 0.0, 1, -180.0, 180.0);    /* twist */
+   chainAddJoint(&arm, 0.0, 1.0, 0.0, 2, -120.0, 120.0);    /* wrist */
+   arm.tip[1] = 1.3;
+   buildClips();
+   animInstanceInit(&armAnim, ARM_TRACKS);
+   loopInit(&loop, ANIM_RATE * 2, ANIM_RATE * 2, animate);
+   for (i = 0; i < BENCH_GRID * BENCH_GRID; i++)
+      fieldLevels[i] = -1;
+}
+
+/*  Step a joint of the arm, within its limits; a joint free all
+ *  the way round wraps instead.
+ */
+static void turn(GLfloat *angle, GLfloat by)
+{
+   const ChainJoint *j;
+   int i;
+
+   for (i = 0; armAngles[i] != angle; i++)
+      ;
+   j = &arm.joints[i];
+   *angle += by;
+   if (j->max - j->min >= 360.0) {
+      if (*angle > j->max)
+         *angle -= 360.0;
+      else if (*angle <= j->min)
+         *angle += 360.0;
+   } else if (*angle > j->max) {
+      *angle = j->max;
+   } else if (*angle < j->min) {
+      *angle = j->min;
+   }
+}
+
+/*  Put the gripper around the sphere on the floor, pointing down,
+ *  or as close to it as the arm reaches.
+ */
+static void reach(void)
+{
+   GLfloat angles[5], error;
+   int i, method = CHAIN_ANALYTIC, iterations = 0;
+
+   for (i = 0; i < 5; i++)
+      angles[i] = *armAngles[i];
+   error = chainSolveAnalytic(&arm, angles, floorSphere, 180.0);
+   if (error < 0) {
+      method = CHAIN_DLS;
+      error = chainSolveDLS(&arm, angles, floorSphere, CHAIN_DAMPING,
+                            &iterations);
+   }
+   for (i = 0; i < 5; i++)
+      *armAngles[i] = angles[i];
+   printf("%s: %.4f from the sphere after %d iterations\n",
+          chainMethodName(method), error, iterations);
+}
+
+/*  One tick of the loop: the arm takes the pose of the animation.
+ *  The loop stops once nothing moves any more.
+ */
+static void animate(double dt)
+{
+   const AnimClip *clip = armAnim.clip;
+   int i;
+
+   animUpdate(&armAnim, 1, (GLfloat) dt);
+   for (i = 0; i < 5; i++)
+      *armAngles[i] = animHingeAngle(armAnim.pose[i], arm.joints[i].axis);
+   fingers = (int) floor(animHingeAngle(armAnim.pose[5], 2) + 0.5);
+   fingers = fingers < 0 ? 0 : fingers > 30 ? 30 : fingers;
+   if (armAnim.additive == NULL && armAnim.fade >= armAnim.fadeTime &&
+       (clip == NULL ||
+        (!clip->loop && armAnim.time >= animClipDuration(clip))))
+      loopStop(&loop);
+}
+
+/*  Start the animation from the pose the arm is in.  */
+static void animateFromHere(void)
+{
+   int i;
+
+   if (loop.running)
+      return;
+   for (i = 0; i < 5; i++)
+      animHinge(armAnim.pose[i], arm.joints[i].axis, *armAngles[i]);
+   animHinge(armAnim.pose[5], 2, (GLfloat) fingers);
+   memcpy(armAnim.from, armAnim.pose, sizeof(armAnim.from));
+   loopStart(&loop);
+}
+
+static void nextClip(void)
+{
+   animateFromHere();
+   playing = playing + 1 < CLIPS ? playing + 1 : -1;
+   animPlay(&armAnim, playing >= 0 ? &clips[playing] : NULL, 0.5);
+   printf("%s\n", playing >= 0 ? clipNames[playing] : "no clip");
+}
+
+static void toggleSway(void)
+{
+   animateFromHere();
+   armAnim.additive = armAnim.additive ? NULL : &sway;
+   armAnim.additiveTime = 0;
+   armAnim.additiveWeight = 1.0;
+}
+
+/*  Keys that move the joints take the arm from the animation.  */
+static void stopAnimation(void)
+{
+   loopStop(&loop);
+   playing = -1;
+   armAnim.clip = NULL;
+   armAnim.additive = NULL;
+   armAnim.fade = armAnim.fadeTime = 0;
+}
+
+/*  Apply a key to the robot.  */
+static void apply(const InputEvent *e)
+{
+   if (e->key < 128 && strchr("bBsSeEtTwWfFkK", e->key))
+      stopAnimation();
+   switch (e->key)
    {
    case 'b':  // Rotaciona base (horizontal) no sentido anti-horário
-      base = (base + 5) % 360;
-      glutPostRedisplay();
+      turn(&base, 5);
       break;
    case 'B':  // Rotaciona base (horizontal) no sentido horário
-      base = (base - 5) % 360;
-      glutPostRedisplay();
+      turn(&base, -5);
       break;
    case 's':  // Rotaciona shoulder (braço superior) no sentido anti-horário
-      shoulder = (shoulder + 5) % 360;
-      glutPostRedisplay();
+      turn(&shoulder, 5);
       break;
    case 'S':  // Rotaciona shoulder (braço superior) no sentido horário
-      shoulder = (shoulder - 5) % 360;
-      glutPostRedisplay();
+      turn(&shoulder, -5);
       break;
    case 'e':  // Rotaciona elbow (cotovelo) no sentido anti-horário
-      elbow = (elbow + 5) % 360;
-      glutPostRedisplay();
+      turn(&elbow, 5);
       break;
    case 'E':  // Rotaciona elbow (cotovelo) no sentido horário
-      elbow = (elbow - 5) % 360;
-      glutPostRedisplay();
+      turn(&elbow, -5);
       break;
    case 't':  // Torce antebraço (twist) no sentido anti-horário
-      twist = (twist + 5) % 360;
-      glutPostRedisplay();
+      turn(&twist, 5);
       break;
    case 'T':  // Torce antebraço (twist) no sentido horário
-      twist = (twist - 5) % 360;
-      glutPostRedisplay();
+      turn(&twist, -5);
       break;
    case 'w':  // Rotaciona wrist (pulso) no sentido anti-horário
-      wrist = (wrist + 5) % 360;
-      glutPostRedisplay();
+      turn(&wrist, 5);
       break;
    case 'W':  // Rotaciona wrist (pulso) no sentido horário
-      wrist = (wrist - 5) % 360;
-      glutPostRedisplay();
+      turn(&wrist, -5);
       break;
    case 'f':  // Abre os dedos do end effector
       if (fingers < 30) fingers += 5;  // Limita abertura máxima
-      glutPostRedisplay();
       break;
    case 'F':  // Fecha os dedos do end effector
       if (fingers > 0) fingers -= 5;   // Limita fechamento mínimo
-      glutPostRedisplay();
       break;
    case 'g':  // Pega a esfera (grab)
    case 'G':  // Solta a esfera (release)
       grabbed = !grabbed;  // Alterna entre pegar (1) e soltar (0)
-      glutPostRedisplay();
+      break;
+   case 'k':
+   case 'K':
+      reach();
+      break;
+   case 'n':
+   case 'N':
+      nextClip();
+      break;
+   case 'u':
+   case 'U':
+      toggleSway();
+      break;
+   case 'o':
+   case 'O':
+      if (culling && !occlusionStale)
+         printf("%u of %u parts hidden\n", occlusion.culled,
+                occlusion.tested);
+      culling = !culling;
+      printf("occlusion culling %s\n", culling ? "on" : "off");
+      break;
+   case 'l':
+   case 'L':
+      lodPrintStats("spheres", &lod);
+      lodResetStats(&lod);
+      lod.enabled = !lod.enabled;
+      printf("level of detail %s\n", lod.enabled ? "on" : "off");
+      break;
+   default:
+      break;
+   }
+}
+
+void display(void)
+{
+   GLfloat angles[ARM_TRACKS];
+   InputEvent e;
+
+   inputBeginFrame(&input);
+   while (inputPoll(&input, &e))
+      apply(&e);
+   occlusionEnd(&occlusion);
+   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+   
+   angles[sceneJoints[0]] = base;
+   angles[sceneJoints[1]] = shoulder;
+   angles[sceneJoints[2]] = elbow;
+   angles[sceneJoints[3]] = twist;
+   angles[sceneJoints[4]] = wrist;
+   angles[sceneJoints[5]] = (GLfloat) fingers;
+   sceneFilePlace(&scene, angles);
+   ecsForEach(&entities, ECS_BIT(ballComponent) | ECS_BIT(linkComponent), 0,
+              grabSystem, NULL);
+   ecsForEach(&entities, ECS_BIT(linkComponent) |
+              ECS_BIT(transformComponent), 0, placeSystem, &scene);
+   ecsForEach(&entities, ECS_BIT(transformComponent) |
+              ECS_BIT(partComponent), 0, drawSystem, NULL);
+
+   occlusionStale = 0;
+   occlusionBegin(&occlusion);
+   inputSwapBuffers(&input);
+}
+
+void reshape(int w, int h)
+{
+   occlusionStale = 1;
+   glViewport(0, 0, (GLsizei)w, (GLsizei)h);
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   gluPerspective(65.0, (GLfloat)w / (GLfloat)h, 1.0, 30.0);
+   glMatrixMode(GL_MODELVIEW);
+   glLoadIdentity();
+   
+   // Posiciona a câmera para ver o robô inteiro e os objetos ao lado
+   gluLookAt(4.0, 2.0, 8.0,   // Posição da câmera (mais afastada e mais alta)
+             0.0, 0.5, 0.0,    // Olha para o centro da cena
+             0.0, 1.0, 0.0);   // Vetor "up"
+}
+
+/*  A field of BENCH_GRID x BENCH_GRID boxes seen from just above
+ *  the lids, with a sphere in each box.
+ */
+static void drawField(void)
+{
+   int i, j;
+
+   for (i = 0; i < BENCH_GRID; i++) {
+      for (j = 0; j < BENCH_GRID; j++) {
+         glPushMatrix();
+         glTranslatef((j - BENCH_GRID / 2) * 2.0, -1.2, -i * 2.0);
+         sceneFileDrawNode(&scene, boxNode, NULL, drawBoxPart, NULL);
+         glTranslatef(0.0, 0.65, 0.0);
+         glScalef(0.5, 0.5, 0.5);
+         glColor3f(0.8, 0.2, 0.2);
+         drawSphere(&fieldLevels[i * BENCH_GRID + j]);
+         glPopMatrix();
+      }
+   }
+}
+
+static double timeField(unsigned *hidden, unsigned *parts)
+{
+   double start, t;
+   int i;
+
+   occlusionEnd(&occlusion);
+   drawField();
+   occlusionBegin(&occlusion);
+   glFinish();
+   start = timerSeconds();
+   for (i = 0; i < BENCH_FRAMES; i++) {
+      occlusionEnd(&occlusion);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      drawField();
+      occlusionBegin(&occlusion);
+   }
+   glFinish();
+   t = (timerSeconds() - start) * 1000.0 / BENCH_FRAMES;
+   *hidden = occlusion.culled;
+   *parts = occlusion.tested;
+   occlusionEnd(&occlusion);
+   return t;
+}
+
+static void benchmark(void)
+{
+   int saved = culling, savedLod = lod.enabled;
+   unsigned hidden, parts;
+   double t;
+
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   gluPerspective(65.0, 1.0, 1.0, 100.0);
+   glMatrixMode(GL_MODELVIEW);
+   glLoadIdentity();
+   gluLookAt(0.0, 0.2, 4.0, 0.0, -0.4, -20.0, 0.0, 1.0, 0.0);
+   occlusionStale = 0;
+
+   culling = 0;
+   t = timeField(&hidden, &parts);
+   printf("%d boxes: %.2f ms per frame without culling\n",
+          BENCH_GRID * BENCH_GRID, t);
+   culling = 1;
+   occlusion.parallelMin = ~0u;
+   t = timeField(&hidden, &parts);
+   printf("buffer on one thread: %.2f ms per frame, %u triangles "
+          "in %.2f ms\n", t, occlusion.triangles, occlusion.drawTime);
+   occlusion.parallelMin = OCCLUSION_PARALLEL_MIN;
+   t = timeField(&hidden, &parts);
+   printf("buffer on %d threads: %.2f ms per frame, %u triangles "
+          "in %.2f ms\n", jobsThreadCount() + 1, t, occlusion.triangles,
+          occlusion.drawTime);
+   printf("%u of %u parts hidden\n", hidden, parts);
+
+/*  every sphere, near and far, without culling  */
+   culling = 0;
+   lod.enabled = 0;
+   t = timeField(&hidden, &parts);
+   printf("spheres at full detail: %.2f ms per frame\n", t);
+   lod.enabled = 1;
+   lodResetStats(&lod);
+   t = timeField(&hidden, &parts);
+   printf("spheres by level of detail: %.2f ms per frame\n", t);
+   lodPrintStats("spheres", &lod);
+   lod.enabled = savedLod;
+   lodResetStats(&lod);
+
+   culling = saved;
+   occlusionStale = 1;
+   reshape(glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+   glutPostRedisplay();
+}
+
+/*  Solve arms reaching for random points, each made by a random pose
+ *  within the limits so that it can be reached, from a pose ready to
+ *  move; the analytic solver is given the approach of that pose.
+ */
+static void ikBenchmark(void)
+{
+   static const GLfloat ready[5] = { 0.0, -30.0, 60.0, 0.0, 30.0 };
+   ChainProblem *problems, *start;
+   int i, k, method, close;
+   double t, error, iterations;
+
+   problems = (ChainProblem *)
+      malloc(2 * IK_BENCH_CHAINS * sizeof(ChainProblem));
+   if (problems == NULL) {
+      printf("robot: out of memory\n");
+      exit(1);
+   }
+   start = problems + IK_BENCH_CHAINS;
+   srand(1);
+   for (i = 0; i < IK_BENCH_CHAINS; i++) {
+      ChainProblem *p = &start[i];
+      GLfloat pose[5], side;
+
+      for (k = 0; k < 5; k++) {
+         const ChainJoint *j = &arm.joints[k];
+
+         pose[k] = j->min + (j->max - j->min) * rand() / RAND_MAX;
+      }
+      pose[3] = 0.0;
+      chainForward(&arm, pose, NULL, NULL, p->target);
+      side = p->target[0] * (GLfloat) cos(pose[0] * PI_ / 180.0) -
+             p->target[2] * (GLfloat) sin(pose[0] * PI_ / 180.0);
+      p->approach = pose[1] + pose[2] + pose[4];
+      if (side >= 0)
+         p->approach = -p->approach;
+      p->chain = &arm;
+      for (k = 0; k < 5; k++)
+         p->angles[k] = ready[k];
+   }
+
+   printf("%d arms on %d threads:\n", IK_BENCH_CHAINS, jobsThreadCount() + 1);
+   for (method = 0; method < CHAIN_METHODS; method++) {
+      memcpy(problems, start, IK_BENCH_CHAINS * sizeof(ChainProblem));
+      t = timerSeconds();
+      chainSolveBatch(problems, IK_BENCH_CHAINS, method);
+      t = (timerSeconds() - t) * 1000.0;
+      close = 0;
+      error = iterations = 0;
+      for (i = 0; i < IK_BENCH_CHAINS; i++) {
+         if (problems[i].error >= 0 && problems[i].error < CHAIN_TOLERANCE)
+            close++;
+         if (problems[i].error >= 0)
+            error += problems[i].error;
+         iterations += problems[i].iterations;
+      }
+      printf("   %s: %.0f arms per ms, %.1f%% reached, mean error %.4f, "
+             "%.1f iterations\n", chainMethodName(method),
+             IK_BENCH_CHAINS / t, close * 100.0 / IK_BENCH_CHAINS,
+             error / IK_BENCH_CHAINS, iterations / IK_BENCH_CHAINS);
+   }
+   free(problems);
+}
+
+/*  Animate many arms, each playing a clip from its own time at its
+ *  own speed, half of them crossfading to the other clip and all with
+ *  the sway added.
+ */
+static void animBenchmark(void)
+{
+   AnimInstance *instances;
+   int i, frames = 60;
+   double t;
+
+   for (i = 0; i < CLIPS; i++)
+      printf("%s: %d frames of %d tracks in %d keys, %lu bytes "
+             "(%lu as floats)\n", clipNames[i], clips[i].frames,
+             clips[i].trackCount, clips[i].keyCount,
+             (unsigned long) (clips[i].keyCount * sizeof(AnimKey)),
+             (unsigned long) (clips[i].frames * clips[i].trackCount * 4 *
+                              sizeof(GLfloat)));
+
+   instances = (AnimInstance *)
+      malloc(ANIM_BENCH_INSTANCES * sizeof(AnimInstance));
+   if (instances == NULL) {
+      printf("robot: out of memory\n");
+      exit(1);
+   }
+   srand(1);
+   for (i = 0; i < ANIM_BENCH_INSTANCES; i++) {
+      AnimInstance *a = &instances[i];
+
+      animInstanceInit(a, ARM_TRACKS);
+      animPlay(a, &clips[i % CLIPS], 0.0);
+      a->time = animClipDuration(a->clip) * rand() / RAND_MAX;
+      a->speed = 0.5f + (GLfloat) rand() / RAND_MAX;
+      if (i % 2) {
+         animUpdate(a, 1, 0.0f);
+         animPlay(a, &clips[(i + 1) % CLIPS], 1.0);
+      }
+      a->additive = &sway;
+      a->additiveWeight = 0.5;
+   }
+
+   t = timerSeconds();
+   for (i = 0; i < frames; i++)
+      animUpdate(instances, ANIM_BENCH_INSTANCES, 1.0f / 60);
+   t = (timerSeconds() - t) * 1000.0 / frames;
+   printf("%d arms on %d threads: %.2f ms per frame, %.0f arms per ms\n",
+          ANIM_BENCH_INSTANCES, jobsThreadCount() + 1, t,
+          ANIM_BENCH_INSTANCES / t);
+   free(instances);
+}
+
+static void drawNothing(const SceneFile *s, int node, void *user)
+{
+}
+
+/*  Import a scene of SCENE_BENCH_NODES nodes, each branching into
+ *  four, write it out and time loading it back, checking it and
+ *  placing every node.
+ */
+static void sceneBenchmark(void)
+{
+   static const char *path = "robot-bench.scene";
+   GLfloat angle = 30.0;
+   SceneFile big;
+   char *text, *p;
+   void *data;
+   size_t bytes;
+   double t;
+   int i;
+
+   text = (char *) malloc(SCENE_BENCH_NODES * 128 + 256);
+   if (text == NULL) {
+      printf("robot: out of memory\n");
+      exit(1);
+   }
+   p = text + sprintf(text, "material gray 0.5 0.5 0.5\nmesh cube\n"
+                      "joint bend\nnode n0 - mesh cube material gray\n");
+   for (i = 1; i < SCENE_BENCH_NODES; i++)
+      p += sprintf(p, "node n%d n%d translate %d 1 0 joint bend 0 0 1 "
+                   "scale 0.5 0.5 0.5 mesh cube material gray\n",
+                   i, (i - 1) / 4, i % 4 - 2);
+
+   t = timerSeconds();
+   if (!sceneFileImport(text, &data, &bytes)) {
+      free(text);
+      return;
+   }
+   printf("imported %d nodes from %lu bytes of text in %.1f ms\n",
+          SCENE_BENCH_NODES, (unsigned long) (p - text),
+          (timerSeconds() - t) * 1000.0);
+   free(text);
+   i = sceneFileWrite(path, data, bytes);
+   free(data);
+   if (!i)
+      return;
+
+   t = timerSeconds();
+   if (!sceneFileLoad(&big, path)) {
+      remove(path);
+      return;
+   }
+   printf("loaded %lu bytes in %.3f ms\n", (unsigned long) bytes,
+          (timerSeconds() - t) * 1000.0);
+   t = timerSeconds();
+   sceneFileValidate(&big);
+   printf("validated in %.1f ms\n", (timerSeconds() - t) * 1000.0);
+   t = timerSeconds();
+   sceneFileDraw(&big, &angle, drawNothing, NULL);
+   printf("placed every node in %.1f ms\n", (timerSeconds() - t) * 1000.0);
+   sceneFileFree(&big);
+   remove(path);
+}
+
+/*  Bodies falling and bouncing, some of them spinning.  */
+typedef struct spin {
+   GLfloat  angle, rate;
+} Spin;
+
+typedef struct benchcomponents {
+   int      position, velocity, spin;
+   GLfloat  dt;
+} BenchComponents;
+
+static void fallSystem(EcsChunk *c, void *user)
+{
+   const BenchComponents *b = (const BenchComponents *) user;
+   GLfloat *p = (GLfloat *) ecsColumn(c, b->position);
+   GLfloat *v = (GLfloat *) ecsColumn(c, b->velocity);
+   int i;
+
+   for (i = 0; i < c->count * 3; i += 3) {
+      v[i + 1] -= 9.8f * b->dt;
+      p[i] += v[i] * b->dt;
+      p[i + 1] += v[i + 1] * b->dt;
+      p[i + 2] += v[i + 2] * b->dt;
+      if (p[i + 1] < 0) {
+         p[i + 1] = -p[i + 1];
+         v[i + 1] *= -0.8f;
+      }
+   }
+}
+
+static void spinSystem(EcsChunk *c, void *user)
+{
+   const BenchComponents *b = (const BenchComponents *) user;
+   Spin *s = (Spin *) ecsColumn(c, b->spin);
+   int i;
+
+   for (i = 0; i < c->count; i++) {
+      s[i].angle += s[i].rate * b->dt;
+      if (s[i].angle >= 360.0f)
+         s[i].angle -= 360.0f;
+   }
+}
+
+static double runSystems(EcsWorld *w, BenchComponents *b, int parallel)
+{
+   EcsMask falling = ECS_BIT(b->position) | ECS_BIT(b->velocity);
+   double t = timerSeconds();
+   int i;
+
+   for (i = 0; i < ECS_BENCH_FRAMES; i++) {
+      if (parallel) {
+         ecsForEachParallel(w, falling, 0, fallSystem, b);
+         ecsForEachParallel(w, ECS_BIT(b->spin), 0, spinSystem, b);
+      } else {
+         ecsForEach(w, falling, 0, fallSystem, b);
+         ecsForEach(w, ECS_BIT(b->spin), 0, spinSystem, b);
+      }
+   }
+   return (timerSeconds() - t) * 1000.0 / ECS_BENCH_FRAMES;
+}
+
+/*  Make a million entities of three kinds, run systems over them,
+ *  destroy half at random and make them again, and move some from one
+ *  archetype to another.
+ */
+static void ecsBenchmark(void)
+{
+   EcsWorld w;
+   BenchComponents b;
+   EcsEntity *ids, stale;
+   EcsMask masks[4];
+   double t;
+   int i, destroyed, n = ECS_BENCH_ENTITIES, moves = n / 10;
+
+   ecsPrintStats("robot", &entities);
+   ids = (EcsEntity *) malloc(n * sizeof(EcsEntity));
+   if (ids == NULL) {
+      printf("robot: out of memory\n");
+      exit(1);
+   }
+   ecsInit(&w);
+   b.position = ecsComponent(&w, 3 * sizeof(GLfloat), "position");
+   b.velocity = ecsComponent(&w, 3 * sizeof(GLfloat), "velocity");
+   b.spin = ecsComponent(&w, sizeof(Spin), "spin");
+   b.dt = 1.0f / 60;
+   masks[0] = masks[1] = ECS_BIT(b.position) | ECS_BIT(b.velocity);
+   masks[2] = masks[0] | ECS_BIT(b.spin);
+   masks[3] = ECS_BIT(b.position);
+
+   srand(1);
+   t = timerSeconds();
+   for (i = 0; i < n; i++) {
+      GLfloat *p;
+
+      ids[i] = ecsCreate(&w, masks[i % 4]);
+      p = (GLfloat *) ecsGet(&w, ids[i], b.position);
+      p[0] = (GLfloat) (rand() % 1000);
+      p[1] = (GLfloat) (rand() % 100);
+      p[2] = (GLfloat) (rand() % 1000);
+   }
+   printf("made %d entities in %.1f ms\n", n, (timerSeconds() - t) * 1000.0);
+   t = runSystems(&w, &b, 0);
+   printf("systems: %.2f ms per frame on one thread, ", t);
+   t = runSystems(&w, &b, 1);
+   printf("%.2f ms on %d threads\n", t, jobsThreadCount() + 1);
+
+   t = timerSeconds();
+   stale = ECS_NULL;
+   for (i = 0, destroyed = 0; i < n / 2; i++) {
+      int k = (int) ((double) rand() / ((double) RAND_MAX + 1) * n);
+
+      if (ecsAlive(&w, ids[k])) {
+         if (stale == ECS_NULL)
+            stale = ids[k];
+         ecsDestroy(&w, ids[k]);
+         destroyed++;
+      }
+   }
+   for (i = 0; i < n; i++)
+      if (!ecsAlive(&w, ids[i]))
+         ids[i] = ecsCreate(&w, masks[i % 4]);
+   printf("destroyed %d at random and made them again in %.1f ms; "
+          "the id of the first is %s\n", destroyed,
+          (timerSeconds() - t) * 1000.0,
+          ecsAlive(&w, stale) ? "alive again" : "still dead");
+
+   t = timerSeconds();
+   for (i = 0; i < moves; i++)
+      ecsAdd(&w, ids[i * 8], b.spin);
+   for (i = 0; i < moves; i++)
+      ecsRemove(&w, ids[i * 8], b.spin);
+   printf("added and removed a component of %d in %.1f ms\n", moves,
+          (timerSeconds() - t) * 1000.0);
+   ecsPrintStats("bodies", &w);
+   ecsFree(&w);
+   free(ids);
+}
+
+/*  A unit cube with a normal for each face.  */
+static void cubeShape(MeshBuilder *b)
+{
+   static const GLfloat normals[6][3] = {
+      { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 },
+      { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+   };
+   GLfloat u[3], v[3], p[3];
+   GLuint first;
+   int f, k, i;
+
+   meshBegin(b, GL_TRIANGLES);
+   for (f = 0; f < 6; f++) {
+      const GLfloat *n = normals[f];
+
+      /*  u and v across the face, so that u x v = n  */
+      u[0] = n[1]; u[1] = n[2]; u[2] = n[0];
+      v[0] = n[1] * u[2] - n[2] * u[1];
+      v[1] = n[2] * u[0] - n[0] * u[2];
+      v[2] = n[0] * u[1] - n[1] * u[0];
+      first = b->vertexCount;
+      for (k = 0; k < 4; k++) {
+         GLfloat su = (k & 1) ? 0.5 : -0.5, sv = (k & 2) ? 0.5 : -0.5;
+
+         for (i = 0; i < 3; i++)
+            p[i] = n[i] * 0.5 + u[i] * su + v[i] * sv;
+         meshVertex(b, p, n, NULL);
+      }
+      meshIndex(b, first);
+      meshIndex(b, first + 1);
+      meshIndex(b, first + 3);
+      meshIndex(b, first);
+      meshIndex(b, first + 3);
+      meshIndex(b, first + 2);
+   }
+   meshEnd(b);
+}
+
+static void buildCrowd(void)
+{
+   MeshBuilder b;
+
+   indirectInit(&crowd);
+   meshBuilderInit(&b, MESH_NORMAL);
+   cubeShape(&b);
+   crowdCube = indirectAddMesh(&crowd, &b);
+   meshBuilderFree(&b);
+   meshBuilderInit(&b, MESH_NORMAL);
+   shapeSphere(&b, 0.5, 12, 12);
+   crowdSphere = indirectAddMesh(&crowd, &b);
+   meshBuilderFree(&b);
+   indirectCompile(&crowd);
+}
+
+/*  Add the parts of a placed robot to the batch, moved along x and z.  */
+static void crowdSystem(EcsChunk *c, void *user)
+{
+   const GLfloat *at = (const GLfloat *) user;
+   const GLfloat *t = (const GLfloat *) ecsColumn(c, transformComponent);
+   const Part *part = (const Part *) ecsColumn(c, partComponent);
+   GLfloat m[16];
+   int i, k;
+
+   for (i = 0; i < c->count; i++) {
+      const Part *p = &part[i];
+
+      memcpy(m, t + i * 16, sizeof(m));
+      for (k = 0; k < 4; k++) {
+         m[k] *= p->scale[0];
+         m[4 + k] *= p->scale[1];
+         m[8 + k] *= p->scale[2];
+      }
+      m[12] += at[0];
+      m[14] += at[1];
+      indirectAdd(&crowd, p->mesh == cubeMesh ? crowdCube : crowdSphere,
+                  m, p->color);
+   }
+}
+
+/*  CROWD_GRID x CROWD_GRID robots, each in a pose of its own, all in
+ *  view and lit, drawn by each way the batch has, down to a draw call
+ *  for every part.
+ */
+static void crowdBenchmark(void)
+{
+   static const GLfloat light[4] = { 1.0, 2.0, 1.5, 0.0 };
+   GLfloat angles[ARM_TRACKS], at[2];
+   int i, j, f, method;
+   double start, t, submit;
+
+   if (crowd.vbo == 0)
+      buildCrowd();
+   indirectBegin(&crowd);
+   for (i = 0; i < CROWD_GRID; i++) {
+      for (j = 0; j < CROWD_GRID; j++) {
+         angles[sceneJoints[0]] = (i * 37 + j * 11) % 360 - 180;
+         angles[sceneJoints[1]] = (i + j) % 9 * 10 - 40;
+         angles[sceneJoints[2]] = 30 + j % 5 * 15;
+         angles[sceneJoints[3]] = i % 4 * 30;
+         angles[sceneJoints[4]] = (i * j) % 7 * 10 - 30;
+         angles[sceneJoints[5]] = j % 3 * 10;
+         sceneFilePlace(&scene, angles);
+         at[0] = (j - CROWD_GRID / 2) * 4.0;
+         at[1] = (i - CROWD_GRID / 2) * 4.0;
+         ecsForEach(&entities, ECS_BIT(ballComponent) |
+                    ECS_BIT(linkComponent), 0, grabSystem, NULL);
+         ecsForEach(&entities, ECS_BIT(linkComponent) |
+                    ECS_BIT(transformComponent), 0, placeSystem, &scene);
+         ecsForEach(&entities, ECS_BIT(transformComponent) |
+                    ECS_BIT(partComponent), 0, crowdSystem, at);
+      }
+   }
+
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   gluPerspective(65.0, 1.0, 10.0, 1000.0);
+   glMatrixMode(GL_MODELVIEW);
+   glLoadIdentity();
+   gluLookAt(0.0, 260.0, 160.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0);
+   glLightfv(GL_LIGHT0, GL_POSITION, light);
+   glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+   glEnable(GL_COLOR_MATERIAL);
+   glEnable(GL_LIGHTING);
+   glEnable(GL_LIGHT0);
+   glEnable(GL_NORMALIZE);
+   glShadeModel(GL_SMOOTH);
+
+   for (method = crowd.best; method <= INDIRECT_CPU; method++) {
+      indirectSetMethod(&crowd, method);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      indirectDraw(&crowd);
+      glFinish();
+      submit = 0.0;
+      start = timerSeconds();
+      for (f = 0; f < BENCH_FRAMES; f++) {
+         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+         t = timerSeconds();
+         indirectDraw(&crowd);
+         submit += timerSeconds() - t;
+      }
+      glFinish();
+      t = (timerSeconds() - start) * 1000.0 / BENCH_FRAMES;
+      printf("%.2f ms per frame, %.3f ms of it issuing the draws\n", t,
+             submit * 1000.0 / BENCH_FRAMES);
+      indirectPrintStats("robots", &crowd);
+   }
+   indirectSetMethod(&crowd, crowd.best);
+
+   glDisable(GL_COLOR_MATERIAL);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_LIGHT0);
+   glDisable(GL_NORMALIZE);
+   glShadeModel(GL_FLAT);
+   occlusionStale = 1;
+   reshape(glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+   glutPostRedisplay();
+}
+
+void keyboard(unsigned char key, int x, int y)
+{
+   switch (key)
+   {
+   case 'p':
+   case 'P':
+      benchmark();
+      break;
+   case 'j':
+   case 'J':
+      ikBenchmark();
+      break;
+   case 'v':
+   case 'V':
+      animBenchmark();
+      break;
+   case 'x':
+   case 'X':
+      sceneBenchmark();
+      break;
+   case 'c':
+   case 'C':
+      ecsBenchmark();
+      break;
+   case 'd':
+   case 'D':
+      crowdBenchmark();
+      break;
+   case 'm':
+   case 'M':
+      inputPrintStats("input", &input);
+      inputResetStats(&input);
+      inputSetLowLatency(&input, !input.lowLatency);
+      printf("low latency mode %s\n", input.lowLatency ? "on" : "off");
+      break;
+   case 'i':
+   case 'I':
+      inputPrintStats("input", &input);
+      inputResetStats(&input);
       break;
    case 27:   // ESC - sai do programa
       exit(0);
       break;
    default:
+      inputKeyboard(&input, key, x, y);
       break;
    }
 }
@@ -379,3 +1402,12 @@ int main(int argc, char **argv)
    glutMainLoop();
    return 0;
 }
+#else
+int main(int argc, char** argv)
+{
+    fprintf (stderr, "This program demonstrates a feature which is not in OpenGL before Version 1.5.\n");
+    fprintf (stderr, "If your implementation has the ARB_vertex_buffer_object extension,\n");
+    fprintf (stderr, "you may be able to modify this program to make it run.\n");
+    return 0;
+}
+#endif
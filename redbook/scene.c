@@ -40,9 +40,96 @@
  *  This program demonstrates the use of the GL lighting model.
  *  Objects are drawn using a grey material characteristic. 
  *  A single light source illuminates the objects.
+ *  Press 'l' to light them instead by many colored point lights,
+ *  shaded per pixel with the lights assigned to clusters of the view
+ *  volume; '+' and '-' change the number of lights, 's' prints the
+ *  cluster statistics and 'b' times building the clusters and drawing
+ *  for growing numbers of lights.  The lights move in fixed ticks of a
+ *  game loop (loop.h), which runs only while they are on.
  */
+#define GL_GLEXT_PROTOTYPES
 #include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include "cluster.h"
+#include "loop.h"
+#include "matcache.h"
+#include "timer.h"
+
+#define MIN_LIGHTS    16
+#define MAX_LIGHTS    4096
+#define BENCH_FRAMES  10
+#define TICK_RATE     30.0
+#define FRAME_RATE    60.0
+#define PI_           3.14159265358979323846
+
+static MatHandle grey;
+static ClusterGrid grid;
+static int clustered = 0;
+static int lightCount = 256;
+static double lightTime = 0.0, lastLightTime = 0.0;   /* seconds */
+static GameLoop loop;
+
+/*  Each point light circles the y axis at its own height, distance
+ *  and speed.
+ */
+typedef struct orbit {
+   GLfloat height, distance, phase, speed;
+} Orbit;
+
+static Orbit orbits[MAX_LIGHTS];
+static ClusterLight lights[MAX_LIGHTS];
+
+static GLfloat randomf(unsigned *seed)
+{
+   *seed = *seed * 1103515245 + 12345;
+   return ((*seed >> 8) & 0xffff) / 65535.0;
+}
+
+static void initLights(void)
+{
+   unsigned seed = 7;
+   int i;
+
+   for (i = 0; i < MAX_LIGHTS; i++) {
+      GLfloat hue = randomf(&seed) * 6.0, f = hue - floor(hue);
+      GLfloat rgb[6][3] = {
+         { 1.0, f, 0.0 }, { 1.0 - f, 1.0, 0.0 }, { 0.0, 1.0, f },
+         { 0.0, 1.0 - f, 1.0 }, { f, 0.0, 1.0 }, { 1.0, 0.0, 1.0 - f }
+      };
+      int h = (int) hue % 6;
+
+      orbits[i].height = randomf(&seed) * 5.0 - 2.5;
+      orbits[i].distance = 0.5 + randomf(&seed) * 2.5;
+      orbits[i].phase = randomf(&seed) * 2.0 * PI_;
+      orbits[i].speed = (0.2 + randomf(&seed) * 0.8) *
+                        (randomf(&seed) < 0.5 ? -1.0 : 1.0);
+      lights[i].radius = 0.4 + randomf(&seed) * 0.4;
+      lights[i].color[0] = rgb[h][0];
+      lights[i].color[1] = rgb[h][1];
+      lights[i].color[2] = rgb[h][2];
+   }
+}
+
+static void tick(double dt)
+{
+   lastLightTime = lightTime;
+   lightTime += dt;
+}
+
+static void moveLights(double t)
+{
+   int i;
+
+   for (i = 0; i < lightCount; i++) {
+      GLfloat a = orbits[i].phase + orbits[i].speed * t;
+
+      lights[i].position[0] = orbits[i].distance * cos(a);
+      lights[i].position[1] = orbits[i].height;
+      lights[i].position[2] = orbits[i].distance * sin(a);
+   }
+}
 
 /*  Initialize material property and light source.
  */
@@ -53,6 +140,7 @@ void init (void)
    GLfloat light_specular[] = { 1.0, 1.0, 1.0, 1.0 };
 /*	light_position is NOT default value	*/
    GLfloat light_position[] = { 1.0, 1.0, 1.0, 0.0 };
+   MatBlock m;
 
    glLightfv (GL_LIGHT0, GL_AMBIENT, light_ambient);
    glLightfv (GL_LIGHT0, GL_DIFFUSE, light_diffuse);
@@ -62,12 +150,18 @@ void init (void)
    glEnable (GL_LIGHTING);
    glEnable (GL_LIGHT0);
    glEnable(GL_DEPTH_TEST);
+
+/*	the default material is the grey one	*/
+   matDefaults(&m);
+   grey = matIntern(&m);
+
+   clusterInit(&grid);
+   initLights();
+   loopInit(&loop, TICK_RATE, FRAME_RATE, tick);
 }
 
-void display (void)
+static void drawObjects(void)
 {
-   glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
    glPushMatrix ();
    glRotatef (20.0, 1.0, 0.0, 0.0);
 
@@ -89,9 +183,92 @@ void display (void)
    glPopMatrix ();
 
    glPopMatrix ();
+}
+
+void display (void)
+{
+   glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+   matBind (grey);
+   if (clustered) {
+      moveLights(lastLightTime + (lightTime - lastLightTime) *
+                 loopAlpha(&loop));
+      clusterBuild(&grid, lights, lightCount);
+      clusterBegin(&grid);
+      drawObjects();
+      clusterEnd();
+   } else
+      drawObjects();
    glFlush ();
 }
 
+static void setClustered(int on)
+{
+   if (on && !clusterSupported(&grid)) {
+      printf("clustered lighting needs OpenGL 3.3\n");
+      on = 0;
+   }
+   clustered = on;
+   if (clustered)
+      loopStart(&loop);
+   else
+      loopStop(&loop);
+   glutPostRedisplay();
+}
+
+/*  Build time, and the time to draw a frame, for each number of
+ *  lights, against the single fixed-function light.
+ */
+static void lightBenchmark(void)
+{
+   int count, i, saved = lightCount;
+   double t0, fixed, build, frame;
+
+   glFinish();
+   t0 = timerSeconds();
+   for (i = 0; i < BENCH_FRAMES; i++) {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      matBind(grey);
+      drawObjects();
+   }
+   glFinish();
+   fixed = (timerSeconds() - t0) / BENCH_FRAMES;
+   printf("fixed-function light 0: frame %8.3f ms\n", fixed * 1000.0);
+
+   if (!clusterSupported(&grid)) {
+      printf("clustered lighting needs OpenGL 3.3\n");
+      return;
+   }
+   printf("lights  in view  build ms  upload ms  avg/cluster  most"
+          "  frame ms\n");
+   for (count = MIN_LIGHTS; count <= MAX_LIGHTS; count *= 4) {
+      lightCount = count;
+      moveLights(0.0);
+      build = 0.0;
+      glFinish();
+      t0 = timerSeconds();
+      for (i = 0; i < BENCH_FRAMES; i++) {
+         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+         matBind(grey);
+         clusterBuild(&grid, lights, lightCount);
+         build += grid.stats.buildTime;
+         clusterBegin(&grid);
+         drawObjects();
+         clusterEnd();
+      }
+      glFinish();
+      frame = (timerSeconds() - t0) / BENCH_FRAMES;
+      printf("%6d  %7d  %8.3f  %9.3f  %11.1f  %4d  %8.3f\n", count,
+             grid.stats.visible, build / BENCH_FRAMES * 1000.0,
+             grid.stats.uploadTime * 1000.0,
+             grid.stats.clusters ?
+                (double) grid.stats.indices / grid.stats.clusters : 0.0,
+             grid.stats.most, frame * 1000.0);
+   }
+   lightCount = saved;
+   glutPostRedisplay();
+}
+
 void reshape(int w, int h)
 {
    glViewport (0, 0, (GLsizei) w, (GLsizei) h);
@@ -110,7 +287,29 @@ void reshape(int w, int h)
 void keyboard(unsigned char key, int x, int y)
 {
    switch (key) {
+      case 'l':
+         setClustered(!clustered);
+         break;
+      case '+':
+         if (lightCount < MAX_LIGHTS)
+            lightCount *= 2;
+         printf("%d lights\n", lightCount);
+         glutPostRedisplay();
+         break;
+      case '-':
+         if (lightCount > MIN_LIGHTS)
+            lightCount /= 2;
+         printf("%d lights\n", lightCount);
+         glutPostRedisplay();
+         break;
+      case 's':
+         clusterPrintStats("clusters", &grid);
+         break;
+      case 'b':
+         lightBenchmark();
+         break;
       case 27:
+         clusterFree(&grid);
          exit(0);
          break;
    }
@@ -0,0 +1,692 @@
+/*
+ *  scenefile.c
+ *  Binary scene files.  See scenefile.h.
+ *
+ *  The importer builds each array in memory as it reads the text,
+ *  finding parents by name in a hash table, and lays them out one
+ *  after another, each at a multiple of four bytes, with the strings
+ *  last.  Loading checks only the header and that each array lies
+ *  within the file, which takes the same time however large the
+ *  scene; the pages of the file are read when they are first used.
+ */
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scenefile.h"
+
+#define PI_ 3.14159265358979323846
+#define TOKEN_MAX 256
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("scene: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+/*
+ *  Import
+ */
+typedef struct importer {
+   SceneNode      *nodes;
+   int             nodeCount, maxNodes;
+   SceneMaterial  *materials;
+   int             materialCount, maxMaterials;
+   GLuint         *meshes, *joints;
+   int             meshCount, maxMeshes, jointCount, maxJoints;
+   char           *strings;
+   size_t          stringBytes, maxStringBytes;
+   int            *table;           /* node + 1 by hash of its name */
+   int             tableSize;       /* a power of two */
+   int             line;
+} Importer;
+
+static unsigned hash(const char *name)
+{
+   unsigned h = 2166136261u;
+
+   while (*name)
+      h = (h ^ (unsigned char) *name++) * 16777619u;
+   return h;
+}
+
+static GLuint addString(Importer *im, const char *s)
+{
+   size_t n = strlen(s) + 1;
+   GLuint offset = (GLuint) im->stringBytes;
+
+   if (im->stringBytes + n > im->maxStringBytes) {
+      im->maxStringBytes = (im->stringBytes + n) * 2;
+      im->strings = (char *) allocate(im->strings, im->maxStringBytes);
+   }
+   memcpy(im->strings + offset, s, n);
+   im->stringBytes += n;
+   return offset;
+}
+
+static int findNode(const Importer *im, const char *name)
+{
+   unsigned i;
+
+   if (im->tableSize == 0)
+      return -1;
+   for (i = hash(name); ; i++) {
+      int n = im->table[i & (im->tableSize - 1)] - 1;
+
+      if (n < 0)
+         return -1;
+      if (strcmp(im->strings + im->nodes[n].name, name) == 0)
+         return n;
+   }
+}
+
+static void insertNode(Importer *im, int n)
+{
+   unsigned i;
+
+   for (i = hash(im->strings + im->nodes[n].name); ; i++)
+      if (im->table[i & (im->tableSize - 1)] == 0) {
+         im->table[i & (im->tableSize - 1)] = n + 1;
+         return;
+      }
+}
+
+/*  Keep the table at most half full.  */
+static void growTable(Importer *im)
+{
+   int i;
+
+   if (2 * (im->nodeCount + 1) <= im->tableSize)
+      return;
+   im->tableSize = im->tableSize ? im->tableSize * 2 : 1024;
+   free(im->table);
+   im->table = (int *) calloc(im->tableSize, sizeof(int));
+   if (im->table == NULL) {
+      printf("scene: out of memory\n");
+      exit(1);
+   }
+   for (i = 0; i < im->nodeCount; i++)
+      insertNode(im, i);
+}
+
+static int findName(const Importer *im, const GLuint *names, int count,
+                    const char *name)
+{
+   int i;
+
+   for (i = 0; i < count; i++)
+      if (strcmp(im->strings + names[i], name) == 0)
+         return i;
+   return -1;
+}
+
+/*  The next word of the line into buf, or 0 at the end of the line.  */
+static int token(const char **p, char *buf)
+{
+   const char *s = *p;
+   int n = 0;
+
+   while (*s == ' ' || *s == '\t' || *s == '\r')
+      s++;
+   if (*s == '#')
+      while (*s && *s != '\n')
+         s++;
+   while (*s && *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n') {
+      if (n < TOKEN_MAX - 1)
+         buf[n++] = *s;
+      s++;
+   }
+   buf[n] = '\0';
+   *p = s;
+   return n > 0;
+}
+
+static int numbers(const char **p, GLfloat *v, int count)
+{
+   char buf[TOKEN_MAX], *end;
+   int i;
+
+   for (i = 0; i < count; i++) {
+      if (!token(p, buf))
+         return 0;
+      v[i] = (GLfloat) strtod(buf, &end);
+      if (*end)
+         return 0;
+   }
+   return 1;
+}
+
+static int fail(const Importer *im, const char *message, const char *what)
+{
+   printf("scene: line %d: %s%s\n", im->line, message, what);
+   return 0;
+}
+
+static int readNode(Importer *im, const char **p)
+{
+   char name[TOKEN_MAX], buf[TOKEN_MAX];
+   SceneNode *n;
+
+   if (!token(p, name) || !token(p, buf))
+      return fail(im, "node needs a name and a parent", "");
+   if (findNode(im, name) >= 0)
+      return fail(im, "node defined twice: ", name);
+   growTable(im);
+   if (im->nodeCount == im->maxNodes) {
+      im->maxNodes = im->maxNodes ? im->maxNodes * 2 : 64;
+      im->nodes = (SceneNode *)
+         allocate(im->nodes, im->maxNodes * sizeof(SceneNode));
+   }
+   n = &im->nodes[im->nodeCount];
+   memset(n, 0, sizeof(SceneNode));
+   n->parent = n->mesh = n->material = n->joint = -1;
+   n->scale[0] = n->scale[1] = n->scale[2] = 1.0f;
+   n->rotate[3] = n->axis[2] = 1.0f;
+   if (strcmp(buf, "-") != 0 && (n->parent = findNode(im, buf)) < 0)
+      return fail(im, "parent not defined before: ", buf);
+
+   while (token(p, buf)) {
+      if (strcmp(buf, "translate") == 0) {
+         if (!numbers(p, n->translate, 3))
+            return fail(im, "translate needs x, y and z", "");
+      } else if (strcmp(buf, "rotate") == 0) {
+         if (!numbers(p, n->rotate, 4))
+            return fail(im, "rotate needs an angle and an axis", "");
+      } else if (strcmp(buf, "scale") == 0) {
+         if (!numbers(p, n->scale, 3))
+            return fail(im, "scale needs x, y and z", "");
+      } else if (strcmp(buf, "joint") == 0) {
+         if (!token(p, buf) ||
+             (n->joint = findName(im, im->joints, im->jointCount,
+                                  buf)) < 0)
+            return fail(im, "no such joint: ", buf);
+         if (!numbers(p, n->axis, 3))
+            return fail(im, "joint needs an axis", "");
+      } else if (strcmp(buf, "mesh") == 0) {
+         if (!token(p, buf) ||
+             (n->mesh = findName(im, im->meshes, im->meshCount, buf)) < 0)
+            return fail(im, "no such mesh: ", buf);
+      } else if (strcmp(buf, "material") == 0) {
+         int i;
+
+         if (!token(p, buf))
+            return fail(im, "material needs a name", "");
+         for (i = 0; i < im->materialCount; i++)
+            if (strcmp(im->strings + im->materials[i].name, buf) == 0)
+               break;
+         if (i == im->materialCount)
+            return fail(im, "no such material: ", buf);
+         n->material = i;
+      } else if (strcmp(buf, "occluder") == 0) {
+         n->flags |= SCENE_OCCLUDER;
+      } else {
+         return fail(im, "unknown node property: ", buf);
+      }
+   }
+   n->name = addString(im, name);
+   insertNode(im, im->nodeCount++);
+   return 1;
+}
+
+static int readLine(Importer *im, const char **p)
+{
+   char word[TOKEN_MAX], name[TOKEN_MAX];
+
+   if (!token(p, word))
+      return 1;
+   if (strcmp(word, "node") == 0)
+      return readNode(im, p);
+   if (!token(p, name))
+      return fail(im, word, " needs a name");
+   if (strcmp(word, "material") == 0) {
+      SceneMaterial *m;
+
+      if (im->materialCount == im->maxMaterials) {
+         im->maxMaterials = im->maxMaterials ? im->maxMaterials * 2 : 16;
+         im->materials = (SceneMaterial *) allocate(im->materials,
+                            im->maxMaterials * sizeof(SceneMaterial));
+      }
+      m = &im->materials[im->materialCount++];
+      m->color[3] = 1.0f;
+      if (!numbers(p, m->color, 3))
+         return fail(im, "material needs a color", "");
+      numbers(p, m->color + 3, 1);
+      m->name = addString(im, name);
+   } else if (strcmp(word, "mesh") == 0) {
+      if (im->meshCount == im->maxMeshes) {
+         im->maxMeshes = im->maxMeshes ? im->maxMeshes * 2 : 16;
+         im->meshes = (GLuint *)
+            allocate(im->meshes, im->maxMeshes * sizeof(GLuint));
+      }
+      im->meshes[im->meshCount++] = addString(im, name);
+   } else if (strcmp(word, "joint") == 0) {
+      if (im->jointCount == im->maxJoints) {
+         im->maxJoints = im->maxJoints ? im->maxJoints * 2 : 16;
+         im->joints = (GLuint *)
+            allocate(im->joints, im->maxJoints * sizeof(GLuint));
+      }
+      im->joints[im->jointCount++] = addString(im, name);
+   } else {
+      return fail(im, "unknown item: ", word);
+   }
+   if (token(p, word))
+      return fail(im, "unexpected ", word);
+   return 1;
+}
+
+static size_t align4(size_t n)
+{
+   return (n + 3) & ~(size_t) 3;
+}
+
+static void freeImporter(Importer *im)
+{
+   free(im->nodes);
+   free(im->materials);
+   free(im->meshes);
+   free(im->joints);
+   free(im->strings);
+   free(im->table);
+}
+
+int sceneFileImport(const char *text, void **data, size_t *bytes)
+{
+   Importer im;
+   SceneHeader h;
+   const char *p = text;
+   char *out;
+   size_t size;
+
+   memset(&im, 0, sizeof(im));
+   for (im.line = 1; *p; im.line++) {
+      if (!readLine(&im, &p)) {
+         freeImporter(&im);
+         return 0;
+      }
+      while (*p && *p != '\n')
+         p++;
+      if (*p)
+         p++;
+   }
+
+   memset(&h, 0, sizeof(h));
+   memcpy(h.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+   h.version = SCENE_VERSION;
+   h.nodes = (GLuint) align4(sizeof(h));
+   h.nodeCount = im.nodeCount;
+   h.materials = h.nodes + im.nodeCount * sizeof(SceneNode);
+   h.materialCount = im.materialCount;
+   h.meshes = h.materials + im.materialCount * sizeof(SceneMaterial);
+   h.meshCount = im.meshCount;
+   h.joints = h.meshes + im.meshCount * sizeof(GLuint);
+   h.jointCount = im.jointCount;
+   h.strings = h.joints + im.jointCount * sizeof(GLuint);
+   h.stringBytes = (GLuint) im.stringBytes;
+   size = align4(h.strings + im.stringBytes);
+   h.bytes = (GLuint) size;
+
+   out = (char *) allocate(NULL, size);
+   memset(out, 0, size);
+   memcpy(out, &h, sizeof(h));
+   memcpy(out + h.nodes, im.nodes, im.nodeCount * sizeof(SceneNode));
+   memcpy(out + h.materials, im.materials,
+          im.materialCount * sizeof(SceneMaterial));
+   memcpy(out + h.meshes, im.meshes, im.meshCount * sizeof(GLuint));
+   memcpy(out + h.joints, im.joints, im.jointCount * sizeof(GLuint));
+   memcpy(out + h.strings, im.strings, im.stringBytes);
+   freeImporter(&im);
+   *data = out;
+   *bytes = size;
+   return 1;
+}
+
+int sceneFileWrite(const char *path, const void *data, size_t bytes)
+{
+   FILE *f = fopen(path, "wb");
+   int ok;
+
+   if (f == NULL) {
+      printf("scene: cannot write %s\n", path);
+      return 0;
+   }
+   ok = fwrite(data, 1, bytes, f) == bytes;
+   if (fclose(f) != 0 || !ok) {
+      printf("scene: error writing %s\n", path);
+      return 0;
+   }
+   return 1;
+}
+
+/*
+ *  Load
+ */
+static int within(size_t bytes, GLuint offset, GLuint count, size_t size)
+{
+   return offset % 4 == 0 && offset <= bytes &&
+          count <= (bytes - offset) / size;
+}
+
+/*  Point the scene at the arrays in data.  */
+static int fixup(SceneFile *s, const char *name)
+{
+   const SceneHeader *h = (const SceneHeader *) s->data;
+   const char *base = (const char *) s->data;
+
+   if (s->bytes < sizeof(SceneHeader) ||
+       memcmp(h->magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0) {
+      printf("scene: %s is not a scene\n", name);
+      return 0;
+   }
+   if (h->version != SCENE_VERSION) {
+      printf("scene: %s has version %u, not %d\n", name, h->version,
+             SCENE_VERSION);
+      return 0;
+   }
+   if (h->bytes != s->bytes ||
+       !within(s->bytes, h->nodes, h->nodeCount, sizeof(SceneNode)) ||
+       !within(s->bytes, h->materials, h->materialCount,
+               sizeof(SceneMaterial)) ||
+       !within(s->bytes, h->meshes, h->meshCount, sizeof(GLuint)) ||
+       !within(s->bytes, h->joints, h->jointCount, sizeof(GLuint)) ||
+       !within(s->bytes, h->strings, h->stringBytes, 1) ||
+       (h->stringBytes > 0 && base[h->strings + h->stringBytes - 1])) {
+      printf("scene: %s is damaged\n", name);
+      return 0;
+   }
+   s->header = h;
+   s->nodes = (const SceneNode *) (base + h->nodes);
+   s->nodeCount = (int) h->nodeCount;
+   s->materials = (const SceneMaterial *) (base + h->materials);
+   s->materialCount = (int) h->materialCount;
+   s->meshes = (const GLuint *) (base + h->meshes);
+   s->meshCount = (int) h->meshCount;
+   s->joints = (const GLuint *) (base + h->joints);
+   s->jointCount = (int) h->jointCount;
+   s->strings = base + h->strings;
+   return 1;
+}
+
+int sceneFileLoadMemory(SceneFile *s, void *data, size_t bytes)
+{
+   memset(s, 0, sizeof(SceneFile));
+   s->data = data;
+   s->bytes = bytes;
+   if (!fixup(s, "scene")) {
+      sceneFileFree(s);
+      return 0;
+   }
+   return 1;
+}
+
+int sceneFileLoad(SceneFile *s, const char *path)
+{
+#ifdef _WIN32
+   HANDLE file, mapping;
+   DWORD high;
+#else
+   struct stat st;
+   int fd;
+#endif
+
+   memset(s, 0, sizeof(SceneFile));
+#ifdef _WIN32
+   file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+   if (file == INVALID_HANDLE_VALUE) {
+      printf("scene: cannot open %s\n", path);
+      return 0;
+   }
+   s->bytes = GetFileSize(file, &high);
+   mapping = s->bytes && !high ? CreateFileMappingA(file, NULL,
+                                    PAGE_READONLY, 0, 0, NULL) : NULL;
+   CloseHandle(file);
+   if (mapping == NULL) {
+      printf("scene: cannot map %s\n", path);
+      return 0;
+   }
+   s->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+   if (s->data == NULL) {
+      CloseHandle(mapping);
+      printf("scene: cannot map %s\n", path);
+      return 0;
+   }
+   s->handle = mapping;
+#else
+   fd = open(path, O_RDONLY);
+   if (fd < 0) {
+      printf("scene: cannot open %s\n", path);
+      return 0;
+   }
+   if (fstat(fd, &st) != 0 || st.st_size == 0 ||
+       (s->data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE,
+                       fd, 0)) == MAP_FAILED) {
+      close(fd);
+      s->data = NULL;
+      printf("scene: cannot map %s\n", path);
+      return 0;
+   }
+   close(fd);
+   s->bytes = (size_t) st.st_size;
+#endif
+   s->mapped = 1;
+   if (!fixup(s, path)) {
+      sceneFileFree(s);
+      return 0;
+   }
+   return 1;
+}
+
+int sceneFileValidate(const SceneFile *s)
+{
+   GLuint strings = s->header->stringBytes;
+   int i;
+
+   for (i = 0; i < s->nodeCount; i++) {
+      const SceneNode *n = &s->nodes[i];
+
+      if (n->parent < -1 || n->parent >= i ||
+          n->mesh < -1 || n->mesh >= s->meshCount ||
+          n->material < -1 || n->material >= s->materialCount ||
+          n->joint < -1 || n->joint >= s->jointCount ||
+          n->name >= strings) {
+         printf("scene: node %d is damaged\n", i);
+         return 0;
+      }
+   }
+   for (i = 0; i < s->materialCount; i++)
+      if (s->materials[i].name >= strings) {
+         printf("scene: material %d is damaged\n", i);
+         return 0;
+      }
+   for (i = 0; i < s->meshCount; i++)
+      if (s->meshes[i] >= strings) {
+         printf("scene: mesh %d is damaged\n", i);
+         return 0;
+      }
+   for (i = 0; i < s->jointCount; i++)
+      if (s->joints[i] >= strings) {
+         printf("scene: joint %d is damaged\n", i);
+         return 0;
+      }
+   return 1;
+}
+
+void sceneFileFree(SceneFile *s)
+{
+   if (s->data && s->mapped) {
+#ifdef _WIN32
+      UnmapViewOfFile(s->data);
+      CloseHandle((HANDLE) s->handle);
+#else
+      munmap(s->data, s->bytes);
+#endif
+   } else {
+      free(s->data);
+   }
+   free(s->world);
+   memset(s, 0, sizeof(SceneFile));
+}
+
+const char *sceneFileString(const SceneFile *s, GLuint offset)
+{
+   return offset < s->header->stringBytes ? s->strings + offset : "";
+}
+
+int sceneFileFindNode(const SceneFile *s, const char *name)
+{
+   int i;
+
+   for (i = 0; i < s->nodeCount; i++)
+      if (strcmp(sceneFileString(s, s->nodes[i].name), name) == 0)
+         return i;
+   return -1;
+}
+
+static int findIn(const SceneFile *s, const GLuint *names, int count,
+                  const char *name)
+{
+   int i;
+
+   for (i = 0; i < count; i++)
+      if (strcmp(sceneFileString(s, names[i]), name) == 0)
+         return i;
+   return -1;
+}
+
+int sceneFileFindMesh(const SceneFile *s, const char *name)
+{
+   return findIn(s, s->meshes, s->meshCount, name);
+}
+
+int sceneFileFindJoint(const SceneFile *s, const char *name)
+{
+   return findIn(s, s->joints, s->jointCount, name);
+}
+
+/*
+ *  Draw
+ */
+
+/*  m = m * the rotation glRotatef() makes, for an affine m.  */
+static void rotate(GLfloat m[16], GLfloat degrees, const GLfloat axis[3])
+{
+   double a = degrees * PI_ / 180.0, c = cos(a), s = sin(a);
+   double x = axis[0], y = axis[1], z = axis[2];
+   double len = sqrt(x * x + y * y + z * z), r[3][3];
+   GLfloat out[12];
+   int i, j;
+
+   if (degrees == 0 || len == 0)
+      return;
+   x /= len;
+   y /= len;
+   z /= len;
+   r[0][0] = x * x * (1 - c) + c;
+   r[0][1] = x * y * (1 - c) - z * s;
+   r[0][2] = x * z * (1 - c) + y * s;
+   r[1][0] = y * x * (1 - c) + z * s;
+   r[1][1] = y * y * (1 - c) + c;
+   r[1][2] = y * z * (1 - c) - x * s;
+   r[2][0] = z * x * (1 - c) - y * s;
+   r[2][1] = z * y * (1 - c) + x * s;
+   r[2][2] = z * z * (1 - c) + c;
+   for (j = 0; j < 3; j++)
+      for (i = 0; i < 3; i++)
+         out[j * 4 + i] = (GLfloat) (m[i] * r[0][j] + m[4 + i] * r[1][j] +
+                                     m[8 + i] * r[2][j]);
+   for (j = 0; j < 3; j++)
+      for (i = 0; i < 3; i++)
+         m[j * 4 + i] = out[j * 4 + i];
+}
+
+static void place(const GLfloat *parent, const SceneNode *n,
+                  const GLfloat *angles, GLfloat m[16])
+{
+   static const GLfloat identity[16] = {
+      1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1
+   };
+   int i;
+
+   memcpy(m, parent ? parent : identity, 16 * sizeof(GLfloat));
+   if (n == NULL)
+      return;
+   for (i = 0; i < 3; i++)
+      m[12 + i] += m[i] * n->translate[0] + m[4 + i] * n->translate[1] +
+                   m[8 + i] * n->translate[2];
+   rotate(m, n->rotate[0], n->rotate + 1);
+   if (n->joint >= 0 && angles)
+      rotate(m, angles[n->joint], n->axis);
+}
+
+/*  Place the nodes from root on, and draw their meshes if there is a
+ *  function to, where root is -1 for the whole scene or the node at
+ *  the origin of a part of it.  The last element of the matrix of a
+ *  node outside that part is set to 0, which no placement makes.
+ */
+static void drawNodes(SceneFile *s, int root, const GLfloat *angles,
+                      SceneMeshFunc draw, void *user)
+{
+   int i;
+
+   if (s->world == NULL)
+      s->world = (GLfloat *)
+         allocate(NULL, s->nodeCount * 16 * sizeof(GLfloat));
+   for (i = root < 0 ? 0 : root; i < s->nodeCount; i++) {
+      const SceneNode *n = &s->nodes[i];
+      GLfloat *m = s->world + i * 16;
+
+      if (i == root) {
+         place(NULL, NULL, NULL, m);
+      } else if (n->parent < 0) {
+         if (root >= 0) {
+            m[15] = 0;
+            continue;
+         }
+         place(NULL, n, angles, m);
+      } else if (n->parent < root || s->world[n->parent * 16 + 15] == 0) {
+         m[15] = 0;
+         continue;
+      } else {
+         place(s->world + n->parent * 16, n, angles, m);
+      }
+      if (n->mesh < 0 || draw == NULL)
+         continue;
+      glPushMatrix();
+      glMultMatrixf(m);
+      glScalef(n->scale[0], n->scale[1], n->scale[2]);
+      if (n->material >= 0)
+         glColor4fv(s->materials[n->material].color);
+      draw(s, i, user);
+      glPopMatrix();
+   }
+}
+
+void sceneFilePlace(SceneFile *s, const GLfloat *angles)
+{
+   drawNodes(s, -1, angles, NULL, NULL);
+}
+
+void sceneFileDraw(SceneFile *s, const GLfloat *angles, SceneMeshFunc draw,
+                   void *user)
+{
+   drawNodes(s, -1, angles, draw, user);
+}
+
+void sceneFileDrawNode(SceneFile *s, int node, const GLfloat *angles,
+                       SceneMeshFunc draw, void *user)
+{
+   drawNodes(s, node, angles, draw, user);
+}
@@ -0,0 +1,123 @@
+/*
+ *  scenefile.h
+ *  A binary scene format for hierarchical models.  A scene is a
+ *  header followed by flat arrays of nodes, materials, mesh names,
+ *  joint names and a block of strings.  Every reference in it is an
+ *  index or an offset from the start of the file, never a pointer,
+ *  so a file is loaded by mapping it into memory and pointing a
+ *  SceneFile at its arrays, whatever address it lands at.
+ *
+ *  Nodes come after their parents.  Each is placed, in the frame of
+ *  its parent, by a translation, a fixed rotation and a rotation
+ *  about a joint axis by the angle the program gives that joint, as
+ *  glTranslatef() and glRotatef() would do it.  A node may draw a
+ *  mesh, scaled by its own scale, which its children do not inherit.
+ *  Meshes and joints are only names: the program binds them to what
+ *  it draws and to its own angles.
+ *
+ *  Scenes are written from a text form, one item to a line:
+ *
+ *     material <name> <r> <g> <b> [<a>]
+ *     mesh <name>
+ *     joint <name>
+ *     node <name> <parent or -> [translate <x> <y> <z>]
+ *          [rotate <degrees> <x> <y> <z>] [joint <name> <x> <y> <z>]
+ *          [scale <x> <y> <z>] [mesh <name>] [material <name>]
+ *          [occluder]
+ *
+ *  with # starting a comment.
+ */
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <stddef.h>
+
+#define SCENE_MAGIC     "RBSCENE"
+#define SCENE_VERSION   1
+#define SCENE_OCCLUDER  1           /* node flag */
+
+typedef struct sceneheader {
+   char     magic[8];
+   GLuint   version;
+   GLuint   bytes;                  /* of the whole file */
+   GLuint   nodes, nodeCount;       /* offset and count */
+   GLuint   materials, materialCount;
+   GLuint   meshes, meshCount;
+   GLuint   joints, jointCount;
+   GLuint   strings, stringBytes;
+} SceneHeader;
+
+typedef struct scenenode {
+   GLint    parent;                 /* -1 at the root */
+   GLint    mesh, material, joint;  /* -1 for none */
+   GLuint   name;                   /* offset in the strings */
+   GLuint   flags;
+   GLfloat  translate[3];
+   GLfloat  rotate[4];              /* degrees, then the axis */
+   GLfloat  axis[3];                /* of the joint */
+   GLfloat  scale[3];               /* of the mesh */
+} SceneNode;
+
+typedef struct scenematerial {
+   GLfloat  color[4];
+   GLuint   name;
+} SceneMaterial;
+
+typedef struct scenefile {
+   const SceneHeader    *header;
+   const SceneNode      *nodes;
+   const SceneMaterial  *materials;
+   const GLuint         *meshes, *joints;     /* names */
+   const char           *strings;
+   int                   nodeCount, materialCount, meshCount, jointCount;
+
+   void                 *data;
+   size_t                bytes;
+   int                   mapped;
+   void                 *handle;              /* of the mapping */
+   GLfloat              *world;               /* a matrix for each node */
+} SceneFile;
+
+/*  Called by sceneFileDraw() for each node with a mesh, with the
+ *  node's matrix and scale on the modelview and its material's color
+ *  current.
+ */
+typedef void (*SceneMeshFunc)(const SceneFile *s, int node, void *user);
+
+/*  Write the binary form of a text scene to a block of memory from
+ *  malloc().  Returns 0 and prints the line at fault on an error.
+ */
+int sceneFileImport(const char *text, void **data, size_t *bytes);
+int sceneFileWrite(const char *path, const void *data, size_t bytes);
+
+/*  Map a file, or take over a block from sceneFileImport(), and
+ *  check its header; sceneFileValidate() also checks every reference
+ *  in it, for files from elsewhere.  Return 0 and print why on
+ *  failure.
+ */
+int sceneFileLoad(SceneFile *s, const char *path);
+int sceneFileLoadMemory(SceneFile *s, void *data, size_t bytes);
+int sceneFileValidate(const SceneFile *s);
+void sceneFileFree(SceneFile *s);
+
+const char *sceneFileString(const SceneFile *s, GLuint offset);
+
+/*  Index of the node, mesh or joint with the name, or -1.  */
+int sceneFileFindNode(const SceneFile *s, const char *name);
+int sceneFileFindMesh(const SceneFile *s, const char *name);
+int sceneFileFindJoint(const SceneFile *s, const char *name);
+
+/*  Work out where every node is, with the joints at the given
+ *  angles, into world, and draw the meshes in the current modelview.
+ */
+void sceneFilePlace(SceneFile *s, const GLfloat *angles);
+void sceneFileDraw(SceneFile *s, const GLfloat *angles, SceneMeshFunc draw,
+                   void *user);
+
+/*  Draw a node and the nodes under it, with the node at the origin of
+ *  the current modelview, as a part to be drawn in many places.
+ */
+void sceneFileDrawNode(SceneFile *s, int node, const GLfloat *angles,
+                       SceneMeshFunc draw, void *user);
+
+#endif
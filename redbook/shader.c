@@ -0,0 +1,96 @@
+/*
+ *  shader.c
+ *  GLSL program helpers.  See shader.h.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "shader.h"
+
+int shaderGLVersion(int major, int minor)
+{
+   const char *v = (const char *) glGetString(GL_VERSION);
+   int ma = 0, mi = 0;
+
+   if (v != NULL)
+      sscanf(v, "%d.%d", &ma, &mi);
+   return ma > major || (ma == major && mi >= minor);
+}
+
+#ifdef GL_VERSION_2_0
+static void printLog(const char *what, GLuint object, int program)
+{
+   GLint length = 0;
+   char *log;
+
+   if (program)
+      glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+   else
+      glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+   log = (char *) malloc(length + 1);
+   if (log == NULL)
+      return;
+   log[0] = '\0';
+   if (program)
+      glGetProgramInfoLog(object, length + 1, NULL, log);
+   else
+      glGetShaderInfoLog(object, length + 1, NULL, log);
+   fprintf(stderr, "%s:\n%s\n", what, log);
+   free(log);
+}
+
+GLuint shaderCompile(GLenum type, const char *source)
+{
+   GLuint s = glCreateShader(type);
+   GLint ok = 0;
+
+   glShaderSource(s, 1, &source, NULL);
+   glCompileShader(s);
+   glGetShaderiv(s, GL_COMPILE_STATUS, &ok);
+   if (!ok) {
+      printLog(type == GL_VERTEX_SHADER ? "vertex shader" : "fragment shader",
+               s, 0);
+      glDeleteShader(s);
+      return 0;
+   }
+   return s;
+}
+
+GLuint shaderProgram(const char *vertex, const char *fragment)
+{
+   GLuint vs, fs, p;
+   GLint ok = 0;
+
+   vs = shaderCompile(GL_VERTEX_SHADER, vertex);
+   fs = shaderCompile(GL_FRAGMENT_SHADER, fragment);
+   if (vs == 0 || fs == 0) {
+      glDeleteShader(vs);
+      glDeleteShader(fs);
+      return 0;
+   }
+   p = glCreateProgram();
+   glAttachShader(p, vs);
+   glAttachShader(p, fs);
+   glLinkProgram(p);
+   glDeleteShader(vs);
+   glDeleteShader(fs);
+   glGetProgramiv(p, GL_LINK_STATUS, &ok);
+   if (!ok) {
+      printLog("program", p, 1);
+      glDeleteProgram(p);
+      return 0;
+   }
+   return p;
+}
+#else
+GLuint shaderCompile(GLenum type, const char *source)
+{
+   return 0;
+}
+
+GLuint shaderProgram(const char *vertex, const char *fragment)
+{
+   return 0;
+}
+#endif
@@ -0,0 +1,18 @@
+/*
+ *  shader.h
+ *  GLSL program helpers.  Compile and link errors are printed with
+ *  the info log and reported by returning 0, so a caller can fall
+ *  back to the fixed-function path.
+ *
+ *  Requires OpenGL 2.0.
+ */
+#ifndef SHADER_H
+#define SHADER_H
+
+/*  True when the context reports at least OpenGL major.minor.  */
+int shaderGLVersion(int major, int minor);
+
+GLuint shaderCompile(GLenum type, const char *source);
+GLuint shaderProgram(const char *vertex, const char *fragment);
+
+#endif
@@ -0,0 +1,730 @@
+/*
+ *  shadow.c
+ *  Shadow maps.  See shadow.h.
+ *
+ *  Each view is drawn with its whole transformation, world to clip
+ *  coordinates, as the modelview matrix and an identity projection.
+ *  The view is compared with the one the static map was drawn with,
+ *  so a light or a cascade that moved is found without being told.
+ *  A caster that moved is tested, as it was and as it is, against the
+ *  planes of each view; only the views it touches are drawn again,
+ *  and only the casters inside those.
+ *
+ *  The shader looks up a point light's cube map with the direction
+ *  from the light in world coordinates, and compares the depth the
+ *  face across that direction would give the point.  For a cascade
+ *  it picks the first whose slice holds the point's depth and takes
+ *  the point from eye to map coordinates with one matrix.  Either way
+ *  the point is first moved a texel and a half along its normal, so
+ *  that a surface does not shadow itself where it faces away from the
+ *  light.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shadow.h"
+#include "shader.h"
+#include "timer.h"
+
+/*  How the eye's depth range is split between cascades: 0 evenly, 1
+ *  in proportion to depth.
+ */
+#define SPLIT_LAMBDA  0.75
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("shadow: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+#ifdef GL_VERSION_3_3
+static const char *shadowVertex =
+   "#version 330 compatibility\n"
+   "out vec3 eyePosition, eyeNormal;\n"
+   "void main()\n"
+   "{\n"
+   "   eyePosition = (gl_ModelViewMatrix * gl_Vertex).xyz;\n"
+   "   eyeNormal = gl_NormalMatrix * gl_Normal;\n"
+   "   gl_Position = ftransform();\n"
+   "}\n";
+
+static const char *shadowFragment =
+   "#version 330 compatibility\n"
+   "uniform samplerCubeShadow cube;\n"
+   "uniform sampler2DArrayShadow cascades;\n"
+   "uniform bool directional;\n"
+   "uniform int cascadeCount;\n"
+   "uniform mat4 matrices[4];\n"
+   "uniform vec4 splits;\n"
+   "uniform mat3 eyeToWorld;\n"
+   "uniform vec2 depthRange;\n"
+   "uniform vec3 lightPosition;\n"
+   "in vec3 eyePosition, eyeNormal;\n"
+   "float lit(vec3 n)\n"
+   "{\n"
+   "   if (directional) {\n"
+   "      float depth = -eyePosition.z, texel;\n"
+   "      int c = 0;\n"
+   "      vec4 p;\n"
+   "      while (c < cascadeCount - 1 && depth > splits[c])\n"
+   "         c++;\n"
+   "      texel = 1.0 / (float(textureSize(cascades, 0).x) * length(vec3(\n"
+   "                 matrices[c][0][0], matrices[c][1][0], matrices[c][2][0])));\n"
+   "      p = matrices[c] * vec4(eyePosition + n * 1.5 * texel, 1.0);\n"
+   "      if (any(lessThan(p.xyz, vec3(0.0))) ||\n"
+   "          any(greaterThan(p.xyz, vec3(1.0))))\n"
+   "         return 1.0;\n"
+   "      return texture(cascades, vec4(p.xy, float(c), p.z - 0.0005));\n"
+   "   } else {\n"
+   "      vec3 d = eyePosition - lightPosition, a;\n"
+   "      float z = length(d) * 3.0 / float(textureSize(cube, 0).x);\n"
+   "      float near = depthRange.x, far = depthRange.y, ref;\n"
+   "      d = eyeToWorld * (d + n * z);\n"
+   "      a = abs(d);\n"
+   "      z = max(a.x, max(a.y, a.z));\n"
+   "      ref = (far + near) / (far - near) -\n"
+   "            2.0 * far * near / ((far - near) * z);\n"
+   "      if (z >= far)\n"
+   "         return 1.0;\n"
+   "      return texture(cube, vec4(d, ref * 0.5 + 0.5 - 0.0005));\n"
+   "   }\n"
+   "}\n"
+   "void main()\n"
+   "{\n"
+   "   vec3 n = normalize(eyeNormal), L;\n"
+   "   vec4 lp = gl_LightSource[0].position;\n"
+   "   float a = 1.0, nl, sp;\n"
+   "   vec3 color;\n"
+   "   if (!gl_FrontFacing)\n"
+   "      n = -n;\n"
+   "   if (lp.w == 0.0)\n"
+   "      L = normalize(lp.xyz);\n"
+   "   else {\n"
+   "      vec3 d = lp.xyz / lp.w - eyePosition;\n"
+   "      float dist = length(d);\n"
+   "      L = d / dist;\n"
+   "      a = 1.0 / (gl_LightSource[0].constantAttenuation +\n"
+   "                 gl_LightSource[0].linearAttenuation * dist +\n"
+   "                 gl_LightSource[0].quadraticAttenuation * dist * dist);\n"
+   "   }\n"
+   "   nl = max(dot(n, L), 0.0);\n"
+   "   sp = nl > 0.0 ? pow(max(dot(n, normalize(L + vec3(0.0, 0.0, 1.0))),\n"
+   "                           0.0), gl_FrontMaterial.shininess) : 0.0;\n"
+   "   color = gl_FrontLightModelProduct.sceneColor.rgb + a *\n"
+   "           (gl_FrontLightProduct[0].ambient.rgb + lit(n) *\n"
+   "            (nl * gl_FrontLightProduct[0].diffuse.rgb +\n"
+   "             sp * gl_FrontLightProduct[0].specular.rgb));\n"
+   "   gl_FragColor = vec4(color, gl_FrontMaterial.diffuse.a);\n"
+   "}\n";
+
+static void setupTexture(GLenum target, GLuint texture, int size, int layers)
+{
+   int i;
+
+   glBindTexture(target, texture);
+   if (target == GL_TEXTURE_CUBE_MAP)
+      for (i = 0; i < 6; i++)
+         glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
+                      GL_DEPTH_COMPONENT24, size, size, 0,
+                      GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+   else
+      glTexImage3D(target, 0, GL_DEPTH_COMPONENT24, size, size, layers, 0,
+                   GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+   glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+   glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+   glTexParameteri(target, GL_TEXTURE_COMPARE_MODE,
+                   GL_COMPARE_REF_TO_TEXTURE);
+   glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+   glBindTexture(target, 0);
+}
+
+static void setupFramebuffers(ShadowMaps *s)
+{
+   GLint saved;
+   int i, j;
+
+   glGetIntegerv(GL_FRAMEBUFFER_BINDING, &saved);
+   for (i = 0; i < s->viewCount; i++) {
+      glGenFramebuffers(2, s->views[i].fbo);
+      for (j = 0; j < 2; j++) {
+         glBindFramebuffer(GL_FRAMEBUFFER, s->views[i].fbo[j]);
+         if (s->type == SHADOW_POINT)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                   GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+                                   s->textures[j], 0);
+         else
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                      s->textures[j], 0, i);
+         glDrawBuffer(GL_NONE);
+         glReadBuffer(GL_NONE);
+      }
+   }
+   glBindFramebuffer(GL_FRAMEBUFFER, saved);
+}
+#endif
+
+void shadowInit(ShadowMaps *s, int type, int size, int cascades)
+{
+   memset(s, 0, sizeof(*s));
+   s->type = type;
+   s->size = size;
+   if (cascades < 1)
+      cascades = 1;
+   if (cascades > SHADOW_MAX_CASCADES)
+      cascades = SHADOW_MAX_CASCADES;
+   s->cascades = cascades;
+   s->viewCount = type == SHADOW_POINT ? 6 : cascades;
+   s->light[2] = 1.0;
+   s->nearPlane = 0.05;
+   s->farPlane = 10.0;
+   s->distance = 20.0;
+#ifdef GL_VERSION_3_3
+   if (!shaderGLVersion(3, 3))
+      return;
+   s->program = shaderProgram(shadowVertex, shadowFragment);
+   if (s->program == 0)
+      return;
+   glUseProgram(s->program);
+   glUniform1i(glGetUniformLocation(s->program, "cube"), 1);
+   glUniform1i(glGetUniformLocation(s->program, "cascades"), 2);
+   s->directionalLocation = glGetUniformLocation(s->program, "directional");
+   s->cascadeCountLocation = glGetUniformLocation(s->program, "cascadeCount");
+   s->matricesLocation = glGetUniformLocation(s->program, "matrices");
+   s->splitsLocation = glGetUniformLocation(s->program, "splits");
+   s->eyeToWorldLocation = glGetUniformLocation(s->program, "eyeToWorld");
+   s->depthRangeLocation = glGetUniformLocation(s->program, "depthRange");
+   s->lightLocation = glGetUniformLocation(s->program, "lightPosition");
+   glUseProgram(0);
+
+   glGenTextures(2, s->textures);
+   setupTexture(type == SHADOW_POINT ? GL_TEXTURE_CUBE_MAP :
+                GL_TEXTURE_2D_ARRAY, s->textures[0], size, cascades);
+   setupTexture(type == SHADOW_POINT ? GL_TEXTURE_CUBE_MAP :
+                GL_TEXTURE_2D_ARRAY, s->textures[1], size, cascades);
+   setupFramebuffers(s);
+#endif
+}
+
+void shadowFree(ShadowMaps *s)
+{
+#ifdef GL_VERSION_3_3
+   int i;
+
+   if (s->program) {
+      glDeleteProgram(s->program);
+      glDeleteTextures(2, s->textures);
+      for (i = 0; i < s->viewCount; i++)
+         glDeleteFramebuffers(2, s->views[i].fbo);
+   }
+#endif
+   free(s->casters);
+   memset(s, 0, sizeof(*s));
+}
+
+int shadowSupported(const ShadowMaps *s)
+{
+   return s->program != 0;
+}
+
+/*  Grow the sphere around all the casters to hold another.  */
+static void growBounds(ShadowMaps *s, const GLfloat c[3], GLfloat r)
+{
+   GLfloat *b = s->bounds, d[3], len, grown;
+   int i;
+
+   for (i = 0; i < 3; i++)
+      d[i] = c[i] - b[i];
+   len = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+   if (b[3] <= 0.0 && s->count == 1) {
+      memcpy(b, c, 3 * sizeof(GLfloat));
+      b[3] = r;
+   } else if (len + r > b[3]) {
+      grown = (len + r + b[3]) * 0.5;
+      if (len > 0.0)
+         for (i = 0; i < 3; i++)
+            b[i] += d[i] / len * (grown - b[3]);
+      b[3] = grown;
+   }
+}
+
+int shadowAddCaster(ShadowMaps *s, ShadowDrawFunc draw, void *data,
+                    const GLfloat center[3], GLfloat radius, int dynamic)
+{
+   ShadowCaster *c;
+
+   if (s->count == s->capacity) {
+      s->capacity = s->capacity ? s->capacity * 2 : 64;
+      s->casters = (ShadowCaster *)
+         allocate(s->casters, s->capacity * sizeof(ShadowCaster));
+   }
+   c = &s->casters[s->count++];
+   c->draw = draw;
+   c->data = data;
+   memcpy(c->center, center, 3 * sizeof(GLfloat));
+   c->radius = radius;
+   c->drawn[3] = -1.0;                /* in no view yet */
+   c->dynamic = dynamic;
+   c->moved = 1;
+   growBounds(s, center, radius);
+   return s->count - 1;
+}
+
+void shadowMoveCaster(ShadowMaps *s, int caster, const GLfloat center[3])
+{
+   ShadowCaster *c = &s->casters[caster];
+
+   memcpy(c->center, center, 3 * sizeof(GLfloat));
+   c->moved = 1;
+   growBounds(s, center, c->radius);
+}
+
+void shadowClearCasters(ShadowMaps *s)
+{
+   s->count = 0;
+   memset(s->bounds, 0, sizeof(s->bounds));
+   shadowInvalidate(s);
+}
+
+void shadowSetLight(ShadowMaps *s, const GLfloat light[3], GLfloat farPlane)
+{
+   memcpy(s->light, light, 3 * sizeof(GLfloat));
+   if (s->type == SHADOW_POINT)
+      s->farPlane = farPlane;
+   else
+      s->distance = farPlane;
+}
+
+void shadowInvalidate(ShadowMaps *s)
+{
+   int i;
+
+   for (i = 0; i < s->viewCount; i++)
+      s->views[i].valid = 0;
+}
+
+static void normalize(GLfloat v[3])
+{
+   GLfloat len = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+
+   if (len > 0.0) {
+      v[0] /= len;
+      v[1] /= len;
+      v[2] /= len;
+   }
+}
+
+static void cross(const GLfloat a[3], const GLfloat b[3], GLfloat c[3])
+{
+   c[0] = a[1] * b[2] - a[2] * b[1];
+   c[1] = a[2] * b[0] - a[0] * b[2];
+   c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static GLfloat dot(const GLfloat a[3], const GLfloat b[3])
+{
+   return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/*  c = a b, all column major.  */
+static void multiply(const GLfloat a[16], const GLfloat b[16], GLfloat c[16])
+{
+   int i, j;
+
+   for (i = 0; i < 4; i++)
+      for (j = 0; j < 4; j++)
+         c[i * 4 + j] = a[j] * b[i * 4] + a[4 + j] * b[i * 4 + 1] +
+                        a[8 + j] * b[i * 4 + 2] + a[12 + j] * b[i * 4 + 3];
+}
+
+/*  A matrix with rows x, y and z, each with its translation, and
+ *  0 0 0 1.
+ */
+static void rows(GLfloat m[16], const GLfloat x[4], const GLfloat y[4],
+                 const GLfloat z[4])
+{
+   int i;
+
+   for (i = 0; i < 4; i++) {
+      m[i * 4] = x[i];
+      m[i * 4 + 1] = y[i];
+      m[i * 4 + 2] = z[i];
+      m[i * 4 + 3] = i == 3 ? 1.0 : 0.0;
+   }
+}
+
+/*  The cube map face: a 90 degree frustum from the light along one
+ *  axis, turned as GL expects the faces to be.
+ */
+static void faceMatrix(const ShadowMaps *s, int face, GLfloat m[16])
+{
+   static const GLfloat axes[6][2][3] = {
+      { {  1.0,  0.0,  0.0 }, {  0.0, -1.0,  0.0 } },
+      { { -1.0,  0.0,  0.0 }, {  0.0, -1.0,  0.0 } },
+      { {  0.0,  1.0,  0.0 }, {  0.0,  0.0,  1.0 } },
+      { {  0.0, -1.0,  0.0 }, {  0.0,  0.0, -1.0 } },
+      { {  0.0,  0.0,  1.0 }, {  0.0, -1.0,  0.0 } },
+      { {  0.0,  0.0, -1.0 }, {  0.0, -1.0,  0.0 } }
+   };
+   const GLfloat *f = axes[face][0], *up = axes[face][1];
+   GLfloat n = s->nearPlane, fp = s->farPlane, side[3], u[3];
+   GLfloat x[4], y[4], z[4], view[16], p[16];
+
+   cross(f, up, side);
+   cross(side, f, u);
+   memcpy(x, side, sizeof(side));
+   memcpy(y, u, sizeof(u));
+   z[0] = -f[0];
+   z[1] = -f[1];
+   z[2] = -f[2];
+   x[3] = -dot(side, s->light);
+   y[3] = -dot(u, s->light);
+   z[3] = dot(f, s->light);
+   rows(view, x, y, z);
+
+   memset(p, 0, sizeof(p));
+   p[0] = p[5] = 1.0;
+   p[10] = (fp + n) / (n - fp);
+   p[11] = -1.0;
+   p[14] = 2.0 * fp * n / (n - fp);
+   multiply(p, view, m);
+}
+
+/*  The cascade: an orthographic view along the light of the sphere
+ *  around a slice of the eye's view volume, deep enough to hold every
+ *  caster, and moved only in whole texels.
+ */
+static void cascadeMatrix(ShadowMaps *s, int cascade, const GLfloat eye[16],
+                          const GLfloat p[16], GLfloat m[16])
+{
+   GLfloat n, f, z0, z1, center[3] = { 0.0, 0.0, 0.0 }, world[3];
+   GLfloat corners[8][3], r = 0.0, texel, cx, cy, lo, hi, bz;
+   GLfloat x[4], y[4], z[4], up[3] = { 0.0, 1.0, 0.0 };
+   int i, j;
+
+   if (p[15] == 0.0) {
+      n = p[14] / (p[10] - 1.0);
+      f = p[14] / (p[10] + 1.0);
+   } else {
+      n = (p[14] + 1.0) / p[10];
+      f = (p[14] - 1.0) / p[10];
+   }
+   if (f > s->distance)
+      f = s->distance;
+   for (i = 0; i < s->cascades; i++) {
+      GLfloat t = (GLfloat) (i + 1) / s->cascades;
+
+      s->splits[i] = n + (f - n) * t;
+      if (n > 0.0)
+         s->splits[i] += SPLIT_LAMBDA * (n * pow(f / n, t) - s->splits[i]);
+   }
+   z0 = cascade == 0 ? n : s->splits[cascade - 1];
+   z1 = s->splits[cascade];
+
+   /*  the corners of the slice, in eye coordinates  */
+   for (i = 0; i < 8; i++) {
+      GLfloat depth = i & 4 ? z1 : z0, sx = i & 1 ? 1.0 : -1.0;
+      GLfloat sy = i & 2 ? 1.0 : -1.0;
+
+      if (p[15] == 0.0) {
+         corners[i][0] = depth * (sx + p[8]) / p[0];
+         corners[i][1] = depth * (sy + p[9]) / p[5];
+      } else {
+         corners[i][0] = (sx - p[12]) / p[0];
+         corners[i][1] = (sy - p[13]) / p[5];
+      }
+      corners[i][2] = -depth;
+      for (j = 0; j < 3; j++)
+         center[j] += corners[i][j] / 8.0;
+   }
+   for (i = 0; i < 8; i++) {
+      GLfloat d[3], len;
+
+      for (j = 0; j < 3; j++)
+         d[j] = corners[i][j] - center[j];
+      len = sqrt(dot(d, d));
+      if (len > r)
+         r = len;
+   }
+   r = ceil(r * 16.0) / 16.0;
+
+   /*  the eye's view matrix is a rotation and a translation  */
+   for (j = 0; j < 3; j++)
+      world[j] = eye[j * 4] * (center[0] - eye[12]) +
+                 eye[j * 4 + 1] * (center[1] - eye[13]) +
+                 eye[j * 4 + 2] * (center[2] - eye[14]);
+
+   memcpy(z, s->light, 3 * sizeof(GLfloat));
+   normalize(z);
+   if (fabs(z[1]) > 0.99) {
+      up[0] = 1.0;
+      up[1] = 0.0;
+   }
+   cross(up, z, x);
+   normalize(x);
+   cross(z, x, y);
+
+   texel = 2.0 * r / s->size;
+   cx = floor(dot(world, x) / texel) * texel;
+   cy = floor(dot(world, y) / texel) * texel;
+   lo = dot(world, z) - r;
+   hi = dot(world, z) + r;
+   bz = dot(s->bounds, z);
+   if (bz - s->bounds[3] < lo)
+      lo = bz - s->bounds[3];
+   if (bz + s->bounds[3] > hi)
+      hi = bz + s->bounds[3];
+   lo = floor(lo / texel) * texel;
+   hi = ceil(hi / texel) * texel;
+
+   for (i = 0; i < 3; i++) {
+      x[i] /= r;
+      y[i] /= r;
+      z[i] *= -2.0 / (hi - lo);
+   }
+   x[3] = -cx / r;
+   y[3] = -cy / r;
+   z[3] = (hi + lo) / (hi - lo);
+   rows(m, x, y, z);
+}
+
+/*  Planes of the view volume of a world to clip matrix, facing in.  */
+static void viewPlanes(ShadowView *v)
+{
+   const GLfloat *m = v->matrix;
+   int i, j;
+
+   for (i = 0; i < 6; i++) {
+      int row = i / 2;
+      GLfloat sign = i & 1 ? -1.0 : 1.0, len;
+
+      for (j = 0; j < 4; j++)
+         v->planes[i][j] = m[j * 4 + 3] + sign * m[j * 4 + row];
+      len = sqrt(dot(v->planes[i], v->planes[i]));
+      for (j = 0; j < 4; j++)
+         v->planes[i][j] /= len;
+   }
+}
+
+static int sphereInView(const ShadowView *v, const GLfloat c[3], GLfloat r)
+{
+   int i;
+
+   if (r < 0.0)
+      return 0;
+   for (i = 0; i < 6; i++)
+      if (dot(v->planes[i], c) + v->planes[i][3] < -r)
+         return 0;
+   return 1;
+}
+
+#ifdef GL_VERSION_3_3
+/*  Draw the static or the dynamic casters inside a view.  */
+static void drawCasters(ShadowMaps *s, const ShadowView *v, int dynamic)
+{
+   int i;
+
+   glLoadMatrixf(v->matrix);
+   for (i = 0; i < s->count; i++) {
+      ShadowCaster *c = &s->casters[i];
+
+      if (c->dynamic != dynamic)
+         continue;
+      if (!sphereInView(v, c->center, c->radius)) {
+         s->stats.culled++;
+         continue;
+      }
+      glPushMatrix();
+      c->draw(c->data);
+      glPopMatrix();
+      s->stats.drawn++;
+   }
+}
+#endif
+
+void shadowUpdate(ShadowMaps *s)
+{
+   GLfloat eye[16], p[16], m[16], inverse[16], bias[16];
+   int staticDirty[SHADOW_MAX_VIEWS], dynamicDirty[SHADOW_MAX_VIEWS];
+   double t0 = timerSeconds();
+   int i, j;
+
+   memset(&s->stats, 0, sizeof(s->stats));
+   glGetFloatv(GL_MODELVIEW_MATRIX, eye);
+   glGetFloatv(GL_PROJECTION_MATRIX, p);
+   for (i = 0; i < 3; i++)
+      for (j = 0; j < 3; j++)
+         s->eyeToWorld[j * 3 + i] = eye[i * 4 + j];
+   for (i = 0; i < 3; i++)
+      s->lightEye[i] = eye[i] * s->light[0] + eye[4 + i] * s->light[1] +
+                       eye[8 + i] * s->light[2] + eye[12 + i];
+
+   /*  eye to world, then to map coordinates in [0, 1]  */
+   memset(inverse, 0, sizeof(inverse));
+   for (i = 0; i < 3; i++) {
+      for (j = 0; j < 3; j++)
+         inverse[j * 4 + i] = eye[i * 4 + j];
+      inverse[12 + i] = -(eye[i * 4] * eye[12] + eye[i * 4 + 1] * eye[13] +
+                          eye[i * 4 + 2] * eye[14]);
+   }
+   inverse[15] = 1.0;
+   memset(bias, 0, sizeof(bias));
+   bias[0] = bias[5] = bias[10] = 0.5;
+   bias[12] = bias[13] = bias[14] = 0.5;
+   bias[15] = 1.0;
+
+   for (i = 0; i < s->viewCount; i++) {
+      ShadowView *v = &s->views[i];
+
+      if (s->type == SHADOW_POINT)
+         faceMatrix(s, i, m);
+      else {
+         GLfloat t[16];
+
+         cascadeMatrix(s, i, eye, p, m);
+         multiply(bias, m, t);
+         multiply(t, inverse, s->eyeMatrices[i]);
+      }
+      if (memcmp(m, v->matrix, sizeof(m)) != 0) {
+         memcpy(v->matrix, m, sizeof(m));
+         viewPlanes(v);
+         v->valid = 0;
+      }
+      staticDirty[i] = !v->valid;
+      dynamicDirty[i] = 0;
+   }
+
+   /*  the views that the casters that moved were or are in  */
+   for (j = 0; j < s->count; j++) {
+      ShadowCaster *c = &s->casters[j];
+
+      if (!c->moved)
+         continue;
+      for (i = 0; i < s->viewCount; i++)
+         if (sphereInView(&s->views[i], c->drawn, c->drawn[3]) ||
+             sphereInView(&s->views[i], c->center, c->radius)) {
+            if (c->dynamic)
+               dynamicDirty[i] = 1;
+            else
+               staticDirty[i] = 1;
+         }
+      memcpy(c->drawn, c->center, 3 * sizeof(GLfloat));
+      c->drawn[3] = c->radius;
+      c->moved = 0;
+   }
+
+#ifdef GL_VERSION_3_3
+   if (s->program) {
+      GLint saved;
+
+      glGetIntegerv(GL_FRAMEBUFFER_BINDING, &saved);
+      glPushAttrib(GL_ENABLE_BIT | GL_VIEWPORT_BIT | GL_POLYGON_BIT |
+                   GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      glMatrixMode(GL_PROJECTION);
+      glPushMatrix();
+      glLoadIdentity();
+      glMatrixMode(GL_MODELVIEW);
+      glPushMatrix();
+      glViewport(0, 0, s->size, s->size);
+      glDisable(GL_LIGHTING);
+      glDisable(GL_CULL_FACE);
+      glEnable(GL_DEPTH_TEST);
+      glDepthMask(GL_TRUE);
+      glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+      glEnable(GL_POLYGON_OFFSET_FILL);
+      glPolygonOffset(2.0, 4.0);
+
+      for (i = 0; i < s->viewCount; i++) {
+         ShadowView *v = &s->views[i];
+
+         if (staticDirty[i]) {
+            glBindFramebuffer(GL_FRAMEBUFFER, v->fbo[0]);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            drawCasters(s, v, 0);
+            v->valid = 1;
+            s->stats.staticViews++;
+         }
+         if (!staticDirty[i] && !dynamicDirty[i]) {
+            s->stats.skipped++;
+            continue;
+         }
+         glBindFramebuffer(GL_READ_FRAMEBUFFER, v->fbo[0]);
+         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, v->fbo[1]);
+         glBlitFramebuffer(0, 0, s->size, s->size, 0, 0, s->size, s->size,
+                           GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+         glBindFramebuffer(GL_FRAMEBUFFER, v->fbo[1]);
+         drawCasters(s, v, 1);
+         s->stats.dynamicViews++;
+      }
+
+      glPopMatrix();
+      glMatrixMode(GL_PROJECTION);
+      glPopMatrix();
+      glMatrixMode(GL_MODELVIEW);
+      glPopAttrib();
+      glBindFramebuffer(GL_FRAMEBUFFER, saved);
+   }
+#endif
+   s->stats.time = timerSeconds() - t0;
+}
+
+void shadowBegin(const ShadowMaps *s)
+{
+#ifdef GL_VERSION_3_3
+   GLfloat splits[4] = { 1e30, 1e30, 1e30, 1e30 };
+
+   if (s->program == 0)
+      return;
+   glUseProgram(s->program);
+   glUniform1i(s->directionalLocation, s->type == SHADOW_DIRECTIONAL);
+   glUniform1i(s->cascadeCountLocation, s->cascades);
+   glUniformMatrix4fv(s->matricesLocation, s->cascades, GL_FALSE,
+                      &s->eyeMatrices[0][0]);
+   memcpy(splits, s->splits, s->cascades * sizeof(GLfloat));
+   glUniform4fv(s->splitsLocation, 1, splits);
+   glUniformMatrix3fv(s->eyeToWorldLocation, 1, GL_FALSE, s->eyeToWorld);
+   glUniform2f(s->depthRangeLocation, s->nearPlane, s->farPlane);
+   glUniform3fv(s->lightLocation, 1, s->lightEye);
+   if (s->type == SHADOW_POINT) {
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_CUBE_MAP, s->textures[1]);
+   } else {
+      glActiveTexture(GL_TEXTURE2);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, s->textures[1]);
+   }
+   glActiveTexture(GL_TEXTURE0);
+#endif
+}
+
+void shadowEnd(void)
+{
+#ifdef GL_VERSION_3_3
+   glActiveTexture(GL_TEXTURE1);
+   glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+   glActiveTexture(GL_TEXTURE2);
+   glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+   glActiveTexture(GL_TEXTURE0);
+   glUseProgram(0);
+#endif
+}
+
+void shadowPrintStats(const char *name, const ShadowMaps *s)
+{
+   const ShadowStats *st = &s->stats;
+
+   printf("%s: %d casters, %d %s\n", name, s->count, s->viewCount,
+          s->type == SHADOW_POINT ? "cube faces" : "cascades");
+   printf("  %d static maps drawn, %d completed with dynamic casters, "
+          "%d kept\n", st->staticViews, st->dynamicViews, st->skipped);
+   printf("  %d casters drawn, %d culled, in %.3f ms\n", st->drawn,
+          st->culled, st->time * 1000.0);
+}
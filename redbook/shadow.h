@@ -0,0 +1,130 @@
+/*
+ *  shadow.h
+ *  Shadow maps for light 0, kept up to date at the cost of what moved.
+ *
+ *  A point light renders the shadow casters into the six faces of a
+ *  depth cube map; a directional light into cascades, orthographic
+ *  maps of slices of the view volume that are each wider and coarser
+ *  than the one before, so that texels near the eye are small.  The
+ *  casters are registered with a bounding sphere and a function that
+ *  draws them in world coordinates; each view of the light draws only
+ *  those whose sphere it contains.
+ *
+ *  Every view keeps two maps: one of the static casters alone, and one
+ *  that adds the dynamic casters to a copy of it.  The static map is
+ *  drawn again only when the view changes (the light moved, or for a
+ *  cascade the eye did) or a static caster moved in or out of it; the
+ *  other only when that happened or a dynamic caster in the view, or
+ *  in it the last time, moved.  A frame in which nothing moved draws
+ *  nothing, and one in which a single caster moved draws it and copies
+ *  the static maps of the views it touches.  Cascades are fitted to
+ *  spheres and moved in whole texels so that they stay still while
+ *  the eye does.
+ *
+ *  Between shadowBegin() and shadowEnd() a shader lights the scene by
+ *  light 0 per pixel, as the fixed-function pipeline would with the
+ *  current material and a viewer at infinity, and darkens what the
+ *  shadow map hides from the light.
+ *
+ *  Requires OpenGL 3.3.
+ */
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#define SHADOW_POINT         0        /* a cube map */
+#define SHADOW_DIRECTIONAL   1        /* cascades */
+
+#define SHADOW_MAX_CASCADES  4
+#define SHADOW_MAX_VIEWS     6
+
+typedef void (*ShadowDrawFunc)(void *data);
+
+typedef struct shadowcaster {
+   ShadowDrawFunc  draw;
+   void           *data;
+   GLfloat         center[3], radius;
+   GLfloat         drawn[4];          /* sphere when last drawn */
+   int             dynamic;
+   int             moved;
+} ShadowCaster;
+
+typedef struct shadowview {
+   GLfloat  matrix[16];               /* world to clip coordinates */
+   GLfloat  planes[6][4];
+   GLuint   fbo[2];                   /* static, and with dynamic */
+   int      valid;                    /* the static map is current */
+} ShadowView;
+
+/*  For the last update.  */
+typedef struct shadowstats {
+   int      staticViews;              /* static maps drawn */
+   int      dynamicViews;             /* maps copied and completed */
+   int      skipped;                  /* views left as they were */
+   int      drawn, culled;            /* casters */
+   double   time;                     /* seconds, to issue the commands */
+} ShadowStats;
+
+typedef struct shadowmaps {
+   int            type, size, cascades;
+   GLuint         program;
+   GLuint         textures[2];        /* static, and with dynamic */
+   GLint          directionalLocation, cascadeCountLocation;
+   GLint          matricesLocation, splitsLocation;
+   GLint          eyeToWorldLocation, depthRangeLocation;
+   GLint          lightLocation;
+
+   GLfloat        light[3];           /* world position or direction */
+   GLfloat        nearPlane, farPlane;     /* of the cube map faces */
+   GLfloat        distance;           /* covered by the cascades */
+   GLfloat        bounds[4];          /* sphere around the casters */
+   int            viewCount;
+   ShadowView     views[SHADOW_MAX_VIEWS];
+   GLfloat        splits[SHADOW_MAX_CASCADES];
+   GLfloat        eyeMatrices[SHADOW_MAX_CASCADES][16];
+   GLfloat        eyeToWorld[9];
+   GLfloat        lightEye[3];        /* point light, in eye space */
+
+   ShadowCaster  *casters;
+   int            count, capacity;
+   ShadowStats    stats;
+} ShadowMaps;
+
+/*  size is the width of each map in texels; cascades is ignored for a
+ *  point light.
+ */
+void shadowInit(ShadowMaps *s, int type, int size, int cascades);
+void shadowFree(ShadowMaps *s);
+
+/*  False where the GL cannot run the shader.  */
+int shadowSupported(const ShadowMaps *s);
+
+/*  Casters, given in world coordinates.  The draw function is called
+ *  with the light's view as the modelview matrix, and must not change
+ *  the projection or the viewport.
+ */
+int shadowAddCaster(ShadowMaps *s, ShadowDrawFunc draw, void *data,
+                    const GLfloat center[3], GLfloat radius, int dynamic);
+void shadowMoveCaster(ShadowMaps *s, int caster, const GLfloat center[3]);
+void shadowClearCasters(ShadowMaps *s);
+
+/*  A point light at light[0..2], casting as far as farPlane, or for a
+ *  directional one light is the direction towards it and farPlane is
+ *  how far from the eye the cascades reach.
+ */
+void shadowSetLight(ShadowMaps *s, const GLfloat light[3], GLfloat farPlane);
+
+/*  Bring the maps up to date for an eye with the current modelview
+ *  matrix, mapping world to eye coordinates without scaling, and
+ *  projection.  Restores the framebuffer, viewport and matrices.
+ */
+void shadowUpdate(ShadowMaps *s);
+
+/*  Forget the maps, so that the next update draws them all.  */
+void shadowInvalidate(ShadowMaps *s);
+
+void shadowBegin(const ShadowMaps *s);
+void shadowEnd(void);
+
+void shadowPrintStats(const char *name, const ShadowMaps *s);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ *  shapes.c
+ *  Generated quadrics and Bezier patches.  See shapes.h.
+ */
+#include <GL/glut.h>
+#include <math.h>
+#include "shapes.h"
+
+#define PI_ 3.14159265358979323846
+
+/*  Triangles for a grid of (rows + 1) x (cols + 1) vertices stored
+ *  row by row from first.  They face along row x column, or the other
+ *  way when flip is set.
+ */
+static void grid(MeshBuilder *b, GLuint first, int rows, int cols, int flip)
+{
+   int r, c;
+
+   meshBegin(b, GL_TRIANGLES);
+   for (r = 0; r < rows; r++) {
+      for (c = 0; c < cols; c++) {
+         GLuint v00 = first + r * (cols + 1) + c;
+         GLuint v01 = v00 + 1;
+         GLuint v10 = v00 + cols + 1;
+         GLuint v11 = v10 + 1;
+
+         meshIndex(b, v00);
+         meshIndex(b, flip ? v01 : v10);
+         meshIndex(b, flip ? v10 : v01);
+         meshIndex(b, v01);
+         meshIndex(b, flip ? v11 : v10);
+         meshIndex(b, flip ? v10 : v11);
+      }
+   }
+   meshEnd(b);
+}
+
+void shapeSphere(MeshBuilder *b, GLdouble radius, int slices, int stacks)
+{
+   GLuint first = b->vertexCount;
+   GLfloat p[3], n[3];
+   int i, j;
+
+   for (i = 0; i <= stacks; i++) {
+      double rho = PI_ * i / stacks;
+
+      for (j = 0; j <= slices; j++) {
+         double theta = 2 * PI_ * j / slices;
+
+         n[0] = (GLfloat) (cos(theta) * sin(rho));
+         n[1] = (GLfloat) (sin(theta) * sin(rho));
+         n[2] = (GLfloat) cos(rho);
+         p[0] = (GLfloat) radius * n[0];
+         p[1] = (GLfloat) radius * n[1];
+         p[2] = (GLfloat) radius * n[2];
+         meshVertex(b, p, n, NULL);
+      }
+   }
+   grid(b, first, stacks, slices, 0);
+}
+
+void shapeCylinder(MeshBuilder *b, GLdouble base, GLdouble top,
+                   GLdouble height, int slices, int stacks)
+{
+   GLuint first = b->vertexCount;
+   double slope = (base - top) / height;
+   double scale = 1 / sqrt(1 + slope * slope);
+   GLfloat p[3], n[3];
+   int i, j;
+
+   for (i = 0; i <= stacks; i++) {
+      double z = height * i / stacks;
+      double r = base + (top - base) * i / stacks;
+
+      for (j = 0; j <= slices; j++) {
+         double theta = 2 * PI_ * j / slices;
+
+         p[0] = (GLfloat) (r * cos(theta));
+         p[1] = (GLfloat) (r * sin(theta));
+         p[2] = (GLfloat) z;
+         n[0] = (GLfloat) (cos(theta) * scale);
+         n[1] = (GLfloat) (sin(theta) * scale);
+         n[2] = (GLfloat) (slope * scale);
+         meshVertex(b, p, n, NULL);
+      }
+   }
+   grid(b, first, stacks, slices, 1);
+}
+
+void shapeDisk(MeshBuilder *b, GLdouble inner, GLdouble outer,
+               int slices, int loops)
+{
+   GLuint first = b->vertexCount;
+   static const GLfloat n[3] = { 0.0, 0.0, 1.0 };
+   GLfloat p[3];
+   int i, j;
+
+   p[2] = 0;
+   for (i = 0; i <= loops; i++) {
+      double r = inner + (outer - inner) * i / loops;
+
+      for (j = 0; j <= slices; j++) {
+         double theta = 2 * PI_ * j / slices;
+
+         p[0] = (GLfloat) (r * cos(theta));
+         p[1] = (GLfloat) (r * sin(theta));
+         meshVertex(b, p, n, NULL);
+      }
+   }
+   grid(b, first, loops, slices, 0);
+}
+
+void shapeTorus(MeshBuilder *b, GLdouble inner, GLdouble outer,
+                int sides, int rings)
+{
+   GLuint first = b->vertexCount;
+   GLfloat p[3], n[3];
+   int i, j;
+
+   for (i = 0; i <= rings; i++) {
+      double theta = 2 * PI_ * i / rings;
+
+      for (j = 0; j <= sides; j++) {
+         double phi = 2 * PI_ * j / sides;
+         double r = outer + inner * cos(phi);
+
+         n[0] = (GLfloat) (cos(theta) * cos(phi));
+         n[1] = (GLfloat) (sin(theta) * cos(phi));
+         n[2] = (GLfloat) sin(phi);
+         p[0] = (GLfloat) (r * cos(theta));
+         p[1] = (GLfloat) (r * sin(theta));
+         p[2] = (GLfloat) (inner * sin(phi));
+         meshVertex(b, p, n, NULL);
+      }
+   }
+   grid(b, first, rings, sides, 0);
+}
+
+/*  Cubic Bernstein weights and their derivatives at t.  */
+static void bernstein(double t, double w[4], double d[4])
+{
+   double s = 1 - t;
+
+   w[0] = s * s * s;
+   w[1] = 3 * t * s * s;
+   w[2] = 3 * t * t * s;
+   w[3] = t * t * t;
+   d[0] = -3 * s * s;
+   d[1] = 3 * s * s - 6 * t * s;
+   d[2] = 6 * t * s - 3 * t * t;
+   d[3] = 3 * t * t;
+}
+
+/*  Normals are dP/du x dP/dv, as GL_AUTO_NORMAL computes them.  */
+void shapeBezierPatch(MeshBuilder *b, const GLfloat ctrl[4][4][3],
+                      int un, int vn)
+{
+   GLuint first = b->vertexCount;
+   double wu[4], du[4], wv[4], dv[4];
+   GLfloat p[3], n[3];
+   int i, j, k, l, c;
+
+   for (i = 0; i <= vn; i++) {
+      bernstein((double) i / vn, wv, dv);
+      for (j = 0; j <= un; j++) {
+         double pu[3] = { 0, 0, 0 }, pv[3] = { 0, 0, 0 }, len;
+
+         bernstein((double) j / un, wu, du);
+         p[0] = p[1] = p[2] = 0;
+         for (k = 0; k < 4; k++) {
+            for (l = 0; l < 4; l++) {
+               for (c = 0; c < 3; c++) {
+                  p[c] += (GLfloat) (wv[k] * wu[l] * ctrl[k][l][c]);
+                  pu[c] += wv[k] * du[l] * ctrl[k][l][c];
+                  pv[c] += dv[k] * wu[l] * ctrl[k][l][c];
+               }
+            }
+         }
+         n[0] = (GLfloat) (pu[1] * pv[2] - pu[2] * pv[1]);
+         n[1] = (GLfloat) (pu[2] * pv[0] - pu[0] * pv[2]);
+         n[2] = (GLfloat) (pu[0] * pv[1] - pu[1] * pv[0]);
+         len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+         if (len > 0) {
+            n[0] /= (GLfloat) len;
+            n[1] /= (GLfloat) len;
+            n[2] /= (GLfloat) len;
+         }
+         meshVertex(b, p, n, NULL);
+      }
+   }
+   grid(b, first, vn, un, 1);
+}
@@ -0,0 +1,29 @@
+/*
+ *  shapes.h
+ *  Quadric, torus and Bezier patch geometry generated into a
+ *  MeshBuilder.  The parameters follow gluSphere(), gluCylinder(),
+ *  gluDisk(), glutSolidTorus() and glMap2f()/glEvalMesh2(), and like
+ *  them the shapes are emitted band by band, as one GL_TRIANGLES
+ *  range per shape, with smooth normals.  The builder must have
+ *  been created with MESH_NORMAL.
+ */
+#ifndef SHAPES_H
+#define SHAPES_H
+
+#include "mesh.h"
+
+void shapeSphere(MeshBuilder *b, GLdouble radius, int slices, int stacks);
+void shapeCylinder(MeshBuilder *b, GLdouble base, GLdouble top,
+                   GLdouble height, int slices, int stacks);
+void shapeDisk(MeshBuilder *b, GLdouble inner, GLdouble outer,
+               int slices, int loops);
+void shapeTorus(MeshBuilder *b, GLdouble inner, GLdouble outer,
+                int sides, int rings);
+
+/*  Bicubic Bezier patch over [0,1] x [0,1], ctrl[v][u], evaluated on
+ *  a un x vn grid.
+ */
+void shapeBezierPatch(MeshBuilder *b, const GLfloat ctrl[4][4][3],
+                      int un, int vn);
+
+#endif
@@ -0,0 +1,197 @@
+/*
+ *  stream.c
+ *  Streaming vertex ring buffer.  See stream.h.
+ *
+ *  A persistent mapping is also coherent, so what is written is seen
+ *  by GL without a flush; the fence of a part is placed at the end of
+ *  the frame that wrote it and waited on when the ring comes round to
+ *  it again.  Without one, the buffer holds a single part and each
+ *  frame asks GL for fresh storage before copying, so the driver
+ *  never waits for draws that still read the old data.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+#include "shader.h"
+#include "timer.h"
+
+#define STREAM_ALIGN  16
+#define ROUND(n, a)   (((n) + (a) - 1) / (a) * (a))
+
+#ifdef GL_VERSION_4_4
+#define MAP_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | \
+                   GL_MAP_COHERENT_BIT)
+#endif
+
+static void create(StreamBuffer *s)
+{
+   glGenBuffers(1, &s->vbo);
+   glBindBuffer(GL_ARRAY_BUFFER, s->vbo);
+#ifdef GL_VERSION_4_4
+   if (s->persistent) {
+      glBufferStorage(GL_ARRAY_BUFFER, s->part * STREAM_FRAMES, NULL,
+                      MAP_FLAGS);
+      s->memory = (char *) glMapBufferRange(GL_ARRAY_BUFFER, 0,
+                                            s->part * STREAM_FRAMES,
+                                            MAP_FLAGS);
+   }
+#endif
+   if (!s->persistent) {
+      glBufferData(GL_ARRAY_BUFFER, s->part, NULL, GL_STREAM_DRAW);
+      s->memory = (char *) malloc(s->part);
+   }
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   if (s->memory == NULL) {
+      printf("stream: out of memory\n");
+      exit(1);
+   }
+}
+
+/*  Wait for the GPU to finish with a part, counting it as a stall
+ *  if it has not already.
+ */
+static void waitFence(StreamBuffer *s, int i)
+{
+#ifdef GL_VERSION_4_4
+   GLsync fence = (GLsync) s->fences[i];
+   double t0;
+
+   if (fence == NULL)
+      return;
+   if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      t0 = timerSeconds();
+      while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                              1000000000) == GL_TIMEOUT_EXPIRED)
+         ;
+      s->stats.stalls++;
+      s->stats.stallTime += timerSeconds() - t0;
+   }
+   glDeleteSync(fence);
+   s->fences[i] = NULL;
+#endif
+}
+
+static void destroy(StreamBuffer *s)
+{
+   int i;
+
+   for (i = 0; i < STREAM_FRAMES; i++)
+      waitFence(s, i);
+   if (s->persistent) {
+      glBindBuffer(GL_ARRAY_BUFFER, s->vbo);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+   } else
+      free(s->memory);
+   glDeleteBuffers(1, &s->vbo);
+   s->memory = NULL;
+   s->vbo = 0;
+}
+
+void streamInit(StreamBuffer *s, size_t bytesPerFrame, int allowPersistent)
+{
+   memset(s, 0, sizeof(*s));
+   s->part = ROUND(bytesPerFrame > 0 ? bytesPerFrame : 1, 256);
+#ifdef GL_VERSION_4_4
+   s->persistent = allowPersistent && shaderGLVersion(4, 4);
+#endif
+   create(s);
+}
+
+void streamFree(StreamBuffer *s)
+{
+   destroy(s);
+}
+
+void streamBegin(StreamBuffer *s)
+{
+   memset(&s->stats, 0, sizeof(s->stats));
+
+   /*  a frame was refused memory; make room for all it wanted  */
+   if (s->wanted > s->part) {
+      destroy(s);
+      s->part = ROUND(s->wanted, 256);
+      create(s);
+      printf("stream: grown to %lu bytes a frame\n",
+             (unsigned long) s->part);
+   }
+
+   s->current = (s->current + 1) % STREAM_FRAMES;
+   if (s->persistent) {
+      waitFence(s, s->current);
+      s->base = s->current * s->part;
+   } else
+      s->base = 0;
+   s->head = 0;
+   s->asked = 0;
+}
+
+void *streamAlloc(StreamBuffer *s, size_t bytes, size_t *offset)
+{
+   char *p;
+
+   bytes = ROUND(bytes, STREAM_ALIGN);
+   s->asked += bytes;
+   if (s->head + bytes > s->part) {
+      s->stats.refused++;
+      return NULL;
+   }
+   p = s->memory + s->base + s->head;
+   *offset = s->base + s->head;
+   s->head += bytes;
+   s->stats.allocs++;
+   s->stats.bytes += bytes;
+   return p;
+}
+
+void streamUpload(StreamBuffer *s)
+{
+   double t0;
+
+   if (s->persistent || s->head == 0)
+      return;
+   t0 = timerSeconds();
+   glBindBuffer(GL_ARRAY_BUFFER, s->vbo);
+   glBufferData(GL_ARRAY_BUFFER, s->part, NULL, GL_STREAM_DRAW);
+   glBufferSubData(GL_ARRAY_BUFFER, 0, s->head, s->memory);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   s->stats.uploadTime += timerSeconds() - t0;
+}
+
+void streamEnd(StreamBuffer *s)
+{
+   double now = timerSeconds();
+
+#ifdef GL_VERSION_4_4
+   if (s->persistent)
+      s->fences[s->current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+   if (s->asked > s->wanted)
+      s->wanted = s->asked;
+   s->stats.frameTime = s->frames > 0 ? now - s->lastEnd : 0.0;
+   s->lastEnd = now;
+   s->last = s->stats;
+   s->frames++;
+}
+
+double streamBandwidth(const StreamBuffer *s)
+{
+   return s->last.frameTime > 0.0 ? s->last.bytes / s->last.frameTime : 0.0;
+}
+
+void streamPrintStats(const char *name, const StreamBuffer *s)
+{
+   const StreamStats *st = &s->last;
+
+   printf("%s: %s, %lu bytes a frame in %d parts\n", name,
+          s->persistent ? "persistent mapping" : "orphan and copy",
+          (unsigned long) s->part, s->persistent ? STREAM_FRAMES : 1);
+   printf("  frame %lu: %lu bytes in %d allocations, %d refused, "
+          "%.1f MB/s\n", s->frames, st->bytes, st->allocs, st->refused,
+          streamBandwidth(s) / (1024.0 * 1024.0));
+   printf("  %d stalls for %.3f ms, %.3f ms copying\n", st->stalls,
+          st->stallTime * 1000.0, st->uploadTime * 1000.0);
+}
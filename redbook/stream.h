@@ -0,0 +1,77 @@
+/*
+ *  stream.h
+ *  A ring buffer for vertex data that changes every frame, written
+ *  straight into buffer object memory rather than kept in client
+ *  arrays that GL copies on every draw.
+ *
+ *  The ring is split into STREAM_FRAMES parts, one for each frame in
+ *  flight.  Where GL 4.4 is available the buffer is mapped once, for
+ *  good, and a fence after each frame's draws tells when the GPU is
+ *  done with its part, so writing three frames later only has to wait
+ *  when the GPU is that far behind.  Elsewhere the data is written to
+ *  memory of our own and streamUpload() orphans the buffer and copies
+ *  it in with glBufferSubData().
+ *
+ *  A frame is:
+ *
+ *     streamBegin(s);
+ *     p = streamAlloc(s, bytes, &offset);    as many as needed
+ *     ... fill p, on any thread ...
+ *     streamUpload(s);                       once the writes are done
+ *     ... draw with arrays at offset in s->vbo ...
+ *     streamEnd(s);
+ *
+ *  Only streamAlloc() has to be on the GL thread; what it returns may
+ *  be handed to jobs (jobs.h) to fill.  A frame that asks for more
+ *  than its part holds gets NULL, and the ring grows to fit the frame
+ *  after.
+ */
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+
+#define STREAM_FRAMES  3
+
+typedef struct streamstats {
+   unsigned long  bytes;              /* written in the frame */
+   int            allocs;
+   int            refused;            /* allocations that did not fit */
+   int            stalls;             /* waits for the GPU */
+   double         stallTime;          /* seconds */
+   double         uploadTime;         /* in glBufferSubData() */
+   double         frameTime;          /* since the end of the last */
+} StreamStats;
+
+typedef struct streambuffer {
+   GLuint        vbo;
+   int           persistent;          /* else orphaned and copied */
+   size_t        part;                /* bytes for each frame */
+   char         *memory;              /* mapping, or our own copy */
+   void         *fences[STREAM_FRAMES];
+   int           current;
+   size_t        base, head;          /* of the current frame */
+   size_t        asked;               /* by this frame */
+   size_t        wanted;              /* most a frame asked for */
+   double        lastEnd;
+   unsigned long frames;
+   StreamStats   stats, last;         /* this frame and the last */
+} StreamBuffer;
+
+/*  allowPersistent 0 uses the orphaning path even where mapping is
+ *  possible, to compare the two.
+ */
+void streamInit(StreamBuffer *s, size_t bytesPerFrame, int allowPersistent);
+void streamFree(StreamBuffer *s);
+
+void streamBegin(StreamBuffer *s);
+void *streamAlloc(StreamBuffer *s, size_t bytes, size_t *offset);
+void streamUpload(StreamBuffer *s);
+void streamEnd(StreamBuffer *s);
+
+/*  Bytes per second written in the last frame, at its frame rate.  */
+double streamBandwidth(const StreamBuffer *s);
+
+void streamPrintStats(const char *name, const StreamBuffer *s);
+
+#endif
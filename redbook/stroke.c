@@ -38,23 +38,25 @@
 /*
  *  stroke.c 
  *  This program demonstrates some characters of a 
- *  stroke (vector) font.  The characters are represented
- *  by display lists, which are given numbers which 
- *  correspond to the ASCII values of the characters.
- *  Use of glCallLists() is demonstrated.
+ *  stroke (vector) font.  The characters are compiled once
+ *  into a stroke font, and each frame the strings are laid
+ *  out into one batch of line segments and drawn with a
+ *  single call.  Press "t" to switch between thin lines and
+ *  thick antialiased ones, and "b" to time many labels drawn
+ *  as a batch against one draw per character.
  */
+#define GL_GLEXT_PROTOTYPES
 #include <GL/glut.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "strokefont.h"
+#include "timer.h"
 
-#define PT 1
-#define STROKE 2
-#define END 3
+#ifdef GL_VERSION_1_5
 
-typedef struct charpoint {
-   GLfloat   x, y;
-   int    type;
-} CP;
+#define BENCH_LABELS 2000
+#define THICK_WIDTH 3.0
 
 CP Adata[] = {
    { 0, 0, PT}, {0, 9, PT}, {1, 10, PT}, {4, 10, PT}, 
@@ -82,75 +84,81 @@ CP Sdata[] = {
    {4, 10, PT}, {5, 9, END}
 };
 
-/*  drawLetter() interprets the instructions from the array
- *  for that letter and renders the letter with line segments.
- */
-static void drawLetter(CP *l)
-{
-   glBegin(GL_LINE_STRIP);
-   while (1) {
-      switch (l->type) {
-         case PT:
-            glVertex2fv(&l->x);
-            break;
-         case STROKE:
-            glVertex2fv(&l->x);
-            glEnd();
-            glBegin(GL_LINE_STRIP);
-            break;
-         case END:
-            glVertex2fv(&l->x);
-            glEnd();
-            glTranslatef(8.0, 0.0, 0.0);
-            return;
-      }
-      l++;
-   }
-}
+StrokeFont font;
+StrokeBatch batch;
 
-/*  Create a display list for each of 6 characters	*/
+/*  Create a font with 5 characters	*/
 static void init (void)
 {
-   GLuint base;
-
    glShadeModel (GL_FLAT);
 
-   base = glGenLists (128);
-   glListBase(base);
-   glNewList(base+'A', GL_COMPILE); drawLetter(Adata); glEndList();
-   glNewList(base+'E', GL_COMPILE); drawLetter(Edata); glEndList();
-   glNewList(base+'P', GL_COMPILE); drawLetter(Pdata); glEndList();
-   glNewList(base+'R', GL_COMPILE); drawLetter(Rdata); glEndList();
-   glNewList(base+'S', GL_COMPILE); drawLetter(Sdata); glEndList();
-   glNewList(base+' ', GL_COMPILE); glTranslatef(8.0, 0.0, 0.0); glEndList();
+   strokeFontInit(&font, 8.0);
+   strokeFontGlyph(&font, 'A', Adata);
+   strokeFontGlyph(&font, 'E', Edata);
+   strokeFontGlyph(&font, 'P', Pdata);
+   strokeFontGlyph(&font, 'R', Rdata);
+   strokeFontGlyph(&font, 'S', Sdata);
+   strokeFontBuild(&font);
+   strokeBatchInit(&batch, 0.0);
 }
 
 char *test1 = "A SPARE SERAPE APPEARS AS";
 char *test2 = "APES PREPARE RARE PEPPERS";
 
+/*  Draw each character's range and advance; characters
+ *  without a range, like the space, only advance.  This
+ *  is one draw per character, kept for comparison.
+ */
 static void printStrokedString(char *s)
 {
-   GLsizei len = strlen(s);
-   glCallLists(len, GL_BYTE, (GLbyte *)s);
+   for (; *s; s++) {
+      strokeFontDrawGlyph(&font, *s & 0x7f);
+      glTranslatef(8.0, 0.0, 0.0);
+   }
 }
 
 void display(void)
 {
+   static const GLubyte white[4] = { 255, 255, 255, 255 };
+
    glClear(GL_COLOR_BUFFER_BIT);
-   glColor3f(1.0, 1.0, 1.0);
-   glPushMatrix();
-   glScalef(2.0, 2.0, 2.0);
-   glTranslatef(10.0, 30.0, 0.0);
-   printStrokedString(test1);
-   glPopMatrix();
-   glPushMatrix();
-   glScalef(2.0, 2.0, 2.0);
-   glTranslatef(10.0, 13.0, 0.0);
-   printStrokedString(test2);
-   glPopMatrix();
+   strokeBatchString(&batch, &font, 20.0, 60.0, 2.0, test1, white);
+   strokeBatchString(&batch, &font, 20.0, 26.0, 2.0, test2, white);
+   strokeBatchDraw(&batch);
    glFlush();
 }
 
+static void benchmark(void)
+{
+   static const GLubyte white[4] = { 255, 255, 255, 255 };
+   double start, perGlyph, batched;
+   int i;
+
+   glColor3f(1.0, 1.0, 1.0);
+   glFinish();
+   start = timerSeconds();
+   for (i = 0; i < BENCH_LABELS; i++) {
+      glPushMatrix();
+      glTranslatef(20.0, 20.0 + i % 60, 0.0);
+      printStrokedString(i & 1 ? test1 : test2);
+      glPopMatrix();
+   }
+   glFinish();
+   perGlyph = timerSeconds() - start;
+
+   start = timerSeconds();
+   for (i = 0; i < BENCH_LABELS; i++)
+      strokeBatchString(&batch, &font, 20.0, 20.0 + i % 60, 1.0,
+                        i & 1 ? test1 : test2, white);
+   strokeBatchDraw(&batch);
+   glFinish();
+   batched = timerSeconds() - start;
+
+   printf("%d labels: per character %.2f ms, batched %.2f ms\n",
+          BENCH_LABELS, perGlyph * 1000.0, batched * 1000.0);
+   glutPostRedisplay();
+}
+
 void reshape(int w, int h)
 {
    glViewport(0, 0, (GLsizei) w, (GLsizei) h);
@@ -165,6 +173,15 @@ void keyboard(unsigned char key, int x, int y)
       case ' ':
          glutPostRedisplay();
          break;
+      case 't':
+      case 'T':
+         batch.width = batch.width > 0 ? 0.0 : THICK_WIDTH;
+         glutPostRedisplay();
+         break;
+      case 'b':
+      case 'B':
+         benchmark();
+         break;
       case 27:
          exit(0);
    }
@@ -187,3 +204,12 @@ int main(int argc, char** argv)
    glutMainLoop();
    return 0;
 }
+#else
+int main(int argc, char** argv)
+{
+    fprintf (stderr, "This program demonstrates a feature which is not in OpenGL before Version 1.5.\n");
+    fprintf (stderr, "If your implementation has the ARB_vertex_buffer_object extension,\n");
+    fprintf (stderr, "you may be able to modify this program to make it run.\n");
+    return 0;
+}
+#endif
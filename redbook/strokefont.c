@@ -0,0 +1,323 @@
+/*
+ *  strokefont.c
+ *  Compiled stroke fonts and batched stroke text.  See strokefont.h.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "strokefont.h"
+
+#define LAYOUT_CACHE_SIZE 256   /* power of two */
+#define RAMP_SIZE 16            /* texels across a thick line */
+#define RAMP_FADE 4             /* of which fade out at each edge */
+
+/*  A laid out string: its segments in glyph units from the origin.
+ *  The cache is direct mapped, as in text.c.
+ */
+typedef struct layout {
+   const StrokeFont *font;
+   char             *string;
+   GLfloat          *segments;
+   GLuint            count;
+} Layout;
+
+static Layout cache[LAYOUT_CACHE_SIZE];
+static GLuint rampTexture;
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("strokefont: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+void strokeFontInit(StrokeFont *f, GLfloat advance)
+{
+   int c;
+
+   memset(f, 0, sizeof(*f));
+   f->advance = advance;
+   for (c = 0; c < STROKE_GLYPHS; c++)
+      f->glyphs[c].range = -1;
+   meshBuilderInit(&f->builder, 0);
+}
+
+static void addSegment(StrokeFont *f, const CP *a, const CP *b)
+{
+   GLfloat *s;
+
+   if (f->segmentCount == f->maxSegments) {
+      f->maxSegments = f->maxSegments ? f->maxSegments * 2 : 64;
+      f->segments = (GLfloat *) allocate(f->segments,
+                                         f->maxSegments * 4 * sizeof(GLfloat));
+   }
+   s = f->segments + f->segmentCount++ * 4;
+   s[0] = a->x; s[1] = a->y;
+   s[2] = b->x; s[3] = b->y;
+}
+
+/*  Interpret the program into segments, and into a GL_LINES range
+ *  of the font mesh.
+ */
+void strokeFontGlyph(StrokeFont *f, int c, const CP *l)
+{
+   StrokeGlyph *g;
+   MeshBuilder *b = &f->builder;
+   const CP *prev = NULL;
+   GLuint prevIndex = 0;
+   GLfloat v[3];
+
+   if (c < 0 || c >= STROKE_GLYPHS)
+      return;
+   g = &f->glyphs[c];
+   g->first = f->segmentCount;
+   v[2] = 0.0;
+   meshBegin(b, GL_LINES);
+   while (1) {
+      GLuint i;
+
+      v[0] = l->x; v[1] = l->y;
+      i = meshVertex(b, v, NULL, NULL);
+      if (prev) {
+         meshIndex(b, prevIndex);
+         meshIndex(b, i);
+         addSegment(f, prev, l);
+      }
+      prev = l;
+      prevIndex = i;
+      if (l->type == STROKE)
+         prev = NULL;
+      else if (l->type == END)
+         break;
+      l++;
+   }
+   meshEnd(b);
+   g->count = f->segmentCount - g->first;
+   g->range = b->rangeCount - 1;
+}
+
+void strokeFontBuild(StrokeFont *f)
+{
+   meshCompile(&f->mesh, &f->builder);
+   meshBuilderFree(&f->builder);
+}
+
+void strokeFontDelete(StrokeFont *f)
+{
+   int i;
+
+   for (i = 0; i < LAYOUT_CACHE_SIZE; i++) {
+      if (cache[i].font == f) {
+         free(cache[i].string);
+         free(cache[i].segments);
+         memset(&cache[i], 0, sizeof(Layout));
+      }
+   }
+   meshRelease(&f->mesh);
+   meshBuilderFree(&f->builder);
+   free(f->segments);
+   memset(f, 0, sizeof(*f));
+}
+
+void strokeFontDrawGlyph(const StrokeFont *f, int c)
+{
+   if (c >= 0 && c < STROKE_GLYPHS && f->glyphs[c].range >= 0)
+      meshDrawRange(&f->mesh, f->glyphs[c].range);
+}
+
+static unsigned hashString(const StrokeFont *f, const char *s)
+{
+   unsigned h = 2166136261U;
+
+   for (; *s; s++) {
+      h ^= (unsigned char) *s;
+      h *= 16777619U;
+   }
+   return (h ^ (unsigned) ((size_t) f >> 4)) & (LAYOUT_CACHE_SIZE - 1);
+}
+
+static void layoutString(Layout *l, const StrokeFont *f, const char *s)
+{
+   GLfloat pen = 0, *d;
+   GLuint n = 0, k;
+   const char *p;
+
+   for (p = s; *p; p++)
+      if ((unsigned char) *p < STROKE_GLYPHS)
+         n += f->glyphs[(unsigned char) *p].count;
+   l->font = f;
+   l->string = (char *) allocate(l->string, strlen(s) + 1);
+   strcpy(l->string, s);
+   l->segments = (GLfloat *) allocate(l->segments, n * 4 * sizeof(GLfloat));
+   l->count = n;
+
+   d = l->segments;
+   for (p = s; *p; p++, pen += f->advance) {
+      const StrokeGlyph *g;
+      const GLfloat *src;
+
+      if ((unsigned char) *p >= STROKE_GLYPHS)
+         continue;
+      g = &f->glyphs[(unsigned char) *p];
+      src = f->segments + g->first * 4;
+      for (k = 0; k < g->count; k++, src += 4, d += 4) {
+         d[0] = src[0] + pen; d[1] = src[1];
+         d[2] = src[2] + pen; d[3] = src[3];
+      }
+   }
+}
+
+void strokeBatchInit(StrokeBatch *b, GLfloat width)
+{
+   memset(b, 0, sizeof(*b));
+   b->width = width;
+}
+
+void strokeBatchFree(StrokeBatch *b)
+{
+   free(b->verts);
+   memset(b, 0, sizeof(*b));
+}
+
+static StrokeVertex *reserve(StrokeBatch *b, GLuint n)
+{
+   StrokeVertex *v;
+
+   if (b->count + n > b->max) {
+      GLuint max = b->max ? b->max : 1024;
+
+      while (max < b->count + n)
+         max *= 2;
+      b->verts = (StrokeVertex *) allocate(b->verts,
+                                           max * sizeof(StrokeVertex));
+      b->max = max;
+   }
+   v = b->verts + b->count;
+   b->count += n;
+   return v;
+}
+
+static void setVertex(StrokeVertex *v, GLfloat x, GLfloat y, GLfloat s,
+                      const GLubyte color[4])
+{
+   v->x = x;
+   v->y = y;
+   v->s = s;
+   memcpy(v->color, color, 4);
+}
+
+/*  A thick segment is a quad reaching half the width to each side,
+ *  and half the width past each end so that joints are covered.
+ */
+void strokeBatchString(StrokeBatch *b, const StrokeFont *f,
+                       GLfloat x, GLfloat y, GLfloat scale,
+                       const char *s, const GLubyte color[4])
+{
+   Layout *l = &cache[hashString(f, s)];
+   const GLfloat *seg;
+   StrokeVertex *v;
+   GLfloat h = b->width * 0.5f;
+   GLuint k;
+
+   if (l->font != f || l->string == NULL || strcmp(l->string, s) != 0)
+      layoutString(l, f, s);
+
+   seg = l->segments;
+   if (b->width <= 0) {
+      v = reserve(b, l->count * 2);
+      for (k = 0; k < l->count; k++, seg += 4, v += 2) {
+         setVertex(&v[0], x + seg[0] * scale, y + seg[1] * scale, 0, color);
+         setVertex(&v[1], x + seg[2] * scale, y + seg[3] * scale, 0, color);
+      }
+      return;
+   }
+
+   v = reserve(b, l->count * 4);
+   for (k = 0; k < l->count; k++, seg += 4, v += 4) {
+      GLfloat x0 = x + seg[0] * scale, y0 = y + seg[1] * scale;
+      GLfloat x1 = x + seg[2] * scale, y1 = y + seg[3] * scale;
+      GLfloat dx = x1 - x0, dy = y1 - y0;
+      GLfloat len = (GLfloat) sqrt(dx * dx + dy * dy);
+
+      if (len > 0) {
+         dx *= h / len;
+         dy *= h / len;
+      }
+      else {
+         dx = h;
+         dy = 0;
+      }
+      setVertex(&v[0], x0 - dx - dy, y0 - dy + dx, 0, color);
+      setVertex(&v[1], x0 - dx + dy, y0 - dy - dx, 1, color);
+      setVertex(&v[2], x1 + dx + dy, y1 + dy - dx, 1, color);
+      setVertex(&v[3], x1 + dx - dy, y1 + dy + dx, 0, color);
+   }
+}
+
+/*  Alpha across a thick line: opaque in the middle, fading to zero
+ *  over the outer texels on each side.
+ */
+static void makeRamp(void)
+{
+   GLubyte ramp[RAMP_SIZE];
+   int i;
+
+   for (i = 0; i < RAMP_SIZE; i++) {
+      int edge = i < RAMP_SIZE - 1 - i ? i : RAMP_SIZE - 1 - i;
+
+      ramp[i] = (GLubyte) (edge >= RAMP_FADE ? 255 : 255 * edge / RAMP_FADE);
+   }
+   glGenTextures(1, &rampTexture);
+   glBindTexture(GL_TEXTURE_1D, rampTexture);
+   glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+   glTexImage1D(GL_TEXTURE_1D, 0, GL_ALPHA, RAMP_SIZE, 0,
+                GL_ALPHA, GL_UNSIGNED_BYTE, ramp);
+   glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+void strokeBatchDraw(StrokeBatch *b)
+{
+   if (b->count == 0)
+      return;
+
+   glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_TEXTURE_BIT |
+                GL_COLOR_BUFFER_BIT);
+   glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT | GL_CLIENT_PIXEL_STORE_BIT);
+   glDisable(GL_LIGHTING);
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_COLOR_ARRAY);
+   glDisableClientState(GL_NORMAL_ARRAY);
+   glVertexPointer(2, GL_FLOAT, sizeof(StrokeVertex), &b->verts[0].x);
+   glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(StrokeVertex),
+                  b->verts[0].color);
+
+   if (b->width <= 0) {
+      glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+      glDrawArrays(GL_LINES, 0, b->count);
+   }
+   else {
+      if (rampTexture == 0)
+         makeRamp();
+      glEnable(GL_TEXTURE_1D);
+      glBindTexture(GL_TEXTURE_1D, rampTexture);
+      glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+      glEnable(GL_BLEND);
+      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+      glTexCoordPointer(1, GL_FLOAT, sizeof(StrokeVertex), &b->verts[0].s);
+      glDrawArrays(GL_QUADS, 0, b->count);
+   }
+
+   glPopClientAttrib();
+   glPopAttrib();
+   b->count = 0;
+}
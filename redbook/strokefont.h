@@ -0,0 +1,84 @@
+/*
+ *  strokefont.h
+ *  Vector stroke fonts.  A glyph is a small program of points: PT
+ *  continues the current stroke to the point, STROKE ends the stroke
+ *  at the point and END ends the glyph there.  The programs are
+ *  compiled once into a line list, kept both on the CPU and in a
+ *  mesh with one GL_LINES range per glyph.
+ *
+ *  Strings are laid out into a StrokeBatch, which draws everything
+ *  appended to it with a single call: as GL_LINES when its width is
+ *  0, or, for thicker text, with each segment expanded into a quad
+ *  whose edges are faded by a small alpha texture.  The width is in
+ *  the units of the coordinates the strings are placed in, so labels
+ *  placed in the world keep their thickness relative to the world.
+ *  Laid out strings are cached, so a label drawn every frame is only
+ *  laid out once.
+ *
+ *  Requires OpenGL 1.5 (see mesh.h).
+ */
+#ifndef STROKEFONT_H
+#define STROKEFONT_H
+
+#include "mesh.h"
+
+#define PT 1
+#define STROKE 2
+#define END 3
+
+typedef struct charpoint {
+   GLfloat   x, y;
+   int    type;
+} CP;
+
+#define STROKE_GLYPHS 128
+
+typedef struct strokeglyph {
+   GLuint first;            /* first segment */
+   GLuint count;            /* number of segments */
+   int    range;            /* draw range in the mesh, -1 if none */
+} StrokeGlyph;
+
+typedef struct strokefont {
+   StrokeGlyph glyphs[STROKE_GLYPHS];
+   GLfloat    *segments;    /* x0, y0, x1, y1 for each segment */
+   GLuint      segmentCount, maxSegments;
+   GLfloat     advance;     /* pen movement per character */
+   MeshBuilder builder;     /* until strokeFontBuild() */
+   Mesh        mesh;
+} StrokeFont;
+
+typedef struct strokevertex {
+   GLfloat x, y;
+   GLfloat s;               /* across a thick line, 0 to 1 */
+   GLubyte color[4];
+} StrokeVertex;
+
+typedef struct strokebatch {
+   GLfloat       width;     /* 0 draws one pixel wide lines */
+   StrokeVertex *verts;
+   GLuint        count, max;
+} StrokeBatch;
+
+void strokeFontInit(StrokeFont *f, GLfloat advance);
+void strokeFontGlyph(StrokeFont *f, int c, const CP *program);
+void strokeFontBuild(StrokeFont *f);
+void strokeFontDelete(StrokeFont *f);
+
+/*  Draw one glyph's range of the mesh at the origin.  */
+void strokeFontDrawGlyph(const StrokeFont *f, int c);
+
+void strokeBatchInit(StrokeBatch *b, GLfloat width);
+void strokeBatchFree(StrokeBatch *b);
+
+/*  Append s with its origin at (x, y), with glyph coordinates
+ *  multiplied by scale.
+ */
+void strokeBatchString(StrokeBatch *b, const StrokeFont *f,
+                       GLfloat x, GLfloat y, GLfloat scale,
+                       const char *s, const GLubyte color[4]);
+
+/*  Draw everything appended and empty the batch.  */
+void strokeBatchDraw(StrokeBatch *b);
+
+#endif
@@ -0,0 +1,383 @@
+/*
+ *  swrender.c
+ *  This program renders the scenes of smooth.c, light.c, wrap.c (in
+ *  both wrap modes), fog.c, stencil.c and alpha.c with the software
+ *  rasterizer in raster.c, without a window or a GPU.  For each scene it prints
+ *  the time per frame and a checksum of the image, which is the same
+ *  for any number of threads, so the output can be kept as a
+ *  baseline and compared from run to run.
+ *
+ *  Usage: swrender [-t threads] [-n frames] [-w]
+ *  -w writes each image to <scene>.ppm.
+ */
+#include <GL/glut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raster.h"
+#include "mesh.h"
+#include "shapes.h"
+#include "jobs.h"
+#include "timer.h"
+
+typedef struct scene {
+   const char *name;
+   int         width, height;
+   void      (*draw)(RasterContext *c, int width, int height);
+} Scene;
+
+static MeshBuilder lightSphere, fogSphere, stencilSphere, torus;
+
+static void drawBuilder(RasterContext *c, const MeshBuilder *b)
+{
+   GLsizei stride = b->floatsPerVertex * sizeof(GLfloat);
+
+   rasterVertexPointer(c, 3, stride, b->verts);
+   rasterNormalPointer(c, stride, b->verts + 3);
+   rasterDrawElements(c, GL_TRIANGLES, b->indexCount, b->indices);
+}
+
+static void smooth(RasterContext *c, int w, int h)
+{
+   rasterClearColor(c, 0.0, 0.0, 0.0, 0.0);
+   rasterShadeModel(c, GL_SMOOTH);
+   rasterViewport(c, 0, 0, w, h);
+   rasterMatrixMode(c, GL_PROJECTION);
+   rasterLoadIdentity(c);
+   rasterOrtho(c, 0.0, 30.0, 0.0, 30.0 * h / w, -1.0, 1.0);
+   rasterMatrixMode(c, GL_MODELVIEW);
+
+   rasterClear(c, GL_COLOR_BUFFER_BIT);
+   rasterBegin(c, GL_TRIANGLES);
+   rasterColor3f(c, 1.0, 0.0, 0.0);
+   rasterVertex2f(c, 5.0, 5.0);
+   rasterColor3f(c, 0.0, 1.0, 0.0);
+   rasterVertex2f(c, 25.0, 5.0);
+   rasterColor3f(c, 0.0, 0.0, 1.0);
+   rasterVertex2f(c, 5.0, 25.0);
+   rasterEnd(c);
+}
+
+static void light(RasterContext *c, int w, int h)
+{
+   GLfloat mat_specular[] = { 1.0, 1.0, 1.0, 1.0 };
+   GLfloat mat_diffuse[] = { 0.8, 0.8, 0.8, 1.0 };
+   GLfloat red[] = { 1.0, 0.0, 0.0, 1.0 };
+   GLfloat green[] = { 0.0, 1.0, 0.0, 1.0 };
+   GLfloat blue[] = { 0.0, 0.0, 1.0, 1.0 };
+   GLfloat red_position[] = { 0.0, 2.0, 0.0, 1.0 };
+   GLfloat green_position[] = { 2.0, 0.0, 0.0, 1.0 };
+   GLfloat blue_position[] = { -2.0, 0.0, 0.0, 1.0 };
+
+   rasterClearColor(c, 0.0, 0.0, 0.0, 0.0);
+   rasterShadeModel(c, GL_SMOOTH);
+   rasterMaterialfv(c, GL_FRONT, GL_SPECULAR, mat_specular);
+   rasterMaterialfv(c, GL_FRONT, GL_DIFFUSE, mat_diffuse);
+   rasterMaterialf(c, GL_FRONT, GL_SHININESS, 100.0);
+   rasterLightfv(c, GL_LIGHT0, GL_DIFFUSE, red);
+   rasterLightfv(c, GL_LIGHT0, GL_SPECULAR, red);
+   rasterLightfv(c, GL_LIGHT1, GL_DIFFUSE, green);
+   rasterLightfv(c, GL_LIGHT1, GL_SPECULAR, green);
+   rasterLightfv(c, GL_LIGHT2, GL_DIFFUSE, blue);
+   rasterLightfv(c, GL_LIGHT2, GL_SPECULAR, blue);
+   rasterEnable(c, GL_LIGHTING);
+   rasterEnable(c, GL_LIGHT0);
+   rasterEnable(c, GL_LIGHT1);
+   rasterEnable(c, GL_LIGHT2);
+   rasterEnable(c, GL_DEPTH_TEST);
+   rasterViewport(c, 0, 0, w, h);
+   rasterMatrixMode(c, GL_PROJECTION);
+   rasterLoadIdentity(c);
+   rasterPerspective(c, 40.0, (GLfloat) w / h, 1.0, 20.0);
+   rasterMatrixMode(c, GL_MODELVIEW);
+   rasterLoadIdentity(c);
+
+   rasterClear(c, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+   rasterPushMatrix(c);
+   rasterLookAt(c, 0.0, 0.0, 5.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0);
+   rasterLightfv(c, GL_LIGHT0, GL_POSITION, red_position);
+   rasterLightfv(c, GL_LIGHT1, GL_POSITION, green_position);
+   rasterLightfv(c, GL_LIGHT2, GL_POSITION, blue_position);
+   drawBuilder(c, &lightSphere);
+   rasterPopMatrix(c);
+}
+
+#define checkImageWidth 64
+#define checkImageHeight 64
+
+static void texturedQuads(RasterContext *c, int w, int h, GLenum wrapMode)
+{
+   static GLubyte checkImage[checkImageHeight][checkImageWidth][4];
+   int i, j, k;
+
+   for (i = 0; i < checkImageHeight; i++) {
+      for (j = 0; j < checkImageWidth; j++) {
+         k = ((((i&0x8)==0)^((j&0x8)==0)))*255;
+         checkImage[i][j][0] = (GLubyte) k;
+         checkImage[i][j][1] = (GLubyte) k;
+         checkImage[i][j][2] = (GLubyte) k;
+         checkImage[i][j][3] = (GLubyte) 255;
+      }
+   }
+   rasterClearColor(c, 0.0, 0.0, 0.0, 0.0);
+   rasterShadeModel(c, GL_FLAT);
+   rasterEnable(c, GL_DEPTH_TEST);
+   rasterTexParameteri(c, GL_TEXTURE_WRAP_S, wrapMode);
+   rasterTexParameteri(c, GL_TEXTURE_WRAP_T, wrapMode);
+   rasterTexParameteri(c, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+   rasterTexImage2D(c, checkImageWidth, checkImageHeight, &checkImage[0][0][0]);
+   rasterViewport(c, 0, 0, w, h);
+   rasterMatrixMode(c, GL_PROJECTION);
+   rasterLoadIdentity(c);
+   rasterPerspective(c, 60.0, (GLfloat) w / h, 1.0, 30.0);
+   rasterMatrixMode(c, GL_MODELVIEW);
+   rasterLoadIdentity(c);
+   rasterTranslatef(c, 0.0, 0.0, -3.6);
+
+   rasterClear(c, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+   rasterEnable(c, GL_TEXTURE_2D);
+   rasterTexEnvi(c, GL_DECAL);
+   rasterBegin(c, GL_QUADS);
+   rasterTexCoord2f(c, 0.0, 0.0); rasterVertex3f(c, -2.0, -1.0, 0.0);
+   rasterTexCoord2f(c, 0.0, 3.0); rasterVertex3f(c, -2.0, 1.0, 0.0);
+   rasterTexCoord2f(c, 3.0, 3.0); rasterVertex3f(c, 0.0, 1.0, 0.0);
+   rasterTexCoord2f(c, 3.0, 0.0); rasterVertex3f(c, 0.0, -1.0, 0.0);
+   rasterTexCoord2f(c, 0.0, 0.0); rasterVertex3f(c, 1.0, -1.0, 0.0);
+   rasterTexCoord2f(c, 0.0, 3.0); rasterVertex3f(c, 1.0, 1.0, 0.0);
+   rasterTexCoord2f(c, 3.0, 3.0); rasterVertex3f(c, 2.41421, 1.0, -1.41421);
+   rasterTexCoord2f(c, 3.0, 0.0); rasterVertex3f(c, 2.41421, -1.0, -1.41421);
+   rasterEnd(c);
+   rasterDisable(c, GL_TEXTURE_2D);
+}
+
+static void wrap(RasterContext *c, int w, int h)
+{
+   texturedQuads(c, w, h, GL_REPEAT);
+}
+
+/*  wrap.c after the 's' and 't' keys  */
+static void clamp(RasterContext *c, int w, int h)
+{
+   texturedQuads(c, w, h, GL_CLAMP);
+}
+
+static void fog(RasterContext *c, int w, int h)
+{
+   GLfloat position[] = { 0.5, 0.5, 3.0, 0.0 };
+   GLfloat mat[3] = { 0.1745, 0.01175, 0.01175 };
+   GLfloat fogColor[4] = { 0.5, 0.5, 0.5, 1.0 };
+   int i;
+
+   rasterEnable(c, GL_DEPTH_TEST);
+   rasterLightfv(c, GL_LIGHT0, GL_POSITION, position);
+   rasterEnable(c, GL_LIGHTING);
+   rasterEnable(c, GL_LIGHT0);
+   rasterMaterialfv(c, GL_FRONT, GL_AMBIENT, mat);
+   mat[0] = 0.61424; mat[1] = 0.04136; mat[2] = 0.04136;
+   rasterMaterialfv(c, GL_FRONT, GL_DIFFUSE, mat);
+   mat[0] = 0.727811; mat[1] = 0.626959; mat[2] = 0.626959;
+   rasterMaterialfv(c, GL_FRONT, GL_SPECULAR, mat);
+   rasterMaterialf(c, GL_FRONT, GL_SHININESS, 0.6*128.0);
+   rasterEnable(c, GL_FOG);
+   rasterFogi(c, GL_FOG_MODE, GL_EXP);
+   rasterFogfv(c, GL_FOG_COLOR, fogColor);
+   rasterFogf(c, GL_FOG_DENSITY, 0.35);
+   rasterFogf(c, GL_FOG_START, 1.0);
+   rasterFogf(c, GL_FOG_END, 5.0);
+   rasterClearColor(c, 0.5, 0.5, 0.5, 1.0);
+   rasterViewport(c, 0, 0, w, h);
+   rasterMatrixMode(c, GL_PROJECTION);
+   rasterLoadIdentity(c);
+   rasterOrtho(c, -2.5, 2.5, -2.5 * h / w, 2.5 * h / w, -10.0, 10.0);
+   rasterMatrixMode(c, GL_MODELVIEW);
+   rasterLoadIdentity(c);
+
+   rasterClear(c, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+   for (i = 0; i < 5; i++) {
+      rasterPushMatrix(c);
+      rasterTranslatef(c, i - 2.0, -0.5, -1.0 - i);
+      drawBuilder(c, &fogSphere);
+      rasterPopMatrix(c);
+   }
+}
+
+static void stencil(RasterContext *c, int w, int h)
+{
+   GLfloat yellow_diffuse[] = { 0.7, 0.7, 0.0, 1.0 };
+   GLfloat yellow_specular[] = { 1.0, 1.0, 1.0, 1.0 };
+   GLfloat blue_diffuse[] = { 0.1, 0.1, 0.7, 1.0 };
+   GLfloat blue_specular[] = { 0.1, 1.0, 1.0, 1.0 };
+   GLfloat position_one[] = { 1.0, 1.0, 1.0, 0.0 };
+
+   rasterLightfv(c, GL_LIGHT0, GL_POSITION, position_one);
+   rasterEnable(c, GL_LIGHT0);
+   rasterEnable(c, GL_LIGHTING);
+   rasterEnable(c, GL_DEPTH_TEST);
+   rasterClearStencil(c, 0x0);
+   rasterEnable(c, GL_STENCIL_TEST);
+
+/*  the diamond shaped stencil area, as reshape() draws it  */
+   rasterViewport(c, 0, 0, w, h);
+   rasterMatrixMode(c, GL_PROJECTION);
+   rasterLoadIdentity(c);
+   rasterOrtho(c, -3.0, 3.0, -3.0 * h / w, 3.0 * h / w, -1.0, 1.0);
+   rasterMatrixMode(c, GL_MODELVIEW);
+   rasterLoadIdentity(c);
+   rasterClear(c, GL_STENCIL_BUFFER_BIT);
+   rasterStencilFunc(c, GL_ALWAYS, 0x1, 0x1);
+   rasterStencilOp(c, GL_REPLACE, GL_REPLACE, GL_REPLACE);
+   rasterBegin(c, GL_QUADS);
+   rasterVertex2f(c, -1.0, 0.0);
+   rasterVertex2f(c, 0.0, 1.0);
+   rasterVertex2f(c, 1.0, 0.0);
+   rasterVertex2f(c, 0.0, -1.0);
+   rasterEnd(c);
+   rasterMatrixMode(c, GL_PROJECTION);
+   rasterLoadIdentity(c);
+   rasterPerspective(c, 45.0, (GLfloat) w / h, 3.0, 7.0);
+   rasterMatrixMode(c, GL_MODELVIEW);
+   rasterLoadIdentity(c);
+   rasterTranslatef(c, 0.0, 0.0, -5.0);
+
+   rasterClear(c, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+   rasterStencilFunc(c, GL_EQUAL, 0x1, 0x1);
+   rasterStencilOp(c, GL_KEEP, GL_KEEP, GL_KEEP);
+   rasterMaterialfv(c, GL_FRONT, GL_DIFFUSE, blue_diffuse);
+   rasterMaterialfv(c, GL_FRONT, GL_SPECULAR, blue_specular);
+   rasterMaterialf(c, GL_FRONT, GL_SHININESS, 45.0);
+   drawBuilder(c, &stencilSphere);
+
+   rasterStencilFunc(c, GL_NOTEQUAL, 0x1, 0x1);
+   rasterPushMatrix(c);
+   rasterRotatef(c, 45.0, 0.0, 0.0, 1.0);
+   rasterRotatef(c, 45.0, 0.0, 1.0, 0.0);
+   rasterMaterialfv(c, GL_FRONT, GL_DIFFUSE, yellow_diffuse);
+   rasterMaterialfv(c, GL_FRONT, GL_SPECULAR, yellow_specular);
+   rasterMaterialf(c, GL_FRONT, GL_SHININESS, 64.0);
+   drawBuilder(c, &torus);
+   rasterPushMatrix(c);
+   rasterRotatef(c, 90.0, 1.0, 0.0, 0.0);
+   drawBuilder(c, &torus);
+   rasterPopMatrix(c);
+   rasterPopMatrix(c);
+}
+
+static void alpha(RasterContext *c, int w, int h)
+{
+   rasterEnable(c, GL_BLEND);
+   rasterBlendFunc(c, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+   rasterShadeModel(c, GL_FLAT);
+   rasterClearColor(c, 0.0, 0.0, 0.0, 0.0);
+   rasterViewport(c, 0, 0, w, h);
+   rasterMatrixMode(c, GL_PROJECTION);
+   rasterLoadIdentity(c);
+   rasterOrtho(c, 0.0, 1.0, 0.0, 1.0 * h / w, -1.0, 1.0);
+   rasterMatrixMode(c, GL_MODELVIEW);
+
+   rasterClear(c, GL_COLOR_BUFFER_BIT);
+   rasterBegin(c, GL_TRIANGLES);
+   rasterColor4f(c, 1.0, 1.0, 0.0, 0.75);
+   rasterVertex3f(c, 0.1, 0.9, 0.0);
+   rasterVertex3f(c, 0.1, 0.1, 0.0);
+   rasterVertex3f(c, 0.7, 0.5, 0.0);
+   rasterColor4f(c, 0.0, 1.0, 1.0, 0.75);
+   rasterVertex3f(c, 0.9, 0.9, 0.0);
+   rasterVertex3f(c, 0.3, 0.5, 0.0);
+   rasterVertex3f(c, 0.9, 0.1, 0.0);
+   rasterEnd(c);
+}
+
+static const Scene scenes[] = {
+   { "smooth", 500, 500, smooth },
+   { "light", 500, 500, light },
+   { "wrap", 250, 250, wrap },
+   { "clamp", 250, 250, clamp },
+   { "fog", 500, 500, fog },
+   { "stencil", 400, 400, stencil },
+   { "alpha", 200, 200, alpha },
+};
+
+#define NUM_SCENES ((int) (sizeof(scenes) / sizeof(scenes[0])))
+
+static unsigned checksum(const GLubyte *p, size_t n)
+{
+   unsigned h = 2166136261U;
+
+   while (n--) {
+      h ^= *p++;
+      h *= 16777619U;
+   }
+   return h;
+}
+
+static void writePPM(const char *name, const GLubyte *p, int w, int h)
+{
+   char path[64];
+   FILE *f;
+   int x, y;
+
+   sprintf(path, "%s.ppm", name);
+   f = fopen(path, "wb");
+   if (f == NULL) {
+      printf("swrender: cannot write %s\n", path);
+      return;
+   }
+   fprintf(f, "P6\n%d %d\n255\n", w, h);
+   for (y = h - 1; y >= 0; y--)
+      for (x = 0; x < w; x++)
+         fwrite(p + ((size_t) y * w + x) * 4, 1, 3, f);
+   fclose(f);
+}
+
+int main(int argc, char** argv)
+{
+   int threads = 0, frames = 20, write = 0, i, f;
+
+   for (i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+         threads = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+         frames = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-w") == 0)
+         write = 1;
+      else {
+         printf("usage: %s [-t threads] [-n frames] [-w]\n", argv[0]);
+         return 1;
+      }
+   }
+   if (frames < 1)
+      frames = 1;
+   jobsInit(threads);
+
+   meshBuilderInit(&lightSphere, MESH_NORMAL);
+   shapeSphere(&lightSphere, 1.0, 40, 32);
+   meshBuilderInit(&fogSphere, MESH_NORMAL);
+   shapeSphere(&fogSphere, 0.4, 16, 16);
+   meshBuilderInit(&stencilSphere, MESH_NORMAL);
+   shapeSphere(&stencilSphere, 0.5, 15, 15);
+   meshBuilderInit(&torus, MESH_NORMAL);
+   shapeTorus(&torus, 0.275, 0.85, 15, 15);
+
+   printf("%d threads, %d frames\n", jobsThreadCount() + 1, frames);
+   for (i = 0; i < NUM_SCENES; i++) {
+      const Scene *s = &scenes[i];
+      RasterContext *c = rasterCreate(s->width, s->height);
+      const GLubyte *pixels;
+      double start;
+
+      start = timerSeconds();
+      for (f = 0; f < frames; f++) {
+         s->draw(c, s->width, s->height);
+         rasterFinish(c);
+      }
+      pixels = rasterPixels(c);
+      printf("%-8s %4d x %-4d %8.3f ms  %08x\n", s->name, s->width,
+             s->height, (timerSeconds() - start) * 1000.0 / frames,
+             checksum(pixels, (size_t) s->width * s->height * 4));
+      if (write)
+         writePPM(s->name, pixels, s->width, s->height);
+      rasterDestroy(c);
+   }
+   jobsShutdown();
+   return 0;
+}
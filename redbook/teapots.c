@@ -39,11 +39,178 @@
  *  teapots.c
  *  This program demonstrates lots of material properties.
  *  A single light source illuminates the objects.
+ *  The teapots are recorded into command buffers by the worker
+ *  threads, a column each, and replayed in material order.
+ *  Press 's' for the command buffer statistics of the last frame,
+ *  'b' to run the material benchmark and 'c' to time recording
+ *  commands on one thread and on all of them.
  */
 #include <stdlib.h>
+#include <stdio.h>
 #include <GL/glut.h>
+#include <math.h>
+#include "cmdbuf.h"
+#include "drawqueue.h"
+#include "jobs.h"
+#include "matcache.h"
+#include "timer.h"
 
 GLuint teapotList;
+static DrawQueue queue;
+static CmdQueue commands;
+
+/*
+ *  Position and material of each teapot.
+ *  First column:  emerald, jade, obsidian, pearl, ruby, turquoise
+ *  2nd column:  brass, bronze, chrome, copper, gold, silver
+ *  3rd column:  black, cyan, green, red, white, yellow plastic
+ *  4th column:  black, cyan, green, red, white, yellow rubber
+ */
+typedef struct teapot {
+   GLfloat x, y;
+   GLfloat amb[3], dif[3], spec[3], shine;
+   MatHandle mat;
+} Teapot;
+
+static Teapot teapots[] = {
+   { 2.0, 17.0,
+     { 0.0215, 0.1745, 0.0215 }, { 0.07568, 0.61424, 0.07568 },
+     { 0.633, 0.727811, 0.633 }, 0.6 },
+   { 2.0, 14.0,
+     { 0.135, 0.2225, 0.1575 }, { 0.54, 0.89, 0.63 },
+     { 0.316228, 0.316228, 0.316228 }, 0.1 },
+   { 2.0, 11.0,
+     { 0.05375, 0.05, 0.06625 }, { 0.18275, 0.17, 0.22525 },
+     { 0.332741, 0.328634, 0.346435 }, 0.3 },
+   { 2.0, 8.0,
+     { 0.25, 0.20725, 0.20725 }, { 1, 0.829, 0.829 },
+     { 0.296648, 0.296648, 0.296648 }, 0.088 },
+   { 2.0, 5.0,
+     { 0.1745, 0.01175, 0.01175 }, { 0.61424, 0.04136, 0.04136 },
+     { 0.727811, 0.626959, 0.626959 }, 0.6 },
+   { 2.0, 2.0,
+     { 0.1, 0.18725, 0.1745 }, { 0.396, 0.74151, 0.69102 },
+     { 0.297254, 0.30829, 0.306678 }, 0.1 },
+   { 6.0, 17.0,
+     { 0.329412, 0.223529, 0.027451 }, { 0.780392, 0.568627, 0.113725 },
+     { 0.992157, 0.941176, 0.807843 }, 0.21794872 },
+   { 6.0, 14.0,
+     { 0.2125, 0.1275, 0.054 }, { 0.714, 0.4284, 0.18144 },
+     { 0.393548, 0.271906, 0.166721 }, 0.2 },
+   { 6.0, 11.0,
+     { 0.25, 0.25, 0.25 }, { 0.4, 0.4, 0.4 },
+     { 0.774597, 0.774597, 0.774597 }, 0.6 },
+   { 6.0, 8.0,
+     { 0.19125, 0.0735, 0.0225 }, { 0.7038, 0.27048, 0.0828 },
+     { 0.256777, 0.137622, 0.086014 }, 0.1 },
+   { 6.0, 5.0,
+     { 0.24725, 0.1995, 0.0745 }, { 0.75164, 0.60648, 0.22648 },
+     { 0.628281, 0.555802, 0.366065 }, 0.4 },
+   { 6.0, 2.0,
+     { 0.19225, 0.19225, 0.19225 }, { 0.50754, 0.50754, 0.50754 },
+     { 0.508273, 0.508273, 0.508273 }, 0.4 },
+   { 10.0, 17.0,
+     { 0.0, 0.0, 0.0 }, { 0.01, 0.01, 0.01 },
+     { 0.50, 0.50, 0.50 }, .25 },
+   { 10.0, 14.0,
+     { 0.0, 0.1, 0.06 }, { 0.0, 0.50980392, 0.50980392 },
+     { 0.50196078, 0.50196078, 0.50196078 }, .25 },
+   { 10.0, 11.0,
+     { 0.0, 0.0, 0.0 }, { 0.1, 0.35, 0.1 },
+     { 0.45, 0.55, 0.45 }, .25 },
+   { 10.0, 8.0,
+     { 0.0, 0.0, 0.0 }, { 0.5, 0.0, 0.0 },
+     { 0.7, 0.6, 0.6 }, .25 },
+   { 10.0, 5.0,
+     { 0.0, 0.0, 0.0 }, { 0.55, 0.55, 0.55 },
+     { 0.70, 0.70, 0.70 }, .25 },
+   { 10.0, 2.0,
+     { 0.0, 0.0, 0.0 }, { 0.5, 0.5, 0.0 },
+     { 0.60, 0.60, 0.50 }, .25 },
+   { 14.0, 17.0,
+     { 0.02, 0.02, 0.02 }, { 0.01, 0.01, 0.01 },
+     { 0.4, 0.4, 0.4 }, .078125 },
+   { 14.0, 14.0,
+     { 0.0, 0.05, 0.05 }, { 0.4, 0.5, 0.5 },
+     { 0.04, 0.7, 0.7 }, .078125 },
+   { 14.0, 11.0,
+     { 0.0, 0.05, 0.0 }, { 0.4, 0.5, 0.4 },
+     { 0.04, 0.7, 0.04 }, .078125 },
+   { 14.0, 8.0,
+     { 0.05, 0.0, 0.0 }, { 0.5, 0.4, 0.4 },
+     { 0.7, 0.04, 0.04 }, .078125 },
+   { 14.0, 5.0,
+     { 0.05, 0.05, 0.05 }, { 0.5, 0.5, 0.5 },
+     { 0.7, 0.7, 0.7 }, .078125 },
+   { 14.0, 2.0,
+     { 0.05, 0.05, 0.0 }, { 0.5, 0.5, 0.4 },
+     { 0.7, 0.7, 0.04 }, .078125 },
+};
+
+#define NTEAPOTS (sizeof(teapots) / sizeof(teapots[0]))
+
+/*
+ * Set the material of a teapot with one glMaterial() call per
+ * parameter, whatever is already bound.  Only used as the baseline
+ * of the material benchmark.
+ */
+static void setMaterialDirect(const Teapot *t)
+{
+   GLfloat mat[4];
+
+   mat[0] = t->amb[0]; mat[1] = t->amb[1]; mat[2] = t->amb[2]; mat[3] = 1.0;
+   glMaterialfv(GL_FRONT, GL_AMBIENT, mat);
+   mat[0] = t->dif[0]; mat[1] = t->dif[1]; mat[2] = t->dif[2];
+   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat);
+   mat[0] = t->spec[0]; mat[1] = t->spec[1]; mat[2] = t->spec[2];
+   glMaterialfv(GL_FRONT, GL_SPECULAR, mat);
+   glMaterialf(GL_FRONT, GL_SHININESS, t->shine * 128.0);
+}
+
+/*
+ * Called by the draw queue and the command buffers only when the
+ * material differs from the one that is already bound; the id is a
+ * material cache handle.
+ */
+static void bindMaterial(unsigned id, void *user)
+{
+   matBind(id);
+}
+
+#define COLUMNS 4
+
+static void translation(GLfloat m[16], GLfloat x, GLfloat y, GLfloat z)
+{
+   int i;
+
+   for (i = 0; i < 16; i++)
+      m[i] = (i % 5 == 0) ? 1.0 : 0.0;
+   m[12] = x;
+   m[13] = y;
+   m[14] = z;
+}
+
+/*
+ * Record the teapots of one column: bind its material, move it into
+ * position and draw it.  The depth in the key keeps teapots of the
+ * same material in the order of the table.
+ */
+static void recordColumn(int column, void *user)
+{
+   CmdBuffer *b = cmdThreadBuffer(&commands);
+   unsigned i, n = NTEAPOTS / COLUMNS;
+   GLfloat m[16];
+
+   for (i = column * n; i < (column + 1) * n; i++) {
+      cmdBegin(b, drawQueueKey(0, teapots[i].mat, 0,
+                               (float) i / NTEAPOTS));
+      cmdMaterial(b, teapots[i].mat);
+      translation(m, teapots[i].x, teapots[i].y, 0.0);
+      cmdMatrix(b, m);
+      cmdCallList(b, teapotList);
+      cmdEnd(b);
+   }
+}
 
 /*
  * Initialize depth buffer, projection matrix, light source, and lighting
@@ -51,6 +218,7 @@ GLuint teapotList;
  */
 void init(void)
 {
+   unsigned i;
    GLfloat ambient[] = {0.0, 0.0, 0.0, 1.0};
    GLfloat diffuse[] = {1.0, 1.0, 1.0, 1.0};
    GLfloat specular[] = {1.0, 1.0, 1.0, 1.0};
@@ -76,90 +244,28 @@ void init(void)
    glNewList (teapotList, GL_COMPILE);
    glutSolidTeapot(1.0);
    glEndList ();
-}
 
-/*
- * Move object into position.  Use 3rd through 12th 
- * parameters to specify the material property.  Draw a teapot.
- */
-void renderTeapot(GLfloat x, GLfloat y,
-   GLfloat ambr, GLfloat ambg, GLfloat ambb,
-   GLfloat difr, GLfloat difg, GLfloat difb,
-   GLfloat specr, GLfloat specg, GLfloat specb, GLfloat shine)
-{
-   GLfloat mat[4];
+/*  intern the 24 materials; shininess is given as a fraction of 128  */
+   for (i = 0; i < NTEAPOTS; i++)
+      teapots[i].mat = matInternColors(teapots[i].amb, teapots[i].dif,
+                                       teapots[i].spec,
+                                       teapots[i].shine * 128.0);
 
-   glPushMatrix();
-   glTranslatef(x, y, 0.0);
-   mat[0] = ambr; mat[1] = ambg; mat[2] = ambb; mat[3] = 1.0;
-   glMaterialfv(GL_FRONT, GL_AMBIENT, mat);
-   mat[0] = difr; mat[1] = difg; mat[2] = difb;
-   glMaterialfv(GL_FRONT, GL_DIFFUSE, mat);
-   mat[0] = specr; mat[1] = specg; mat[2] = specb;
-   glMaterialfv(GL_FRONT, GL_SPECULAR, mat);
-   glMaterialf(GL_FRONT, GL_SHININESS, shine * 128.0);
-   glCallList(teapotList);
-   glPopMatrix();
+   drawQueueInit(&queue, 64);
+   queue.bindMaterial = bindMaterial;
+   cmdQueueInit(&commands);
+   commands.bindMaterial = bindMaterial;
 }
 
-/**
- *  First column:  emerald, jade, obsidian, pearl, ruby, turquoise
- *  2nd column:  brass, bronze, chrome, copper, gold, silver
- *  3rd column:  black, cyan, green, red, white, yellow plastic
- *  4th column:  black, cyan, green, red, white, yellow rubber
+/*
+ *  Record one draw item per teapot, keyed by material, and let the
+ *  queue sort them and issue only the material changes it needs.
  */
 void display(void)
 {
    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-   renderTeapot(2.0, 17.0, 0.0215, 0.1745, 0.0215,
-      0.07568, 0.61424, 0.07568, 0.633, 0.727811, 0.633, 0.6);
-   renderTeapot(2.0, 14.0, 0.135, 0.2225, 0.1575,
-      0.54, 0.89, 0.63, 0.316228, 0.316228, 0.316228, 0.1);
-   renderTeapot(2.0, 11.0, 0.05375, 0.05, 0.06625,
-      0.18275, 0.17, 0.22525, 0.332741, 0.328634, 0.346435, 0.3);
-   renderTeapot(2.0, 8.0, 0.25, 0.20725, 0.20725,
-      1, 0.829, 0.829, 0.296648, 0.296648, 0.296648, 0.088);
-   renderTeapot(2.0, 5.0, 0.1745, 0.01175, 0.01175,
-      0.61424, 0.04136, 0.04136, 0.727811, 0.626959, 0.626959, 0.6);
-   renderTeapot(2.0, 2.0, 0.1, 0.18725, 0.1745,
-      0.396, 0.74151, 0.69102, 0.297254, 0.30829, 0.306678, 0.1);
-   renderTeapot(6.0, 17.0, 0.329412, 0.223529, 0.027451,
-      0.780392, 0.568627, 0.113725, 0.992157, 0.941176, 0.807843,
-      0.21794872);
-   renderTeapot(6.0, 14.0, 0.2125, 0.1275, 0.054,
-      0.714, 0.4284, 0.18144, 0.393548, 0.271906, 0.166721, 0.2);
-   renderTeapot(6.0, 11.0, 0.25, 0.25, 0.25,
-      0.4, 0.4, 0.4, 0.774597, 0.774597, 0.774597, 0.6);
-   renderTeapot(6.0, 8.0, 0.19125, 0.0735, 0.0225,
-      0.7038, 0.27048, 0.0828, 0.256777, 0.137622, 0.086014, 0.1);
-   renderTeapot(6.0, 5.0, 0.24725, 0.1995, 0.0745,
-      0.75164, 0.60648, 0.22648, 0.628281, 0.555802, 0.366065, 0.4);
-   renderTeapot(6.0, 2.0, 0.19225, 0.19225, 0.19225,
-      0.50754, 0.50754, 0.50754, 0.508273, 0.508273, 0.508273, 0.4);
-   renderTeapot(10.0, 17.0, 0.0, 0.0, 0.0, 0.01, 0.01, 0.01,
-      0.50, 0.50, 0.50, .25);
-   renderTeapot(10.0, 14.0, 0.0, 0.1, 0.06, 0.0, 0.50980392, 0.50980392,
-      0.50196078, 0.50196078, 0.50196078, .25);
-   renderTeapot(10.0, 11.0, 0.0, 0.0, 0.0,
-      0.1, 0.35, 0.1, 0.45, 0.55, 0.45, .25);
-   renderTeapot(10.0, 8.0, 0.0, 0.0, 0.0, 0.5, 0.0, 0.0,
-      0.7, 0.6, 0.6, .25);
-   renderTeapot(10.0, 5.0, 0.0, 0.0, 0.0, 0.55, 0.55, 0.55,
-      0.70, 0.70, 0.70, .25);
-   renderTeapot(10.0, 2.0, 0.0, 0.0, 0.0, 0.5, 0.5, 0.0,
-      0.60, 0.60, 0.50, .25);
-   renderTeapot(14.0, 17.0, 0.02, 0.02, 0.02, 0.01, 0.01, 0.01,
-      0.4, 0.4, 0.4, .078125);
-   renderTeapot(14.0, 14.0, 0.0, 0.05, 0.05, 0.4, 0.5, 0.5,
-      0.04, 0.7, 0.7, .078125);
-   renderTeapot(14.0, 11.0, 0.0, 0.05, 0.0, 0.4, 0.5, 0.4,
-      0.04, 0.7, 0.04, .078125);
-   renderTeapot(14.0, 8.0, 0.05, 0.0, 0.0, 0.5, 0.4, 0.4,
-      0.7, 0.04, 0.04, .078125);
-   renderTeapot(14.0, 5.0, 0.05, 0.05, 0.05, 0.5, 0.5, 0.5,
-      0.7, 0.7, 0.7, .078125);
-   renderTeapot(14.0, 2.0, 0.05, 0.05, 0.0, 0.5, 0.5, 0.4,
-      0.7, 0.7, 0.04, .078125);
+   jobsParallelFor(COLUMNS, recordColumn, NULL);
+   cmdSubmit(&commands);
    glFlush();
 }
 
@@ -177,9 +283,161 @@ void reshape(int w, int h)
    glMatrixMode(GL_MODELVIEW);
 }
 
+/*
+ *  Material benchmark: BENCH_INSTANCES points, each using one of the
+ *  24 teapot materials in a fixed pseudo-random order, drawn three
+ *  ways -- one glMaterial() call per parameter per instance, a
+ *  material cache bind per instance, and material cache binds through
+ *  the sorted draw queue.
+ */
+#define BENCH_INSTANCES 10000
+
+static void drawPoint(void *data)
+{
+   glBegin(GL_POINTS);
+   glVertex2f(0.0, 0.0);
+   glEnd();
+}
+
+static void benchmark(void)
+{
+   static unsigned order[BENCH_INSTANCES];
+   unsigned i, seed = 1;
+   double t0, direct, cached, sorted;
+   MatCacheStats cs;
+
+   for (i = 0; i < BENCH_INSTANCES; i++) {
+      seed = seed * 1103515245 + 12345;
+      order[i] = (seed >> 16) % NTEAPOTS;
+   }
+
+   glFinish();
+   t0 = timerSeconds();
+   for (i = 0; i < BENCH_INSTANCES; i++) {
+      setMaterialDirect(&teapots[order[i]]);
+      drawPoint(NULL);
+   }
+   glFinish();
+   direct = timerSeconds() - t0;
+
+   matInvalidate();
+   matResetStats();
+   t0 = timerSeconds();
+   for (i = 0; i < BENCH_INSTANCES; i++) {
+      matBind(teapots[order[i]].mat);
+      drawPoint(NULL);
+   }
+   glFinish();
+   cached = timerSeconds() - t0;
+   cs = *matStats();
+
+   matInvalidate();
+   matResetStats();
+   t0 = timerSeconds();
+   for (i = 0; i < BENCH_INSTANCES; i++)
+      drawQueueSubmit(&queue, drawQueueKey(0, teapots[order[i]].mat, 0, 0.0),
+                      drawPoint, NULL);
+   drawQueueFlush(&queue);
+   glFinish();
+   sorted = timerSeconds() - t0;
+
+   printf("%d instances, %d materials\n", BENCH_INSTANCES, (int) NTEAPOTS);
+   printf("  glMaterial per draw    %8.3f ms, %d calls\n",
+          direct * 1000.0, BENCH_INSTANCES * 4);
+   printf("  material cache         %8.3f ms, %u calls, %u skipped\n",
+          cached * 1000.0, cs.paramsIssued, cs.paramsSkipped);
+   printf("  cache + sorted queue   %8.3f ms, %u calls, %u skipped\n",
+          sorted * 1000.0, matStats()->paramsIssued,
+          matStats()->paramsSkipped);
+   glutPostRedisplay();
+}
+
+/*
+ * Command buffer benchmark: every packet works out a matrix as a
+ * real program would before recording, so recording is what the
+ * threads share out.  Packets are recorded in batches, first all on
+ * this thread and then as jobs on every thread, and each time the
+ * GL thread sorts and replays them.
+ */
+#define BENCH_PACKETS  100000
+#define BENCH_BATCH    1000
+
+static void recordBatch(int batch, void *user)
+{
+   CmdBuffer *b = cmdThreadBuffer(&commands);
+   const unsigned *order = (const unsigned *) user;
+   int i;
+   GLfloat m[16];
+
+   for (i = batch * BENCH_BATCH; i < (batch + 1) * BENCH_BATCH; i++) {
+      const Teapot *t = &teapots[order[i]];
+      float a = i * 0.001f, c = cos(a), s = sin(a);
+
+      translation(m, t->x, t->y, 0.0);
+      m[0] = c;  m[1] = s;
+      m[4] = -s; m[5] = c;
+      cmdBegin(b, drawQueueKey(0, t->mat, 0, 0.0));
+      cmdMaterial(b, t->mat);
+      cmdMatrix(b, m);
+      cmdCall(b, drawPoint, NULL);
+      cmdEnd(b);
+   }
+}
+
+static void commandBenchmark(void)
+{
+   static unsigned order[BENCH_PACKETS];
+   int i, batches = BENCH_PACKETS / BENCH_BATCH;
+   unsigned seed = 1;
+   double t0, serial, parallel, replay[2];
+
+   for (i = 0; i < BENCH_PACKETS; i++) {
+      seed = seed * 1103515245 + 12345;
+      order[i] = (seed >> 16) % NTEAPOTS;
+   }
+
+   glFinish();
+   t0 = timerSeconds();
+   for (i = 0; i < batches; i++)
+      recordBatch(i, order);
+   serial = timerSeconds() - t0;
+   t0 = timerSeconds();
+   cmdSubmit(&commands);
+   glFinish();
+   replay[0] = timerSeconds() - t0;
+
+   t0 = timerSeconds();
+   jobsParallelFor(batches, recordBatch, order);
+   parallel = timerSeconds() - t0;
+   t0 = timerSeconds();
+   cmdSubmit(&commands);
+   glFinish();
+   replay[1] = timerSeconds() - t0;
+
+   printf("%d packets in batches of %d\n", BENCH_PACKETS, BENCH_BATCH);
+   printf("  record on 1 thread     %8.3f ms, submit %8.3f ms\n",
+          serial * 1000.0, replay[0] * 1000.0);
+   printf("  record on %2d threads   %8.3f ms, submit %8.3f ms\n",
+          jobsThreadCount() + 1, parallel * 1000.0, replay[1] * 1000.0);
+   cmdPrintStats(&commands);
+   glutPostRedisplay();
+}
+
 void keyboard(unsigned char key, int x, int y)
 {
    switch (key) {
+      case 's':
+      case 'S':
+         cmdPrintStats(&commands);
+         break;
+      case 'b':
+      case 'B':
+         benchmark();
+         break;
+      case 'c':
+      case 'C':
+         commandBenchmark();
+         break;
       case 27:
          exit(0);
          break;
@@ -0,0 +1,740 @@
+/*
+ *  terrain.c
+ *  Streaming chunked terrain.  See terrain.h.
+ *
+ *  A chunk is one vertex buffer: the (TERRAIN_GRID + 1)^2 grid, then
+ *  a copy of its four edges lowered by TERRAIN_SKIRT.  Every chunk has
+ *  the same topology, so the triangles of all levels live in a single
+ *  index buffer, one range per level.  Cells are split along the
+ *  diagonal from (i, j) to (i + 1, j + 1) at every level, so each
+ *  vertex a level drops lies on an edge of the next level's triangles,
+ *  halfway between two vertices that level keeps.  Its texture
+ *  coordinate holds the height it must move by to reach that edge and
+ *  the level that drops it; the shader moves only the vertices of the
+ *  level being drawn.
+ *
+ *  Vertices are made as floats and packed into the layout that
+ *  vertexLayoutChoose() picks for a sample chunk.  Positions are kept
+ *  relative to the middle of the chunk and the texture coordinates
+ *  scaled into [-1, 1], so that with OpenGL 3.3 a vertex is 16 bytes
+ *  of half floats and a 10-bit normal instead of 32 bytes of floats.
+ *  The shader reads the normal as a generic attribute, as not every
+ *  driver takes 2_10_10_10 normals in glNormalPointer(); without the
+ *  shader the vertices stay floats.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "terrain.h"
+#include "shader.h"
+#include "timer.h"
+#include "vformat.h"
+
+#define BUFFER_OFFSET(n) ((char *) NULL + (n))
+#ifndef GL_INT_2_10_10_10_REV
+#define GL_INT_2_10_10_10_REV 0x8D9F
+#endif
+#define PI_       3.14159265358979323846
+#define SIDE      (TERRAIN_GRID + 1)
+#define VERTICES  (SIDE * SIDE + 4 * SIDE)
+#define FLOATS    8                     /* per vertex, before packing */
+#define HALF      (TERRAIN_CHUNK_SIZE / 2)
+#define MORPH_RANGE  1200.0f    /* meters, over twice the highest peak */
+
+enum { CHUNK_FREE, CHUNK_GENERATING, CHUNK_LOADED };
+
+typedef struct tcandidate {
+   GLfloat distance;
+   int     x, z;
+} Candidate;
+
+/*  lattice spacing and height of each scale, in meters  */
+static const struct octave {
+   GLfloat spacing, amplitude;
+} octaves[] = {
+   { 2048.0, 420.0 },
+   {  512.0, 110.0 },
+   {  128.0,  24.0 },
+   {   32.0,   3.0 }
+};
+#define OCTAVES ((int) (sizeof(octaves) / sizeof(octaves[0])))
+
+#ifdef GL_VERSION_2_0
+/*  Light 0, directional, with GL_COLOR_MATERIAL and linear fog, as
+ *  the fixed-function path draws.
+ */
+static const char *morphVertex =
+   "attribute vec3 normal;\n"
+   "uniform float level;\n"
+   "uniform float morph;\n"
+   "void main()\n"
+   "{\n"
+   "   vec4 p = gl_Vertex;\n"
+   "   vec3 n = normalize(gl_NormalMatrix * normal);\n"
+   "   vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+   "   if (abs(gl_MultiTexCoord0.y - level) < 0.01)\n"
+   "      p.y += gl_MultiTexCoord0.x * morph;\n"
+   "   gl_FrontColor = clamp(gl_FrontLightModelProduct.sceneColor +\n"
+   "                         gl_FrontLightProduct[0].ambient +\n"
+   "                         max(dot(n, l), 0.0) *\n"
+   "                         gl_FrontLightProduct[0].diffuse, 0.0, 1.0);\n"
+   "   gl_FrontColor.a = 1.0;\n"
+   "   gl_FogFragCoord = -(gl_ModelViewMatrix * p).z;\n"
+   "   gl_Position = gl_ModelViewProjectionMatrix * p;\n"
+   "}\n";
+
+static const char *morphFragment =
+   "void main()\n"
+   "{\n"
+   "   float f = clamp((gl_Fog.end - gl_FogFragCoord) * gl_Fog.scale,\n"
+   "                   0.0, 1.0);\n"
+   "   gl_FragColor = mix(gl_Fog.color, gl_Color, f);\n"
+   "}\n";
+#endif
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("terrain: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+/*
+ *  Heights
+ */
+static GLfloat lattice(int x, int z, int octave)
+{
+   unsigned h = (unsigned) x * 73856093u ^ (unsigned) z * 19349663u ^
+                (unsigned) octave * 83492791u;
+
+   h ^= h >> 13;
+   h *= 0x5bd1e995u;
+   h ^= h >> 15;
+   return (h & 0xffff) / 32767.5f - 1.0f;
+}
+
+/*  uniform cubic B-spline weights of the four control points  */
+static void basis(GLfloat t, GLfloat w[4])
+{
+   GLfloat s = 1 - t;
+
+   w[0] = s * s * s / 6;
+   w[1] = (3 * t * t * t - 6 * t * t + 4) / 6;
+   w[2] = (-3 * t * t * t + 3 * t * t + 3 * t + 1) / 6;
+   w[3] = t * t * t / 6;
+}
+
+GLfloat terrainHeight(GLfloat x, GLfloat z)
+{
+   GLfloat h = 0, wx[4], wz[4];
+   int o, i, j;
+
+   for (o = 0; o < OCTAVES; o++) {
+      GLfloat u = x / octaves[o].spacing, v = z / octaves[o].spacing;
+      GLfloat sum = 0;
+      int iu = (int) floor(u), iv = (int) floor(v);
+
+      basis(u - iu, wx);
+      basis(v - iv, wz);
+      for (j = 0; j < 4; j++) {
+         GLfloat row = 0;
+
+         for (i = 0; i < 4; i++)
+            row += wx[i] * lattice(iu + i - 1, iv + j - 1, o);
+         sum += wz[j] * row;
+      }
+      h += octaves[o].amplitude * sum;
+   }
+   return h;
+}
+
+/*
+ *  Chunk generation, on the workers
+ */
+
+/*  The finest level that drops vertex i, j; the coarsest level for
+ *  the vertices every level keeps.
+ */
+static int dropLevel(int i, int j)
+{
+   int m = 0;
+
+   while (m < TERRAIN_LEVELS - 1 && i % (2 << m) == 0 && j % (2 << m) == 0)
+      m++;
+   return m;
+}
+
+/*  grid vertex of skirt vertex k  */
+static int edgeVertex(int k)
+{
+   int n = k % SIDE;
+
+   switch (k / SIDE) {
+   case 0:  return n;
+   case 1:  return n * SIDE + TERRAIN_GRID;
+   case 2:  return TERRAIN_GRID * SIDE + n;
+   default: return n * SIDE;
+   }
+}
+
+/*  The float vertices of chunk c, around its middle, which sets
+ *  c->centerY.  c->minY and c->maxY are in world coordinates.
+ */
+static void buildVertices(TerrainChunk *c, GLfloat *v)
+{
+   static const int rowLength = SIDE + 2;
+   GLfloat step = TERRAIN_CHUNK_SIZE / TERRAIN_GRID;
+   GLfloat x0 = c->x * TERRAIN_CHUNK_SIZE, z0 = c->z * TERRAIN_CHUNK_SIZE;
+   GLfloat heights[(SIDE + 2) * (SIDE + 2)], *p;
+   int i, j, k;
+
+/*  with a border of one sample for the normals  */
+#define H(i, j) heights[((j) + 1) * rowLength + (i) + 1]
+   for (j = -1; j <= SIDE; j++)
+      for (i = -1; i <= SIDE; i++)
+         H(i, j) = terrainHeight(x0 + i * step, z0 + j * step);
+
+   c->minY = c->maxY = H(0, 0);
+   for (j = 0; j < SIDE; j++)
+      for (i = 0; i < SIDE; i++) {
+         if (H(i, j) < c->minY)
+            c->minY = H(i, j);
+         if (H(i, j) > c->maxY)
+            c->maxY = H(i, j);
+      }
+   c->centerY = (c->minY + c->maxY) / 2;
+
+   for (j = 0; j < SIDE; j++) {
+      for (i = 0; i < SIDE; i++) {
+         int m = dropLevel(i, j), h = 1 << m;
+         GLfloat nx = H(i - 1, j) - H(i + 1, j);
+         GLfloat nz = H(i, j - 1) - H(i, j + 1);
+         GLfloat ny = 2 * step, len, coarse;
+
+         p = v + (j * SIDE + i) * FLOATS;
+         len = (GLfloat) sqrt(nx * nx + ny * ny + nz * nz);
+         p[0] = i * step - HALF;
+         p[1] = H(i, j) - c->centerY;
+         p[2] = j * step - HALF;
+         p[3] = nx / len;
+         p[4] = ny / len;
+         p[5] = nz / len;
+
+         if (m == TERRAIN_LEVELS - 1)
+            coarse = H(i, j);
+         else if (i % (2 * h) == 0)
+            coarse = (H(i, j - h) + H(i, j + h)) / 2;
+         else if (j % (2 * h) == 0)
+            coarse = (H(i - h, j) + H(i + h, j)) / 2;
+         else
+            coarse = (H(i - h, j - h) + H(i + h, j + h)) / 2;
+         p[6] = (coarse - H(i, j)) / MORPH_RANGE;
+         p[7] = (GLfloat) m / (TERRAIN_LEVELS - 1);
+      }
+   }
+#undef H
+
+   for (k = 0; k < 4 * SIDE; k++) {
+      p = v + (SIDE * SIDE + k) * FLOATS;
+      memcpy(p, v + edgeVertex(k) * FLOATS, FLOATS * sizeof(GLfloat));
+      p[1] -= TERRAIN_SKIRT;
+   }
+   c->minY -= TERRAIN_SKIRT;
+}
+
+static void vertexSource(VertexSource *src, const GLfloat *v)
+{
+   memset(src, 0, sizeof(VertexSource));
+   src->count = VERTICES;
+   src->position = v;
+   src->positionStride = FLOATS * sizeof(GLfloat);
+   src->normal = v + 3;
+   src->normalStride = FLOATS * sizeof(GLfloat);
+   src->texcoord = v + 6;
+   src->texcoordStride = FLOATS * sizeof(GLfloat);
+}
+
+static void generate(int index, void *user)
+{
+   TerrainChunk *c = (TerrainChunk *) user;
+   double start = timerSeconds();
+   int thread = jobsThreadIndex();
+   size_t mark = scratchMark(thread);
+   GLfloat *v = (GLfloat *)
+      scratchAlloc(thread, VERTICES * FLOATS * sizeof(GLfloat));
+   VertexSource src;
+
+   buildVertices(c, v);
+   vertexSource(&src, v);
+   vertexPack(c->vertices, c->layout, &src);
+   scratchRelease(thread, mark);
+   c->generateTime = (timerSeconds() - start) * 1000.0;
+}
+
+/*
+ *  Setup
+ */
+static void buildIndices(Terrain *t)
+{
+   GLushort *indices, *q;
+   GLsizei total = 0;
+   int k, i, j, e;
+
+   for (k = 0; k < TERRAIN_LEVELS; k++) {
+      int g = TERRAIN_GRID >> k;
+
+      t->first[k] = total;
+      t->count[k] = (g * g + 4 * g) * 6;
+      total += t->count[k];
+   }
+   indices = q = (GLushort *) allocate(NULL, total * sizeof(GLushort));
+   for (k = 0; k < TERRAIN_LEVELS; k++) {
+      int s = 1 << k, g = TERRAIN_GRID >> k;
+
+      for (j = 0; j < g; j++) {
+         for (i = 0; i < g; i++) {
+            GLushort v00 = (GLushort) (j * s * SIDE + i * s);
+            GLushort v10 = (GLushort) (v00 + s);
+            GLushort v01 = (GLushort) (v00 + s * SIDE);
+            GLushort v11 = (GLushort) (v01 + s);
+
+            *q++ = v00;  *q++ = v01;  *q++ = v11;
+            *q++ = v00;  *q++ = v11;  *q++ = v10;
+         }
+      }
+/*  skirts; both faces are seen as culling is left off  */
+      for (e = 0; e < 4; e++) {
+         for (i = 0; i < g; i++) {
+            int a = e * SIDE + i * s, b = a + s;
+            GLushort ta = (GLushort) edgeVertex(a);
+            GLushort tb = (GLushort) edgeVertex(b);
+            GLushort ba = (GLushort) (SIDE * SIDE + a);
+            GLushort bb = (GLushort) (SIDE * SIDE + b);
+
+            *q++ = ta;  *q++ = ba;  *q++ = bb;
+            *q++ = ta;  *q++ = bb;  *q++ = tb;
+         }
+      }
+   }
+
+   glGenBuffers(1, &t->ibo);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, t->ibo);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER, total * sizeof(GLushort), indices,
+                GL_STATIC_DRAW);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+   free(indices);
+}
+
+/*  The layout of a chunk in the middle of the world, for all of them:
+ *  every chunk has the same extent, and heights and morph offsets
+ *  within the same bounds.
+ */
+static void chooseLayout(Terrain *t)
+{
+   TerrainChunk c;
+   VertexSource src;
+   GLfloat *v = (GLfloat *) allocate(NULL, VERTICES * FLOATS *
+                                           sizeof(GLfloat));
+
+   memset(&c, 0, sizeof(c));
+   c.x = c.z = t->worldChunks / 2;
+   buildVertices(&c, v);
+   vertexSource(&src, v);
+   if (t->program)
+      vertexLayoutChoose(&t->layout, &src);
+   else
+      vertexLayoutFloat(&t->layout, &src);
+   free(v);
+}
+
+void terrainInit(Terrain *t, int worldChunks, unsigned long budget)
+{
+   GLfloat r;
+
+   memset(t, 0, sizeof(Terrain));
+   t->worldChunks = worldChunks;
+#ifdef GL_VERSION_2_0
+   if (shaderGLVersion(2, 0))
+      t->program = shaderProgram(morphVertex, morphFragment);
+   if (t->program) {
+      t->levelLocation = glGetUniformLocation(t->program, "level");
+      t->morphLocation = glGetUniformLocation(t->program, "morph");
+      t->normalLocation = glGetAttribLocation(t->program, "normal");
+   }
+#endif
+   t->morphing = t->program != 0;
+   chooseLayout(t);
+   t->chunkBytes = VERTICES * t->layout.stride;
+   t->maxChunks = (int) (budget / t->chunkBytes);
+   t->chunks = (TerrainChunk *)
+      allocate(NULL, t->maxChunks * sizeof(TerrainChunk));
+   memset(t->chunks, 0, t->maxChunks * sizeof(TerrainChunk));
+   t->map = (TerrainChunk **)
+      allocate(NULL, worldChunks * worldChunks * sizeof(TerrainChunk *));
+   memset(t->map, 0, worldChunks * worldChunks * sizeof(TerrainChunk *));
+
+/*  The chunks that touch a circle of radius r, and the band of one
+ *  chunk kept around it, fit in a circle of r + 2 chunks.
+ */
+   r = (GLfloat) sqrt(t->maxChunks / PI_) - 2;
+   t->loadRadius = (r > 1 ? r : 1) * TERRAIN_CHUNK_SIZE;
+   t->maxPending = 4 * jobsThreadCount();
+   poolInit(&t->vertexBlocks, t->chunkBytes, t->maxPending);
+   t->uploads = TERRAIN_UPLOADS;
+   t->lodDistance = TERRAIN_LOD_DISTANCE;
+
+   buildIndices(t);
+}
+
+static void release(Terrain *t, TerrainChunk *c)
+{
+   if (c->state == CHUNK_GENERATING) {
+      jobsWait(&c->group);
+      t->pending--;
+   }
+   poolRelease(&t->vertexBlocks, c->vertices);
+   c->vertices = NULL;
+   if (c->vbo)
+      glDeleteBuffers(1, &c->vbo);
+   c->vbo = 0;
+   t->map[c->z * t->worldChunks + c->x] = NULL;
+   c->state = CHUNK_FREE;
+   t->resident--;
+}
+
+void terrainFree(Terrain *t)
+{
+   int i;
+
+   for (i = 0; i < t->maxChunks; i++)
+      if (t->chunks[i].state != CHUNK_FREE)
+         release(t, &t->chunks[i]);
+   glDeleteBuffers(1, &t->ibo);
+#ifdef GL_VERSION_2_0
+   if (t->program)
+      glDeleteProgram(t->program);
+#endif
+   free(t->chunks);
+   free(t->map);
+   free(t->candidates);
+   poolFree(&t->vertexBlocks);
+   memset(t, 0, sizeof(Terrain));
+}
+
+/*
+ *  Streaming
+ */
+
+/*  from the eye to the nearest point of a chunk, across the ground  */
+static GLfloat groundDistance(int x, int z, const GLfloat eye[3])
+{
+   GLfloat x0 = x * TERRAIN_CHUNK_SIZE, z0 = z * TERRAIN_CHUNK_SIZE;
+   GLfloat dx = 0, dz = 0;
+
+   if (eye[0] < x0)
+      dx = x0 - eye[0];
+   else if (eye[0] > x0 + TERRAIN_CHUNK_SIZE)
+      dx = eye[0] - x0 - TERRAIN_CHUNK_SIZE;
+   if (eye[2] < z0)
+      dz = z0 - eye[2];
+   else if (eye[2] > z0 + TERRAIN_CHUNK_SIZE)
+      dz = eye[2] - z0 - TERRAIN_CHUNK_SIZE;
+   return (GLfloat) sqrt(dx * dx + dz * dz);
+}
+
+static int compareCandidates(const void *a, const void *b)
+{
+   GLfloat da = ((const Candidate *) a)->distance;
+   GLfloat db = ((const Candidate *) b)->distance;
+
+   return da < db ? -1 : da > db;
+}
+
+static void upload(Terrain *t, TerrainChunk *c)
+{
+   glGenBuffers(1, &c->vbo);
+   glBindBuffer(GL_ARRAY_BUFFER, c->vbo);
+   glBufferData(GL_ARRAY_BUFFER, t->chunkBytes, c->vertices, GL_STATIC_DRAW);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   poolRelease(&t->vertexBlocks, c->vertices);
+   c->vertices = NULL;
+   c->state = CHUNK_LOADED;
+   t->pending--;
+   t->generated++;
+   t->generateTime += c->generateTime;
+}
+
+/*  A free slot, or the slot of the farthest loaded chunk if that is
+ *  at least a chunk farther than distance.
+ */
+static TerrainChunk *findSlot(Terrain *t, const GLfloat eye[3],
+                              GLfloat distance)
+{
+   TerrainChunk *far = NULL;
+   GLfloat farDistance = distance + TERRAIN_CHUNK_SIZE;
+   int i;
+
+   for (i = 0; i < t->maxChunks; i++) {
+      TerrainChunk *c = &t->chunks[i];
+      GLfloat d;
+
+      if (c->state == CHUNK_FREE)
+         return c;
+      if (c->state != CHUNK_LOADED)
+         continue;
+      d = groundDistance(c->x, c->z, eye);
+      if (d > farDistance) {
+         far = c;
+         farDistance = d;
+      }
+   }
+   if (far) {
+      release(t, far);
+      t->evicted++;
+   }
+   return far;
+}
+
+void terrainUpdate(Terrain *t, const GLfloat eye[3])
+{
+   double start = timerSeconds();
+   GLfloat keep = t->loadRadius + TERRAIN_CHUNK_SIZE;
+   int uploads = 0, count = 0, x0, x1, z0, z1, x, z, i, n;
+
+   for (i = 0; i < t->maxChunks; i++) {
+      TerrainChunk *c = &t->chunks[i];
+
+      if (c->state == CHUNK_FREE)
+         continue;
+      if (c->state == CHUNK_GENERATING && !jobsDone(&c->group))
+         continue;
+      if (groundDistance(c->x, c->z, eye) > keep) {
+         release(t, c);
+         t->evicted++;
+      }
+      else if (c->state == CHUNK_GENERATING && uploads < t->uploads) {
+         upload(t, c);
+         uploads++;
+      }
+   }
+
+   x0 = (int) floor((eye[0] - t->loadRadius) / TERRAIN_CHUNK_SIZE);
+   x1 = (int) floor((eye[0] + t->loadRadius) / TERRAIN_CHUNK_SIZE);
+   z0 = (int) floor((eye[2] - t->loadRadius) / TERRAIN_CHUNK_SIZE);
+   z1 = (int) floor((eye[2] + t->loadRadius) / TERRAIN_CHUNK_SIZE);
+   x0 = x0 < 0 ? 0 : x0;
+   z0 = z0 < 0 ? 0 : z0;
+   x1 = x1 >= t->worldChunks ? t->worldChunks - 1 : x1;
+   z1 = z1 >= t->worldChunks ? t->worldChunks - 1 : z1;
+   n = (x1 - x0 + 1) * (z1 - z0 + 1);
+   if (n > t->maxCandidates) {
+      t->maxCandidates = n;
+      t->candidates = (Candidate *)
+         allocate(t->candidates, n * sizeof(Candidate));
+   }
+   for (z = z0; z <= z1; z++) {
+      for (x = x0; x <= x1; x++) {
+         GLfloat d = groundDistance(x, z, eye);
+
+         if (d <= t->loadRadius && t->map[z * t->worldChunks + x] == NULL) {
+            t->candidates[count].distance = d;
+            t->candidates[count].x = x;
+            t->candidates[count].z = z;
+            count++;
+         }
+      }
+   }
+   qsort(t->candidates, count, sizeof(Candidate), compareCandidates);
+
+   for (i = 0; i < count && t->pending < t->maxPending; i++) {
+      Candidate *a = &t->candidates[i];
+      TerrainChunk *c = findSlot(t, eye, a->distance);
+
+      if (c == NULL)
+         break;
+      c->x = a->x;
+      c->z = a->z;
+      c->state = CHUNK_GENERATING;
+      c->vertices = poolAlloc(&t->vertexBlocks);
+      c->layout = &t->layout;
+      c->group.pending = 0;
+      t->map[c->z * t->worldChunks + c->x] = c;
+      t->resident++;
+      t->pending++;
+      jobsSubmit(&c->group, 1, generate, c);
+   }
+   t->bytes = t->resident * t->chunkBytes;
+   t->updateTime = (timerSeconds() - start) * 1000.0;
+}
+
+/*
+ *  Drawing
+ */
+static void frustumPlanes(GLfloat planes[6][4])
+{
+   GLfloat p[16], mv[16], m[16];
+   int i, j, k;
+
+   glGetFloatv(GL_PROJECTION_MATRIX, p);
+   glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+   for (i = 0; i < 4; i++)
+      for (j = 0; j < 4; j++) {
+         m[j * 4 + i] = 0;
+         for (k = 0; k < 4; k++)
+            m[j * 4 + i] += p[k * 4 + i] * mv[j * 4 + k];
+      }
+/*  row 4 plus and minus each of rows 1 to 3  */
+   for (i = 0; i < 6; i++)
+      for (j = 0; j < 4; j++)
+         planes[i][j] = m[j * 4 + 3] + (i & 1 ? -1 : 1) * m[j * 4 + i / 2];
+}
+
+static int boxVisible(GLfloat planes[6][4], const GLfloat min[3],
+                      const GLfloat max[3])
+{
+   int i;
+
+   for (i = 0; i < 6; i++) {
+      const GLfloat *q = planes[i];
+
+      if (q[0] * (q[0] > 0 ? max[0] : min[0]) +
+          q[1] * (q[1] > 0 ? max[1] : min[1]) +
+          q[2] * (q[2] > 0 ? max[2] : min[2]) + q[3] < 0)
+         return 0;
+   }
+   return 1;
+}
+
+/*  Level k is drawn out to lodDistance * 2^k and morphs over the last
+ *  TERRAIN_MORPH of that range, ending on the geometry of level k + 1.
+ */
+static int selectLevel(const Terrain *t, GLfloat distance, GLfloat *morph)
+{
+   GLfloat end = t->lodDistance, m;
+   int k = 0;
+
+   while (k < TERRAIN_LEVELS - 1 && distance >= end) {
+      end *= 2;
+      k++;
+   }
+   m = (distance - end * (1 - TERRAIN_MORPH)) / (end * TERRAIN_MORPH);
+   *morph = k == TERRAIN_LEVELS - 1 || m < 0 ? 0 : m > 1 ? 1 : m;
+   return k;
+}
+
+#ifdef GL_VERSION_2_0
+/*  The normals of the chunk in the bound buffer, for the shader.  */
+static void normalArray(const Terrain *t)
+{
+   const VertexAttrib *n = &t->layout.attr[VA_NORMAL];
+
+   if (n->format == VF_SNORM10)
+      glVertexAttribPointer(t->normalLocation, 4, GL_INT_2_10_10_10_REV,
+                            GL_TRUE, t->layout.stride,
+                            BUFFER_OFFSET(n->offset));
+   else
+      glVertexAttribPointer(t->normalLocation, 3, GL_FLOAT, GL_FALSE,
+                            t->layout.stride, BUFFER_OFFSET(n->offset));
+}
+#endif
+
+void terrainDraw(Terrain *t, const GLfloat eye[3])
+{
+   GLfloat planes[6][4];
+   VertexLayout arrays = t->layout;
+   int i;
+
+   frustumPlanes(planes);
+   t->drawn = 0;
+   t->triangles = 0;
+   memset(t->levelChunks, 0, sizeof(t->levelChunks));
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, t->ibo);
+#ifdef GL_VERSION_2_0
+   if (t->program) {
+      glUseProgram(t->program);
+      arrays.attr[VA_NORMAL].format = VF_NONE;
+      glEnableVertexAttribArray(t->normalLocation);
+   }
+#endif
+
+   for (i = 0; i < t->maxChunks; i++) {
+      TerrainChunk *c = &t->chunks[i];
+      GLfloat min[3], max[3], d[3], morph;
+      int k, level;
+
+      if (c->state != CHUNK_LOADED)
+         continue;
+      min[0] = c->x * TERRAIN_CHUNK_SIZE - eye[0];
+      min[1] = c->minY - eye[1];
+      min[2] = c->z * TERRAIN_CHUNK_SIZE - eye[2];
+      max[0] = min[0] + TERRAIN_CHUNK_SIZE;
+      max[1] = c->maxY - eye[1];
+      max[2] = min[2] + TERRAIN_CHUNK_SIZE;
+      if (!boxVisible(planes, min, max))
+         continue;
+
+      for (k = 0; k < 3; k++)
+         d[k] = min[k] > 0 ? min[k] : max[k] < 0 ? -max[k] : 0;
+      level = selectLevel(t, (GLfloat) sqrt(d[0] * d[0] + d[1] * d[1] +
+                                            d[2] * d[2]), &morph);
+      glBindBuffer(GL_ARRAY_BUFFER, c->vbo);
+      vertexLayoutEnable(&arrays, 0);
+#ifdef GL_VERSION_2_0
+      if (t->program) {
+         glUniform1f(t->levelLocation,
+                     (GLfloat) level / (TERRAIN_LEVELS - 1));
+         glUniform1f(t->morphLocation,
+                     t->morphing ? morph * MORPH_RANGE : 0.0f);
+         normalArray(t);
+      }
+#endif
+      glPushMatrix();
+      glTranslatef(min[0] + HALF, c->centerY - eye[1], min[2] + HALF);
+      glDrawElements(GL_TRIANGLES, t->count[level], GL_UNSIGNED_SHORT,
+                     BUFFER_OFFSET(t->first[level] * sizeof(GLushort)));
+      glPopMatrix();
+
+      t->drawn++;
+      t->triangles += t->count[level] / 3;
+      t->levelChunks[level]++;
+   }
+
+   vertexLayoutDisable(&arrays);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+#ifdef GL_VERSION_2_0
+   if (t->program) {
+      glDisableVertexAttribArray(t->normalLocation);
+      glUseProgram(0);
+   }
+#endif
+}
+
+void terrainPrintStats(const Terrain *t)
+{
+   char name[64];
+   int k;
+
+   printf("terrain: %d of %d chunks resident, %.1f of %.1f MB, "
+          "%d generating, load radius %.0f m\n", t->resident, t->maxChunks,
+          t->bytes / 1048576.0, t->maxChunks * t->chunkBytes / 1048576.0,
+          t->pending, t->loadRadius);
+   printf("   %lu generated, %.2f ms each on the workers, %lu evicted, "
+          "update %.2f ms\n", t->generated,
+          t->generated ? t->generateTime / t->generated : 0.0,
+          t->evicted, t->updateTime);
+   printf("   %d chunks drawn, %lu triangles, per level:", t->drawn,
+          t->triangles);
+   for (k = 0; k < TERRAIN_LEVELS; k++)
+      printf(" %d", t->levelChunks[k]);
+   printf("%s\n", t->morphing ? ", morphing" : "");
+   printf("   vertices %s\n",
+          vertexLayoutName(&t->layout, name, sizeof(name)));
+   poolPrintStats("   vertex blocks", &t->vertexBlocks);
+}
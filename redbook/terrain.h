@@ -0,0 +1,121 @@
+/*
+ *  terrain.h
+ *  Streaming chunked terrain.  The world is a square of
+ *  TERRAIN_CHUNK_SIZE meter chunks, each a heightfield of
+ *  TERRAIN_GRID x TERRAIN_GRID cells.  Heights are uniform bicubic
+ *  B-spline surfaces, the surface surface.c draws as a single Bezier
+ *  patch, over lattices of pseudo-random control heights at a few
+ *  scales, so any point of the world can be evaluated on its own and
+ *  neighbouring chunks meet exactly.
+ *
+ *  terrainUpdate() keeps the chunks around the camera resident: the
+ *  missing ones, nearest first, are generated on the worker pool
+ *  (jobs.h) into blocks from a pool (arena.h) and uploaded to a
+ *  vertex buffer a few per frame, and the ones that fall out of range
+ *  are freed.  The number of resident chunks is fixed by the memory
+ *  budget, which also sets the load radius.
+ *
+ *  Each chunk is drawn at one of TERRAIN_LEVELS levels, every second
+ *  vertex of the level before, chosen by its distance.  Over the last
+ *  TERRAIN_MORPH of its range a level is geomorphed: the vertices it
+ *  has and the next level lacks slide onto the coarser surface, so a
+ *  chunk changes level without popping.  Morphing needs a vertex
+ *  shader (OpenGL 2.0); without one levels switch abruptly.  Skirts
+ *  hang from the chunk edges to hide cracks between chunks at
+ *  different levels.
+ *
+ *  Vertices are packed to 16 bytes, half floats and a 10-bit normal,
+ *  when the context has OpenGL 3.3, and are 32 bytes of floats
+ *  otherwise; the budget holds twice as many packed chunks.
+ *
+ *  Requires OpenGL 1.5 buffer objects.
+ */
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "arena.h"
+#include "jobs.h"
+#include "vformat.h"
+
+#define TERRAIN_CHUNK_SIZE    256.0f    /* meters */
+#define TERRAIN_GRID          64        /* cells on a side at level 0 */
+#define TERRAIN_LEVELS        5         /* 64 .. 4 cells on a side */
+#define TERRAIN_WORLD_CHUNKS  40        /* 10.24 km on a side */
+#define TERRAIN_BUDGET        (64ul << 20)      /* bytes */
+#define TERRAIN_LOD_DISTANCE  320.0f    /* end of level 0, doubling */
+#define TERRAIN_MORPH         0.3f
+#define TERRAIN_UPLOADS       2         /* chunks per update */
+#define TERRAIN_SKIRT         24.0f     /* meters */
+
+typedef struct terrainchunk {
+   int       x, z;                      /* chunk coordinates */
+   int       state;
+   JobGroup  group;
+   void     *vertices;                  /* packed, until uploaded */
+   const VertexLayout *layout;
+   GLuint    vbo;
+   GLfloat   minY, maxY;
+   GLfloat   centerY;                   /* vertex heights are from */
+   double    generateTime;              /* ms */
+} TerrainChunk;
+
+typedef struct terrain {
+   int             worldChunks;
+   TerrainChunk   *chunks;              /* resident slots */
+   int             maxChunks;
+   TerrainChunk  **map;                 /* worldChunks^2, or NULL */
+   struct tcandidate *candidates;       /* chunks to load, by distance */
+   int             maxCandidates;
+   VertexLayout    layout;              /* of every chunk */
+   unsigned long   chunkBytes;
+   Pool            vertexBlocks;        /* of chunkBytes, until uploaded */
+   GLfloat         loadRadius;          /* meters */
+   int             maxPending;          /* chunks being generated */
+   int             uploads;             /* per update */
+   GLfloat         lodDistance;
+
+   GLuint          ibo;                 /* shared by every chunk */
+   GLuint          first[TERRAIN_LEVELS];
+   GLsizei         count[TERRAIN_LEVELS];
+   GLuint          program;             /* 0 without morphing */
+   GLint           levelLocation, morphLocation, normalLocation;
+   int             morphing;
+
+   /* current state */
+   int             resident, pending;
+   unsigned long   bytes;
+
+   /* totals */
+   unsigned long   generated, evicted;
+   double          generateTime;        /* ms on the workers */
+
+   /* last update and draw */
+   double          updateTime;          /* ms */
+   int             drawn;
+   unsigned long   triangles;
+   int             levelChunks[TERRAIN_LEVELS];
+} Terrain;
+
+/*  Allocate chunk slots for budget bytes of vertices, in the smallest
+ *  layout the context can draw; a chunk holds the same amount whether
+ *  it is in memory or in a buffer object.  Compiles the morphing
+ *  shader when the context has OpenGL 2.0.
+ */
+void terrainInit(Terrain *t, int worldChunks, unsigned long budget);
+void terrainFree(Terrain *t);
+
+/*  Height of the world surface at x, z in meters.  */
+GLfloat terrainHeight(GLfloat x, GLfloat z);
+
+/*  Stream chunks around the eye, in world coordinates.  */
+void terrainUpdate(Terrain *t, const GLfloat eye[3]);
+
+/*  Draw the resident chunks.  The modelview matrix must hold only
+ *  the rotation of the camera: chunks are drawn relative to the eye,
+ *  which keeps coordinates small however far the camera flies.
+ */
+void terrainDraw(Terrain *t, const GLfloat eye[3]);
+
+void terrainPrintStats(const Terrain *t);
+
+#endif
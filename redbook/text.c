@@ -0,0 +1,326 @@
+/*
+ *  text.c
+ *  Glyph atlas and batched text.  See text.h.
+ */
+#include <GL/glut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "text.h"
+
+#define ATLAS_WIDTH 128
+#define TEXT_CACHE_SIZE 256     /* power of two */
+
+/*  A laid out string: its quads relative to the origin, without
+ *  color.  The cache is direct mapped; a string that collides with
+ *  another replaces it.
+ */
+typedef struct layout {
+   const TextFont *font;
+   char           *string;
+   TextVertex     *verts;
+   GLuint          count;
+} Layout;
+
+static Layout cache[TEXT_CACHE_SIZE];
+static TextStats stats;
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("text: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+void textFontInit(TextFont *f)
+{
+   memset(f, 0, sizeof(*f));
+}
+
+void textFontGlyph(TextFont *f, int c, GLsizei width, GLsizei height,
+                   GLfloat xorig, GLfloat yorig, GLfloat xmove,
+                   const GLubyte *bitmap)
+{
+   TextGlyph *g;
+   GLsizei bytes = (width + 7) / 8 * height, i;
+
+   if (c < 0 || c >= TEXT_GLYPHS)
+      return;
+   g = &f->glyphs[c];
+   g->xorig = xorig;
+   g->yorig = yorig;
+   g->xmove = xmove;
+
+/*  blank glyphs only move the pen  */
+   for (i = 0; i < bytes; i++)
+      if (bitmap[i])
+         break;
+   if (i == bytes) {
+      g->width = g->height = 0;
+      return;
+   }
+   g->width = (short) width;
+   g->height = (short) height;
+   f->bitmaps[c] = (GLubyte *) allocate(f->bitmaps[c], bytes);
+   memcpy(f->bitmaps[c], bitmap, bytes);
+}
+
+/*  Cached layouts hold texture coordinates into the font's atlas.  */
+static void forgetLayouts(const TextFont *f)
+{
+   int i;
+
+   for (i = 0; i < TEXT_CACHE_SIZE; i++) {
+      if (cache[i].font == f) {
+         free(cache[i].string);
+         free(cache[i].verts);
+         memset(&cache[i], 0, sizeof(Layout));
+      }
+   }
+}
+
+/*  Shelf packing: glyphs are placed left to right in rows as tall as
+ *  the tallest glyph in them, with a texel of space around each so
+ *  neighbours never bleed into one another.
+ */
+void textFontBuild(TextFont *f)
+{
+   GLubyte *atlas;
+   int c, x = 1, y = 1, shelf = 0, r, col;
+   GLsizei height;
+
+   forgetLayouts(f);
+   for (c = 0; c < TEXT_GLYPHS; c++) {
+      TextGlyph *g = &f->glyphs[c];
+
+      if (f->bitmaps[c] == NULL)
+         continue;
+      if (x + g->width + 1 > ATLAS_WIDTH) {
+         x = 1;
+         y += shelf + 1;
+         shelf = 0;
+      }
+      g->x = (short) x;
+      g->y = (short) y;
+      x += g->width + 1;
+      if (g->height > shelf)
+         shelf = g->height;
+   }
+   for (height = 1; height < y + shelf + 1; height *= 2)
+      ;
+
+   atlas = (GLubyte *) allocate(NULL, ATLAS_WIDTH * height);
+   memset(atlas, 0, ATLAS_WIDTH * height);
+   for (c = 0; c < TEXT_GLYPHS; c++) {
+      TextGlyph *g = &f->glyphs[c];
+      const GLubyte *bits = f->bitmaps[c];
+      int rowBytes = (g->width + 7) / 8;
+
+      if (bits == NULL)
+         continue;
+/*  bitmap rows run bottom to top, most significant bit first  */
+      for (r = 0; r < g->height; r++)
+         for (col = 0; col < g->width; col++)
+            if (bits[r * rowBytes + col / 8] & (0x80 >> (col % 8)))
+               atlas[(g->y + r) * ATLAS_WIDTH + g->x + col] = 0xff;
+      free(f->bitmaps[c]);
+      f->bitmaps[c] = NULL;
+   }
+
+   if (f->texture == 0)
+      glGenTextures(1, &f->texture);
+   glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+   glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+   glBindTexture(GL_TEXTURE_2D, f->texture);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+   glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, ATLAS_WIDTH, height, 0,
+                GL_ALPHA, GL_UNSIGNED_BYTE, atlas);
+   glBindTexture(GL_TEXTURE_2D, 0);
+   glPopClientAttrib();
+   free(atlas);
+
+   f->atlasWidth = ATLAS_WIDTH;
+   f->atlasHeight = height;
+}
+
+void textFontDelete(TextFont *f)
+{
+   int c;
+
+   forgetLayouts(f);
+   for (c = 0; c < TEXT_GLYPHS; c++)
+      free(f->bitmaps[c]);
+   if (f->texture)
+      glDeleteTextures(1, &f->texture);
+   memset(f, 0, sizeof(*f));
+}
+
+GLfloat textWidth(const TextFont *f, const char *s)
+{
+   GLfloat w = 0;
+
+   for (; *s; s++)
+      if ((unsigned char) *s < TEXT_GLYPHS)
+         w += f->glyphs[(unsigned char) *s].xmove;
+   return w;
+}
+
+static unsigned hashString(const TextFont *f, const char *s)
+{
+   unsigned h = 2166136261U;
+
+   for (; *s; s++) {
+      h ^= (unsigned char) *s;
+      h *= 16777619U;
+   }
+   return (h ^ (unsigned) ((size_t) f >> 4)) & (TEXT_CACHE_SIZE - 1);
+}
+
+static void layoutString(Layout *l, const TextFont *f, const char *s)
+{
+   GLfloat pen = 0, sw = 1.0f / f->atlasWidth, th = 1.0f / f->atlasHeight;
+   TextVertex *v;
+   GLuint n = 0;
+   const char *p;
+
+   for (p = s; *p; p++)
+      if ((unsigned char) *p < TEXT_GLYPHS &&
+          f->glyphs[(unsigned char) *p].width > 0)
+         n++;
+   l->font = f;
+   l->string = (char *) allocate(l->string, strlen(s) + 1);
+   strcpy(l->string, s);
+   l->verts = (TextVertex *) allocate(l->verts, n * 4 * sizeof(TextVertex));
+   l->count = n * 4;
+
+   v = l->verts;
+   for (p = s; *p; p++) {
+      const TextGlyph *g;
+      GLfloat x0, y0, x1, y1, s0, t0, s1, t1;
+
+      if ((unsigned char) *p >= TEXT_GLYPHS)
+         continue;
+      g = &f->glyphs[(unsigned char) *p];
+      if (g->width > 0) {
+         x0 = pen - g->xorig;
+         y0 = -g->yorig;
+         x1 = x0 + g->width;
+         y1 = y0 + g->height;
+         s0 = g->x * sw;
+         t0 = g->y * th;
+         s1 = (g->x + g->width) * sw;
+         t1 = (g->y + g->height) * th;
+         v[0].x = x0; v[0].y = y0; v[0].s = s0; v[0].t = t0;
+         v[1].x = x1; v[1].y = y0; v[1].s = s1; v[1].t = t0;
+         v[2].x = x1; v[2].y = y1; v[2].s = s1; v[2].t = t1;
+         v[3].x = x0; v[3].y = y1; v[3].s = s0; v[3].t = t1;
+         v += 4;
+      }
+      pen += g->xmove;
+   }
+}
+
+void textBatchInit(TextBatch *b)
+{
+   memset(b, 0, sizeof(*b));
+}
+
+void textBatchFree(TextBatch *b)
+{
+   free(b->verts);
+   memset(b, 0, sizeof(*b));
+}
+
+void textBatchClear(TextBatch *b)
+{
+   b->count = 0;
+}
+
+void textBatchString(TextBatch *b, const TextFont *f, GLfloat x, GLfloat y,
+                     const char *s, const GLubyte color[4])
+{
+   Layout *l = &cache[hashString(f, s)];
+   TextVertex *v;
+   GLuint i;
+
+   stats.strings++;
+   if (l->font == f && l->string && strcmp(l->string, s) == 0)
+      stats.cacheHits++;
+   else
+      layoutString(l, f, s);
+
+   if (b->count + l->count > b->max) {
+      GLuint n = b->max ? b->max : 1024;
+
+      while (n < b->count + l->count)
+         n *= 2;
+      b->verts = (TextVertex *) allocate(b->verts, n * sizeof(TextVertex));
+      b->max = n;
+   }
+   v = b->verts + b->count;
+   for (i = 0; i < l->count; i++, v++) {
+      *v = l->verts[i];
+      v->x += x;
+      v->y += y;
+      v->color[0] = color[0];
+      v->color[1] = color[1];
+      v->color[2] = color[2];
+      v->color[3] = color[3];
+   }
+   b->count += l->count;
+   stats.glyphs += l->count / 4;
+}
+
+/*  The atlas holds only alpha; GL_MODULATE takes the color from the
+ *  vertices, and the alpha test keeps the edges as hard as glBitmap()
+ *  draws them.
+ */
+void textBatchDraw(TextBatch *b, const TextFont *f)
+{
+   if (b->count == 0)
+      return;
+
+   glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_TEXTURE_BIT |
+                GL_COLOR_BUFFER_BIT);
+   glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_DEPTH_TEST);
+   glEnable(GL_TEXTURE_2D);
+   glBindTexture(GL_TEXTURE_2D, f->texture);
+   glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+   glEnable(GL_ALPHA_TEST);
+   glAlphaFunc(GL_GREATER, 0.5);
+
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+   glEnableClientState(GL_COLOR_ARRAY);
+   glDisableClientState(GL_NORMAL_ARRAY);
+   glVertexPointer(2, GL_FLOAT, sizeof(TextVertex), &b->verts[0].x);
+   glTexCoordPointer(2, GL_FLOAT, sizeof(TextVertex), &b->verts[0].s);
+   glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(TextVertex),
+                  b->verts[0].color);
+   glDrawArrays(GL_QUADS, 0, b->count);
+
+   glPopClientAttrib();
+   glPopAttrib();
+
+   b->count = 0;
+   stats.draws++;
+}
+
+const TextStats *textStats(void)
+{
+   return &stats;
+}
+
+void textResetStats(void)
+{
+   memset(&stats, 0, sizeof(stats));
+}
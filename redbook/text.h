@@ -0,0 +1,87 @@
+/*
+ *  text.h
+ *  Batched bitmap text.  Glyphs are given once, in the same form as
+ *  glBitmap() takes them, and rasterized into a single alpha texture
+ *  (the atlas).  Strings are laid out into textured quads and
+ *  appended to a TextBatch, which draws everything it holds with one
+ *  glDrawArrays() call; a string costs four vertices per glyph
+ *  instead of a glBitmap() each.
+ *
+ *  Layouts are cached by string, so a label that is drawn every frame
+ *  is only laid out once.  Quads are placed in the coordinate system
+ *  of the current matrices at the time of textBatchDraw(); with an
+ *  orthographic projection of 0..w, 0..h they land on the same pixels
+ *  as glBitmap() at the same raster position.
+ *
+ *  Uses texture objects and vertex arrays (OpenGL 1.1).
+ */
+#ifndef TEXT_H
+#define TEXT_H
+
+#define TEXT_GLYPHS 128
+
+typedef struct textglyph {
+   short   x, y;            /* position in the atlas, in texels */
+   short   width, height;
+   GLfloat xorig, yorig;
+   GLfloat xmove;
+} TextGlyph;
+
+typedef struct textfont {
+   TextGlyph glyphs[TEXT_GLYPHS];
+   GLubyte  *bitmaps[TEXT_GLYPHS];     /* kept until textFontBuild() */
+   GLuint    texture;
+   GLsizei   atlasWidth, atlasHeight;
+} TextFont;
+
+typedef struct textvertex {
+   GLfloat x, y;
+   GLfloat s, t;
+   GLubyte color[4];
+} TextVertex;
+
+typedef struct textbatch {
+   TextVertex *verts;
+   GLuint      count, max;
+} TextBatch;
+
+typedef struct textstats {
+   unsigned strings;        /* strings appended to batches */
+   unsigned cacheHits;      /* of those, layouts found in the cache */
+   unsigned glyphs;         /* quads appended */
+   unsigned draws;          /* textBatchDraw() calls that drew */
+} TextStats;
+
+void textFontInit(TextFont *f);
+
+/*  Define character c.  The arguments are those of glBitmap(); the
+ *  bitmap rows are packed with an unpack alignment of 1.
+ */
+void textFontGlyph(TextFont *f, int c, GLsizei width, GLsizei height,
+                   GLfloat xorig, GLfloat yorig, GLfloat xmove,
+                   const GLubyte *bitmap);
+
+/*  Pack the defined glyphs into the atlas texture.  */
+void textFontBuild(TextFont *f);
+void textFontDelete(TextFont *f);
+
+/*  Width of a string in the units of xmove.  */
+GLfloat textWidth(const TextFont *f, const char *s);
+
+void textBatchInit(TextBatch *b);
+void textBatchFree(TextBatch *b);
+void textBatchClear(TextBatch *b);
+
+/*  Append s with its origin at (x, y), as glRasterPos2f(x, y) would
+ *  place it.
+ */
+void textBatchString(TextBatch *b, const TextFont *f, GLfloat x, GLfloat y,
+                     const char *s, const GLubyte color[4]);
+
+/*  Draw the batch with f's atlas and empty it.  */
+void textBatchDraw(TextBatch *b, const TextFont *f);
+
+const TextStats *textStats(void);
+void textResetStats(void);
+
+#endif
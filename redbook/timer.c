@@ -0,0 +1,30 @@
+/*
+ *  timer.c
+ *  Monotonic clock: QueryPerformanceCounter on Windows,
+ *  clock_gettime(CLOCK_MONOTONIC) elsewhere.
+ */
+#ifdef _WIN32
+#include <windows.h>
+#else
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#endif
+#include "timer.h"
+
+double timerSeconds(void)
+{
+#ifdef _WIN32
+   static LARGE_INTEGER freq;
+   LARGE_INTEGER now;
+
+   if (freq.QuadPart == 0)
+      QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&now);
+   return (double) now.QuadPart / (double) freq.QuadPart;
+#else
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
@@ -0,0 +1,11 @@
+/*
+ *  timer.h
+ *  High resolution wall clock for the benchmark and frame timing code.
+ */
+#ifndef TIMER_H
+#define TIMER_H
+
+/*  Seconds since an arbitrary fixed point; only differences matter.  */
+double timerSeconds(void);
+
+#endif
@@ -37,49 +37,111 @@
 
 /*
  *  torus.c
- *  This program demonstrates the creation of a display list.
+ *  This program demonstrates the creation of a mesh object: the
+ *  torus is built once into vertex and index buffer objects and
+ *  drawn with a single call, where it used to be a display list.
+ *  Its triangles are reordered for the vertex cache when it is
+ *  loaded.  Press "m" to print the size of the mesh and the cache
+ *  statistics before and after.
+ *
+ *  The torus is built at several levels of detail, and the coarsest
+ *  that stays within half a pixel of the true surface is drawn.
+ *  Press "z" and "Z" to move it away and back and print the level it
+ *  is drawn at.
  */
 
+#define GL_GLEXT_PROTOTYPES
 #include <GL/glut.h>
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include "lod.h"
+#include "mesh.h"
+#include "meshopt.h"
 
 #define PI_ 3.14159265358979323846
 
-GLuint theTorus;
+#ifdef GL_VERSION_1_5
+LodManager lod;
+LodMesh theTorus;
+MeshOptStats torusStats[LOD_MAX_LEVELS];
+int torusLevel = -1;
 
-/* Draw a torus */
-static void torus(int numc, int numt)
+/*  Build a torus of numc rings around the tube and numt segments
+ *  around the hole.  Every vertex is computed once, from tabulated
+ *  cosines and sines, and each ring is an indexed triangle strip;
+ *  rings are joined with degenerate triangles so the whole torus is
+ *  a single strip.
+ */
+static void torus(MeshBuilder *b, int numc, int numt)
 {
-   int i, j, k;
-   double s, t, x, y, z, twopi;
+   int i, j;
+   double *cs, *ss, *ct, *st, twopi;
+   GLuint first;
+   GLfloat v[3];
 
    twopi = 2 * PI_;
+   cs = (double *) malloc((numc + numt) * 2 * sizeof(double));
+   ss = cs + numc;
+   ct = ss + numc;
+   st = ct + numt;
+   for (i = 0; i < numc; i++) {
+      cs[i] = cos((i + 0.5) * twopi / numc);
+      ss[i] = sin((i + 0.5) * twopi / numc);
+   }
+   for (j = 0; j < numt; j++) {
+      ct[j] = cos(j * twopi / numt);
+      st[j] = sin(j * twopi / numt);
+   }
+
+   first = b->vertexCount;
    for (i = 0; i < numc; i++) {
-      glBegin(GL_QUAD_STRIP);
+      for (j = 0; j < numt; j++) {
+         v[0] = (1 + .1 * cs[i]) * ct[j];
+         v[1] = (1 + .1 * cs[i]) * st[j];
+         v[2] = .1 * ss[i];
+         meshVertex(b, v, NULL, NULL);
+      }
+   }
+   free(cs);
+
+#define TORUS_VERTEX(c, t) (first + ((c) % numc) * numt + (t) % numt)
+   meshBegin(b, GL_TRIANGLE_STRIP);
+   for (i = 0; i < numc; i++) {
+      if (i > 0)
+         meshIndex(b, TORUS_VERTEX(i + 1, 0));
       for (j = 0; j <= numt; j++) {
-         for (k = 1; k >= 0; k--) {
-            s = (i + k) % numc + 0.5;
-            t = j % numt;
-
-            x = (1+.1*cos(s*twopi/numc))*cos(t*twopi/numt);
-            y = (1+.1*cos(s*twopi/numc))*sin(t*twopi/numt);
-            z = .1 * sin(s * twopi / numc);
-            glVertex3f(x, y, z);
-         }
+         meshIndex(b, TORUS_VERTEX(i + 1, j));
+         meshIndex(b, TORUS_VERTEX(i, j));
       }
-      glEnd();
+      if (i < numc - 1)
+         meshIndex(b, TORUS_VERTEX(i, numt));
    }
+   meshEnd(b);
+#undef TORUS_VERTEX
 }
 
-/* Create display list with Torus and initialize state */
+static void buildTorus(MeshBuilder *b, int level, int numc, int numt,
+                       void *data)
+{
+   torus(b, numc, numt);
+   meshOptimize(b, &torusStats[level]);
+}
+
+/* Create torus meshes and initialize state */
 static void init(void)
 {
-   theTorus = glGenLists (1);
-   glNewList(theTorus, GL_COMPILE);
-   torus(8, 25);
-   glEndList();
+   LodShape s;
+
+   s.u = 8;
+   s.v = 25;
+   s.minU = s.minV = 3;
+   s.radiusU = .1;
+   s.radiusV = 1.1;
+   s.angleU = s.angleV = 2 * PI_;
+   s.bound = 1.1;
+   lodInit(&lod);
+   lodBuild(&theTorus, 0, &s, buildTorus, NULL);
 
    glShadeModel(GL_FLAT);
    glClearColor(0.0, 0.0, 0.0, 0.0);
@@ -90,7 +152,7 @@ void display(void)
 {
    glClear(GL_COLOR_BUFFER_BIT);
    glColor3f (1.0, 1.0, 1.0);
-   glCallList(theTorus);
+   lodDraw(&lod, &theTorus, &torusLevel);
    glFlush();
 }
 
@@ -106,10 +168,31 @@ void reshape(int w, int h)
    gluLookAt(0, 0, 10, 0, 0, 0, 0, 1, 0);
 }
 
+/* Move the torus along the line of sight, in front of the rotations */
+/*  Move the torus along the line of sight and print the level the
+ *  next frame will draw it at.
+ */
+static void moveTorus(GLfloat z)
+{
+   GLfloat m[16];
+   int level = torusLevel;
+
+   glGetFloatv(GL_MODELVIEW_MATRIX, m);
+   glLoadIdentity();
+   glTranslatef(0.0, 0.0, z);
+   glMultMatrixf(m);
+   lodSelect(&lod, &theTorus, lodPixelScale(theTorus.bound), &level);
+   printf("torus level %d: %d x %d, %u triangles\n", level,
+          theTorus.u[level], theTorus.v[level], theTorus.triangles[level]);
+}
+
 /* Rotate about x-axis when "x" typed; rotate about y-axis
    when "y" typed; "i" returns torus to original view */
 void keyboard(unsigned char key, int x, int y)
 {
+   int i;
+   char name[32];
+
    switch (key) {
    case 'x':
    case 'X':
@@ -127,6 +210,27 @@ void keyboard(unsigned char key, int x, int y)
       gluLookAt(0, 0, 10, 0, 0, 0, 0, 1, 0);
       glutPostRedisplay();
       break;
+   case 'z':
+      moveTorus(-5.0);
+      glutPostRedisplay();
+      break;
+   case 'Z':
+      moveTorus(5.0);
+      glutPostRedisplay();
+      break;
+   case 'm':
+   case 'M':
+      for (i = 0; i < theTorus.levelCount; i++) {
+         sprintf(name, "torus level %d", i);
+         printf("%s: %d x %d, %u vertices, %u indices, %lu bytes\n",
+                name, theTorus.u[i], theTorus.v[i],
+                theTorus.levels[i].vertexCount,
+                theTorus.levels[i].indexCount,
+                meshBytes(&theTorus.levels[i]));
+         meshoptPrintStats(name, &torusStats[i]);
+      }
+      lodPrintStats("torus", &lod);
+      break;
    case 27:
       exit(0);
       break;
@@ -146,3 +250,12 @@ int main(int argc, char **argv)
    glutMainLoop();
    return 0;
 }
+#else
+int main(int argc, char** argv)
+{
+    fprintf (stderr, "This program demonstrates a feature which is not in OpenGL before Version 1.5.\n");
+    fprintf (stderr, "If your implementation has the ARB_vertex_buffer_object extension,\n");
+    fprintf (stderr, "you may be able to modify this program to make it run.\n");
+    return 0;
+}
+#endif
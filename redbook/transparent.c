@@ -0,0 +1,458 @@
+/*
+ *  transparent.c
+ *  Sorted and weighted blended transparency.  See transparent.h.
+ *
+ *  Sorting is an LSD radix sort of 32 bit keys, one byte per pass,
+ *  made from the view depth of each item so that an ascending sort is
+ *  back to front.  For large queues each pass is split into chunks:
+ *  the chunks are histogrammed in parallel, the histograms are turned
+ *  into per chunk output offsets, and the chunks are scattered in
+ *  parallel, which keeps the sort stable.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "transparent.h"
+#include "shader.h"
+#include "jobs.h"
+
+#define CHUNK_MIN   2048
+#define MAX_CHUNKS  65
+
+static void *allocate(void *p, size_t bytes)
+{
+   p = realloc(p, bytes ? bytes : 1);
+   if (p == NULL) {
+      printf("transparent: out of memory\n");
+      exit(1);
+   }
+   return p;
+}
+
+void transparentInit(TransparentQueue *q, int mode)
+{
+   memset(q, 0, sizeof(*q));
+   q->mode = mode;
+   q->parallelMin = TRANSPARENT_PARALLEL_MIN;
+}
+
+void transparentFree(TransparentQueue *q)
+{
+   free(q->items);
+   free(q->keys);
+   free(q->scratch);
+#ifdef GL_VERSION_3_0
+   if (q->fbo) {
+      glDeleteFramebuffers(1, &q->fbo);
+      glDeleteTextures(1, &q->accum);
+      glDeleteTextures(1, &q->reveal);
+      glDeleteRenderbuffers(1, &q->depth);
+   }
+   if (q->drawProgram)
+      glDeleteProgram(q->drawProgram);
+   if (q->resolveProgram)
+      glDeleteProgram(q->resolveProgram);
+#endif
+   memset(q, 0, sizeof(*q));
+}
+
+/*  Float bits ordered like the floats: negative values have all bits
+ *  flipped, positive values only the sign.
+ */
+static unsigned sortableFloat(GLfloat f)
+{
+   unsigned u;
+
+   memcpy(&u, &f, sizeof(u));
+   return u ^ ((u >> 31) ? 0xffffffffU : 0x80000000U);
+}
+
+/*  Eye space z of the center: more negative is farther away, so
+ *  ascending order is back to front.
+ */
+void transparentSubmit(TransparentQueue *q, const GLfloat center[3],
+                       TransparentDrawFunc draw, void *data)
+{
+   TransparentItem *it;
+   GLfloat *m, z;
+
+   if (q->count == q->capacity) {
+      q->capacity = q->capacity ? q->capacity * 2 : 256;
+      q->items = (TransparentItem *)
+         allocate(q->items, q->capacity * sizeof(TransparentItem));
+      q->keys = (unsigned *)
+         allocate(q->keys, q->capacity * 2 * sizeof(unsigned));
+      q->scratch = (unsigned *)
+         allocate(q->scratch, q->capacity * 2 * sizeof(unsigned));
+   }
+   it = &q->items[q->count];
+   m = it->matrix;
+   glGetFloatv(GL_MODELVIEW_MATRIX, m);
+   it->draw = draw;
+   it->data = data;
+
+   z = m[2] * center[0] + m[6] * center[1] + m[10] * center[2] + m[14];
+   q->keys[q->count * 2] = sortableFloat(z);
+   q->keys[q->count * 2 + 1] = q->count;
+   q->count++;
+}
+
+typedef struct sortpass {
+   const unsigned *src;
+   unsigned       *dst;
+   unsigned        n, chunk;
+   int             shift;
+   unsigned      (*hist)[256];
+} SortPass;
+
+static void histogramChunk(int c, void *user)
+{
+   SortPass *p = (SortPass *) user;
+   unsigned i = c * p->chunk, end = i + p->chunk;
+   unsigned *h = p->hist[c];
+
+   if (end > p->n)
+      end = p->n;
+   memset(h, 0, 256 * sizeof(unsigned));
+   for (; i < end; i++)
+      h[(p->src[i * 2] >> p->shift) & 0xff]++;
+}
+
+/*  hist[c] holds the chunk's output offsets by now.  */
+static void scatterChunk(int c, void *user)
+{
+   SortPass *p = (SortPass *) user;
+   unsigned i = c * p->chunk, end = i + p->chunk;
+   unsigned *off = p->hist[c];
+
+   if (end > p->n)
+      end = p->n;
+   for (; i < end; i++) {
+      unsigned o = off[(p->src[i * 2] >> p->shift) & 0xff]++;
+
+      p->dst[o * 2] = p->src[i * 2];
+      p->dst[o * 2 + 1] = p->src[i * 2 + 1];
+   }
+}
+
+void transparentSort(TransparentQueue *q)
+{
+   static unsigned hist[MAX_CHUNKS][256];
+   SortPass p;
+   unsigned chunks = 1, b, c, sum;
+   unsigned *tmp;
+   int pass;
+
+   q->sortPasses = 0;
+   q->sortChunks = 1;
+   if (q->count < 2)
+      return;
+
+   p.n = q->count;
+   if (p.n >= q->parallelMin) {
+      chunks = jobsThreadCount() + 1;
+      if (chunks > p.n / CHUNK_MIN)
+         chunks = p.n / CHUNK_MIN;
+      if (chunks > MAX_CHUNKS)
+         chunks = MAX_CHUNKS;
+      if (chunks < 1)
+         chunks = 1;
+   }
+   p.chunk = (p.n + chunks - 1) / chunks;
+   p.hist = hist;
+   q->sortChunks = chunks;
+
+   for (pass = 0; pass < 4; pass++) {
+      p.src = q->keys;
+      p.dst = q->scratch;
+      p.shift = pass * 8;
+      if (chunks > 1)
+         jobsParallelFor(chunks, histogramChunk, &p);
+      else
+         histogramChunk(0, &p);
+
+/*  skip the pass when every key has the same byte  */
+      for (b = 0; b < 256; b++) {
+         for (sum = 0, c = 0; c < chunks; c++)
+            sum += hist[c][b];
+         if (sum != 0)
+            break;
+      }
+      if (sum == p.n)
+         continue;
+
+      for (sum = 0, b = 0; b < 256; b++) {
+         for (c = 0; c < chunks; c++) {
+            unsigned n = hist[c][b];
+
+            hist[c][b] = sum;
+            sum += n;
+         }
+      }
+      if (chunks > 1)
+         jobsParallelFor(chunks, scatterChunk, &p);
+      else
+         scatterChunk(0, &p);
+
+      tmp = q->keys;
+      q->keys = q->scratch;
+      q->scratch = tmp;
+      q->sortPasses++;
+   }
+}
+
+static void flushSorted(TransparentQueue *q)
+{
+   unsigned i;
+
+   transparentSort(q);
+   glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
+                GL_TRANSFORM_BIT);
+   glEnable(GL_BLEND);
+   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+   glDepthMask(GL_FALSE);
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   for (i = 0; i < q->count; i++) {
+      TransparentItem *it = &q->items[q->keys[i * 2 + 1]];
+
+      glLoadMatrixf(it->matrix);
+      it->draw(it->data);
+   }
+   glPopMatrix();
+   glPopAttrib();
+}
+
+#ifdef GL_VERSION_3_0
+/*  Per vertex lighting with light 0, as the fixed-function pipeline
+ *  computes it for a directional light and a non-local viewer.
+ */
+static const char *drawVertex =
+   "#version 130\n"
+   "uniform bool lighting;\n"
+   "out vec4 color;\n"
+   "void main()\n"
+   "{\n"
+   "   gl_Position = ftransform();\n"
+   "   if (lighting) {\n"
+   "      vec3 n = normalize(gl_NormalMatrix * gl_Normal);\n"
+   "      vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+   "      vec3 h = normalize(l + vec3(0.0, 0.0, 1.0));\n"
+   "      float d = max(dot(n, l), 0.0);\n"
+   "      float s = d > 0.0 ? pow(max(dot(n, h), 0.0),\n"
+   "                              gl_FrontMaterial.shininess) : 0.0;\n"
+   "      color.rgb = gl_FrontLightModelProduct.sceneColor.rgb +\n"
+   "                  gl_FrontLightProduct[0].ambient.rgb +\n"
+   "                  d * gl_FrontLightProduct[0].diffuse.rgb +\n"
+   "                  s * gl_FrontLightProduct[0].specular.rgb;\n"
+   "      color.a = gl_FrontMaterial.diffuse.a;\n"
+   "      color = clamp(color, 0.0, 1.0);\n"
+   "   }\n"
+   "   else\n"
+   "      color = gl_Color;\n"
+   "}\n";
+
+/*  Accumulate premultiplied color and coverage, weighted to favour
+ *  near surfaces, and the log of the transmittance: summing logs
+ *  multiplies transmittances with the same additive blending.
+ */
+static const char *drawFragment =
+   "#version 130\n"
+   "in vec4 color;\n"
+   "void main()\n"
+   "{\n"
+   "   float a = clamp(color.a, 0.0, 0.999);\n"
+   "   float w = clamp(3e3 * pow(1.0 - gl_FragCoord.z, 3.0), 1e-2, 3e3);\n"
+   "   gl_FragData[0] = vec4(color.rgb * a, a) * w;\n"
+   "   gl_FragData[1] = vec4(log(1.0 - a));\n"
+   "}\n";
+
+static const char *resolveVertex =
+   "#version 130\n"
+   "out vec2 tc;\n"
+   "void main()\n"
+   "{\n"
+   "   tc = gl_Vertex.xy * 0.5 + 0.5;\n"
+   "   gl_Position = gl_Vertex;\n"
+   "}\n";
+
+static const char *resolveFragment =
+   "#version 130\n"
+   "uniform sampler2D accumTex, revealTex;\n"
+   "in vec2 tc;\n"
+   "void main()\n"
+   "{\n"
+   "   vec4 a = texture(accumTex, tc);\n"
+   "   float t = exp(texture(revealTex, tc).r);\n"
+   "   gl_FragColor = vec4(a.rgb / clamp(a.a, 1e-4, 1e30), 1.0 - t);\n"
+   "}\n";
+
+static GLuint makeTarget(GLenum format, GLsizei w, GLsizei h)
+{
+   GLuint t;
+
+   glGenTextures(1, &t);
+   glBindTexture(GL_TEXTURE_2D, t);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+   glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
+   glBindTexture(GL_TEXTURE_2D, 0);
+   return t;
+}
+
+/*  The accumulation target is 32 bit float: with thousands of layers
+ *  the weighted sums overflow half floats.
+ */
+static int makeTargets(TransparentQueue *q, GLsizei w, GLsizei h)
+{
+   static const GLenum buffers[2] = {
+      GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1
+   };
+
+   if (q->fbo && q->width == w && q->height == h)
+      return 1;
+   if (q->fbo) {
+      glDeleteFramebuffers(1, &q->fbo);
+      glDeleteTextures(1, &q->accum);
+      glDeleteTextures(1, &q->reveal);
+      glDeleteRenderbuffers(1, &q->depth);
+   }
+   q->accum = makeTarget(GL_RGBA32F, w, h);
+   q->reveal = makeTarget(GL_R16F, w, h);
+   glGenRenderbuffers(1, &q->depth);
+   glBindRenderbuffer(GL_RENDERBUFFER, q->depth);
+   glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+   glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+   glGenFramebuffers(1, &q->fbo);
+   glBindFramebuffer(GL_FRAMEBUFFER, q->fbo);
+   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                          GL_TEXTURE_2D, q->accum, 0);
+   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+                          GL_TEXTURE_2D, q->reveal, 0);
+   glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                             GL_RENDERBUFFER, q->depth);
+   glDrawBuffers(2, buffers);
+   q->width = w;
+   q->height = h;
+   if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      fprintf(stderr, "transparent: incomplete framebuffer\n");
+      return 0;
+   }
+   return 1;
+}
+
+static int makePrograms(TransparentQueue *q)
+{
+   if (q->drawProgram == 0) {
+      q->drawProgram = shaderProgram(drawVertex, drawFragment);
+      q->resolveProgram = shaderProgram(resolveVertex, resolveFragment);
+      if (q->resolveProgram) {
+         glUseProgram(q->resolveProgram);
+         glUniform1i(glGetUniformLocation(q->resolveProgram, "accumTex"), 0);
+         glUniform1i(glGetUniformLocation(q->resolveProgram, "revealTex"), 1);
+         glUseProgram(0);
+      }
+   }
+   return q->drawProgram && q->resolveProgram;
+}
+
+static void flushWeighted(TransparentQueue *q)
+{
+   static const GLfloat zero[4] = { 0.0, 0.0, 0.0, 0.0 };
+   static const GLfloat one = 1.0;
+   static const GLfloat quad[8] = { -1, -1, 1, -1, 1, 1, -1, 1 };
+   GLint viewport[4], drawFbo, readFbo, ok;
+   unsigned i;
+
+   glGetIntegerv(GL_VIEWPORT, viewport);
+   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFbo);
+   glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFbo);
+   ok = makePrograms(q) && makeTargets(q, viewport[2], viewport[3]);
+   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+   if (!ok) {
+      q->mode = TRANSPARENT_SORTED;
+      flushSorted(q);
+      return;
+   }
+
+/*  the opaque scene's depth, then empty accumulation targets  */
+   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, q->fbo);
+   glClearBufferfv(GL_DEPTH, 0, &one);
+   glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFbo);
+   glBlitFramebuffer(viewport[0], viewport[1],
+                     viewport[0] + viewport[2], viewport[1] + viewport[3],
+                     0, 0, viewport[2], viewport[3],
+                     GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+   glClearBufferfv(GL_COLOR, 0, zero);
+   glClearBufferfv(GL_COLOR, 1, zero);
+
+   glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
+                GL_TRANSFORM_BIT | GL_VIEWPORT_BIT | GL_TEXTURE_BIT);
+   glViewport(0, 0, viewport[2], viewport[3]);
+   glEnable(GL_BLEND);
+   glBlendFunc(GL_ONE, GL_ONE);
+   glDepthMask(GL_FALSE);
+   glUseProgram(q->drawProgram);
+   glUniform1i(glGetUniformLocation(q->drawProgram, "lighting"),
+               glIsEnabled(GL_LIGHTING));
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   for (i = 0; i < q->count; i++) {
+      glLoadMatrixf(q->items[i].matrix);
+      q->items[i].draw(q->items[i].data);
+   }
+   glPopMatrix();
+
+/*  composite the average color over the scene by the coverage  */
+   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+   glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+   glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+   glDisable(GL_DEPTH_TEST);
+   glDisable(GL_LIGHTING);
+   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+   glUseProgram(q->resolveProgram);
+   glActiveTexture(GL_TEXTURE1);
+   glBindTexture(GL_TEXTURE_2D, q->reveal);
+   glActiveTexture(GL_TEXTURE0);
+   glBindTexture(GL_TEXTURE_2D, q->accum);
+   glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+   glDisableClientState(GL_NORMAL_ARRAY);
+   glDisableClientState(GL_COLOR_ARRAY);
+   glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glVertexPointer(2, GL_FLOAT, 0, quad);
+   glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+   glPopClientAttrib();
+   glUseProgram(0);
+   glPopAttrib();
+}
+
+int transparentWeightedSupported(void)
+{
+   return shaderGLVersion(3, 0);
+}
+#else
+static void flushWeighted(TransparentQueue *q)
+{
+   flushSorted(q);
+}
+
+int transparentWeightedSupported(void)
+{
+   return 0;
+}
+#endif
+
+void transparentFlush(TransparentQueue *q)
+{
+   if (q->count > 0) {
+      if (q->mode == TRANSPARENT_WEIGHTED && transparentWeightedSupported())
+         flushWeighted(q);
+      else
+         flushSorted(q);
+   }
+   q->count = 0;
+}
@@ -0,0 +1,79 @@
+/*
+ *  transparent.h
+ *  Transparent draws.  Objects are submitted with a center point and
+ *  a draw callback while the opaque scene is drawn, and are drawn
+ *  after it by transparentFlush(), with depth writes off, in one of
+ *  two modes:
+ *
+ *     TRANSPARENT_SORTED    back to front by the view depth of each
+ *                           center, with GL_SRC_ALPHA,
+ *                           GL_ONE_MINUS_SRC_ALPHA blending.  The
+ *                           depths are radix sorted, on the worker
+ *                           pool (jobs.h) when there are many.
+ *     TRANSPARENT_WEIGHTED  weighted blended order independent
+ *                           transparency (McGuire and Bavoil, 2013):
+ *                           no sorting; colors are accumulated with a
+ *                           depth based weight into floating point
+ *                           targets and resolved over the scene.
+ *                           Needs OpenGL 3.0; the queue falls back to
+ *                           sorting without it.
+ *
+ *  The modelview matrix current at submission is restored for each
+ *  draw.  The weighted mode lights with the built-in light 0 and the
+ *  front material when lighting is enabled, and otherwise uses the
+ *  current color, so callbacks set materials and colors as usual.
+ *  It tests against the depth buffer of the framebuffer that is bound
+ *  when the queue is flushed, which is copied with glBlitFramebuffer()
+ *  and so must be a 24 bit depth, 8 bit stencil buffer or none.
+ */
+#ifndef TRANSPARENT_H
+#define TRANSPARENT_H
+
+#define TRANSPARENT_SORTED    0
+#define TRANSPARENT_WEIGHTED  1
+
+#define TRANSPARENT_PARALLEL_MIN  8192
+
+typedef void (*TransparentDrawFunc)(void *data);
+
+typedef struct transparentitem {
+   GLfloat              matrix[16];
+   TransparentDrawFunc  draw;
+   void                *data;
+} TransparentItem;
+
+typedef struct transparentqueue {
+   int               mode;
+   TransparentItem  *items;
+   unsigned          count, capacity;
+   unsigned         *keys;          /* key, item index pairs */
+   unsigned         *scratch;
+   unsigned          parallelMin;   /* items from which sorts use the
+                                       job pool */
+   int               sortPasses;    /* radix passes of the last sort */
+   int               sortChunks;    /* jobs per pass, 1 when serial */
+
+   /* weighted mode targets */
+   GLuint            fbo, accum, reveal, depth;
+   GLsizei           width, height;
+   GLuint            drawProgram, resolveProgram;
+} TransparentQueue;
+
+void transparentInit(TransparentQueue *q, int mode);
+void transparentFree(TransparentQueue *q);
+
+/*  Whether TRANSPARENT_WEIGHTED can be used in this context.  */
+int transparentWeightedSupported(void);
+
+void transparentSubmit(TransparentQueue *q, const GLfloat center[3],
+                       TransparentDrawFunc draw, void *data);
+
+/*  Sort the submitted items back to front.  transparentFlush() does
+ *  this itself in TRANSPARENT_SORTED mode.
+ */
+void transparentSort(TransparentQueue *q);
+
+/*  Draw the submitted items and empty the queue.  */
+void transparentFlush(TransparentQueue *q);
+
+#endif
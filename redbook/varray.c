@@ -37,14 +37,30 @@
 
 /*
  *  varray.c
- *  This program demonstrates vertex arrays.
+ *  This program demonstrates vertex arrays.  The left mouse
+ *  button cycles through client-side separate arrays, client-side
+ *  interleaved arrays, a packed vertex buffer object and vertices
+ *  written into a streaming ring buffer every frame; the other
+ *  buttons cycle through the ways of dereferencing the arrays.
+ *  Press 's' for streaming statistics and 'b' to time streaming a
+ *  wave of points written by the worker threads.
  */
+#define GL_GLEXT_PROTOTYPES
 #include <GL/glut.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jobs.h"
+#include "stream.h"
+#include "timer.h"
+#include "vformat.h"
 
 #ifdef GL_VERSION_1_1
 #define POINTER 1
 #define INTERLEAVED 2
+#define PACKED 3
+#define STREAMED 4
 
 #define DRAWARRAY 1
 #define ARRAYELEMENT  2
@@ -53,21 +69,21 @@
 int setupMethod = POINTER;
 int derefMethod = DRAWARRAY;
 
+static GLint vertices[] = {25, 25,
+                    100, 325,
+                    175, 25,
+                    175, 325,
+                    250, 25,
+                    325, 325};
+static GLfloat colors[] = {1.0, 0.2, 0.2,
+                    0.2, 0.2, 1.0,
+                    0.8, 1.0, 0.2,
+                    0.75, 0.75, 0.75,
+                    0.35, 0.35, 0.35,
+                    0.5, 0.5, 0.5};
+
 void setupPointers(void)
 {
-   static GLint vertices[] = {25, 25,
-                       100, 325,
-                       175, 25,
-                       175, 325,
-                       250, 25,
-                       325, 325};
-   static GLfloat colors[] = {1.0, 0.2, 0.2,
-                       0.2, 0.2, 1.0,
-                       0.8, 1.0, 0.2,
-                       0.75, 0.75, 0.75,
-                       0.35, 0.35, 0.35,
-                       0.5, 0.5, 0.5};
-
    glEnableClientState (GL_VERTEX_ARRAY);
    glEnableClientState (GL_COLOR_ARRAY);
 
@@ -88,16 +104,214 @@ void setupInterleave(void)
    glInterleavedArrays (GL_C3F_V3F, 0, intertwined);
 }
 
+#ifdef GL_VERSION_1_5
+static VertexBuffer packed;
+
+/*  Pack the same vertices and colors into a buffer object, in the
+ *  smallest layout vformat finds for them, and point the arrays at it.
+ */
+void setupPacked(void)
+{
+   if (packed.vbo == 0) {
+      GLfloat pos[6][3];
+      VertexSource src;
+      VertexLayout l, f;
+      char name[80];
+      int i;
+
+      for (i = 0; i < 6; i++) {
+         pos[i][0] = vertices[i*2];
+         pos[i][1] = vertices[i*2+1];
+         pos[i][2] = 0.0;
+      }
+      memset(&src, 0, sizeof(src));
+      src.count = 6;
+      src.position = &pos[0][0];
+      src.color = colors;
+      src.colorSize = 3;
+      vertexLayoutChoose(&l, &src);
+      vertexLayoutFloat(&f, &src);
+      vertexBufferCreate(&packed, &l, &src);
+      printf("packed layout %s, float layout %d bytes\n",
+             vertexLayoutName(&l, name, sizeof(name)), (int) f.stride);
+   }
+   vertexBufferBind(&packed);
+}
+
+void cleanupPacked(void)
+{
+   vertexBufferUnbind(&packed);
+}
+
+#define BUFFER_OFFSET(bytes) ((const GLubyte *) NULL + (bytes))
+
+static StreamBuffer stream;
+
+/*  Write this frame's vertices into the ring and point the arrays at
+ *  them, as a program whose geometry moves would every frame.
+ */
+void setupStreamed(void)
+{
+   GLfloat *v;
+   size_t offset;
+   int i;
+
+   streamBegin(&stream);
+   v = (GLfloat *) streamAlloc(&stream, 6 * 6 * sizeof(GLfloat), &offset);
+   if (v == NULL)
+      return;
+   for (i = 0; i < 6; i++) {
+      v[i*6] = colors[i*3];
+      v[i*6+1] = colors[i*3+1];
+      v[i*6+2] = colors[i*3+2];
+      v[i*6+3] = vertices[i*2];
+      v[i*6+4] = vertices[i*2+1];
+      v[i*6+5] = 0.0;
+   }
+   streamUpload(&stream);
+   glBindBuffer(GL_ARRAY_BUFFER, stream.vbo);
+   glInterleavedArrays(GL_C3F_V3F, 0, BUFFER_OFFSET(offset));
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*
+ *  Streaming benchmark: a wave of points, its colors and positions
+ *  worked out again each frame, in pieces, by the worker threads.
+ *  Client arrays, which GL copies at each draw, are the baseline.
+ */
+#define WAVE_POINTS  250000
+#define WAVE_PIECES  50
+#define WAVE_FRAMES  30
+
+typedef struct wavevertex {
+   GLubyte color[4];
+   GLfloat x, y;
+} WaveVertex;
+
+typedef struct wave {
+   WaveVertex *verts;
+   float       t;
+} Wave;
+
+static void fillWave(int piece, void *user)
+{
+   Wave *w = (Wave *) user;
+   int i, n = WAVE_POINTS / WAVE_PIECES;
+
+   for (i = piece * n; i < (piece + 1) * n; i++) {
+      WaveVertex *v = &w->verts[i];
+      float u = (float) i / WAVE_POINTS;
+      float h = sin(u * 40.0 + w->t) * 0.5 + 0.5;
+
+      v->x = u * 350.0;
+      v->y = 175.0 + 150.0 * (h - 0.5) * cos(i * 0.01);
+      v->color[0] = (GLubyte) (255 * h);
+      v->color[1] = (GLubyte) (255 * u);
+      v->color[2] = (GLubyte) (255 * (1.0 - h));
+      v->color[3] = 255;
+   }
+}
+
+static void drawWave(const GLvoid *verts)
+{
+   glInterleavedArrays(GL_C4UB_V2F, 0, verts);
+   glDrawArrays(GL_POINTS, 0, WAVE_POINTS);
+}
+
+/*  Seconds a frame for WAVE_FRAMES frames, from a stream or, without
+ *  one, from client memory.
+ */
+static double timeWave(StreamBuffer *s)
+{
+   static WaveVertex client[WAVE_POINTS];
+   Wave w;
+   size_t offset = 0;
+   double t0;
+   int f;
+
+   glFinish();
+   t0 = timerSeconds();
+   for (f = 0; f < WAVE_FRAMES; f++) {
+      w.t = f * 0.2f;
+      if (s) {
+         streamBegin(s);
+         w.verts = (WaveVertex *)
+            streamAlloc(s, WAVE_POINTS * sizeof(WaveVertex), &offset);
+         if (w.verts == NULL) {
+            streamEnd(s);
+            continue;
+         }
+      } else
+         w.verts = client;
+      glClear(GL_COLOR_BUFFER_BIT);
+      jobsParallelFor(WAVE_PIECES, fillWave, &w);
+      if (s) {
+         streamUpload(s);
+         glBindBuffer(GL_ARRAY_BUFFER, s->vbo);
+         drawWave(BUFFER_OFFSET(offset));
+         glBindBuffer(GL_ARRAY_BUFFER, 0);
+         streamEnd(s);
+      } else
+         drawWave(client);
+      glFlush();
+   }
+   glFinish();
+   return (timerSeconds() - t0) / WAVE_FRAMES;
+}
+
+static void streamBenchmark(void)
+{
+   StreamBuffer orphan, mapped;
+   double t;
+
+   printf("%d points of %d bytes, %d frames\n", WAVE_POINTS,
+          (int) sizeof(WaveVertex), WAVE_FRAMES);
+   t = timeWave(NULL);
+   printf("client arrays: %.3f ms a frame\n", t * 1000.0);
+
+   streamInit(&orphan, WAVE_POINTS * sizeof(WaveVertex), 0);
+   t = timeWave(&orphan);
+   printf("%.3f ms a frame\n", t * 1000.0);
+   streamPrintStats("stream", &orphan);
+   streamFree(&orphan);
+
+   streamInit(&mapped, WAVE_POINTS * sizeof(WaveVertex), 1);
+   if (mapped.persistent) {
+      t = timeWave(&mapped);
+      printf("%.3f ms a frame\n", t * 1000.0);
+      streamPrintStats("stream", &mapped);
+   } else
+      printf("no persistent mapping without OpenGL 4.4\n");
+   streamFree(&mapped);
+
+   /*  put back the arrays of the current method  */
+   if (setupMethod == POINTER)
+      setupPointers();
+   else if (setupMethod == INTERLEAVED)
+      setupInterleave();
+   else if (setupMethod == PACKED)
+      setupPacked();
+   glutPostRedisplay();
+}
+#endif
+
 void init(void) 
 {
    glClearColor (0.0, 0.0, 0.0, 0.0);
    glShadeModel (GL_SMOOTH);
    setupPointers ();
+#ifdef GL_VERSION_1_5
+   streamInit(&stream, 4096, 1);
+#endif
 }
 
 void display(void)
 {
    glClear (GL_COLOR_BUFFER_BIT);
+#ifdef GL_VERSION_1_5
+   if (setupMethod == STREAMED)
+      setupStreamed();
+#endif
 
    if (derefMethod == DRAWARRAY) 
       glDrawArrays (GL_TRIANGLES, 0, 6);
@@ -113,6 +327,10 @@ void display(void)
 
       glDrawElements (GL_POLYGON, 4, GL_UNSIGNED_INT, indices);
    }
+#ifdef GL_VERSION_1_5
+   if (setupMethod == STREAMED)
+      streamEnd(&stream);
+#endif
    glFlush ();
 }
 
@@ -133,10 +351,26 @@ void mouse (int button, int state, int x, int y)
                setupMethod = INTERLEAVED;
                setupInterleave();
             }
+#ifdef GL_VERSION_1_5
             else if (setupMethod == INTERLEAVED) {
+               glDisableClientState (GL_COLOR_ARRAY);
+               setupMethod = PACKED;
+               setupPacked();
+            }
+            else if (setupMethod == PACKED) {
+               cleanupPacked();
+               setupMethod = STREAMED;
+            }
+            else if (setupMethod == STREAMED) {
                setupMethod = POINTER;
                setupPointers();
             }
+#else
+            else if (setupMethod == INTERLEAVED) {
+               setupMethod = POINTER;
+               setupPointers();
+            }
+#endif
             glutPostRedisplay();
          }
          break;
@@ -160,6 +394,16 @@ void mouse (int button, int state, int x, int y)
 void keyboard(unsigned char key, int x, int y)
 {
    switch (key) {
+#ifdef GL_VERSION_1_5
+      case 's':
+      case 'S':
+         streamPrintStats("stream", &stream);
+         break;
+      case 'b':
+      case 'B':
+         streamBenchmark();
+         break;
+#endif
       case 27:
          exit(0);
          break;
@@ -0,0 +1,421 @@
+/*
+ *  vformat.c
+ *  Vertex layouts and packing.  See vformat.h.
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vformat.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT 0x140B
+#endif
+#ifndef GL_INT_2_10_10_10_REV
+#define GL_INT_2_10_10_10_REV 0x8D9F
+#endif
+
+#define BUFFER_OFFSET(bytes) ((const GLubyte *) NULL + (bytes))
+
+/*  every format has a size, and sizes keep 4 byte alignment  */
+VF_STATIC_ASSERT(vf_half4_size, VF_SIZE(VF_HALF4) == 4 * sizeof(GLushort));
+VF_STATIC_ASSERT(vf_half2_size, VF_SIZE(VF_HALF2) == 2 * sizeof(GLushort));
+VF_STATIC_ASSERT(vf_snorm10_size, VF_SIZE(VF_SNORM10) == sizeof(GLuint));
+VF_STATIC_ASSERT(vf_unorm8_size, VF_SIZE(VF_UNORM8) == 4 * sizeof(GLubyte));
+VF_STATIC_ASSERT(vf_float3_size, VF_SIZE(VF_FLOAT3) == 3 * sizeof(GLfloat));
+
+static int packedSupported = -1;
+
+/*  Half floats and 2_10_10_10 vertex data are core in OpenGL 3.3.  */
+static int packedFormats(void)
+{
+   if (packedSupported < 0) {
+      const char *v = (const char *) glGetString(GL_VERSION);
+      int major = 0, minor = 0;
+
+      if (v != NULL)
+         sscanf(v, "%d.%d", &major, &minor);
+      packedSupported = major > 3 || (major == 3 && minor >= 3);
+   }
+   return packedSupported;
+}
+
+static void setLayout(VertexLayout *l, int p, int n, int c, int t)
+{
+   int fmt[VA_COUNT], i, off = 0;
+
+   fmt[VA_POSITION] = p;
+   fmt[VA_NORMAL] = n;
+   fmt[VA_COLOR] = c;
+   fmt[VA_TEXCOORD] = t;
+   for (i = 0; i < VA_COUNT; i++) {
+      l->attr[i].format = (unsigned char) fmt[i];
+      l->attr[i].offset = (unsigned char) off;
+      off += VF_SIZE(fmt[i]);
+   }
+   l->stride = off;
+}
+
+void vertexLayoutFloat(VertexLayout *l, const VertexSource *src)
+{
+   setLayout(l, VF_FLOAT3,
+             src->normal ? VF_FLOAT3 : VF_NONE,
+             src->color ? (src->colorSize == 4 ? VF_FLOAT4 : VF_FLOAT3)
+                        : VF_NONE,
+             src->texcoord ? VF_FLOAT2 : VF_NONE);
+}
+
+/*  element i of a strided float source array of n components  */
+static const GLfloat *srcAt(const GLfloat *p, GLsizei stride, int n, GLuint i)
+{
+   if (stride == 0)
+      stride = n * sizeof(GLfloat);
+   return (const GLfloat *) ((const char *) p + (size_t) i * stride);
+}
+
+void vertexLayoutChoose(VertexLayout *l, const VertexSource *src)
+{
+   GLfloat lo[3], hi[3], maxabs = 0.0, extent = 0.0;
+   int p = VF_FLOAT3, n = VF_NONE, c = VF_NONE, t = VF_NONE;
+   GLuint i;
+   int k, unit = 1, small = 1;
+
+   if (src->count > 0 && packedFormats()) {
+      for (k = 0; k < 3; k++)
+         lo[k] = hi[k] = src->position[k];
+      for (i = 0; i < src->count; i++) {
+         const GLfloat *v = srcAt(src->position, src->positionStride, 3, i);
+         for (k = 0; k < 3; k++) {
+            if (v[k] < lo[k]) lo[k] = v[k];
+            if (v[k] > hi[k]) hi[k] = v[k];
+            if (fabs(v[k]) > maxabs) maxabs = fabs(v[k]);
+         }
+      }
+      for (k = 0; k < 3; k++)
+         if (hi[k] - lo[k] > extent)
+            extent = hi[k] - lo[k];
+   /*  a half keeps 11 significant bits; keep the error within
+    *  1/1024 of the extent of the mesh
+    */
+      if (extent > 0.0 && maxabs <= 2.0 * extent && maxabs <= 65504.0)
+         p = VF_HALF4;
+   }
+
+   if (src->normal)
+      n = packedFormats() ? VF_SNORM10 : VF_FLOAT3;
+
+   if (src->color) {
+      for (i = 0; i < src->count && unit; i++) {
+         const GLfloat *v = srcAt(src->color, src->colorStride,
+                                  src->colorSize, i);
+         for (k = 0; k < src->colorSize; k++)
+            if (v[k] < 0.0 || v[k] > 1.0)
+               unit = 0;
+      }
+      c = unit ? VF_UNORM8 : (src->colorSize == 4 ? VF_FLOAT4 : VF_FLOAT3);
+   }
+
+   if (src->texcoord) {
+      for (i = 0; i < src->count && small; i++) {
+         const GLfloat *v = srcAt(src->texcoord, src->texcoordStride, 2, i);
+         if (fabs(v[0]) > 1.0 || fabs(v[1]) > 1.0)
+            small = 0;
+      }
+      t = small && packedFormats() ? VF_HALF2 : VF_FLOAT2;
+   }
+
+   setLayout(l, p, n, c, t);
+}
+
+#ifndef __SSE2__
+/*  Float to half conversion with round to nearest even, overflow to
+ *  infinity and NaN preserved (after F. Giesen, "float->half variants").
+ */
+static GLushort floatToHalf(GLfloat f)
+{
+   union { GLfloat f; GLuint u; } v, magic;
+   GLuint sign, u;
+   GLushort h;
+
+   v.f = f;
+   sign = v.u & 0x80000000U;
+   u = v.u ^ sign;
+   if (u >= (GLuint) (127 + 16) << 23)
+      h = (u > 0x7f800000U) ? 0x7e00 : 0x7c00;
+   else if (u < (GLuint) (127 - 14) << 23) {
+      magic.u = (GLuint) ((127 - 15) + (23 - 10) + 1) << 23;
+      v.u = u;
+      v.f += magic.f;
+      h = (GLushort) (v.u - magic.u);
+   }
+   else {
+      GLuint odd = (u >> 13) & 1;
+      u += ((GLuint) (15 - 127) << 23) + 0xfff;
+      u += odd;
+      h = (GLushort) (u >> 13);
+   }
+   return (GLushort) (h | (sign >> 16));
+}
+#endif
+
+#ifdef __SSE2__
+/*  Four lanes of floatToHalf(); each 32-bit lane holds a half in its
+ *  low 16 bits, sign extended so _mm_packs_epi32() keeps it intact.
+ */
+static __m128i floatToHalf4(__m128 f)
+{
+   const __m128i f16max = _mm_set1_epi32((127 + 16) << 23);
+   const __m128i minnormal = _mm_set1_epi32((127 - 14) << 23);
+   const __m128i submagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+   const __m128i bias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+   __m128 justsign = _mm_and_ps(f, _mm_castsi128_ps(
+                                   _mm_set1_epi32((int) 0x80000000U)));
+   __m128 absf = _mm_xor_ps(f, justsign);
+   __m128i absi = _mm_castps_si128(absf);
+   __m128i isnan = _mm_castps_si128(_mm_cmpunord_ps(absf, absf));
+   __m128i regular = _mm_cmpgt_epi32(f16max, absi);
+   __m128i special = _mm_or_si128(_mm_and_si128(isnan, _mm_set1_epi32(0x200)),
+                                  _mm_set1_epi32(0x7c00));
+   __m128i issub = _mm_cmpgt_epi32(minnormal, absi);
+   __m128i sub = _mm_sub_epi32(_mm_castps_si128(
+                    _mm_add_ps(absf, _mm_castsi128_ps(submagic))), submagic);
+   __m128i odd = _mm_srai_epi32(_mm_slli_epi32(absi, 31 - 13), 31);
+   __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absi, bias),
+                                                 odd), 13);
+   __m128i h = _mm_or_si128(_mm_and_si128(issub, sub),
+                            _mm_andnot_si128(issub, normal));
+
+   h = _mm_or_si128(_mm_and_si128(regular, h),
+                    _mm_andnot_si128(regular, special));
+   return _mm_or_si128(h, _mm_srai_epi32(_mm_castps_si128(justsign), 16));
+}
+#endif
+
+static void packHalf(GLushort *dst, const GLfloat *v, int n, GLfloat w)
+{
+#ifdef __SSE2__
+   __m128i h = floatToHalf4(_mm_setr_ps(v[0], v[1], n > 2 ? v[2] : w, w));
+   h = _mm_packs_epi32(h, h);
+   if (n == 2)
+      *(GLuint *) dst = (GLuint) _mm_cvtsi128_si32(h);
+   else
+      _mm_storel_epi64((__m128i *) dst, h);
+#else
+   dst[0] = floatToHalf(v[0]);
+   dst[1] = floatToHalf(v[1]);
+   if (n > 2) {
+      dst[2] = floatToHalf(v[2]);
+      dst[3] = floatToHalf(w);
+   }
+#endif
+}
+
+/*  x, y, z in the low 30 bits, w = 0; each a signed 10 bit value
+ *  scaled by 511.
+ */
+static GLuint packSnorm10(const GLfloat *v)
+{
+   GLint q[4];
+#ifdef __SSE2__
+   __m128 x = _mm_setr_ps(v[0], v[1], v[2], 0.0f);
+   x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+   _mm_storeu_si128((__m128i *) q,
+                    _mm_and_si128(_mm_cvtps_epi32(
+                                     _mm_mul_ps(x, _mm_set1_ps(511.0f))),
+                                  _mm_set1_epi32(0x3ff)));
+#else
+   int k;
+   for (k = 0; k < 3; k++) {
+      GLfloat c = v[k] < -1.0 ? -1.0 : (v[k] > 1.0 ? 1.0 : v[k]);
+      q[k] = (GLint) floor(c * 511.0 + 0.5) & 0x3ff;
+   }
+#endif
+   return (GLuint) q[0] | ((GLuint) q[1] << 10) | ((GLuint) q[2] << 20);
+}
+
+static GLuint packUnorm8(const GLfloat *v, int n)
+{
+   GLfloat a = n == 4 ? v[3] : 1.0f;
+#ifdef __SSE2__
+   __m128 x = _mm_setr_ps(v[0], v[1], v[2], a);
+   __m128i q;
+   x = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+   q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(255.0f)));
+   q = _mm_packs_epi32(q, q);
+   q = _mm_packus_epi16(q, q);
+   return (GLuint) _mm_cvtsi128_si32(q);
+#else
+   GLubyte b[4];
+   GLfloat c[4];
+   GLuint r;
+   int k;
+
+   c[0] = v[0]; c[1] = v[1]; c[2] = v[2]; c[3] = a;
+   for (k = 0; k < 4; k++) {
+      GLfloat x = c[k] < 0.0 ? 0.0 : (c[k] > 1.0 ? 1.0 : c[k]);
+      b[k] = (GLubyte) floor(x * 255.0 + 0.5);
+   }
+   memcpy(&r, b, 4);
+   return r;
+#endif
+}
+
+static void packAttrib(char *dst, int format, const GLfloat *v, int n)
+{
+   switch (format) {
+      case VF_FLOAT2:
+         memcpy(dst, v, 2 * sizeof(GLfloat));
+         break;
+      case VF_FLOAT3:
+         memcpy(dst, v, 3 * sizeof(GLfloat));
+         break;
+      case VF_FLOAT4:
+         memcpy(dst, v, 3 * sizeof(GLfloat));
+         ((GLfloat *) dst)[3] = n == 4 ? v[3] : 1.0f;
+         break;
+      case VF_HALF2:
+         packHalf((GLushort *) dst, v, 2, 0.0f);
+         break;
+      case VF_HALF4:
+         packHalf((GLushort *) dst, v, 3, 1.0f);
+         break;
+      case VF_SNORM10:
+         *(GLuint *) dst = packSnorm10(v);
+         break;
+      case VF_UNORM8:
+         *(GLuint *) dst = packUnorm8(v, n);
+         break;
+   }
+}
+
+void vertexPack(void *dst, const VertexLayout *l, const VertexSource *src)
+{
+   char *out = (char *) dst;
+   const VertexAttrib *a = l->attr;
+   GLuint i;
+
+   for (i = 0; i < src->count; i++, out += l->stride) {
+      packAttrib(out + a[VA_POSITION].offset, a[VA_POSITION].format,
+                 srcAt(src->position, src->positionStride, 3, i), 3);
+      if (a[VA_NORMAL].format != VF_NONE)
+         packAttrib(out + a[VA_NORMAL].offset, a[VA_NORMAL].format,
+                    srcAt(src->normal, src->normalStride, 3, i), 3);
+      if (a[VA_COLOR].format != VF_NONE)
+         packAttrib(out + a[VA_COLOR].offset, a[VA_COLOR].format,
+                    srcAt(src->color, src->colorStride, src->colorSize, i),
+                    src->colorSize);
+      if (a[VA_TEXCOORD].format != VF_NONE)
+         packAttrib(out + a[VA_TEXCOORD].offset, a[VA_TEXCOORD].format,
+                    srcAt(src->texcoord, src->texcoordStride, 2, i), 2);
+   }
+}
+
+void vertexBufferCreate(VertexBuffer *vb, const VertexLayout *l,
+                        const VertexSource *src)
+{
+   void *data = malloc(src->count * l->stride + 16);
+
+   if (data == NULL) {
+      printf("vertexBufferCreate: out of memory\n");
+      exit(1);
+   }
+   vertexPack(data, l, src);
+   vb->layout = *l;
+   vb->count = src->count;
+   glGenBuffers(1, &vb->vbo);
+   glBindBuffer(GL_ARRAY_BUFFER, vb->vbo);
+   glBufferData(GL_ARRAY_BUFFER, src->count * l->stride, data,
+                GL_STATIC_DRAW);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   free(data);
+}
+
+void vertexBufferDelete(VertexBuffer *vb)
+{
+   glDeleteBuffers(1, &vb->vbo);
+   vb->vbo = 0;
+}
+
+void vertexLayoutEnable(const VertexLayout *l, GLsizei base)
+{
+   const VertexAttrib *a = l->attr;
+   GLsizei s = l->stride;
+
+   glEnableClientState(GL_VERTEX_ARRAY);
+   if (a[VA_POSITION].format == VF_HALF4)
+      glVertexPointer(3, GL_HALF_FLOAT, s, BUFFER_OFFSET(base));
+   else
+      glVertexPointer(3, GL_FLOAT, s, BUFFER_OFFSET(base));
+
+   if (a[VA_NORMAL].format != VF_NONE) {
+      glEnableClientState(GL_NORMAL_ARRAY);
+      glNormalPointer(a[VA_NORMAL].format == VF_SNORM10 ?
+                      GL_INT_2_10_10_10_REV : GL_FLOAT, s,
+                      BUFFER_OFFSET(base + a[VA_NORMAL].offset));
+   }
+
+   if (a[VA_COLOR].format != VF_NONE) {
+      glEnableClientState(GL_COLOR_ARRAY);
+      if (a[VA_COLOR].format == VF_UNORM8)
+         glColorPointer(4, GL_UNSIGNED_BYTE, s,
+                        BUFFER_OFFSET(base + a[VA_COLOR].offset));
+      else
+         glColorPointer(a[VA_COLOR].format == VF_FLOAT4 ? 4 : 3, GL_FLOAT, s,
+                        BUFFER_OFFSET(base + a[VA_COLOR].offset));
+   }
+
+   if (a[VA_TEXCOORD].format != VF_NONE) {
+      glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+      glTexCoordPointer(2, a[VA_TEXCOORD].format == VF_HALF2 ?
+                        GL_HALF_FLOAT : GL_FLOAT, s,
+                        BUFFER_OFFSET(base + a[VA_TEXCOORD].offset));
+   }
+}
+
+void vertexLayoutDisable(const VertexLayout *l)
+{
+   if (l->attr[VA_TEXCOORD].format != VF_NONE)
+      glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+   if (l->attr[VA_COLOR].format != VF_NONE)
+      glDisableClientState(GL_COLOR_ARRAY);
+   if (l->attr[VA_NORMAL].format != VF_NONE)
+      glDisableClientState(GL_NORMAL_ARRAY);
+   glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void vertexBufferBind(const VertexBuffer *vb)
+{
+   glBindBuffer(GL_ARRAY_BUFFER, vb->vbo);
+   vertexLayoutEnable(&vb->layout, 0);
+}
+
+void vertexBufferUnbind(const VertexBuffer *vb)
+{
+   vertexLayoutDisable(&vb->layout);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*  e.g. "half4 snorm10 unorm8 - (16 bytes)"  */
+const char *vertexLayoutName(const VertexLayout *l, char *buf, int size)
+{
+   static const char *names[] = {
+      "-", "float2", "float3", "float4", "half2", "half4",
+      "snorm10", "unorm8"
+   };
+   char tmp[80];
+
+   sprintf(tmp, "%s %s %s %s (%d bytes)",
+           names[l->attr[VA_POSITION].format],
+           names[l->attr[VA_NORMAL].format],
+           names[l->attr[VA_COLOR].format],
+           names[l->attr[VA_TEXCOORD].format], (int) l->stride);
+   strncpy(buf, tmp, size - 1);
+   buf[size - 1] = '\0';
+   return buf;
+}
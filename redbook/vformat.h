@@ -0,0 +1,132 @@
+/*
+ *  vformat.h
+ *  Vertex layouts.  A layout names a storage format for each vertex
+ *  attribute and the byte offsets that follow from them.  Source data
+ *  is always plain floats; vertexPack() converts it into a layout,
+ *  using SSE2 where available, and vertexBufferCreate() uploads the
+ *  result into a buffer object.
+ *
+ *  Packed formats:
+ *     VF_HALF4    position as 4 half floats (xyz, w = 1), 8 bytes
+ *     VF_HALF2    texture coordinate as 2 half floats, 4 bytes
+ *     VF_SNORM10  normal as GL_INT_2_10_10_10_REV, 4 bytes
+ *     VF_UNORM8   color as 4 unsigned bytes, 4 bytes
+ *
+ *  Half floats and 2_10_10_10 need OpenGL 3.3; on older contexts
+ *  vertexLayoutChoose() only picks the float formats and VF_UNORM8.
+ *
+ *  Layouts are declared with DEFINE_VERTEX_LAYOUT(), which checks at
+ *  compile time that each attribute uses a format valid for it:
+ *
+ *     DEFINE_VERTEX_LAYOUT(terrainLayout,
+ *                          VF_HALF4, VF_SNORM10, VF_UNORM8, VF_NONE);
+ */
+#ifndef VFORMAT_H
+#define VFORMAT_H
+
+enum {
+   VA_POSITION,
+   VA_NORMAL,
+   VA_COLOR,
+   VA_TEXCOORD,
+   VA_COUNT
+};
+
+enum {
+   VF_NONE,
+   VF_FLOAT2,
+   VF_FLOAT3,
+   VF_FLOAT4,
+   VF_HALF2,
+   VF_HALF4,
+   VF_SNORM10,
+   VF_UNORM8
+};
+
+#define VF_SIZE(f) \
+   ((f) == VF_FLOAT2 ? 8 : (f) == VF_FLOAT3 ? 12 : (f) == VF_FLOAT4 ? 16 : \
+    (f) == VF_HALF2 ? 4 : (f) == VF_HALF4 ? 8 : \
+    (f) == VF_SNORM10 ? 4 : (f) == VF_UNORM8 ? 4 : 0)
+
+/*  formats each attribute may be stored in  */
+#define VF_IS_POSITION(f) ((f) == VF_FLOAT3 || (f) == VF_HALF4)
+#define VF_IS_NORMAL(f)   ((f) == VF_NONE || (f) == VF_FLOAT3 || \
+                           (f) == VF_SNORM10)
+#define VF_IS_COLOR(f)    ((f) == VF_NONE || (f) == VF_FLOAT3 || \
+                           (f) == VF_FLOAT4 || (f) == VF_UNORM8)
+#define VF_IS_TEXCOORD(f) ((f) == VF_NONE || (f) == VF_FLOAT2 || \
+                           (f) == VF_HALF2)
+
+typedef struct vertexattrib {
+   unsigned char format;
+   unsigned char offset;
+} VertexAttrib;
+
+typedef struct vertexlayout {
+   VertexAttrib attr[VA_COUNT];
+   GLsizei      stride;
+} VertexLayout;
+
+#define VERTEX_LAYOUT_INIT(p, n, c, t) \
+   { { { (p), 0 }, \
+       { (n), VF_SIZE(p) }, \
+       { (c), VF_SIZE(p) + VF_SIZE(n) }, \
+       { (t), VF_SIZE(p) + VF_SIZE(n) + VF_SIZE(c) } }, \
+     VF_SIZE(p) + VF_SIZE(n) + VF_SIZE(c) + VF_SIZE(t) }
+
+#define VF_STATIC_ASSERT(name, cond) typedef char name[(cond) ? 1 : -1]
+
+#define DEFINE_VERTEX_LAYOUT(name, p, n, c, t) \
+   VF_STATIC_ASSERT(name##_position_format, VF_IS_POSITION(p)); \
+   VF_STATIC_ASSERT(name##_normal_format, VF_IS_NORMAL(n)); \
+   VF_STATIC_ASSERT(name##_color_format, VF_IS_COLOR(c)); \
+   VF_STATIC_ASSERT(name##_texcoord_format, VF_IS_TEXCOORD(t)); \
+   static const VertexLayout name = VERTEX_LAYOUT_INIT(p, n, c, t)
+
+/*  Float source arrays.  A NULL pointer means the attribute is
+ *  absent; a stride of 0 means tightly packed.  Colors are RGB when
+ *  colorSize is 3 and RGBA when it is 4.
+ */
+typedef struct vertexsource {
+   GLuint         count;
+   const GLfloat *position;  GLsizei positionStride;
+   const GLfloat *normal;    GLsizei normalStride;
+   const GLfloat *color;     GLsizei colorStride;  int colorSize;
+   const GLfloat *texcoord;  GLsizei texcoordStride;
+} VertexSource;
+
+typedef struct vertexbuffer {
+   GLuint       vbo;
+   GLuint       count;
+   VertexLayout layout;
+} VertexBuffer;
+
+/*  All-float layout for the attributes present in src.  */
+void vertexLayoutFloat(VertexLayout *l, const VertexSource *src);
+
+/*  Smallest layout that represents src within the format's
+ *  precision: half positions when the coordinates are small compared
+ *  to the mesh extent, 10-bit normals, 8-bit colors in [0, 1] and
+ *  half texture coordinates in [-1, 1].
+ */
+void vertexLayoutChoose(VertexLayout *l, const VertexSource *src);
+
+/*  Convert src into dst, which holds src->count * l->stride bytes.  */
+void vertexPack(void *dst, const VertexLayout *l, const VertexSource *src);
+
+void vertexBufferCreate(VertexBuffer *vb, const VertexLayout *l,
+                        const VertexSource *src);
+void vertexBufferDelete(VertexBuffer *vb);
+
+/*  Set the fixed-function array pointers for a layout whose vertices
+ *  start at byte offset base of the bound GL_ARRAY_BUFFER.
+ */
+void vertexLayoutEnable(const VertexLayout *l, GLsizei base);
+void vertexLayoutDisable(const VertexLayout *l);
+
+void vertexBufferBind(const VertexBuffer *vb);
+void vertexBufferUnbind(const VertexBuffer *vb);
+
+const char *vertexLayoutName(const VertexLayout *l, char *buf, int size);
+
+#endif
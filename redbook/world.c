@@ -0,0 +1,542 @@
+/*
+ *  world.c
+ *  This program flies over a streamed terrain of about 100 square
+ *  kilometers (terrain.h).  Chunks around the camera are generated on
+ *  worker threads and kept within a fixed memory budget; distant
+ *  chunks are drawn with fewer triangles and morph smoothly between
+ *  levels.  Every two seconds it prints the frame times and what is
+ *  resident.
+ *
+ *  The flight advances in fixed ticks of a game loop (loop.h) and is
+ *  drawn between them at 60 frames a second, so it covers the same
+ *  ground in the same time on any machine.
+ *
+ *  Interaction:
+ *  arrow keys - steer and climb
+ *  + and -    - fly faster or slower
+ *  space      - pause
+ *  m          - toggle geomorphing (needs OpenGL 2.0)
+ *  w          - toggle wireframe
+ *  f          - toggle sky and haze from the tables of atmosphere.h
+ *               (needs OpenGL 3.3) and fixed-function fog
+ *  h and H    - thin or thicken the haze
+ *  n and N    - lower or raise the sun
+ *  r          - turn the sun about the vertical
+ *  s          - print terrain, atmosphere and frame timing statistics
+ *  a          - time the allocators of arena.h against malloc()
+ *  b          - time building the atmosphere tables and shading with
+ *               them
+ *  ESC        - exit
+ */
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glut.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+#include "atmosphere.h"
+#include "loop.h"
+#include "terrain.h"
+#include "timer.h"
+
+#define PI_ 3.14159265358979323846
+
+#ifdef GL_VERSION_1_5
+#define ALTITUDE  150.0     /* above the ground ahead */
+#define MARGIN    1000.0    /* turn back this close to the edge */
+#define REPORT    2.0       /* seconds */
+#define TICK_RATE  60.0
+#define FRAME_RATE 60.0
+
+#define ALLOC_FRAMES     200
+#define ALLOC_ITEMS      4096     /* transient allocations per frame */
+#define ALLOC_JOB_ITEMS  512      /* scratch allocations per job */
+#define ALLOC_STEPS      (1 << 20)
+#define ALLOC_OBJECT     64       /* bytes, of the pooled objects */
+
+#define BENCH_FRAMES     20
+
+static Terrain terrain;
+static GLfloat eye[3], lastEye[3], view[3];
+static GLfloat heading = 45.0, lastHeading, viewHeading;
+static GLfloat pitch = -12.0, speed = 200.0;
+static int paused = 0, wireframe = 0;
+static GameLoop loop;
+
+static Atmosphere atmosphere;
+static int scattering = 1;
+static GLfloat sunElevation = 58.0, sunAzimuth = 53.0;    /* degrees */
+
+static double lastFrame, reportStart, worstFrame;
+static int frames;
+
+static void tick(double dt);
+
+static void init(void)
+{
+   static const GLfloat sky[4] = { 0.6, 0.75, 0.9, 1.0 };
+   static const GLfloat ambient[4] = { 0.35, 0.35, 0.35, 1.0 };
+   GLfloat size = TERRAIN_WORLD_CHUNKS * TERRAIN_CHUNK_SIZE;
+
+   terrainInit(&terrain, TERRAIN_WORLD_CHUNKS, TERRAIN_BUDGET);
+   eye[0] = eye[2] = size / 2;
+   eye[1] = terrainHeight(eye[0], eye[2]) + ALTITUDE;
+   lastEye[0] = view[0] = eye[0];
+   lastEye[1] = view[1] = eye[1];
+   lastEye[2] = view[2] = eye[2];
+   lastHeading = viewHeading = heading;
+
+   glClearColor(sky[0], sky[1], sky[2], sky[3]);
+   glEnable(GL_DEPTH_TEST);
+   glEnable(GL_LIGHTING);
+   glEnable(GL_LIGHT0);
+   glLightModelfv(GL_LIGHT_MODEL_AMBIENT, ambient);
+   glEnable(GL_COLOR_MATERIAL);
+   glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+   glEnable(GL_FOG);
+   glFogi(GL_FOG_MODE, GL_LINEAR);
+   glFogfv(GL_FOG_COLOR, sky);
+   glFogf(GL_FOG_START, terrain.loadRadius * 0.6f);
+   glFogf(GL_FOG_END, terrain.loadRadius);
+
+   atmosphereInit(&atmosphere);
+   atmosphereSetFade(&atmosphere, terrain.loadRadius * 0.6f,
+                     terrain.loadRadius);
+   scattering = atmosphereSupported(&atmosphere);
+
+   lastFrame = reportStart = timerSeconds();
+   loopInit(&loop, TICK_RATE, FRAME_RATE, tick);
+   loopStart(&loop);
+}
+
+/*  Fly forward, keeping clear of the ground ahead, and turn back at
+ *  the edges of the world.
+ */
+static void fly(GLfloat dt)
+{
+   GLfloat size = TERRAIN_WORLD_CHUNKS * TERRAIN_CHUNK_SIZE;
+   GLfloat dx = (GLfloat) -sin(heading * PI_ / 180.0);
+   GLfloat dz = (GLfloat) -cos(heading * PI_ / 180.0);
+   GLfloat ground, ahead, k;
+
+   eye[0] += dx * speed * dt;
+   eye[2] += dz * speed * dt;
+   if (eye[0] < MARGIN || eye[0] > size - MARGIN ||
+       eye[2] < MARGIN || eye[2] > size - MARGIN) {
+      GLfloat cx = size / 2 - eye[0], cz = size / 2 - eye[2];
+
+/*  until heading within 45 degrees of the center, in a circle of
+ *  radius MARGIN / 2 whatever the speed
+ */
+      if (dx * cx + dz * cz < 0.7f * sqrt(cx * cx + cz * cz))
+         heading += (GLfloat) (speed * dt / (MARGIN / 2) * 180.0 / PI_);
+   }
+
+   ground = terrainHeight(eye[0], eye[2]);
+   ahead = terrainHeight(eye[0] + dx * 300, eye[2] + dz * 300);
+   if (ahead > ground)
+      ground = ahead;
+   k = dt * 2 < 1 ? dt * 2 : 1;
+   eye[1] += (ground + ALTITUDE - eye[1]) * k;
+}
+
+static void tick(double dt)
+{
+   int i;
+
+   for (i = 0; i < 3; i++)
+      lastEye[i] = eye[i];
+   lastHeading = heading;
+   if (!paused)
+      fly((GLfloat) dt);
+}
+
+static void report(double now)
+{
+   double t = now - reportStart;
+
+   printf("%.1f fps, %.2f ms mean, %.2f ms worst; %d chunks, %.1f MB, "
+          "%d generating\n", frames / t, t * 1000.0 / frames, worstFrame,
+          terrain.resident, terrain.bytes / 1048576.0, terrain.pending);
+   reportStart = now;
+   frames = 0;
+   worstFrame = 0;
+}
+
+/*  The terrain, lit by the sun, and the sky and haze over it, from
+ *  view[] and viewHeading.
+ */
+static void drawScene(int withAtmosphere)
+{
+   GLfloat e = sunElevation * PI_ / 180.0, b = sunAzimuth * PI_ / 180.0;
+   GLfloat sun[4], light[4] = { 1.0, 1.0, 1.0, 1.0 };
+
+   sun[0] = (GLfloat) (cos(e) * sin(b));
+   sun[1] = (GLfloat) sin(e);
+   sun[2] = (GLfloat) (cos(e) * cos(b));
+   sun[3] = 0.0;
+   if (withAtmosphere) {
+      atmosphereSetSun(&atmosphere, sun);
+      atmosphereUpdate(&atmosphere);
+      atmosphereSunColor(&atmosphere, view[1], light);
+      glDisable(GL_FOG);
+   } else
+      glEnable(GL_FOG);
+   glLightfv(GL_LIGHT0, GL_DIFFUSE, light);
+
+   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+   glLoadIdentity();
+   glRotatef(-pitch, 1.0, 0.0, 0.0);
+   glRotatef(-viewHeading, 0.0, 1.0, 0.0);
+   glLightfv(GL_LIGHT0, GL_POSITION, sun);
+   glColor3f(0.35, 0.5, 0.25);
+   terrainUpdate(&terrain, view);
+   terrainDraw(&terrain, view);
+   if (withAtmosphere)
+      atmosphereApply(&atmosphere, view);
+}
+
+void display(void)
+{
+   double now = timerSeconds(), dt = now - lastFrame;
+   GLfloat a = (GLfloat) loopAlpha(&loop);
+   int i;
+
+   lastFrame = now;
+   for (i = 0; i < 3; i++)
+      view[i] = lastEye[i] + (eye[i] - lastEye[i]) * a;
+   viewHeading = lastHeading + (heading - lastHeading) * a;
+
+   drawScene(scattering);
+   glutSwapBuffers();
+
+   frames++;
+   if (dt * 1000.0 > worstFrame)
+      worstFrame = dt * 1000.0;
+   if (now - reportStart >= REPORT)
+      report(now);
+}
+
+void reshape(int w, int h)
+{
+   glViewport(0, 0, (GLsizei) w, (GLsizei) h);
+   glMatrixMode(GL_PROJECTION);
+   glLoadIdentity();
+   gluPerspective(60.0, (GLdouble) w / (GLdouble) h, 1.0,
+                  terrain.loadRadius);
+   glMatrixMode(GL_MODELVIEW);
+}
+
+/*
+ *  Allocator benchmark: each test does the same work with malloc()
+ *  and free() and then with an allocator, and writes to every block
+ *  as the data it stands for would.
+ */
+static size_t allocSizes[ALLOC_ITEMS];
+static void *allocBlocks[ALLOC_ITEMS];
+
+static void allocFailed(void)
+{
+   printf("world: out of memory\n");
+   exit(1);
+}
+
+/*  Temporary buffers inside a job, from scratch if *user is set.  */
+static void allocJob(int index, void *user)
+{
+   int scratch = *(int *) user, thread = jobsThreadIndex(), i;
+   void *blocks[ALLOC_JOB_ITEMS];
+   size_t mark = scratch ? scratchMark(thread) : 0;
+
+   for (i = 0; i < ALLOC_JOB_ITEMS; i++) {
+      size_t bytes = allocSizes[(index * 131 + i) % ALLOC_ITEMS];
+
+      blocks[i] = scratch ? scratchAlloc(thread, bytes) : malloc(bytes);
+      if (blocks[i] == NULL)
+         allocFailed();
+      *(char *) blocks[i] = (char) i;
+   }
+   if (scratch)
+      scratchRelease(thread, mark);
+   else
+      for (i = 0; i < ALLOC_JOB_ITEMS; i++)
+         free(blocks[i]);
+}
+
+static void allocBenchmark(void)
+{
+   FrameArena frame;
+   ArenaStats stats;
+   Pool pool;
+   double t, tMalloc;
+   unsigned k;
+   int f, i, scratch, jobs = ALLOC_FRAMES * jobsThreadCount();
+
+   srand(1);
+   for (i = 0; i < ALLOC_ITEMS; i++)
+      allocSizes[i] = 16 + rand() % 1009;
+
+/*  lists built and thrown away every frame  */
+   t = timerSeconds();
+   for (f = 0; f < ALLOC_FRAMES; f++) {
+      for (i = 0; i < ALLOC_ITEMS; i++) {
+         if ((allocBlocks[i] = malloc(allocSizes[i])) == NULL)
+            allocFailed();
+         *(char *) allocBlocks[i] = (char) i;
+      }
+      for (i = 0; i < ALLOC_ITEMS; i++)
+         free(allocBlocks[i]);
+   }
+   tMalloc = timerSeconds() - t;
+   frameArenaInit(&frame, 64 * 1024);
+   t = timerSeconds();
+   for (f = 0; f < ALLOC_FRAMES; f++) {
+      frameArenaBegin(&frame);
+      for (i = 0; i < ALLOC_ITEMS; i++) {
+         allocBlocks[i] = frameAlloc(&frame, allocSizes[i]);
+         *(char *) allocBlocks[i] = (char) i;
+      }
+   }
+   t = timerSeconds() - t;
+   printf("%d blocks a frame: malloc %.1f ns, frame arena %.1f ns each\n",
+          ALLOC_ITEMS, tMalloc * 1e9 / (ALLOC_FRAMES * ALLOC_ITEMS),
+          t * 1e9 / (ALLOC_FRAMES * ALLOC_ITEMS));
+   arenaPrintStats("   frame arena", &frame.arenas[0].stats);
+   frameArenaFree(&frame);
+
+/*  objects of one size freed in any order: replace one at random  */
+   for (i = 0; i < ALLOC_ITEMS; i++)
+      if ((allocBlocks[i] = malloc(ALLOC_OBJECT)) == NULL)
+         allocFailed();
+   t = timerSeconds();
+   for (i = 0, k = 1; i < ALLOC_STEPS; i++) {
+      k = k * 1103515245u + 12345u;
+      free(allocBlocks[k % ALLOC_ITEMS]);
+      if ((allocBlocks[k % ALLOC_ITEMS] = malloc(ALLOC_OBJECT)) == NULL)
+         allocFailed();
+      *(char *) allocBlocks[k % ALLOC_ITEMS] = (char) i;
+   }
+   tMalloc = timerSeconds() - t;
+   for (i = 0; i < ALLOC_ITEMS; i++)
+      free(allocBlocks[i]);
+   poolInit(&pool, ALLOC_OBJECT, 256);
+   for (i = 0; i < ALLOC_ITEMS; i++)
+      allocBlocks[i] = poolAlloc(&pool);
+   t = timerSeconds();
+   for (i = 0, k = 1; i < ALLOC_STEPS; i++) {
+      k = k * 1103515245u + 12345u;
+      poolRelease(&pool, allocBlocks[k % ALLOC_ITEMS]);
+      allocBlocks[k % ALLOC_ITEMS] = poolAlloc(&pool);
+      *(char *) allocBlocks[k % ALLOC_ITEMS] = (char) i;
+   }
+   t = timerSeconds() - t;
+   printf("%d of %d objects replaced: malloc %.1f ns, pool %.1f ns each\n",
+          ALLOC_STEPS, ALLOC_ITEMS, tMalloc * 1e9 / ALLOC_STEPS,
+          t * 1e9 / ALLOC_STEPS);
+   poolPrintStats("   pool", &pool);
+   poolFree(&pool);
+
+/*  temporary buffers in jobs on every thread  */
+   for (scratch = 0; scratch < 2; scratch++) {
+      t = timerSeconds();
+      jobsParallelFor(jobs, allocJob, &scratch);
+      t = timerSeconds() - t;
+      if (!scratch)
+         tMalloc = t;
+   }
+   printf("%d jobs on %d threads: malloc %.1f ns, scratch %.1f ns each\n",
+          jobs, jobsThreadCount() + 1,
+          tMalloc * 1e9 / ((double) jobs * ALLOC_JOB_ITEMS),
+          t * 1e9 / ((double) jobs * ALLOC_JOB_ITEMS));
+   scratchStats(&stats);
+   arenaPrintStats("   scratch", &stats);
+}
+
+/*  Frames with fixed-function fog and with the atmosphere, and the
+ *  tables built whole and as each change calls for.
+ */
+static void atmosphereBenchmark(void)
+{
+   AtmosphereParams saved = atmosphere.params, p = saved;
+   GLfloat elevation = sunElevation, azimuth = sunAzimuth;
+   double t, serial, parallel, frame[2];
+   int i, k;
+
+   if (!atmosphereSupported(&atmosphere)) {
+      printf("the atmosphere needs OpenGL 3.3\n");
+      return;
+   }
+   for (k = 0; k < 2; k++) {
+      drawScene(k);
+      glFinish();
+      t = timerSeconds();
+      for (i = 0; i < BENCH_FRAMES; i++)
+         drawScene(k);
+      glFinish();
+      frame[k] = (timerSeconds() - t) * 1000.0 / BENCH_FRAMES;
+   }
+   printf("frame: fixed-function fog %.3f ms, atmosphere %.3f ms\n",
+          frame[0], frame[1]);
+
+   serial = atmosphereRebuild(&atmosphere, 0);
+   parallel = atmosphereRebuild(&atmosphere, 1);
+   printf("all tables: %.3f ms on 1 thread, %.3f ms on %d\n",
+          serial * 1000.0, parallel * 1000.0, jobsThreadCount() + 1);
+
+   p.mie *= 2.0;
+   atmosphereSetParams(&atmosphere, &p);
+   t = timerSeconds();
+   atmosphereUpdate(&atmosphere);
+   atmosphereFinish(&atmosphere);
+   printf("haze changed: %.3f ms (transmittance %.3f ms)\n",
+          (timerSeconds() - t) * 1000.0,
+          atmosphere.stats.transmittanceTime * 1000.0);
+
+   sunElevation += 1.0;
+   drawScene(1);
+   atmosphereFinish(&atmosphere);
+   printf("sun raised: scattering only, %.3f ms behind the frames\n",
+          atmosphere.stats.scatteringTime * 1000.0);
+
+   sunAzimuth += 10.0;
+   t = timerSeconds();
+   drawScene(1);
+   glFinish();
+   printf("sun turned: no build, frame %.3f ms\n",
+          (timerSeconds() - t) * 1000.0);
+
+   sunElevation = elevation;
+   sunAzimuth = azimuth;
+   atmosphereSetParams(&atmosphere, &saved);
+   drawScene(scattering);
+   atmosphereFinish(&atmosphere);
+   atmospherePrintStats("atmosphere", &atmosphere);
+}
+
+static void setSun(GLfloat elevation, GLfloat azimuth)
+{
+   sunElevation = elevation < -10.0 ? -10.0 : elevation > 90.0 ? 90.0 :
+                  elevation;
+   sunAzimuth = (GLfloat) fmod(azimuth, 360.0);
+   printf("sun %.0f degrees up, bearing %.0f\n", sunElevation, sunAzimuth);
+}
+
+static void setHaze(GLfloat scale)
+{
+   AtmosphereParams p = atmosphere.params;
+
+   p.mie *= scale;
+   atmosphereSetParams(&atmosphere, &p);
+   printf("haze %.1f per 100 km at sea level\n", p.mie * 1e5);
+}
+
+void keyboard(unsigned char key, int x, int y)
+{
+   switch (key) {
+   case '+':
+      speed *= 2;
+      break;
+   case '-':
+      speed /= 2;
+      break;
+   case ' ':
+      paused = !paused;
+      break;
+   case 'm':
+   case 'M':
+      terrain.morphing = !terrain.morphing && terrain.program;
+      printf("geomorphing %s\n", terrain.morphing ? "on" : "off");
+      break;
+   case 'w':
+   case 'W':
+      wireframe = !wireframe;
+      glPolygonMode(GL_FRONT_AND_BACK, wireframe ? GL_LINE : GL_FILL);
+      break;
+   case 'f':
+   case 'F':
+      scattering = !scattering && atmosphereSupported(&atmosphere);
+      printf("%s\n", scattering ? "atmosphere" : "fixed-function fog");
+      break;
+   case 'h':
+      setHaze(0.5);
+      break;
+   case 'H':
+      setHaze(2.0);
+      break;
+   case 'n':
+      setSun(sunElevation - 5.0, sunAzimuth);
+      break;
+   case 'N':
+      setSun(sunElevation + 5.0, sunAzimuth);
+      break;
+   case 'r':
+   case 'R':
+      setSun(sunElevation, sunAzimuth + 15.0);
+      break;
+   case 's':
+   case 'S':
+      terrainPrintStats(&terrain);
+      atmospherePrintStats("atmosphere", &atmosphere);
+      loopPrintStats("world", &loop);
+      loopResetStats(&loop);
+      break;
+   case 'b':
+   case 'B':
+      atmosphereBenchmark();
+      break;
+   case 'a':
+   case 'A':
+      allocBenchmark();
+      break;
+   case 27:
+      atmosphereFree(&atmosphere);
+      terrainFree(&terrain);
+      exit(0);
+      break;
+   }
+}
+
+void special(int key, int x, int y)
+{
+   switch (key) {
+   case GLUT_KEY_LEFT:
+      heading += 5.0;
+      break;
+   case GLUT_KEY_RIGHT:
+      heading -= 5.0;
+      break;
+   case GLUT_KEY_UP:
+      if (pitch < 30.0)
+         pitch += 3.0;
+      break;
+   case GLUT_KEY_DOWN:
+      if (pitch > -60.0)
+         pitch -= 3.0;
+      break;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   glutInit(&argc, argv);
+   glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+   glutInitWindowSize(800, 500);
+   glutInitWindowPosition(100, 100);
+   glutCreateWindow(argv[0]);
+   init();
+   glutDisplayFunc(display);
+   glutReshapeFunc(reshape);
+   glutKeyboardFunc(keyboard);
+   glutSpecialFunc(special);
+   glutMainLoop();
+   return 0;
+}
+#else
+int main(int argc, char** argv)
+{
+    fprintf (stderr, "This program demonstrates a feature which is not in OpenGL before Version 1.5.\n");
+    fprintf (stderr, "If your implementation has the ARB_vertex_buffer_object extension,\n");
+    fprintf (stderr, "you may be able to modify this program to make it run.\n");
+    return 0;
+}
+#endif